@@ -18,6 +18,28 @@
 #include <BLEUtils.h>
 #include <BLEServer.h>
 #include <BLE2902.h> // for notifications descriptor
+#include <sys/time.h>
+#include "include/wire_proto.h"  // shared zero-copy frame tokenizer
+#include "include/lora_frame.h"  // binary frame codec (ASCII stays as fallback)
+#include "include/radio_ring.h"  // SPSC receive ring filled by OnRxDone
+#include "include/at_engine.h"   // response-terminated AT engine for the modem
+#include "include/outbox.h"      // prioritized status outbox (MQTT / BLE / SMS digest)
+#include "include/event_log.h"   // LittleFS store-and-forward log for MQTT outages
+#include "include/timer_heap.h"  // schedule trigger index (min-heap on next_run_epoch)
+#include "include/sched_db.h"    // single-file binary schedule database
+#include "include/sched_patch.h" // schedule version hash + step patches
+#include "include/nvs_journal.h" // leased ID counters + batched progress writes
+#include "include/perf_stats.h"  // loop stall / ACK rate / step latency metrics
+#include "include/zone_runner.h" // concurrent step groups under a pump capacity
+#include "include/node_power.h"  // duty-cycled nodes: wake cadence table, preamble sizing
+#include "include/tele_delta.h"  // per-node telemetry state rebuilt from delta STATs
+#include "include/node_plan.h"   // node-local runs: PLAN timeline, TIME beacons
+#include "include/tele_series.h" // per-node telemetry history: raw / 15 min / hourly, spilled to LittleFS
+#include "include/step_feedback.h" // moisture-feedback steps: end early / skip when wet, savings per run
+#include "include/fixed_buf.h"    // FixedStr / MsgFifo: long-lived text without heap allocations
+#include "include/state_snap.h"   // retained state snapshot: hashed core, packed JSON
+#include "include/time_service.h" // clock discipline: slew / step, RTC drift, scheduler epoch
+#include "include/auth_ctx.h"     // cached admin set / per-source keys, HMAC-signed commands with a replay window
 
 // ---------------- CONFIG / pins ----------------
 // Modem (TracX EC200U) UART pins (Heltec defaults you provided)
@@ -49,6 +71,7 @@ static SSD1306Wire display(0x3c, 500000, SDA_OLED, SCL_OLED, GEOMETRY_128_64, RS
 #define MQTT_TOPIC_SCHEDULE "irrigation/site01/schedule/set"
 #define MQTT_TOPIC_CONFIG   "irrigation/site01/config/system/set"
 #define MQTT_TOPIC_STATUS   "irrigation/site01/status"
+#define MQTT_TOPIC_STATE    "irrigation/site01/state"    // retained snapshot (state_snap.h)
 
 // LoRa SPI pins
 #define LORA_CS   18
@@ -90,6 +113,13 @@ bool oldDeviceConnected = false;
 // Behavior tuning
 const uint32_t LORA_ACK_TIMEOUT_MS = 3000;
 const uint8_t  LORA_MAX_RETRIES = 3;
+// A run's OPEN carries the node's auto-close time: the step plus the pump lead (timers
+// start after it) plus the next step's OPEN retries, so the CLOSE after the next valve
+// has opened ends the step and the node's timer stays a failsafe for a lost controller
+const uint32_t STEP_FAILSAFE_MARGIN_MS = LORA_ACK_TIMEOUT_MS * LORA_MAX_RETRIES;
+struct LoraTxn;                                            // LoRa transaction table entry (see engine below)
+typedef void (*LoraTxnCallback)(const LoraTxn &t, bool acked);
+struct LoraMcast;                                          // multicast command with a slotted reply window (see below)
 const uint32_t SAVE_PROGRESS_INTERVAL_MS = 10 * 1000;
 const uint32_t PUMP_ON_LEAD_DEFAULT_MS = 2000;
 const uint32_t PUMP_OFF_DELAY_DEFAULT_MS = 5000;
@@ -109,11 +139,16 @@ Preferences prefs;
 RTC_DS3231 rtc;
 HardwareSerial ModemSerial(2);
 
-String modemLineBuffer = "";
+AtEngine atEngine;                 // EC200U command queue + URC demux (include/at_engine.h)
 unsigned long lastModemActivity = 0;
 unsigned long lastMqttURCTime = 0;
 bool mqttAvailable = true;
+bool mqttConnecting = false;         // bring-up queued, QMTCONN not answered yet
 bool ENABLE_SMS_BROADCAST = true; // enabled: allow SMS fallback/broadcast
+Outbox outbox;                      // publishStatusMsg() -> per-channel workers
+const uint32_t SMS_DIGEST_DEFAULT_MS = 15UL * 60UL * 1000UL;
+uint32_t smsDigestMs = SMS_DIGEST_DEFAULT_MS;   // non-alarm SMS are batched this long
+unsigned long lastSmsDigest = 0;
 uint32_t LAST_CLOSE_DELAY_MS = LAST_CLOSE_DELAY_MS_DEFAULT;
 uint32_t DRIFT_THRESHOLD_S = 300;
 uint32_t SYNC_CHECK_INTERVAL_MS = 3600UL * 1000UL;
@@ -131,12 +166,16 @@ struct SystemConfig {
 } sysConfig;
 
 // -------------------- Schedule structures --------------------
-struct SeqStep { int node_id; uint32_t duration_ms; };
+struct SeqStep { int node_id; uint32_t duration_ms; bool par = false; uint8_t target = 0; uint32_t min_ms = 0; };   // par: opens together with the previous step; target: moisture % ending the step (duration = cap)
+// Fixed-size: `schedules` holds up to SDB_MAX of these for months, so no String members.
+// seq is only filled between parsing and saving; entries in `schedules` keep their
+// steps on flash and no allocation.
 struct Schedule {
-  String id;
+  FixedStr<SDB_ID_MAX + 1> id;     // one spare byte so overlong ids are caught, not clipped
+  uint32_t idHash = 0;             // fixedHash(id), set when it enters `schedules`
   char rec; // 'O' = onetime, 'D' = daily, 'W' = weekly
   time_t start_epoch;
-  String timeStr;
+  FixedStr<32> timeStr;            // "HH:MM", or ISO 8601 for a onetime schedule being parsed
   uint8_t weekday_mask;
   std::vector<SeqStep> seq;
   uint32_t pump_on_before_ms;
@@ -148,14 +187,24 @@ struct Schedule {
 
 // runtime collections
 std::vector<Schedule> schedules;
-String currentScheduleId = "";
+TimerHeap schedTimers;             // next_run_epoch per schedule slot
+FixedStr<SDB_ID_MAX> currentScheduleId;
 time_t scheduleStartEpoch = 0;
 uint32_t pumpOnBeforeMs = PUMP_ON_LEAD_DEFAULT_MS;
 uint32_t pumpOffAfterMs = PUMP_OFF_DELAY_DEFAULT_MS;
 
 std::vector<SeqStep> seq;          // sequence loaded from active schedule
-int currentStepIndex = -1;         // -1 = not started
-unsigned long stepStartMillis = 0;
+int currentStepIndex = -1;         // -1 = not started; first open step while running
+ZoneRunner zones;                  // per-step valve state of the running sequence
+PlanRun planRun;                   // node-local run: the timeline pushed to the nodes
+RunFeedback runFb;                 // moisture-feedback steps of the running sequence
+bool planMode = true;              // run schedules node-local when every node can (PLAN_MODE)
+bool planActive = false;           // the current run is node-local
+uint16_t pumpCapacity = 1;         // flow the pump can feed at once, in node weights (PUMP_CAP)
+ZoneFlowTable nodeFlow;            // per-node flow weights (FLOW), 1 when not listed
+NodeWakeTable nodeWake;            // wake cadence of duty-cycled nodes (learned from WAKE=, NODE_POWER)
+NodeTeleTable nodeTele;            // full telemetry per node, delta STATs folded in (TELE_STATS)
+TeleSeries<fs::LittleFSFS> teleSeries;   // history of nodeTele per node (TS_QUERY, TS_STATS)
 bool scheduleLoaded = false;
 bool scheduleRunning = false;
 
@@ -168,8 +217,6 @@ const char* PREF_MANUAL_TIMEOUT_MS = "manual_to_ms";
 
 
 unsigned long lastProgressSave = 0;
-unsigned long lastStatusPublish = 0;
-unsigned long statusPublishInterval = 15 * 1000; // 15s
 
 // Display
 const unsigned long DISPLAY_REFRESH_MS = 800;
@@ -177,27 +224,92 @@ static String disp_time_line = "";
 static String disp_status_line = "";
 static String disp_node_line = "";
 static String disp_error = "";
-static unsigned long lastDisplayMs = 0;
 
-// ---------- Incoming queue (ring buffer) ----------
-#define INQ_SZ 16
-String incomingQueue[INQ_SZ];
-int inq_head = 0, inq_tail = 0;
+// ---------- Tasks (FreeRTOS) ----------
+// The controller runs as four pinned tasks instead of one loop():
+//   core 1  radio  Radio.IrqProcess() -- TX/RX callbacks within a tick of the DIO1 IRQ
+//           ctrl   LoRa transactions, incoming commands, schedule runner, timers, journal
+//   core 0  modem  AT engine, outbox (MQTT / BLE / SMS), event log, RTC drift / NTP
+//           ui     OLED
+// Actuation never waits on the modem: statuses from other tasks reach the outbox through
+// statusQ (the modem task owns it), the UI reads a RunView snapshot the ctrl task
+// overwrites each pass, the modem task reads a ModemCfg copy of the config the ctrl task
+// hands over when it changes, and the radio driver is shared under radioLock.
+#define TASK_RADIO_CORE 1
+#define TASK_CTRL_CORE 1
+#define TASK_MODEM_CORE 0
+#define TASK_UI_CORE 0
+const uint32_t CTRL_TICK_MS = 10;          // ctrl pass when no event wakes it earlier
+const uint32_t MODEM_TICK_MS = 5;
+const uint8_t STATUS_Q_LEN = 16;
+const uint32_t STATUS_Q_WAIT_MS = 5;       // producer wait when the modem task lags
+#define EV_RADIO_RX    (1 << 0)            // OnRxDone queued a packet
+#define EV_INCOMING    (1 << 1)            // incoming command queued
+#define EV_UI_REFRESH  (1 << 2)            // RunView changed: redraw now
+
+enum TaskId : uint8_t { TK_RADIO, TK_CTRL, TK_MODEM, TK_UI, TK_COUNT };
+TaskHandle_t taskHandles[TK_COUNT] = {};
+TaskMeter taskMeters[TK_COUNT];
+EventGroupHandle_t ctrlEvents = nullptr;
+SemaphoreHandle_t radioLock = nullptr;     // Radio.* outside the IRQ callbacks
+SemaphoreHandle_t inqLock = nullptr;       // incomingQueue (BLE, modem and ctrl tasks)
+QueueHandle_t statusQ = nullptr;           // ModemMsg -> modem task
+QueueHandle_t runViewQ = nullptr;          // RunView mailbox (length 1, overwritten)
+QueueHandle_t snapQ = nullptr;             // state snapshot JSON mailbox (length 1, overwritten)
+QueueHandle_t modemCfgQ = nullptr;         // ModemCfg mailbox (length 1, overwritten)
+uint32_t statusQDrops = 0;
+TaskHandle_t outboxOwner = nullptr;        // setup task, then the modem task
+
+struct RadioGuard {
+  RadioGuard() { if (radioLock) xSemaphoreTake(radioLock, portMAX_DELAY); }
+  ~RadioGuard() { if (radioLock) xSemaphoreGive(radioLock); }
+};
 
-bool enqueueIncoming(const String &s){
-  int next = (inq_tail + 1) % INQ_SZ;
-  if (next == inq_head) { // queue full -> drop oldest
-    inq_head = (inq_head + 1) % INQ_SZ;
-  }
-  incomingQueue[inq_tail] = s;
-  inq_tail = next;
-  return true;
-}
-bool dequeueIncoming(String &out){
-  if (inq_head == inq_tail) return false;
-  out = incomingQueue[inq_head];
-  inq_head = (inq_head + 1) % INQ_SZ;
-  return true;
+// Work for the modem task: a status for the outbox, or an outbox route change
+enum ModemMsgKind : uint8_t { MQ_STATUS, MQ_ROUTE, MQ_AUTH_BENCH };
+struct ModemMsg { uint8_t kind; char text[OB_MSG_MAX]; };
+
+// What the display shows of the run, published by the ctrl task
+struct RunView {
+  bool running, manual;
+  int32_t node;                             // node of the first open step, -1 = none
+  uint16_t alsoOpen;                        // further open steps
+  char schedId[24];
+};
+
+// What the modem task uses of sysConfig and the auth tokens. sysConfig and authCtx belong
+// to the ctrl task; authReload() builds one of these from them after every load / change
+// and hands it over (modemCfgQ), the modem task takes it at the top of a pass.
+struct ModemCfg {
+  FixedStr<96> apn, server, user, pass;
+  int port;
+  FixedStr<AUTH_ADMINS_MAX * AUTH_PHONE_MAX> adminPhones;
+  FixedStr<AUTH_TOK_MAX> tok[AUTH_SRC_N], recov;   // what authCtx was loaded from
+  uint8_t sigRequired;
+};
+ModemCfg modemCfg;                          // modem task (setup() before the tasks run)
+
+// ---------- Incoming queue (preallocated arena) ----------
+// Messages are packed into one fixed byte ring; when full the oldest are dropped.
+#define INQ_ARENA_BYTES 4096
+#define INQ_MSG_MAX 768                     // longest command kept (AT response / BLE write size)
+MsgFifo<INQ_ARENA_BYTES> incomingQueue;
+
+bool enqueueIncoming(const char *s, size_t n){
+  if (inqLock) xSemaphoreTake(inqLock, portMAX_DELAY);
+  bool kept = incomingQueue.push(s, (uint16_t)(n < 0xFFFF ? n : 0xFFFF), INQ_MSG_MAX);
+  if (inqLock) xSemaphoreGive(inqLock);
+  if (ctrlEvents) xEventGroupSetBits(ctrlEvents, EV_INCOMING);
+  return kept;
+}
+bool enqueueIncoming(const String &s){ return enqueueIncoming(s.c_str(), s.length()); }
+// more: still something queued after this one
+bool dequeueIncoming(char *out, uint16_t cap, bool &more){
+  if (inqLock) xSemaphoreTake(inqLock, portMAX_DELAY);
+  bool got = incomingQueue.pop(out, cap) >= 0;
+  more = !incomingQueue.empty();
+  if (inqLock) xSemaphoreGive(inqLock);
+  return got;
 }
 
 // ---------- Utilities ----------
@@ -228,17 +340,15 @@ String formatTimeShort() {
   char buf[6]; snprintf(buf, sizeof(buf), "%02d:%02d", tmnow.tm_hour, tmnow.tm_min);
   return String(buf);
 }
-void displayLoop() {
-  unsigned long nowMs = millis();
-  if (nowMs - lastDisplayMs < DISPLAY_REFRESH_MS) return;
-  lastDisplayMs = nowMs;
+// ui task only; the run state comes from the ctrl task's RunView
+void displayLoop(const RunView &v) {
   display.clear();
   display.setFont(ArialMT_Plain_10);
-  display.drawString(0,0,"Irrigation");
-  display.drawString(0,12, String("Time:") + String(formatTimeShort()) + " S:" + (scheduleRunning?"RUN":"IDLE"));
-  display.drawString(0,26, String("SCH:") + (currentScheduleId.length()?currentScheduleId:"NONE"));
+  display.drawString(0,0, v.manual ? "Irrigation  MANUAL" : "Irrigation");
+  display.drawString(0,12, String("Time:") + String(formatTimeShort()) + " S:" + (v.running?"RUN":"IDLE"));
+  display.drawString(0,26, String("SCH:") + (v.schedId[0]?v.schedId:"NONE"));
   String nodeLine = "Node:N/A";
-  if (currentStepIndex>=0 && currentStepIndex < (int)seq.size()) nodeLine = "Node:" + String(seq[currentStepIndex].node_id);
+  if (v.node >= 0) { nodeLine = "Node:" + String(v.node); if (v.alsoOpen) nodeLine += " +" + String(v.alsoOpen); }
   display.drawString(0,40, nodeLine);
   display.display();
 }
@@ -260,34 +370,80 @@ String loadStringFile(const String &path) {
   String c = f.readString(); f.close(); return c;
 }
 
-// Persist per-schedule JSON under /schedules/<ID>.json
-bool saveScheduleFile(const Schedule &s) {
-  DynamicJsonDocument d(4096);
-  d["schedule_id"] = s.id; 
-  d["recurrence"] = (s.rec=='D'?"daily":(s.rec=='W'?"weekly":"onetime"));
-  d["start_time"] = s.timeStr; d["start_epoch"] = (long long)s.start_epoch;
-  d["pump_on_before_ms"] = s.pump_on_before_ms; d["pump_off_after_ms"] = s.pump_off_after_ms;
-  d["ts"] = s.ts;
-  JsonArray arr = d.createNestedArray("sequence");
-  for (auto &st : s.seq) { JsonObject so = arr.createNestedObject(); so["node_id"]=st.node_id; so["duration_ms"]=st.duration_ms; }
-  String out; serializeJson(d, out);
-  String path = String("/schedules/") + s.id + String(".json");
-  return saveStringFile(path, out);
-}
-bool deleteScheduleFile(const String &id) {
-  String path = String("/schedules/") + id + String(".json");
-  if (LittleFS.exists(path)) return LittleFS.remove(path);
+// ---------- Schedule database (/sched.db) ----------
+// All schedules live in one binary file (include/sched_db.h); the index is loaded
+// at boot and step sequences are read back only when a schedule triggers.
+SchedDb<fs::LittleFSFS> schedDb;
+
+SdbRec scheduleToRec(const Schedule &s) {
+  SdbRec r; memset(&r, 0, sizeof(r));
+  snprintf(r.id, sizeof(r.id), "%s", s.id.c_str()); snprintf(r.timeStr, sizeof(r.timeStr), "%s", s.timeStr.c_str());
+  r.rec = s.rec; r.weekdayMask = s.weekday_mask; r.enabled = s.enabled ? 1 : 0; r.startEpoch = (int64_t)s.start_epoch;
+  r.pumpOnMs = s.pump_on_before_ms; r.pumpOffMs = s.pump_off_after_ms; r.ts = s.ts;
+  return r;
+}
+Schedule scheduleFromRec(const SdbRec &r) {
+  Schedule s; s.id.set(r.id, SDB_ID_MAX); s.idHash = fixedHash(s.id); s.rec = r.rec; s.start_epoch = (time_t)r.startEpoch; s.timeStr.set(r.timeStr, sizeof(r.timeStr));
+  s.weekday_mask = r.weekdayMask; s.pump_on_before_ms = r.pumpOnMs; s.pump_off_after_ms = r.pumpOffMs;
+  s.enabled = r.enabled != 0; s.next_run_epoch = 0; s.ts = r.ts;   // seq stays on flash (scheduleSteps)
+  return s;
+}
+SdbStep sdbStepFromSeq(const SeqStep &st) {
+  SdbStep o; o.node = (uint16_t)st.node_id; o.flags = st.par ? SDB_STEP_PAR : 0; o.target = st.target; o.durMs = st.duration_ms;
+  sdbStepSetMin(o, st.target ? st.min_ms : 0);
+  return o;
+}
+SeqStep seqStepFromSdb(const SdbStep &o) {
+  SeqStep st; st.node_id = o.node; st.duration_ms = o.durMs; st.par = o.flags & SDB_STEP_PAR; st.target = o.target; st.min_ms = sdbStepMinMs(o);
+  return st;
+}
+uint16_t packSteps(const std::vector<SeqStep> &seq, SdbStep *out) {
+  uint16_t n = seq.size() < SDB_STEPS_MAX ? (uint16_t)seq.size() : SDB_STEPS_MAX;
+  for (uint16_t i = 0; i < n; ++i) out[i] = sdbStepFromSeq(seq[i]);
+  return n;
+}
+bool saveScheduleRecord(const Schedule &s) {
+  if (s.id.length() >= SDB_ID_MAX || s.seq.size() > SDB_STEPS_MAX) { Serial.printf("Schedule %s too large for the DB\n", s.id.c_str()); return false; }
+  SdbStep steps[SDB_STEPS_MAX]; uint16_t n = packSteps(s.seq, steps);
+  return schedDb.put(scheduleToRec(s), steps, n);
+}
+// Content version; a persisted sequence is covered by its stored CRC, not read back
+uint16_t scheduleVersion(const Schedule &s) {
+  SdbRec r = scheduleToRec(s);
+  int i = s.seq.empty() ? schedDb.find(s.id.c_str()) : -1;
+  if (i >= 0) { r.stepCount = schedDb.idx[i].stepCount; r.stepsCrc = schedDb.idx[i].stepsCrc; }
+  else { SdbStep steps[SDB_STEPS_MAX]; r.stepCount = packSteps(s.seq, steps); r.stepsCrc = sdbCrc32(steps, r.stepCount * sizeof(SdbStep)); }
+  return schedVersion(r);
+}
+// Stores a newer TS for unchanged content: the record alone when its steps are on flash
+bool saveScheduleTs(Schedule &s, uint32_t ts) {
+  uint32_t old = s.ts; s.ts = ts;
+  bool ok = s.seq.empty() ? schedDb.putRecord(scheduleToRec(s)) : saveScheduleRecord(s);
+  if (!ok) { s.ts = old; Serial.printf("Warning: failed saving TS of schedule %s\n", s.id.c_str()); }
+  return ok;
+}
+bool deleteScheduleRecord(const String &id) { return schedDb.erase(id.c_str()); }
+// Sequence of a schedule: from RAM if it never made it to the DB, else read from flash
+bool scheduleSteps(const Schedule &s, std::vector<SeqStep> &out) {
+  out.clear();
+  if (!s.seq.empty()) { out = s.seq; return true; }
+  int i = schedDb.find(s.id.c_str()); if (i < 0) return false;
+  SdbStep steps[SDB_STEPS_MAX]; int n = schedDb.readSteps((uint16_t)i, steps, SDB_STEPS_MAX);
+  if (n < 0) return false;
+  for (int k = 0; k < n; ++k) out.push_back(seqStepFromSdb(steps[k]));
   return true;
 }
+
+// Legacy JSON files (/schedules/<ID>.json) are parsed by the one-time migration only
 Schedule scheduleFromJsonString(const String &json) {
   Schedule s; s.seq.clear(); s.id=""; s.rec='O'; s.start_epoch=0; s.timeStr=""; s.weekday_mask=0;
   s.pump_on_before_ms=PUMP_ON_LEAD_DEFAULT_MS; s.pump_off_after_ms=PUMP_OFF_DELAY_DEFAULT_MS; s.enabled=true; s.next_run_epoch=0; s.ts = 0;
   StaticJsonDocument<4096> doc; DeserializationError err = deserializeJson(doc, json);
   if (err) return s;
-  s.id = String((const char*)(doc["schedule_id"]|doc["id"]|""));
+  s.id = (const char*)(doc["schedule_id"]|doc["id"]|"");
   String recurrence = String((const char*)(doc["recurrence"]|doc["rec"]|""));
   if (recurrence.startsWith("d")||recurrence.startsWith("D")) s.rec='D'; else if (recurrence.startsWith("w")||recurrence.startsWith("W")) s.rec='W'; else s.rec='O';
-  s.timeStr = String((const char*)(doc["start_time"]|doc["time"]|""));
+  s.timeStr = (const char*)(doc["start_time"]|doc["time"]|"");
   s.start_epoch = (time_t)(doc["start_epoch"].as<long long>()? doc["start_epoch"].as<long long>() : 0);
   s.pump_on_before_ms = doc["pump_on_before_ms"] | PUMP_ON_LEAD_DEFAULT_MS;
   s.pump_off_after_ms = doc["pump_off_after_ms"] | PUMP_OFF_DELAY_DEFAULT_MS;
@@ -299,34 +455,58 @@ Schedule scheduleFromJsonString(const String &json) {
   }
   return s;
 }
-void loadAllSchedulesFromFS() {
-  schedules.clear();
-  if (!LittleFS.exists("/schedules")) {
-    LittleFS.mkdir("/schedules");
-    return;
-  }
+// One-time migration: /schedules/*.json -> /sched.db, migrated JSON files removed afterwards
+bool migrateSource(void *ctx, uint16_t i, SdbRec &rec, SdbStep *steps) {
+  const Schedule &s = (*(std::vector<Schedule> *)ctx)[i];
+  rec = scheduleToRec(s);
+  SdbStep buf[SDB_STEPS_MAX]; SdbStep *st = steps ? steps : buf;
+  rec.stepCount = packSteps(s.seq, st);
+  rec.stepsCrc = sdbCrc32(st, rec.stepCount * sizeof(SdbStep));
+  return true;
+}
+void migrateJsonSchedules() {
+  if (!LittleFS.exists("/schedules")) return;
+  std::vector<Schedule> found; std::vector<String> paths;
   File root = LittleFS.open("/schedules");
   File file = root.openNextFile();
   while (file) {
     String name = file.name(); if (name.endsWith(".json")) {
       String content = file.readString(); Schedule s = scheduleFromJsonString(content);
-      if (s.id.length()) schedules.push_back(s);
+      if (s.id.length() && s.id.length() < SDB_ID_MAX && s.seq.size() <= SDB_STEPS_MAX && found.size() < SDB_MAX) { found.push_back(s); paths.push_back(String(file.path())); }
+      else Serial.println("Migration: kept " + name + " (does not fit the DB)");
     }
     file = root.openNextFile();
   }
+  root.close();
+  if (found.empty()) return;
+  std::sort(found.begin(), found.end(), [](const Schedule &a, const Schedule &b) { return strcmp(a.id.c_str(), b.id.c_str()) < 0; });
+  size_t w = 0; for (size_t i = 0; i < found.size(); ++i) if (!w || found[i].id != found[w - 1].id) found[w++] = found[i];   // ids must be unique
+  found.resize(w);
+  bool ok = schedDb.rewrite((uint16_t)found.size(), migrateSource, &found);
+  Serial.printf("Migration: %u JSON schedules -> %s %s\n", (unsigned)found.size(), SDB_PATH, ok ? "OK" : "FAILED");
+  if (ok) for (auto &p : paths) LittleFS.remove(p);
+}
+void loadAllSchedulesFromFS() {
+  unsigned long t0 = millis();
+  schedules.clear(); schedules.reserve(SDB_MAX);     // one allocation for the life of the device
+  seq.reserve(SDB_STEPS_MAX);
+  if (!schedDb.begin(LittleFS)) migrateJsonSchedules();
+  for (uint16_t i = 0; i < schedDb.count; ++i) schedules.push_back(scheduleFromRec(schedDb.idx[i]));
+  schedTimersRebuild(schedNow());
+  Serial.printf("Schedules: %u loaded in %lu ms\n", (unsigned)schedules.size(), millis() - t0);
 }
 
 // -------------------- System config storage --------------------
+AuthCtx authCtx;                   // admin numbers + per-source keys from the config, rebuilt by authReload() (AUTH_STATS)
+
 String normalizePhone(const String &in) {
-  String s = in; s.trim(); s.replace(" ", "");
-  if (s.length() > 0 && s.charAt(0) == '0') s = s.substring(1);
-  String tmp = s; int digits = 0; for (int i=0;i<(int)tmp.length();++i) if (isDigit(tmp[i])) digits++;
-  if (s.length() == 10 && s.charAt(0) != '+') s = String("+91") + s;
-  return s;
+  char b[AUTH_PHONE_MAX]; authNormPhone(in.c_str(), in.length(), b, sizeof(b));
+  return String(b);
 }
+// Modem task
 std::vector<String> adminPhoneList() {
   std::vector<String> out;
-  String s = sysConfig.adminPhones; s.trim();
+  String s = modemCfg.adminPhones.c_str(); s.trim();
   if (s.length() == 0) return out;
   int p = 0;
   while (p < (int)s.length()) {
@@ -339,11 +519,29 @@ std::vector<String> adminPhoneList() {
   }
   return out;
 }
-bool isAdminNumber(const String &num) {
-  String n = normalizePhone(num);
-  auto list = adminPhoneList();
-  for (auto &p : list) if (normalizePhone(p) == n) return true;
-  return false;
+void authLoad(AuthCtx &a, const ModemCfg &c) {
+  a.setAdmins(c.adminPhones);
+  for (uint8_t s = 0; s < AUTH_SRC_N; ++s) a.key[s].load(c.tok[s]);
+  a.recov = c.recov.c_str();
+  a.sigRequired = c.sigRequired;
+}
+// Auth context from the config and the per-source tokens, and the modem task's copy of
+// both; after every load / save (ctrl task, or setup())
+void authReload() {
+  uint32_t t0 = micros();
+  static ModemCfg c;                        // static: too big for the ctrl stack
+  c.apn = sysConfig.simApn; c.server = sysConfig.mqttServer; c.port = sysConfig.mqttPort;
+  c.user = sysConfig.mqttUser; c.pass = sysConfig.mqttPass; c.adminPhones = sysConfig.adminPhones;
+  c.tok[AUTH_SHARED] = sysConfig.sharedTok;
+  c.tok[AUTH_BT] = prefs.getString("tok_bt", "");
+  c.tok[AUTH_LORA] = prefs.getString("tok_lora", "");
+  c.tok[AUTH_MQTT] = prefs.getString("tok_mq", "");
+  c.recov = sysConfig.recoveryTok;
+  c.sigRequired = authSrcMask(prefs.getString("auth_sig", "").c_str());
+  authLoad(authCtx, c);
+  authCtx.stats.reloads++; authCtx.stats.reloadUs = micros() - t0;
+  if (onModemTask()) modemCfg = c;
+  else xQueueOverwrite(modemCfgQ, &c);
 }
 
 void loadSystemConfig() {
@@ -359,6 +557,7 @@ void loadSystemConfig() {
   DRIFT_THRESHOLD_S = prefs.getUInt("drift_s", DRIFT_THRESHOLD_S);
   uint32_t sync_h = prefs.getUInt("sync_h", (uint32_t)(SYNC_CHECK_INTERVAL_MS/3600000UL));
   SYNC_CHECK_INTERVAL_MS = (uint32_t)sync_h * 3600UL * 1000UL;
+  authReload();
   Serial.println("Loaded system config.");
 }
 void saveSystemConfig() {
@@ -373,193 +572,82 @@ void saveSystemConfig() {
   prefs.putULong("last_close_delay_ms", LAST_CLOSE_DELAY_MS);
   prefs.putUInt("drift_s", DRIFT_THRESHOLD_S);
   prefs.putUInt("sync_h", (uint32_t)(SYNC_CHECK_INTERVAL_MS/3600000UL));
+  authReload();
   Serial.println("Saved system config to prefs.");
 }
 
 // ---------- MODEM helpers ----------
-String sendAT(const String &cmd, unsigned long timeoutMs = 2000) {
-  while (ModemSerial.available()) ModemSerial.read();
-  if (cmd.length()) ModemSerial.print(cmd + String("\r\n"));
-  unsigned long start = millis();
-  String out;
-  while (millis() - start < timeoutMs) {
-    while (ModemSerial.available()) { char c = (char)ModemSerial.read(); out += c; lastModemActivity = millis(); }
-    delay(5);
-  }
-  return out;
-}
+// All modem traffic goes through atEngine: commands complete on their result code
+// (or awaited URC), URCs are routed to the handlers registered in modemInit().
+// modemBackgroundRead() pumps UART bytes into it every modem task pass.
+void modemWrite(const char *p, size_t n) { ModemSerial.write((const uint8_t *)p, n); }
+void modemTrace(WireSpan l) { Serial.printf("[MODEM] %.*s\n", (int)l.n, l.p); }
 
-// Wait for a specific prompt character (eg '>' ) from modem
-bool waitForPrompt(char ch, unsigned long timeout = 5000) {
-  unsigned long start = millis();
-  String buf;
-  while (millis() - start < timeout) {
-    while (ModemSerial.available()) {
-      char c = (char)ModemSerial.read(); buf += c; lastModemActivity = millis();
-      if (c == ch) return true;
-    }
-    delay(5);
-  }
-  return false;
+void modemBackgroundRead() {
+  while (ModemSerial.available()) { atEngine.feed((char)ModemSerial.read()); lastModemActivity = millis(); }
+  atEngine.poll(millis());
 }
 
-// -------------------- Modem NTP sync (AT+QNTP) --------------------
-// Attempts to sync via the modem's NTP command (AT+QNTP) and set ESP32 time + RTC.
-// Returns true on success.
-bool modemNtpSyncAndSetRTC() {
-  Serial.println("Attempting modem NTP sync via AT+QNTP...");
-
-  // Ensure PDP active (harmless if already active)
-  String setPdp = String("AT+QICSGP=1,1,\"") + sysConfig.simApn + String("\",\"\",\"\",1");
-  sendAT(setPdp, 4000);
-  sendAT("AT+QIACT=1", 10000);
-
-  // Issue the NTP command. Many modems return a URC like "+QNTP: ...", we read for a while.
-  String resp = sendAT(String("AT+QNTP=1,\"") + ntpServer + String("\""), 15000);
-  Serial.println("AT+QNTP resp:\n" + resp);
-
-  // Look for a +QNTP: line in the response (URC) or any timestamp-like substring
-  int qpos = resp.indexOf("+QNTP:");
-  String dtStr = "";
-
-  if (qpos >= 0) {
-    // get the line containing +QNTP:
-    int lineEnd = resp.indexOf('\n', qpos);
-    if (lineEnd < 0) lineEnd = resp.length();
-    String line = resp.substring(qpos, lineEnd);
-    // try to extract a date/time segment - search for year '20'
-    int ypos = line.indexOf("20");
-    if (ypos >= 0) dtStr = line.substring(ypos);
-    else {
-      // fallback: use entire line after colon
-      int colon = line.indexOf(':');
-      if (colon >= 0) dtStr = line.substring(colon + 1);
-      else dtStr = line;
-    }
-  } else {
-    // fallback: attempt to find a yyyy/mm/dd or yyyy-mm-dd pattern anywhere
-    int ypos = resp.indexOf("20");
-    if (ypos >= 0) dtStr = resp.substring(ypos);
-  }
-
-  dtStr.trim();
-  Serial.println("Parsed candidate date string: '" + dtStr + "'");
-
-  if (dtStr.length() == 0) {
-    Serial.println("modemNtpSync: no datetime substring found in +QNTP response");
-    return false;
-  }
-
-  // Try multiple common formats tolerant parsing
-  int year=0, mon=0, mday=0, hour=0, minute=0, second=0;
-  bool parsed = false;
-
-  // Format 1: YYYY/MM/DD,HH:MM:SS  (some modems)
-  if (!parsed) {
-    if (sscanf(dtStr.c_str(), "%d/%d/%d,%d:%d:%d", &year, &mon, &mday, &hour, &minute, &second) == 6) parsed = true;
-  }
-  // Format 2: YYYY-MM-DD HH:MM:SS
-  if (!parsed) {
-    if (sscanf(dtStr.c_str(), "%d-%d-%d %d:%d:%d", &year, &mon, &mday, &hour, &minute, &second) == 6) parsed = true;
-  }
-  // Format 3: YYYY/MM/DD HH:MM:SS
-  if (!parsed) {
-    if (sscanf(dtStr.c_str(), "%d/%d/%d %d:%d:%d", &year, &mon, &mday, &hour, &minute, &second) == 6) parsed = true;
-  }
-  // Format 4: YYYYMMDDHHMMSS (continuous digits)
-  if (!parsed) {
-    if ((int)dtStr.length() >= 14) {
-      const char *p = dtStr.c_str();
-      if (isdigit(p[0]) && isdigit(p[13])) {
-        char buf[5];
-        memcpy(buf, p, 4); buf[4]=0; year = atoi(buf);
-        memcpy(buf, p+4, 2); buf[2]=0; mon = atoi(buf);
-        memcpy(buf, p+6, 2); buf[2]=0; mday = atoi(buf);
-        memcpy(buf, p+8, 2); buf[2]=0; hour = atoi(buf);
-        memcpy(buf, p+10, 2); buf[2]=0; minute = atoi(buf);
-        memcpy(buf, p+12, 2); buf[2]=0; second = atoi(buf);
-        parsed = (year>2000 && mon>=1 && mon<=12 && mday>=1 && mday<=31);
-      }
-    }
-  }
-  // Format 5: try to scan any integers in order: y m d h m s
-  if (!parsed) {
-    // collect integers
-    std::vector<int> nums;
-    String tmp = dtStr;
-    tmp.replace('/', ' '); tmp.replace('-', ' '); tmp.replace(':', ' '); tmp.replace(',', ' ');
-    const char *c = tmp.c_str();
-    int val = 0; bool innum = false;
-    for (int i=0; i<(int)tmp.length(); ++i) {
-      if (isdigit(c[i])) { innum = true; val = val*10 + (c[i]-'0'); }
-      else { if (innum) { nums.push_back(val); val=0; innum=false; } }
-    }
-    if (innum) nums.push_back(val);
-    if ((int)nums.size() >= 6) {
-      year = nums[0]; mon = nums[1]; mday = nums[2]; hour = nums[3]; minute = nums[4]; second = nums[5];
-      parsed = (year>2000 && mon>=1 && mon<=12);
-    }
-  }
-
-  if (!parsed) {
-    Serial.println("modemNtpSync: failed to parse date/time from modem response");
-    return false;
-  }
-
-  // Assemble tm structure and set system time (treat as local time -> convert using gmtOffset)
-  struct tm tmnow;
-  memset(&tmnow, 0, sizeof(tmnow));
-  tmnow.tm_year = year - 1900;
-  tmnow.tm_mon  = mon - 1;
-  tmnow.tm_mday = mday;
-  tmnow.tm_hour = hour;
-  tmnow.tm_min  = minute;
-  tmnow.tm_sec  = second;
-
-  // mktime assumes localtime; we want epoch in UTC relative to timezone offsets.
-  time_t t = mktime(&tmnow);
-  if (t == (time_t)-1) {
-    Serial.println("modemNtpSync: mktime failed");
-    return false;
-  }
-
-  // set system time (adjust for gmtOffset)
-  // The modem's returned time is almost always UTC or local — many EC200U returns UTC.
-  // We'll assume the returned time is UTC. If needed, adjust here.
-  struct timeval tv;
-  tv.tv_sec = t;
-  tv.tv_usec = 0;
-  if (settimeofday(&tv, NULL) != 0) {
-    Serial.println("modemNtpSync: settimeofday failed");
-    // still try RTC update below
-  } else {
-    Serial.printf("System time set from modem: %s", ctime(&t));
+// Blocking wrapper for the boot-time modem init: returns as soon as the final
+// result code (or waitUrc) arrives, "" on failure. Waits at most for the commands
+// queued ahead plus its own timeout; a late completion of an abandoned call is
+// told apart by its sequence number. Must not be called from AT callbacks/URC handlers.
+static bool syncDone = false;
+static uint32_t syncSeq = 0;
+static String syncResp;
+static void onSyncDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  if ((uint32_t)(uintptr_t)ctx != syncSeq) return;
+  syncResp = String(resp); syncDone = true;
+}
+String sendAT(const String &cmd, unsigned long timeoutMs = 2000, const char *waitUrc = nullptr) {
+  syncDone = false; syncResp = ""; syncSeq++;
+  if (!atEngine.submit(cmd.c_str(), timeoutMs, onSyncDone, (void *)(uintptr_t)syncSeq, waitUrc)) return String("");
+  unsigned long t0 = millis(), limit = atEngine.queuedMs() + 500;
+  while (!syncDone) {
+    if (millis() - t0 > limit) { Serial.printf("sendAT %s: no completion in %lu ms\n", cmd.c_str(), limit); return String(""); }
+    modemBackgroundRead(); delay(2);
   }
+  return syncResp;
+}
 
-  // update DS3231 if available
-  if (rtcAvailable) {
-    DateTime dt((uint32_t)t);
-    rtc.adjust(dt);
-    Serial.println("RTC updated from modem NTP.");
-  }
+// Registration / SIM state is refreshed in the background (modemHealthPoll) so SMS
+// senders never block on AT+CREG?/AT+CPIN?.
+bool modemRegistered = false, modemSimReady = false;
+unsigned long lastModemHealthPoll = 0;
+const unsigned long MODEM_HEALTH_POLL_MS = 30 * 1000;
 
-  prefs.putULong("last_ntp_sync", (unsigned long)t);
-  return true;
+void onCregDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  WireSpan l; modemRegistered = res == AT_OK && atFindLine(resp, len, "+CREG:", l) && (l.contains(",1") || l.contains(",5"));
+}
+void onCpinDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  modemSimReady = res == AT_OK && wireSpan(resp, len).contains("READY");
 }
+bool modemConfigureAndConnectMQTT();
 
-// Basic readiness checks before attempting SMS
-bool modemReadyForSMS() {
-  String creg = sendAT("AT+CREG?", 2000);
-  if (creg.indexOf(",1") < 0 && creg.indexOf(",5") < 0) return false;
-  String cpin = sendAT("AT+CPIN?", 2000);
-  if (cpin.indexOf("READY") < 0) return false;
-  return true;
+void modemHealthPoll() {
+  if (millis() - lastModemHealthPoll < MODEM_HEALTH_POLL_MS) return;
+  lastModemHealthPoll = millis();
+  atEngine.submit("AT+CREG?", 2000, onCregDone);
+  atEngine.submit("AT+CPIN?", 2000, onCpinDone);
+  if (!mqttAvailable && !mqttConnecting) modemConfigureAndConnectMQTT();   // broker was still away at the last attempt
 }
 
+// Basic readiness checks before attempting SMS (cached)
+bool modemReadyForSMS() { return modemRegistered && modemSimReady; }
+
+void onMqttRecvUrc(WireSpan line);
+void onCmtiUrc(WireSpan line);
+void onMqttStatUrc(WireSpan line);
+
 void modemInit(){
   ModemSerial.begin(MODEM_BAUD, SERIAL_8N1, MODEM_RX, MODEM_TX);
   delay(200);
   while (ModemSerial.available()) ModemSerial.read();
+  atEngine.begin(modemWrite);
+  atEngine.trace = modemTrace;
+  atEngine.onUrc("+QMTRECV:", onMqttRecvUrc);
+  atEngine.onUrc("+CMTI:", onCmtiUrc);
+  atEngine.onUrc("+QMTSTAT:", onMqttStatUrc);
   Serial.println("Modem serial init");
   // Configure text-mode and new message indications so +CMTI is emitted
   sendAT("AT+CMGF=1", 1000);
@@ -567,66 +655,76 @@ void modemInit(){
   sendAT("AT+CNMI=2,1,0,0,0", 1000);
   sendAT("AT+QURCCFG=\"urcport\",\"uart1\""); // ensure URCs on UART1
   sendAT("AT+QCFG=\"urc/ri/smsincoming\"");   // query smsincoming config
+  String creg = sendAT("AT+CREG?", 2000); onCregDone(nullptr, AT_OK, creg.c_str(), creg.length());
+  String cpin = sendAT("AT+CPIN?", 2000); onCpinDone(nullptr, AT_OK, cpin.c_str(), cpin.length());
+  lastModemHealthPoll = millis();
 }
 
-bool modemConfigureAndConnectMQTT() {
-  sendAT("AT",2000);
-  String setPdp = String("AT+QICSGP=1,1,\"") + sysConfig.simApn + String("\",\"\",\"\",1");
-  sendAT(setPdp,4000);
-  sendAT("AT+QIACT=1",10000);
-  String openCmd = String("AT+QMTOPEN=0,\"") + sysConfig.mqttServer + String("\",") + String(sysConfig.mqttPort);
-  sendAT(openCmd,10000);
-  String connCmd = String("AT+QMTCONN=0,\"irrig_main\",\"") + sysConfig.mqttUser + String("\",\"") + sysConfig.mqttPass + String("\"");
-  sendAT(connCmd, 10000);
-  sendAT(String("AT+QMTSUB=0,1,\"") + MQTT_TOPIC_SCHEDULE + String("\",1"), 5000);
-  sendAT(String("AT+QMTSUB=0,1,\"") + MQTT_TOPIC_CONFIG + String("\",1"), 5000);
-  Serial.println("Modem configured for MQTT (verify URCs).");
-  return true;
+void onMqttConnDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  // +QMTCONN: <client>,<result>[,<ret_code>] -- result 0 = sent OK, ret_code 0 = accepted
+  WireSpan l; mqttAvailable = res == AT_OK && atFindLine(resp, len, "+QMTCONN:", l) && l.contains(",0,0");
+  mqttConnecting = false;
+  Serial.printf("MQTT connect %s\n", mqttAvailable ? "OK" : "FAILED");
+}
+void onMqttStepDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  if (res != AT_OK) Serial.printf("MQTT setup step '%s' %s\n", (const char *)ctx, atResultName(res));
 }
 
+// Queues the PDP/MQTT bring-up; mqttAvailable is set when QMTCONN reports success
+bool modemConfigureAndConnectMQTT() {
+  mqttAvailable = false;
+  String setPdp = String("AT+QICSGP=1,1,\"") + modemCfg.apn.c_str() + String("\",\"\",\"\",1");
+  String openCmd = String("AT+QMTOPEN=0,\"") + modemCfg.server.c_str() + String("\",") + String(modemCfg.port);
+  String connCmd = String("AT+QMTCONN=0,\"irrig_main\",\"") + modemCfg.user.c_str() + String("\",\"") + modemCfg.pass.c_str() + String("\"");
+  bool ok = atEngine.submit("AT", 2000);
+  ok = ok && atEngine.submit(setPdp.c_str(), 4000, onMqttStepDone, (void *)"QICSGP");
+  ok = ok && atEngine.submit("AT+QIACT=1", 10000);                     // ERROR when already active: harmless
+  ok = ok && atEngine.submit(openCmd.c_str(), 10000, onMqttStepDone, (void *)"QMTOPEN", "+QMTOPEN:");
+  ok = ok && atEngine.submit(connCmd.c_str(), 10000, onMqttConnDone, nullptr, "+QMTCONN:");
+  ok = ok && atEngine.submit((String("AT+QMTSUB=0,1,\"") + MQTT_TOPIC_SCHEDULE + String("\",1")).c_str(), 5000, onMqttStepDone, (void *)"QMTSUB", "+QMTSUB:");
+  ok = ok && atEngine.submit((String("AT+QMTSUB=0,1,\"") + MQTT_TOPIC_CONFIG + String("\",1")).c_str(), 5000, onMqttStepDone, (void *)"QMTSUB", "+QMTSUB:");
+  Serial.println(ok ? "Modem MQTT bring-up queued" : "Modem MQTT bring-up: AT queue full");
+  mqttConnecting = ok;
+  return ok;
+}
+
+void onPublishDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  // +QMTPUB: <client>,<msgID>,<result> -- result 0 = delivered
+  WireSpan l;
+  if (res != AT_OK || !atFindLine(resp, len, "+QMTPUB:", l) || !l.contains(",0,0")) Serial.printf("MQTT publish failed (%s)\n", atResultName(res));
+}
+
+// Queues the publish; returns false only if the AT queue is full
 bool modemPublish(const char* topic, const String &payload) {
   String cmd = String("AT+QMTPUB=0,0,0,1,\"") + topic + String("\",\"");
   String p = payload; p.replace("\"","\\\"");
   cmd += p + String("\"");
-  String resp = sendAT(cmd, 6000);
-  return resp.indexOf("OK") >= 0;
+  return atEngine.submit(cmd.c_str(), 15000, onPublishDone, nullptr, "+QMTPUB:");
+}
+
+void onSmsSent(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  Serial.printf("SMS send %s: %s\n", atResultName(res), resp);
 }
 
-// Send SMS to a single number, robustly waiting for > and reading response
+// Queue an SMS to a single number; the '>' prompt and Ctrl-Z are handled by the engine
 bool sendSMS(const String &num, const String &text) {
   if (!modemReadyForSMS()) {
     Serial.println("Modem not ready for SMS (no network or SIM locked)");
     return false;
   }
-  sendAT("AT+CMGF=1", 1000);
-  sendAT("AT+CSCS=\"GSM\"", 1000);
   String cmd = String("AT+CMGS=\"") + num + String("\"");
-  // Clear any pending chars
-  while (ModemSerial.available()) ModemSerial.read();
-  ModemSerial.print(cmd);
-  ModemSerial.print("\r\n");
-  if (!waitForPrompt('>', 7000)) {
-    Serial.println("No > prompt received from modem for CMGS");
-    String dump = sendAT("", 200);
-    Serial.println("CMGS dump:" + dump);
-    return false;
-  }
-  // send body and Ctrl+Z
-  ModemSerial.print(text);
-  ModemSerial.write(0x1A);
-  // wait for response (may take several seconds)
-  String resp = sendAT("", 10000);
-  Serial.println("SMS send resp: " + resp);
-  if (resp.indexOf("+CMGS:") >= 0 || resp.indexOf("OK") >= 0) return true;
-  return false;
+  return atEngine.submit(cmd.c_str(), 30000, onSmsSent, nullptr, nullptr, text.c_str());
 }
 
 // ---------- LoRa helpers ----------
 // ---------- LoRa (Radio driver) ----------
 char txpacket[BUFFER_SIZE];
-char rxpacket[BUFFER_SIZE];
 
 static RadioEvents_t RadioEvents;
+volatile bool radioTxBusy = false;   // set on Radio.Send, cleared by TxDone/TxTimeout
+unsigned long radioTxStartMs = 0;
+RadioRing radioRx;                   // OnRxDone -> radioDispatch()
+RadioRxCounters radioStats;          // dispatcher-side counters (ring counters via snapshot)
 
 void OnTxDone(void);
 void OnTxTimeout(void);
@@ -656,241 +754,687 @@ void loraInit() {
 }
 void OnTxDone(void) {
   Serial.println("[Radio] TX done");
+  radioTxBusy = false;
   Radio.Rx(0);  // switch back to receive mode
 }
 
 void OnTxTimeout(void) {
   Serial.println("[Radio] TX timeout");
+  radioTxBusy = false;
   Radio.Rx(0);
 }
 
+// Runs from Radio.IrqProcess() in the radio task: copy into the ring, go back to RX
+// and wake the ctrl task. No parsing, no Strings, no publishing here -- radioDispatch()
+// does that.
 void OnRxDone(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr) {
-  memcpy(rxpacket, payload, size);
-  rxpacket[size] = '\0';
-  Serial.printf("[Radio] RX %d bytes RSSI=%d SNR=%d => %s\n", size, rssi, snr, rxpacket);
-
-  // handle incoming LoRa message like before
-  String msg = String(rxpacket);
-  msg.trim();
-  if (msg.length()) {
-    enqueueIncoming(msg);
-    publishStatusMsg(String("EVT|INQ|ENQ|SRC=LORA"));
-  }
-
-  // return to RX mode
+  radioRx.push(payload, size, rssi, snr, millis());
   Radio.Rx(0);
+  if (ctrlEvents) xEventGroupSetBits(ctrlEvents, EV_RADIO_RX);
 }
 
-
-void sendLoRaCmdRaw(const String &cmd) {
-  snprintf(txpacket, BUFFER_SIZE, "%s", cmd.c_str());
-  Radio.Send((uint8_t *)txpacket, strlen(txpacket));
+void sendLoRaCmdRaw(const char *cmd) {
+  snprintf(txpacket, BUFFER_SIZE, "%s", cmd);
+  radioTxBusy = true; radioTxStartMs = millis();
+  { RadioGuard g; Radio.Send((uint8_t *)txpacket, strlen(txpacket)); }
   Serial.printf("[Radio] TX: %s\n", txpacket);
 }
 
-uint32_t getNextMsgId() { uint32_t mid = prefs.getUInt("msg_counter", 0); mid++; prefs.putUInt("msg_counter", mid); return mid; }
-
-// parse ACKs
-bool parseAckWithMid(const String &msg, uint32_t wantMid, const String &wantType, int wantNode, const String &wantSched, int wantSeqIndex) {
-  // expected: ACK|MID=123|OPEN|N=2,I=1,S=SC001|OK
-  if (!msg.startsWith("ACK|")) return false;
-  std::vector<String> parts;
-  int start = 0;
-  for (int i=0;i<(int)msg.length();++i) if (msg[i]=='|') { parts.push_back(msg.substring(start,i)); start = i+1; }
-  parts.push_back(msg.substring(start));
-  if (parts.size() < 4) return false;
-  String midPart = parts[1];
-  if (!midPart.startsWith("MID=")) return false;
-  uint32_t mid = (uint32_t)midPart.substring(4).toInt();
-  if (mid != wantMid) return false;
-  String type = parts[2];
-  if (type != wantType) return false;
-  String kv = parts[3];
-  int node=-1, idx=-1; String sched="";
-  int pos=0;
-  while (pos < (int)kv.length()) {
-    int c = kv.indexOf(',', pos);
-    String t = (c==-1) ? kv.substring(pos) : kv.substring(pos, c);
-    t.trim();
-    if (t.startsWith("N=")) node = t.substring(2).toInt();
-    else if (t.startsWith("I=")) idx = t.substring(2).toInt();
-    else if (t.startsWith("S=")) sched = t.substring(2);
-    if (c==-1) break; pos = c+1;
-  }
-  String last = parts.back();
-  if (node != wantNode) return false;
-  if (idx != wantSeqIndex) return false;
-  if (sched != wantSched) return false;
-  if (last.indexOf("OK") < 0) return false;
+// Preamble for the next transmission: the default, or long enough to span the wake
+// period of a duty-cycled node. Reconfigures the radio only when it changes.
+uint16_t loraTxPreambleSym = LORA_PREAMBLE_LENGTH;
+void loraTxPreamble(uint32_t wakeMs) {
+  uint16_t sym = nodeWakePreamble(wakeMs, LORA_SPREADING_FACTOR, 125000, LORA_PREAMBLE_LENGTH);
+  if (sym == loraTxPreambleSym) return;
+  loraTxPreambleSym = sym;
+  RadioGuard g;
+  Radio.SetTxConfig(MODEM_LORA, TX_OUTPUT_POWER, 0, LORA_BANDWIDTH,
+                    LORA_SPREADING_FACTOR, LORA_CODINGRATE,
+                    sym, LORA_FIX_LENGTH_PAYLOAD_ON,
+                    true, 0, 0, LORA_IQ_INVERSION_ON, 3000 + wakeMs);
+}
+
+// Every ACK / STAT of a current node carries WAKE=<ms>; keep the table (and prefs) in step
+void nodeWakeLearn(const char *text) {
+  WireSpan t = wireSpan(text), n, w;
+  if (!wireFindKey(t, "WAKE", w) || !wireFindKey(t, "N", n)) return;
+  long node = n.toLong(-1), ms = w.toLong(-1);
+  if (node <= 0 || node > 0xFFFF || ms < 0 || !nodeWake.set((uint16_t)node, (uint32_t)ms)) return;
+  char b[NODE_WAKE_SLOTS * 12]; nodeWake.text(b, sizeof(b)); prefs.putString("node_wake", b);
+  Serial.printf("Node %ld wake cadence %ld ms\n", node, ms);
+  publishStatusf("EVT|POWER|N=%ld|WAKE=%ld", node, ms);
+}
+
+// ---------- NVS-backed counters & progress journal ----------
+// MIDs come from a RAM counter that leases blocks from NVS ("msg_counter" holds the
+// lease end); runtime progress (active schedule / step) goes through the journal,
+// which drops unchanged values and batches the rest.
+LeasedCounter<Preferences> midAlloc, evSeqAlloc;
+NvsJournal<Preferences> nvj;
+PerfStats perf;                    // ctrl pass stalls, ACK rate, step-transition latency (PERF_STATS)
+const uint32_t MID_LEASE = 64;
+
+void nvsInit() {
+  midAlloc.begin(prefs, "msg_counter", MID_LEASE);
+  nvj.begin(prefs);
+}
+uint32_t getNextMsgId() { return midAlloc.take(); }
+void saveProgressIndex() { nvj.putInt("active_index", currentStepIndex, millis()); }
+unsigned long lastNvsReport = 0;
+void nvsJournalPoll() {
+  nvj.tick(millis());
+  if (millis() - lastNvsReport >= 3600000UL) { lastNvsReport = millis(); publishStatusMsg(String("EVT|NVS|") + nvsStatsText()); }
+}
+String nvsStatsText() {
+  char buf[120];
+  nvsStatsText(nvj.writes + midAlloc.leases + evSeqAlloc.leases, nvj.avoided() + midAlloc.avoided() + evSeqAlloc.avoided(), millis(), buf, sizeof(buf));
+  return String(buf) + ",MID=" + String(midAlloc.last);
+}
+
+// ---------- Heap metrics ----------
+// Fragmentation shows as the largest free block shrinking while free heap holds steady;
+// both are sampled every minute and reported hourly (EVT|HEAP) so a soak run can be
+// plotted, and on demand (HEAP_STATS).
+uint32_t heapLargestMin = UINT32_MAX, heapSampleMs = 0, heapReportMs = 0;
+String heapStatsText() {
+  uint32_t fr = ESP.getFreeHeap(), big = ESP.getMaxAllocHeap();
+  if (big < heapLargestMin) heapLargestMin = big;
+  char b[200];
+  snprintf(b, sizeof(b), "FREE=%lu,MIN=%lu,LARGEST=%lu,LARGEST_MIN=%lu,FRAG_PCT=%lu,INQ=%u,INQ_HWM=%u/%u,INQ_DROPS=%lu,INQ_CLIP=%lu",
+           (unsigned long)fr, (unsigned long)ESP.getMinFreeHeap(), (unsigned long)big, (unsigned long)heapLargestMin,
+           (unsigned long)(fr ? 100 - (uint64_t)big * 100 / fr : 0), incomingQueue.count, incomingQueue.usedMax, INQ_ARENA_BYTES,
+           (unsigned long)incomingQueue.drops, (unsigned long)incomingQueue.truncated);
+  return String(b);
+}
+void heapPoll() {
+  uint32_t now = millis();
+  if (now - heapSampleMs < 60000UL) return;
+  heapSampleMs = now;
+  uint32_t big = ESP.getMaxAllocHeap(); if (big < heapLargestMin) heapLargestMin = big;
+  if (now - heapReportMs >= 3600000UL) { heapReportMs = now; publishStatusMsg(String("EVT|HEAP|") + heapStatsText()); }
+}
+
+// ---------- Binary frame negotiation ----------
+// Nodes advertise FMT=B1 in their ASCII ACKs (or simply answer in binary); from then on
+// commands to that node go out as binary v1 frames. LORA_BIN=0 forces ASCII for debugging.
+bool loraBinaryEnabled = true;
+#define BIN_NODE_TABLE_SZ 32
+int binNodes[BIN_NODE_TABLE_SZ];
+uint8_t binNodeCaps[BIN_NODE_TABLE_SZ];   // LORA_CAP_* from the node's last binary ACK
+int binNodeCount = 0;
+
+bool nodeUsesBinary(int node) {
+  if (!loraBinaryEnabled) return false;
+  for (int i = 0; i < binNodeCount; ++i) if (binNodes[i] == node) return true;
+  return false;
+}
+// caps 0 keeps what is known (ASCII ACKs only say FMT=B1)
+void markNodeBinary(int node, uint8_t caps = 0) {
+  for (int i = 0; i < binNodeCount; ++i) if (binNodes[i] == node) { if (caps) binNodeCaps[i] = caps; return; }
+  if (binNodeCount < BIN_NODE_TABLE_SZ) {
+    binNodes[binNodeCount] = node; binNodeCaps[binNodeCount++] = caps ? caps : LORA_CAP_BIN1;
+    Serial.printf("Node %d supports binary frames (caps 0x%02X)\n", node, caps);
+  }
+}
+bool nodeCanPlan(int node) {
+  if (!nodeUsesBinary(node)) return false;
+  for (int i = 0; i < binNodeCount; ++i) if (binNodes[i] == node) return binNodeCaps[i] & LORA_CAP_PLAN;
+  return false;
+}
+// Wall clock in ms (PLAN T0, TIME beacons)
+int64_t epochNowMs() { struct timeval tv; gettimeofday(&tv, nullptr); return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000; }
+
+size_t sendLoRaFrame(const LoraFrame &f) {
+  size_t n = loraEncode(f, (uint8_t *)txpacket, BUFFER_SIZE);
+  if (n == 0) { Serial.println("[Radio] TX: frame too large"); return 0; }
+  radioTxBusy = true; radioTxStartMs = millis();
+  { RadioGuard g; Radio.Send((uint8_t *)txpacket, n); }
+  char text[96]; loraFrameToText(f, text, sizeof(text));
+  Serial.printf("[Radio] TX bin %u B: %s\n", (unsigned)n, text);
+  return n;
+}
+
+// Logs on-air size and SF7/125 kHz airtime of each message type, ASCII vs binary
+void logFrameAirtimeReport() {
+  LoraTelemetry tele; loraTelemetryClear(tele);
+  tele.valvePresent = 0x0F; tele.valveOpen = 0x01; tele.vtMs[0] = 59000;
+  tele.moistPresent = 0x07; tele.moist[0] = 41; tele.moist[1] = 38; tele.moist[2] = 55;
+  tele.battPct = 87; tele.bvMv = 4080; tele.solvMv = 5320;
+  char teleText[160]; loraTelemetryText(tele, teleText, sizeof(teleText));
+
+  struct { const char *name; LoraFrame f; char ascii[200]; } rows[4];
+  for (auto &r : rows) loraFrameClear(r.f);
+  rows[0].name = "CMD OPEN";  rows[0].f.kind = LF_CMD; rows[0].f.code = LC_OPEN; rows[0].f.durMs = 60000;
+  rows[1].name = "CMD CLOSE"; rows[1].f.kind = LF_CMD; rows[1].f.code = LC_CLOSE;
+  rows[2].name = "ACK+TELE";  rows[2].f.kind = LF_ACK; rows[2].f.code = LC_OPEN; rows[2].f.hasTele = true; rows[2].f.tele = tele; rows[2].f.caps = LORA_CAP_BIN1;
+  rows[3].name = "STAT";      rows[3].f.kind = LF_STAT; rows[3].f.hasTele = true; rows[3].f.tele = tele;
+  snprintf(rows[0].ascii, sizeof(rows[0].ascii), "CMD|MID=12345|OPEN|N=2,S=SC001,I=1,T=60000");
+  snprintf(rows[1].ascii, sizeof(rows[1].ascii), "CMD|MID=12346|CLOSE|N=2,S=SC001,I=1");
+  snprintf(rows[2].ascii, sizeof(rows[2].ascii), "ACK|MID=12345|OPEN|N=2,S=SC001,I=1|OK|%s,FMT=B1", teleText);
+  snprintf(rows[3].ascii, sizeof(rows[3].ascii), "STAT|N=2|%s", teleText);
+  for (auto &r : rows) {
+    if (r.f.kind != LF_STAT) { r.f.mid = 12345; r.f.idx = 1; r.f.schedHash = loraSchedHash("SC001"); }
+    r.f.node = 2;
+    uint8_t bin[LORA_FRAME_MAX]; size_t bn = loraEncode(r.f, bin, sizeof(bin)); size_t an = strlen(r.ascii);
+    uint32_t at = loraAirtimeUs(an, LORA_SPREADING_FACTOR, 125000, LORA_CODINGRATE, LORA_PREAMBLE_LENGTH);
+    uint32_t bt = loraAirtimeUs(bn, LORA_SPREADING_FACTOR, 125000, LORA_CODINGRATE, LORA_PREAMBLE_LENGTH);
+    Serial.printf("AIRTIME %-9s ascii %3u B %6.1f ms | bin %2u B %5.1f ms | saved %u%%\n", r.name,
+                  (unsigned)an, at / 1000.0f, (unsigned)bn, bt / 1000.0f, at ? (unsigned)(100 - (100ULL * bt) / at) : 0);
+  }
+}
+
+// parse ACKs (zero-copy over the receive buffer)
+bool parseAckWithMid(const char *msg, size_t len, uint32_t wantMid, const char *wantType, int wantNode, const char *wantSched, int wantSeqIndex, bool *binCapable = nullptr) {
+  // expected: ACK|MID=123|OPEN|N=2,I=1,S=SC001|OK[|telemetry]
+  WireCmd ack;
+  if (!wireParseFrame(wireSpan(msg, len), "ACK", ack)) return false;
+  if (ack.mid != wantMid) return false;
+  if (!ack.type.eq(wantType)) return false;
+  if (ack.node != wantNode) return false;
+  if (ack.idx != wantSeqIndex) return false;
+  if (!ack.sched.eq(wantSched)) return false;
+  if (!ack.status.startsWith("OK")) return false;
+  if (binCapable) *binCapable = ack.extra.contains("FMT=B1");
+  return true;
+}
+
+// Match an ACK in either wire format
+bool matchAck(const uint8_t *buf, size_t len, uint32_t wantMid, const char *wantType, int wantNode, const char *wantSched, int wantSeqIndex) {
+  if (loraIsBinary(buf, len)) {
+    LoraFrame f;
+    if (!loraDecode(buf, len, f) || f.kind != LF_ACK) return false;
+    if (f.mid != wantMid || strcmp(loraCmdName(f.code), wantType) != 0) return false;
+    if ((int)f.node != wantNode || f.idx != wantSeqIndex) return false;
+    if (f.schedHash != loraSchedHash(wantSched) || f.status != 0) return false;
+    markNodeBinary(wantNode, f.caps);
+    return true;
+  }
+  bool binCapable = false;
+  if (!parseAckWithMid((const char *)buf, len, wantMid, wantType, wantNode, wantSched, wantSeqIndex, &binCapable)) return false;
+  if (binCapable) markNodeBinary(wantNode);
   return true;
 }
 
-bool waitForAckWithMid(int wantNode, const String &wantType, const String &wantSched, int wantSeqIndex, uint32_t wantMid, uint32_t timeout_ms) {
-  unsigned long start = millis();
-  while (millis() - start < timeout_ms) {
-    int packetSize = LoRa.parsePacket();
-    if (packetSize) {
-      // Read into fixed buffer (avoid repeated String concatenation)
-      char msgBuf[512]; int idx = 0;
-      while (LoRa.available() && idx < (int)sizeof(msgBuf)-1) {
-        int c = LoRa.read();
-        if (c < 0) break;
-        msgBuf[idx++] = (char)c;
-      }
-      msgBuf[idx] = 0;
-      String msg = String(msgBuf);
-      Serial.printf("LoRa RCV: %s\n", msg.c_str());
-      if (parseAckWithMid(msg, wantMid, wantType, wantNode, wantSched, wantSeqIndex)) return true;
-    }
-    delay(10);
+// ---------- LoRa transaction engine ----------
+// Outstanding commands live in a small table keyed by MID so several nodes can be
+// commanded at once. loraTxnPoll() (every ctrl task pass) transmits queued frames one at a
+// time since the radio is half-duplex, re-sends on ACK deadline and fires the
+// completion callback; ACKs are matched by radioDispatch() as it drains the receive ring
+// (OnRxDone only copies frames into it). Nothing here blocks.
+#define LORA_TXN_MAX 12
+#define LORA_TX_STUCK_MS 3000      // recover if TxDone/TxTimeout never arrives (+ long preamble airtime)
+enum TxnOwner : uint8_t { TXN_OWNER_NONE = 0, TXN_OWNER_SCHED, TXN_OWNER_ESTOP, TXN_OWNER_MANUAL };
+struct LoraTxn {
+  bool used;
+  bool waiting;            // frame on air / ACK deadline armed
+  uint32_t mid;
+  char type[12];
+  int node;
+  char sched[32];
+  int idx;
+  uint32_t durMs;
+  uint8_t attempts;
+  unsigned long deadline;
+  LoraTxnCallback cb;
+  uint8_t owner;
+  int tag;
+};
+LoraTxn loraTxns[LORA_TXN_MAX];
+
+int loraTxnInFlight() { int n = 0; for (auto &t : loraTxns) if (t.used) n++; return n; }
+// Longest a TX may take before loraTxnPoll() treats it as stuck
+unsigned long loraTxStuckMs() { return LORA_TX_STUCK_MS + (loraTxPreambleSym > LORA_PREAMBLE_LENGTH ? loraAirtimeUs(0, LORA_SPREADING_FACTOR, 125000, LORA_CODINGRATE, loraTxPreambleSym) / 1000 : 0); }
+
+// Queue a command; returns the slot or -1 when the table is full (caller retries later)
+int loraTxnStart(const char *cmdType, int node, const char *schedId, int seqIndex, uint32_t durationMs,
+                 LoraTxnCallback cb, uint8_t owner, int tag) {
+  for (int i = 0; i < LORA_TXN_MAX; ++i) {
+    LoraTxn &t = loraTxns[i];
+    if (t.used) continue;
+    memset(&t, 0, sizeof(t));
+    t.used = true; t.mid = getNextMsgId(); t.node = node; t.idx = seqIndex; t.durMs = durationMs;
+    snprintf(t.type, sizeof(t.type), "%s", cmdType);
+    snprintf(t.sched, sizeof(t.sched), "%s", schedId);
+    t.cb = cb; t.owner = owner; t.tag = tag;
+    return i;
+  }
+  Serial.printf("LoRa txn table full, %s node %d deferred\n", cmdType, node);
+  return -1;
+}
+
+static void loraTxnFinish(LoraTxn &t, bool acked) {
+  LoraTxn done = t;          // free the slot first so the callback can queue follow-ups
+  t.used = false;
+  perf.txnDone(acked, done.attempts);
+  if (!acked) Serial.printf("No ACK (MID=%u) for %s node %d after %d attempts\n", (unsigned)done.mid, done.type, done.node, done.attempts);
+  if (done.cb) done.cb(done, acked);
+}
+
+// ---------- LoRa multicast (group commands) ----------
+// CLOSE / EMERGENCY / STATUS for many binary-capable nodes go out as one frame (node 0
+// + target bitmap). Every target ACKs in its own slot, so a command to N nodes costs one
+// reply window instead of N round trips; when the window closes the frame is re-sent to
+// the nodes that stayed silent only. Unicast frames wait while a reply window is open so
+// the controller does not transmit over the slots.
+#define LORA_MCAST_MAX 2
+typedef void (*LoraMcastNodeCallback)(const LoraMcast &m, const LoraFrame &ack);
+typedef void (*LoraMcastCallback)(const LoraMcast &m);   // m.pending holds the nodes that never answered
+struct LoraMcast {
+  bool used;
+  bool waiting;            // frame sent, reply window open
+  uint32_t mid;
+  uint8_t code;
+  char sched[32];
+  LoraNodeSet pending;     // targets that have not answered yet
+  uint16_t total;
+  uint16_t slotMs;
+  uint8_t attempts;
+  unsigned long deadline;
+  LoraMcastNodeCallback onNode;
+  LoraMcastCallback onDone;
+  uint8_t owner;
+};
+LoraMcast loraMcasts[LORA_MCAST_MAX];
+
+// One slot fits the largest frame a node can answer with, plus its turnaround
+uint16_t loraMcastSlotMs() { return (uint16_t)(loraAirtimeUs(LORA_FRAME_MAX, LORA_SPREADING_FACTOR, 125000, LORA_CODINGRATE, LORA_PREAMBLE_LENGTH) / 1000 + 15); }
+
+// Queues `code` for the binary-capable nodes of `nodes` that fit one bitmap. The others
+// come back in `unicast` (deduplicated) for the caller to command one by one. Returns the
+// slot, or -1 when nothing went into a multicast.
+int loraMcastStart(uint8_t code, const std::vector<int> &nodes, const char *schedId, LoraMcastNodeCallback onNode,
+                   LoraMcastCallback onDone, uint8_t owner, std::vector<int> &unicast) {
+  unicast.clear();
+  int slot = -1;
+  for (int i = 0; i < LORA_MCAST_MAX; ++i) if (!loraMcasts[i].used) { slot = i; break; }
+  LoraMcast *m = slot >= 0 ? &loraMcasts[slot] : nullptr;
+  if (m) memset(m, 0, sizeof(*m));
+  for (int n : nodes) {
+    if (m && n > 0 && nodeUsesBinary(n) && m->pending.add((uint32_t)n)) continue;
+    bool dup = false; for (int u : unicast) if (u == n) { dup = true; break; }
+    if (!dup) unicast.push_back(n);
+  }
+  if (!m || !m->pending.count()) return -1;
+  m->used = true; m->mid = getNextMsgId(); m->code = code; m->total = m->pending.count(); m->slotMs = loraMcastSlotMs();
+  snprintf(m->sched, sizeof(m->sched), "%s", schedId);
+  m->onNode = onNode; m->onDone = onDone; m->owner = owner;
+  Serial.printf("LoRa multicast %s MID=%u to %u nodes (+%u unicast)\n", loraCmdName(code), (unsigned)m->mid, m->total, (unsigned)unicast.size());
+  return slot;
+}
+
+static void loraMcastFinish(LoraMcast &m) {
+  LoraMcast done = m;
+  m.used = false;
+  perf.txnDone(done.pending.count() == 0, done.attempts);
+  if (done.pending.count()) Serial.printf("Multicast MID=%u: %u of %u nodes never answered\n", (unsigned)done.mid, done.pending.count(), done.total);
+  if (done.onDone) done.onDone(done);
+}
+
+static void loraMcastTransmit(LoraMcast &m) {
+  LoraFrame f; loraFrameClear(f);
+  f.kind = LF_CMD; f.code = m.code; f.mid = m.mid; f.node = LORA_NODE_GROUP; f.schedHash = loraSchedHash(m.sched);
+  f.targets = m.pending; f.slotMs = m.slotMs;
+  uint32_t wake = 0;                                    // the slowest sleeper sets the preamble
+  for (int32_t nd = m.pending.next(0); nd >= 0; nd = m.pending.next(nd + 1)) { uint32_t w = nodeWake.wakeMs((uint16_t)nd); if (w > wake) wake = w; }
+  loraTxPreamble(wake);
+  size_t n = sendLoRaFrame(f);
+  unsigned long air = loraAirtimeUs(n, LORA_SPREADING_FACTOR, 125000, LORA_CODINGRATE, loraTxPreambleSym) / 1000;
+  m.attempts++; m.waiting = true;
+  m.deadline = millis() + air + 2 * LORA_SLOT_GUARD_MS + (unsigned long)m.pending.count() * m.slotMs;   // guard before slot 0 and after the last
+}
+
+bool loraMcastWindowOpen() { for (auto &m : loraMcasts) if (m.used && m.waiting) return true; return false; }
+
+// Binary ACK from one of the targets; true when it belonged to a multicast
+bool loraMcastOnAck(const LoraFrame &f) {
+  for (auto &m : loraMcasts) {
+    if (!m.used || !m.attempts || f.mid != m.mid || f.code != m.code || !m.pending.has(f.node)) continue;
+    if (f.schedHash != loraSchedHash(m.sched) || f.status != 0) continue;
+    m.pending.remove(f.node);
+    if (f.caps) markNodeBinary((int)f.node, f.caps);
+    if (m.onNode) m.onNode(m, f);
+    if (!m.pending.count()) loraMcastFinish(m);    // everyone answered: close the window early
+    return true;
   }
   return false;
 }
 
-bool sendCmdWithAck(const String &cmdType, int node, const String &schedId, int seqIndex, uint32_t durationMs = 0) {
-  uint32_t mid = getNextMsgId();
-  String kv = String("N=") + String(node) + String(",S=") + schedId + String(",I=") + String(seqIndex);
-  if (cmdType == "OPEN" && durationMs > 0) kv += String(",T=") + String(durationMs);
-  String cmd = String("CMD|MID=") + String(mid) + String("|") + cmdType + String("|") + kv;
-  Serial.printf("Sending LoRa cmd: %s\n", cmd.c_str());
-  uint8_t attempt = 0;
-  while (attempt < LORA_MAX_RETRIES) {
+// Drop queued/in-flight commands of one owner without firing callbacks
+void loraTxnCancelOwner(uint8_t owner) {
+  for (auto &t : loraTxns) if (t.used && t.owner == owner) { Serial.printf("Cancel txn MID=%u %s node %d\n", (unsigned)t.mid, t.type, t.node); t.used = false; }
+  for (auto &m : loraMcasts) if (m.used && m.owner == owner) { Serial.printf("Cancel multicast MID=%u %s\n", (unsigned)m.mid, loraCmdName(m.code)); m.used = false; }
+}
+
+// Stamps the controller clock as of the end of the frame (its airtime at the current preamble)
+void loraStampEpoch(LoraFrame &f) {
+  uint8_t tmp[LORA_FRAME_MAX]; f.epochMs = epochNowMs();
+  size_t n = loraEncode(f, tmp, sizeof(tmp));
+  f.epochMs += loraAirtimeUs(n, LORA_SPREADING_FACTOR, 125000, LORA_CODINGRATE, loraTxPreambleSym) / 1000;
+}
+// PLAN for one node: its windows of planRun and T0
+void planFrame(int node, LoraFrame &f) {
+  uint8_t n = planRun.slice((uint16_t)node, f.plan, LORA_PLAN_MAX);
+  f.planN = n > LORA_PLAN_MAX ? LORA_PLAN_MAX : n; f.planT0Ms = planRun.t0;
+  loraStampEpoch(f);
+}
+// TIME beacon: every node resyncs, nobody answers (sent at the slowest sleeper's preamble)
+bool loraBeaconDue = false;
+static void loraBeaconTransmit() {
+  LoraFrame f; loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_TIMESYNC; f.node = LORA_NODE_GROUP;
+  loraTxPreamble(nodeWake.maxWakeMs());
+  loraStampEpoch(f);
+  sendLoRaFrame(f);
+  loraBeaconDue = false;
+}
+
+static void loraTxnTransmit(LoraTxn &t) {
+  bool binary = nodeUsesBinary(t.node);
+  uint32_t wake = nodeWake.wakeMs((uint16_t)t.node);
+  loraTxPreamble(wake);
+  if (binary) {
+    LoraFrame f; loraFrameClear(f);
+    f.kind = LF_CMD; f.code = loraCmdFromName(wireSpan(t.type));
+    f.mid = t.mid; f.node = t.node; f.idx = t.idx; f.schedHash = loraSchedHash(t.sched);
+    if (f.code == LC_OPEN || f.code == LC_POWER || f.code == LC_CAL) f.durMs = t.durMs;
+    if (f.code == LC_PLAN) planFrame(t.node, f);
+    if (f.code != LC_UNKNOWN) sendLoRaFrame(f);
+    else binary = false;     // no binary code for this type
+  }
+  if (!binary) {
+    char cmd[BUFFER_SIZE];
+    int n = snprintf(cmd, sizeof(cmd), "CMD|MID=%u|%s|N=%d,S=%s,I=%d", (unsigned)t.mid, t.type, t.node, t.sched, t.idx);
+    bool withT = (strcmp(t.type, "OPEN") == 0 && t.durMs > 0) || strcmp(t.type, "POWER") == 0 || strcmp(t.type, "CAL") == 0;   // POWER: T = cadence in ms, CAL: point
+    if (withT && n > 0 && n < (int)sizeof(cmd)) snprintf(cmd + n, sizeof(cmd) - n, ",T=%u", (unsigned)t.durMs);
+    Serial.printf("Sending LoRa cmd: %s\n", cmd);
     sendLoRaCmdRaw(cmd);
-    if (waitForAckWithMid(node, cmdType, schedId, seqIndex, mid, LORA_ACK_TIMEOUT_MS)) return true;
-    attempt++; Serial.printf("No ACK (MID=%u) for %s node %d attempt %d\n", (unsigned)mid, cmdType.c_str(), node, attempt);
   }
-  return false;
+  t.attempts++; t.waiting = true; t.deadline = millis() + LORA_ACK_TIMEOUT_MS + wake + NODE_RX_WINDOW_MS;   // + the preamble a sleeping node needs
+}
+
+// Offer a received frame to the table; true when it was an ACK (matched or stale)
+bool loraTxnOnFrame(const uint8_t *buf, size_t len) {
+  bool isAck = false, binary = loraIsBinary(buf, len);
+  LoraFrame f;
+  if (binary) isAck = loraDecode(buf, len, f) && f.kind == LF_ACK;
+  else isAck = len >= 4 && memcmp(buf, "ACK|", 4) == 0;
+  if (!isAck) return false;
+  if (binary && loraMcastOnAck(f)) { radioStats.acks++; return true; }
+  for (auto &t : loraTxns) {
+    if (!t.used || t.attempts == 0) continue;
+    if (matchAck(buf, len, t.mid, t.type, t.node, t.sched, t.idx)) { radioStats.acks++; loraTxnFinish(t, true); return true; }
+  }
+  radioStats.staleAcks++;
+  Serial.println("[Radio] stale/unmatched ACK dropped");
+  return true;
+}
+
+// ctrl task; OnTxDone/OnRxDone come from the radio task's Radio.IrqProcess()
+void loraTxnPoll() {
+  unsigned long now = millis();
+  if (radioTxBusy && now - radioTxStartMs > loraTxStuckMs()) { Serial.println("[Radio] TX stuck, back to RX"); radioTxBusy = false; RadioGuard g; Radio.Rx(0); }
+  for (auto &t : loraTxns) {
+    if (!t.used || !t.waiting || (long)(now - t.deadline) < 0) continue;
+    if (t.attempts >= LORA_MAX_RETRIES) loraTxnFinish(t, false);
+    else { t.waiting = false; Serial.printf("No ACK (MID=%u) for %s node %d attempt %d\n", (unsigned)t.mid, t.type, t.node, t.attempts); }
+  }
+  for (auto &m : loraMcasts) {
+    if (!m.used || !m.waiting || (long)(now - m.deadline) < 0) continue;
+    if (m.attempts >= LORA_MAX_RETRIES) loraMcastFinish(m);
+    else { m.waiting = false; Serial.printf("Multicast MID=%u: %u of %u nodes silent after attempt %d\n", (unsigned)m.mid, m.pending.count(), m.total, m.attempts); }
+  }
+  if (radioTxBusy || loraMcastWindowOpen()) return;
+  if (loraBeaconDue) { loraBeaconTransmit(); return; }
+  for (auto &m : loraMcasts) if (m.used && !m.waiting) { loraMcastTransmit(m); return; }
+  for (auto &t : loraTxns) if (t.used && !t.waiting) { loraTxnTransmit(t); break; }
+}
+
+void onManualValveDone(const LoraTxn &t, bool acked) {
+  publishStatusf("%s|MANUAL|VALVE|%s%s", acked ? "ACK" : "ERR", t.type, acked ? "" : "|NO_ACK");
+}
+
+// Telemetry resync: a delta STAT after a lost one (or with no keyframe seen) leaves the
+// node's state incomplete until a full block arrives; ask for it with a STATUS.
+void onTeleResyncDone(const LoraTxn &t, bool acked) {
+  NodeTeleTable::Entry *x = nodeTele.find((uint16_t)t.node);
+  if (!acked && x) x->resync = false;          // retry on the next delta
+}
+void nodeTeleFold(LoraFrame &f, int16_t rssi) {
+  if (!f.hasTele || f.kind == LF_CMD) return;
+  TeleApply a = nodeTele.apply(f, millis());
+  NodeTeleTable::Entry *x = nodeTele.find((uint16_t)f.node);
+  if (x) x->rssi = rssi;
+  if (a == TA_STALE && x && !x->resync) {
+    x->resync = true;
+    Serial.printf("Node %lu telemetry out of step, requesting STATUS\n", (unsigned long)f.node);
+    loraTxnStart("STATUS", (int)f.node, "TELE", 0, 0, onTeleResyncDone, TXN_OWNER_MANUAL, 0);
+  }
+  if (x && x->full) {
+    int64_t now = epochNowMs();
+    if (now >= NODE_EPOCH_MIN_MS) teleSeries.add((uint16_t)f.node, (uint32_t)(now / 1000), x->t);   // no history before the clock is set
+  }
+  if (f.kind == LF_STAT && x) { f.tele = x->t; f.hasMeta = false; }   // publish the whole picture
+}
+// Legacy ASCII STAT lines always carry complete telemetry
+void nodeTeleFoldText(const char *text, int16_t rssi) {
+  WireSpan t = wireSpan(text), v;
+  if (!wireFindKey(t, "N", v)) return;
+  LoraFrame f; loraFrameClear(f);
+  f.kind = LF_STAT; f.node = v.toU32(); f.hasTele = loraTelemetryParse(t, f.tele) != 0;
+  nodeTeleFold(f, rssi);
+}
+String teleStatsText() {
+  return "NODES=" + String(nodeTele.n) + ",KEYS=" + String(nodeTele.keys) + ",DELTAS=" + String(nodeTele.deltas) +
+         ",FULL=" + String(nodeTele.fulls) + ",GAPS=" + String(nodeTele.gaps) + ",STALE=" + String(nodeTele.stale());
+}
+String teleSeriesStatsText() { char buf[120]; teleSeries.statsText(buf, sizeof(buf)); return String(buf); }
+
+// TS_QUERY=<node>:<field>[:<R|Q|H>[:<from>[:<to>[:AGG]]]]
+// field M1..M4, BATT, BV, SOLV, SOLI; R raw, Q 15 min, H hourly (default); from / to unix
+// seconds, negative = seconds before now, 0 / absent = open end. Points go out as
+// "STATUS|TS|N=3,F=M1,R=H,P=<part>|<t>:<mean>[:<min>:<max>];+<dt>:..." split to the outbox
+// message size, the last part flagged END and MORE=<next from> when TS_QUERY_MAX_PTS or
+// TS_QUERY_MAX_PARTS cut it short. AGG replies with one "STATUS|TS_AGG|..." line instead.
+// The parts go through statusQ in one burst, so a query is held to a quarter of it.
+const uint16_t TS_QUERY_MAX_PTS = 96;
+const uint8_t TS_QUERY_MAX_PARTS = STATUS_Q_LEN / 4;
+void teleSeriesQuery(const String &spec) {
+  WireSpan parts[6]; uint8_t np = wireSplit(wireSpan(spec.c_str(), spec.length()), ':', parts, 6);
+  long nd = np >= 2 ? parts[0].trim().toLong(-1) : -1;
+  int fld = np >= 2 ? tsFieldFromName(parts[1].trim()) : -1;
+  char rc = np >= 3 && parts[2].trim().n ? parts[2].trim().p[0] : 'H';
+  uint8_t res = rc == 'R' ? TS_RAW : rc == 'Q' ? TS_QUARTER : rc == 'H' ? TS_HOUR : 0xFF;
+  if (nd < 0 || nd > 0xFFFF || fld < 0 || res == 0xFF) { publishStatusIfAvailable("ERR|TS|BAD_SPEC"); return; }
+  uint32_t now = (uint32_t)(epochNowMs() / 1000);
+  auto bound = [now](WireSpan v, uint32_t open) -> uint32_t {
+    long t = v.trim().toLong(0);
+    if (t < 0) return (uint32_t)-t < now ? now + t : 0;
+    return t ? (uint32_t)t : open;
+  };
+  uint32_t from = np >= 4 ? bound(parts[3], 0) : 0, to = np >= 5 ? bound(parts[4], 0xFFFFFFFFu) : 0xFFFFFFFFu;
+  char head[48]; snprintf(head, sizeof(head), "N=%ld,F=%s,R=%c", nd, tsFieldName((uint8_t)fld), rc);
+  if (np >= 6 && parts[5].trim().eq("AGG")) {
+    TsAgg a = teleSeries.aggregate((uint16_t)nd, (uint8_t)fld, res, from, to);
+    char b[160];
+    if (!a.points) snprintf(b, sizeof(b), "STATUS|TS_AGG|%s,PTS=0", head);
+    else snprintf(b, sizeof(b), "STATUS|TS_AGG|%s,FROM=%lu,TO=%lu,PTS=%lu,SAMPLES=%lu,MEAN=%d,MIN=%d,MAX=%d", head, (unsigned long)a.first,
+                  (unsigned long)a.last, (unsigned long)a.points, (unsigned long)a.samples, a.mean(), a.lo, a.hi);
+    publishStatusIfAvailable(b);
+    return;
+  }
+  char body[OB_MSG_MAX]; size_t len = 0; uint8_t part = 0; uint16_t cnt = 0; uint32_t prevT = 0, moreT = 0;
+  size_t room = OB_MSG_MAX - strlen(head) - 40;   // "STATUS|TS|", part number, END / MORE
+  auto flush = [&](const char *tail) {
+    char msg[OB_MSG_MAX + 16];
+    snprintf(msg, sizeof(msg), "STATUS|TS|%s,P=%u%s|%s", head, part++, tail, body);
+    publishStatusIfAvailable(msg);
+    len = 0; body[0] = 0;
+  };
+  body[0] = 0;
+  teleSeries.query((uint16_t)nd, (uint8_t)fld, res, from, to, [&](const TsPoint &p) {
+    if (cnt >= TS_QUERY_MAX_PTS) { moreT = p.t; return false; }
+    char pt[48]; int w = 0;
+    for (int pass = 0; pass < 2; ++pass) {            // first point of a part carries the absolute time
+      w = len ? snprintf(pt, sizeof(pt), ";+%lu:%d", (unsigned long)(p.t - prevT), p.mean) : snprintf(pt, sizeof(pt), "%lu:%d", (unsigned long)p.t, p.mean);
+      if (res != TS_RAW) w += snprintf(pt + w, sizeof(pt) - w, ":%d:%d", p.lo, p.hi);
+      if (len + w <= room) break;
+      if (part + 1 >= TS_QUERY_MAX_PARTS) { moreT = p.t; return false; }   // the END part carries MORE=
+      flush("");
+    }
+    memcpy(body + len, pt, w + 1); len += w;
+    prevT = p.t; cnt++;
+    return true;
+  });
+  char tail[32];
+  if (moreT) snprintf(tail, sizeof(tail), ",END,MORE=%lu", (unsigned long)moreT); else snprintf(tail, sizeof(tail), ",END");
+  flush(tail);
 }
 
 // ---------- Incoming handlers (queue) ----------
 void processIncomingScheduleString(const String &payload); // forward
-void handleLoRaIncoming() {
-  int packetSize = LoRa.parsePacket(); if (packetSize==0) return;
-  // Read into fixed buffer to reduce heap churn
-  char payloadBuf[512]; int idx = 0;
-  while (LoRa.available() && idx < (int)sizeof(payloadBuf)-1) {
-    int c = LoRa.read(); if (c < 0) break; payloadBuf[idx++] = (char)c;
-  }
-  payloadBuf[idx] = 0;
-  String payload = String(payloadBuf);
-  payload.trim(); if (payload.length()==0) return;
-  if (payload.indexOf("SRC=") < 0) payload += String(",SRC=LORA");
-  enqueueIncoming(payload);
-  publishStatusMsg(String("EVT|INQ|ENQ|SRC=LORA"));
-}
-
-// ---------- Modem SMS read helper ----------
-String modemReadSMSByIndex(int index, String &outSender) {
-  outSender = "";
-  String cmd = String("AT+CMGR=") + String(index);
-  String resp = sendAT(cmd, 3000);
-  int headerPos = resp.indexOf("+CMGR:");
-  if (headerPos >= 0) {
-    int nl = resp.indexOf('\n', headerPos);
-    if (nl > headerPos) {
-      String header = resp.substring(headerPos, nl);
-      int q1 = header.indexOf('"');
-      if (q1 >= 0) {
-        int q2 = header.indexOf('"', q1 + 1);
-        int q3 = header.indexOf('"', q2 + 1);
-        int q4 = header.indexOf('"', q3 + 1);
-        if (q3 >= 0 && q4 > q3) outSender = header.substring(q3 + 1, q4);
+void planOnReport(const LoraFrame &f);                      // forward
+// Drains the receive ring: ACKs go to the transaction table, STAT and AUTO_OPENED /
+// AUTO_CLOSED lines straight to the status channel, everything else to the incoming queue (binary frames rendered to their
+// ASCII form first).
+void radioDispatch() {
+  const RadioPacket *pk;
+  while ((pk = radioRx.peek()) != nullptr) {
+    char text[RADIO_PKT_MAX + 1]; int16_t rssi = pk->rssi;   // pk is gone after pop()
+    if (loraIsBinary(pk->data, pk->len)) {
+      LoraFrame f;
+      if (!loraDecode(pk->data, pk->len, f)) { radioStats.badFrames++; Serial.printf("[Radio] RX %u bytes binary, bad CRC\n", pk->len); radioRx.pop(); continue; }
+      loraFrameToText(f, text, sizeof(text));
+      if (f.kind == LF_STAT || f.kind == LF_AUTO_OPENED || f.kind == LF_AUTO_CLOSED) {
+        Serial.printf("[Radio] RX %u bytes RSSI=%d SNR=%d => %s\n", pk->len, pk->rssi, pk->snr, text);
+        nodeWakeLearn(text); radioRx.pop();
+        nodeTeleFold(f, rssi);
+        if (f.kind == LF_STAT) loraFrameToText(f, text, sizeof(text)); else planOnReport(f);
+        publishStatusf("%s|SRC=LORA", text);
+        continue;
       }
+      nodeTeleFold(f, rssi);
+    } else {
+      memcpy(text, pk->data, pk->len + 1);
     }
-  }
-  int firstNl = resp.indexOf('\n');
-  if (firstNl < 0) return String("");
-  String after = resp.substring(firstNl + 1);
-  int okpos = after.indexOf("\r\nOK");
-  String body = (okpos >= 0) ? after.substring(0, okpos) : after;
-  body.trim();
-  // delete message
-  sendAT(String("AT+CMGD=") + String(index), 2000);
-  Serial.printf("SMS from %s body: %s\n", outSender.c_str(), body.c_str());
-  return body;
+    Serial.printf("[Radio] RX %u bytes RSSI=%d SNR=%d => %s\n", pk->len, pk->rssi, pk->snr, text);
+    nodeWakeLearn(text);
+    if (loraTxnOnFrame(pk->data, pk->len)) { radioRx.pop(); continue; }
+    radioRx.pop();
+    if (strncmp(text, "STAT|", 5) == 0) nodeTeleFoldText(text, rssi);
+    if (strncmp(text, "STAT|", 5) == 0 || strncmp(text, "AUTO_CLOSED|", 12) == 0) { publishStatusf("%s|SRC=LORA", text); continue; }
+    WireSpan t = wireSpan(text).trim(); if (t.n == 0) continue;
+    char payload[RADIO_PKT_MAX + 16];
+    int n = snprintf(payload, sizeof(payload), "%.*s,SRC=LORA", (int)t.n, t.p);   // own tag last, whatever the sender put in
+    if (!enqueueIncoming(payload, n < (int)sizeof(payload) ? n : sizeof(payload) - 1)) radioStats.queueDrops++;
+    radioStats.queued++;
+    publishStatusMsg("EVT|INQ|ENQ|SRC=LORA");
+  }
+}
+
+String radioStatsText() {
+  RadioRxCounters c = radioStats; radioRx.snapshot(c);
+  char buf[160]; radioCountersText(c, radioRx.depth(), buf, sizeof(buf));
+  return String(buf);
 }
 
-// Modem background read: handles +QMTRECV and +CMTI
-void modemBackgroundRead() {
-  while (ModemSerial.available()) { char c = (char)ModemSerial.read(); modemLineBuffer += c; lastModemActivity = millis(); }
-  int nl;
-  while ((nl = modemLineBuffer.indexOf('\n')) >= 0) {
-    String line = modemLineBuffer.substring(0, nl+1); modemLineBuffer = modemLineBuffer.substring(nl+1);
-    line.trim(); if (line.length()==0) continue;
-    Serial.println(String("[MODEM] ") + line);
-    if (line.startsWith("+QMTRECV:")) {
-      lastMqttURCTime = millis();
-      int firstQuote = line.indexOf('"');
-      if (firstQuote>=0) {
-        int secondQuote = line.indexOf('"', firstQuote+1);
-        if (secondQuote>firstQuote) {
-          int thirdQuote = line.indexOf('"', secondQuote+1);
-          int fourthQuote = line.indexOf('"', thirdQuote+1);
-          if (thirdQuote>=0 && fourthQuote>thirdQuote) {
-            String payload = line.substring(thirdQuote+1, fourthQuote);
-            if (payload.indexOf("SRC=") < 0) payload += ",SRC=MQTT";
-            enqueueIncoming(payload);
-            publishStatusMsg(String("EVT|INQ|ENQ|SRC=MQTT"));
-          }
-        }
-      }
-    } else if (line.startsWith("+CMTI:")) {
-      int comma = line.indexOf(','); if (comma>=0) {
-        String idxStr = line.substring(comma+1); idxStr.trim(); int idx = idxStr.toInt();
-        String sender; String body = modemReadSMSByIndex(idx, sender);
-        if (body.length()) {
-          String pl = body; if (pl.indexOf("SRC=") < 0) pl += ",SRC=SMS";
-          pl += String(",_FROM=") + sender;
-          enqueueIncoming(pl);
-          publishStatusMsg(String("EVT|INQ|ENQ|SRC=SMS"));
-        }
-      }
+// ---------- Modem URC handlers ----------
+// +QMTRECV: <client>,<msgID>,"<topic>","<payload>"
+void onMqttRecvUrc(WireSpan line) {
+  lastMqttURCTime = millis();
+  int q[4]; int from = 0;
+  for (int i = 0; i < 4; ++i) { q[i] = line.indexOf('"', from); if (q[i] < 0) return; from = q[i] + 1; }
+  // payload may itself contain quotes: take up to the last quote on the line
+  int last = q[3]; for (int i = q[3]; i < line.n; ++i) if (line.p[i] == '"') last = i;
+  WireSpan body = line.sub(q[2] + 1, last - q[2] - 1);
+  String payload; payload.reserve(body.n + 10); payload.concat(body.p, body.n);
+  payload += ",SRC=MQTT";
+  enqueueIncoming(payload);
+  publishStatusMsg("EVT|INQ|ENQ|SRC=MQTT");
+}
+
+// AT+CMGR response: +CMGR: "REC UNREAD","<sender>",,"<ts>"\n<body lines>\nOK
+void onSmsRead(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  int index = (int)(intptr_t)ctx;
+  WireSpan hdr;
+  if (res == AT_OK && atFindLine(resp, len, "+CMGR:", hdr)) {
+    String sender;
+    int q1 = hdr.indexOf('"'), q2 = q1 >= 0 ? hdr.indexOf('"', q1 + 1) : -1;
+    int q3 = q2 >= 0 ? hdr.indexOf('"', q2 + 1) : -1, q4 = q3 >= 0 ? hdr.indexOf('"', q3 + 1) : -1;
+    if (q3 >= 0 && q4 > q3) { WireSpan s = hdr.sub(q3 + 1, q4 - q3 - 1); sender.concat(s.p, s.n); }
+    // body: everything between the header line and the final OK
+    const char *b = hdr.p + hdr.n; const char *e = resp + len;
+    if (b < e && *b == '\n') b++;
+    WireSpan body = wireSpan(b, e - b);
+    if (body.n >= 2 && body.sub(body.n - 2).eq("OK")) body = body.sub(0, body.n - 2);
+    body = body.trim();
+    Serial.printf("SMS from %s body: %.*s\n", sender.c_str(), (int)body.n, body.p);
+    if (body.n) {
+      String pl; pl.concat(body.p, body.n);
+      pl += String(",SRC=SMS,_FROM=") + sender;
+      enqueueIncoming(pl);
+      publishStatusMsg("EVT|INQ|ENQ|SRC=SMS");
     }
   }
+  // delete message
+  atEngine.submit((String("AT+CMGD=") + String(index)).c_str(), 2000);
 }
 
-// ---------- Token / source helpers ----------
-String extractSrc(const String &payload) {
-  int p = payload.indexOf("SRC=");
-  if (p < 0) return String("UNKNOWN");
-  String s = payload.substring(p + 4);
-  int c = s.indexOf(',');
-  if (c >= 0) s = s.substring(0, c);
-  s.trim();
-  return s;
+// +CMTI: "SM",<index>
+void onCmtiUrc(WireSpan line) {
+  int comma = line.indexOf(','); if (comma < 0) return;
+  int idx = (int)line.sub(comma + 1).trim().toLong(-1); if (idx < 0) return;
+  if (!atEngine.submit((String("AT+CMGR=") + String(idx)).c_str(), 3000, onSmsRead, (void *)(intptr_t)idx))
+    Serial.printf("SMS %d: AT queue full, left on SIM\n", idx);
 }
+
+// +QMTSTAT: <client>,<err> -- broker link dropped; queue a reconnect
+void onMqttStatUrc(WireSpan line) {
+  Serial.printf("MQTT link state change: %.*s\n", (int)line.n, line.p);
+  modemConfigureAndConnectMQTT();
+}
+
+// ---------- Token / source helpers ----------
 String extractKeyVal(const String &payload, const String &key) {
-  int p = payload.indexOf(key + "=");
-  if (p < 0) return String("");
-  String s = payload.substring(p + key.length() + 1);
-  int c = s.indexOf(',');
-  if (c >= 0) s = s.substring(0, c);
-  s.trim();
-  return s;
+  WireSpan v;
+  if (!wireFindKey(wireSpan(payload.c_str(), payload.length()), key.c_str(), v)) return String("");
+  char buf[96]; v.copyTo(buf, sizeof(buf));
+  return String(buf);
 }
-bool verifyTokenForSrc(const String &payload, const String &fromNumber = "") {
-  String src = extractSrc(payload);
-  if (src == "SMS") {
-    if (fromNumber.length()) {
-      if (isAdminNumber(fromNumber)) return true;
-      String rec = extractKeyVal(payload, "RECOV");
-      if (rec.length() && rec == sysConfig.recoveryTok) { Serial.println("Recovery token accepted for SMS from " + fromNumber); return true; }
-      return false;
-    }
-    return false;
-  }
-  String tok = extractKeyVal(payload, "TOK");
-  if (tok.length() && tok == sysConfig.sharedTok) return true;
-  if (src == "BT") {
-    String t2 = extractKeyVal(payload, "TOK_BT"); if (t2.length() && t2 == prefs.getString("tok_bt","")) return true;
-  }
-  if (src == "LORA") {
-    String t2 = extractKeyVal(payload, "TOK_LORA"); if (t2.length() && t2 == prefs.getString("tok_lora","")) return true;
-  }
-  if (src == "MQTT") {
-    String t2 = extractKeyVal(payload, "TOK_MQ"); if (t2.length() && t2 == prefs.getString("tok_mq","")) return true;
-  }
-  return false;
+// One pass over the payload against the cached context; m: SRC / _FROM (last ones) and what was checked
+AuthResult verifyTokenForSrc(const String &payload, AuthMsg &m) {
+  uint32_t t0 = micros();
+  AuthResult r = authCtx.check(payload.c_str(), payload.length(), trustedNowS(), m);
+  authCtx.stats.done(r, m.path, micros() - t0);
+  if (r == AUTH_OK_RECOV) Serial.printf("Recovery token accepted for SMS from %.*s\n", (int)m.from.n, m.from.p);
+  return r;
+}
+String authStatsText() { char buf[400]; authCtx.text(buf, sizeof(buf)); return String(buf); }
+// AUTH_STATS=BENCH: per-message cost of the cached checks next to the lookups they replaced.
+// Modem task, on a context of its own loaded from modemCfg (authCtx is the ctrl task's);
+// yields between the timed loops so the AT engine keeps its pace.
+void authBench() {
+  const uint16_t N = 100;
+  AuthCtx *a = new (std::nothrow) AuthCtx();            // ~2 KB: off the modem stack
+  if (!a) { publishStatusMsg("ERR|AUTH_BENCH|NO_MEM"); return; }
+  authLoad(*a, modemCfg);
+  String num = a->admins ? String(a->admin[a->admins - 1]) : String("+910000000000");
+  String tokMsg = String("CFG|PERF_STATS=1,TOK=") + modemCfg.tok[AUTH_SHARED].c_str() + ",SRC=MQTT";
+  char sigMsg[160]; int sn = a->sign(AUTH_LORA, "CFG|PERF_STATS=1,ATS=1,NONCE=bench", sigMsg, sizeof(sigMsg) - 10);
+  if (sn > 0) strcat(sigMsg, ",SRC=LORA");
+  AuthMsg m; uint8_t got[AUTH_SIG_BYTES]; volatile uint32_t hits = 0;
+  uint32_t t0 = micros();
+  for (uint16_t i = 0; i < N; ++i) hits += a->isAdmin(num.c_str(), num.length());
+  uint32_t tAdmin = micros() - t0; vTaskDelay(1); t0 = micros();
+  for (uint16_t i = 0; i < N; ++i) { String n = normalizePhone(num); auto list = adminPhoneList(); for (auto &p : list) if (normalizePhone(p) == n) { hits++; break; } }
+  uint32_t tScan = micros() - t0; vTaskDelay(1); t0 = micros();
+  for (uint16_t i = 0; i < N; ++i) hits += a->check(tokMsg.c_str(), tokMsg.length(), 0, m) == AUTH_OK_TOK;
+  uint32_t tTok = micros() - t0; vTaskDelay(1); t0 = micros();
+  for (uint16_t i = 0; i < N; ++i) hits += prefs.getString("tok_mq", "").length();
+  uint32_t tNvs = micros() - t0, tSig = 0; vTaskDelay(1);
+  if (sn > 0) { t0 = micros(); for (uint16_t i = 0; i < N; ++i) { m.scan(sigMsg, strlen(sigMsg)); hits += a->sigValid(sigMsg, m, got); } tSig = micros() - t0; }
+  publishStatusf("STATUS|AUTH_BENCH|N=%u,ADMIN_NS=%lu,ADMIN_SCAN_NS=%lu,TOK_NS=%lu,NVS_TOK_NS=%lu,SIG_NS=%lu", N, tAdmin * 1000UL / N, tScan * 1000UL / N,
+                 tTok * 1000UL / N, tNvs * 1000UL / N, tSig * 1000UL / N);
+  delete a;
 }
 
 
@@ -898,34 +1442,31 @@ bool verifyTokenForSrc(const String &payload, const String &fromNumber = "") {
 void processIncomingScheduleString(const String &payload) {
   String trimmed = payload; trimmed.trim();
   if (trimmed.length() == 0) return;
-  String src = extractSrc(trimmed);
-  String fromNumber = extractKeyVal(trimmed, "_FROM");
+  AuthMsg am;
+  AuthResult ar = verifyTokenForSrc(trimmed, am);
+  String src, fromNumber;                  // _FROM only counts on an SMS
+  src.concat(am.src.p, am.src.n);
+  if (am.s == AUTH_SMS) fromNumber.concat(am.from.p, am.from.n);
   Serial.printf("Processing incoming payload from %s : %s\n", src.c_str(), trimmed.c_str());
 
-  // Auth check: for SMS we pass sender number
-  if (!verifyTokenForSrc(trimmed, fromNumber)) {
-    publishStatusMsg(String("ERR|AUTH_FAIL|SRC=") + src);
+  if (!authOk(ar)) {
+    publishStatusMsg(String("ERR|AUTH_FAIL|SRC=") + src + "|WHY=" + authResultName(ar));
     Serial.println("Auth failed for payload: " + trimmed);
     return;
   }
 
   // If payload is JSON schedule
   if (trimmed.startsWith("{") || trimmed.startsWith("[")) {
-    if (validateAndLoadScheduleFromJson(trimmed)) {
-      broadcastStatus(String("EVT|SCH|SAVED|SRC=") + src);
-    } else {
-      publishStatusMsg("ERR|SCH|JSON_INVALID");
-    }
+    if (!validateAndLoadScheduleFromJson(trimmed, src)) publishStatusMsg("ERR|SCH|JSON_INVALID");
     return;
   }
 
+  // Step patch against a known version (SCHP|...)
+  if (trimmed.indexOf("SCHP|") >= 0) { applySchedulePatch(trimmed, src); return; }
+
   // If compact schedule string (SCH|...)
   if (trimmed.indexOf("SCH|") >= 0) {
-    if (saveCompactScheduleToMultipleFilesAndLoad(trimmed)) {
-      broadcastStatus(String("EVT|SCH|SAVED|S=") + currentScheduleId + String("|SRC=") + src);
-    } else {
-      publishStatusMsg("ERR|SCH|INVALID");
-    }
+    if (!saveCompactScheduleToMultipleFilesAndLoad(trimmed, src)) publishStatusMsg("ERR|SCH|INVALID");
     return;
   }
 
@@ -935,7 +1476,7 @@ void processIncomingScheduleString(const String &payload) {
     String body = trimmed;
     int p = body.indexOf("CFG|");
     if (p >= 0) body = body.substring(p + 4);
-    if (processSystemConfigSms(body, fromNumber)) {
+    if (processSystemConfigSms(body, fromNumber, ar)) {
       broadcastStatus(String("EVT|CFG|OK|SRC=") + src);
     } else publishStatusMsg("ERR|CFG|INVALID");
     return;
@@ -956,48 +1497,172 @@ void processIncomingScheduleString(const String &payload) {
 // ---------- Processing incoming queued messages ----------
 
 // ---------- Modified publish / broadcast that sends SMS per-admin ----------
-void publishStatusMsg(const String &msg) {
-  String out = msg;
-  Serial.println("PublishStatus: " + out);
-
-  // 1) MQTT (if available)
-  if (mqttAvailable) { modemPublish(MQTT_TOPIC_STATUS, out); }
-
-  // 2) BLE notify (if client connected and TX char exists)
-  if (deviceConnected && pTxCharacteristic != nullptr) {
-    // Build a compact BLE notification payload (avoid huge messages)
-    String btMsg = String("STAT|") + out;
-    if (btMsg.length() > 200) btMsg = btMsg.substring(0, 200);
-    pTxCharacteristic->setValue((uint8_t*)btMsg.c_str(), btMsg.length());
-    pTxCharacteristic->notify();
-    Serial.print("BLE notify sent: ");
-    Serial.println(btMsg);
-    delay(10); // short breathing room for BLE stack
-  }
-
-  // 3) SMS fallback (if enabled)
-  if (ENABLE_SMS_BROADCAST) {
-    auto admins = adminPhoneList();
-    if (admins.size() == 0) {
-      String single = sysConfig.adminPhones;
-      if (single.length()) {
-        if (sendSMS(single, out)) Serial.println("SMS sent to fallback admin string");
-        else Serial.println("SMS failed to fallback admin string");
-      }
-    } else {
-      for (auto &num : admins) {
-        String n = normalizePhone(num);
-        Serial.println(String("Sending SMS to ") + n + ": " + out);
-        if (modemReadyForSMS()) {
-          if (sendSMS(n, out)) Serial.println("SMS OK to " + n);
-          else Serial.println("SMS FAILED to " + n);
-        } else {
-          Serial.println("Modem not ready for SMS (skipping): " + n);
-        }
-        delay(500);
-      }
+// Any task. The outbox belongs to the modem task (to setup() before the tasks run);
+// everyone else hands the text over through statusQ.
+void statusPost(const char *msg) {
+  uint8_t live = OB_CH_MQTT;
+  if (deviceConnected && pTxCharacteristic != nullptr) live |= OB_CH_BLE;
+  if (ENABLE_SMS_BROADCAST) live |= OB_CH_SMS;
+  outbox.post(msg, millis(), live);
+}
+bool modemPost(uint8_t kind, const char *text) {
+  ModemMsg m; m.kind = kind; snprintf(m.text, sizeof(m.text), "%s", text);
+  if (xQueueSend(statusQ, &m, pdMS_TO_TICKS(STATUS_Q_WAIT_MS)) == pdTRUE) return true;
+  statusQDrops++; return false;
+}
+bool onModemTask() { return !outboxOwner || xTaskGetCurrentTaskHandle() == outboxOwner; }
+void publishStatusMsg(const char *msg) {
+  Serial.printf("PublishStatus: %s\n", msg);
+  if (onModemTask()) statusPost(msg);
+  else modemPost(MQ_STATUS, msg);
+}
+void publishStatusMsg(const String &msg) { publishStatusMsg(msg.c_str()); }
+// Formatted into a stack buffer (clipped to OB_MSG_MAX like the outbox) -- no String on the hot paths
+void publishStatusf(const char *fmt, ...) {
+  char b[OB_MSG_MAX]; va_list ap;
+  va_start(ap, fmt); vsnprintf(b, sizeof(b), fmt, ap); va_end(ap);
+  publishStatusMsg(b);
+}
+
+// ---------- Outbox workers (modem task, every pass) ----------
+// MQTT: one publish per pass while the AT queue has room. BLE: one notify per pass.
+// SMS: alarms go out at once, everything else as a digest every smsDigestMs.
+// ---------- Store-and-forward (MQTT outages) ----------
+// While the broker link is down -- or a backlog is still replaying, to keep order --
+// MQTT-bound events go to the LittleFS event log instead of the outbox queue. Once
+// QMTCONN succeeds the worker replays the log in batches before live traffic resumes.
+// Every status publish carries |SEQ=<n> so the backend can drop duplicates (replay
+// after a reboot may resend part of the oldest segment).
+EventLog<fs::LittleFSFS> evlog;
+const uint32_t EV_SEQ_LEASE = 256;          // seq allocated in leases to spare NVS
+const uint8_t EVLOG_REPLAY_BATCH = 4;        // publishes in flight while replaying
+uint8_t mqttPubFailures = 0;
+
+void evlogInit() {
+  evSeqAlloc.begin(prefs, "ev_seq_lease", EV_SEQ_LEASE);   // skips whatever the last lease may have used
+  evlog.begin(LittleFS);
+  Serial.printf("Event log: %u segments pending, seq from %lu\n", evlog.segmentsUsed(), (unsigned long)evSeqAlloc.last + 1);
+}
+uint32_t evNextSeq() { return evSeqAlloc.take(); }
+
+struct StatusPub { bool used; bool replay; uint32_t token; uint32_t seq; char text[OB_MSG_MAX + 16]; };
+StatusPub statusPubs[AT_QUEUE_LEN];
+
+void onStatusPublishDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  StatusPub &p = statusPubs[(int)(intptr_t)ctx];
+  // +QMTPUB: <client>,<msgID>,<result> -- result 0 = delivered
+  WireSpan l;
+  bool ok = res == AT_OK && atFindLine(resp, len, "+QMTPUB:", l) && l.contains(",0,0");
+  if (ok) { mqttPubFailures = 0; if (p.replay) evlog.commit(p.token); }
+  else {
+    Serial.printf("MQTT publish failed (%s), SEQ=%lu kept in event log\n", atResultName(res), (unsigned long)p.seq);
+    if (p.replay) evlog.rewind(); else evlog.append(p.text, p.seq, millis());
+    if (++mqttPubFailures >= 3 && mqttAvailable) { mqttPubFailures = 0; Serial.println("MQTT publishes failing, reconnecting"); modemConfigureAndConnectMQTT(); }
+  }
+  p.used = false;
+}
+
+bool publishStatusSeq(const char *text, uint32_t seq, bool replay, uint32_t token) {
+  int slot = -1; for (int i = 0; i < AT_QUEUE_LEN; ++i) if (!statusPubs[i].used) { slot = i; break; }
+  if (slot < 0) return false;
+  StatusPub &p = statusPubs[slot];
+  p.replay = replay; p.token = token; p.seq = seq; snprintf(p.text, sizeof(p.text), "%s", text);
+  String cmd = String("AT+QMTPUB=0,0,0,1,\"") + MQTT_TOPIC_STATUS + String("\",\"");
+  String body = String(text) + "|SEQ=" + String(seq); body.replace("\"","\\\"");
+  cmd += body + String("\"");
+  p.used = atEngine.submit(cmd.c_str(), 15000, onStatusPublishDone, (void *)(intptr_t)slot, "+QMTPUB:");
+  return p.used;
+}
+
+void outboxMqttWorker() {
+  OutboxQueue &q = outbox.q[OB_MQTT];
+  char text[OB_MSG_MAX + 16];
+  if (!mqttAvailable || !evlog.idle()) {
+    while (q.count) { int i = q.peekBest(); outboxFormat(q.slots[i], text, sizeof(text)); evlog.append(text, evNextSeq(), millis()); q.remove(i); }
+  }
+  if (!mqttAvailable) return;
+  if (!evlog.idle()) {
+    // replay in order, a few publishes in flight at a time
+    uint8_t inFlight = 0; for (auto &p : statusPubs) if (p.used && p.replay) inFlight++;
+    while (inFlight < EVLOG_REPLAY_BATCH && atEngine.pending() < AT_QUEUE_LEN / 2) {
+      uint32_t seq, token;
+      if (!evlog.next(text, sizeof(text), seq, token)) break;
+      if (!publishStatusSeq(text, seq, true, token)) { evlog.rewind(); break; }
+      inFlight++;
     }
+    return;
   }
+  if (!q.count || atEngine.pending() >= AT_QUEUE_LEN / 2) return;
+  int i = q.peekBest();
+  outboxFormat(q.slots[i], text, sizeof(text));
+  if (publishStatusSeq(text, evNextSeq(), false, 0)) q.remove(i);
+}
+
+void outboxBleWorker() {
+  OutboxQueue &q = outbox.q[OB_BLE];
+  if (!q.count) return;
+  if (!deviceConnected || pTxCharacteristic == nullptr) { q.clear(); return; }   // client left
+  int i = q.peekBest(); char text[OB_MSG_MAX + 16];
+  // Build a compact BLE notification payload (avoid huge messages)
+  int n = snprintf(text, sizeof(text), "STAT|"); outboxFormat(q.slots[i], text + n, sizeof(text) - n);
+  size_t len = strlen(text); if (len > 200) len = 200;
+  pTxCharacteristic->setValue((uint8_t*)text, len);
+  pTxCharacteristic->notify();
+  Serial.printf("BLE notify sent: %.*s\n", (int)len, text);
+  q.remove(i);
+}
+
+void outboxSmsWorker() {
+  OutboxQueue &q = outbox.q[OB_SMS];
+  if (!q.count) return;
+  bool alarm = q.hasPrio(OB_ALARM);
+  if (!alarm && millis() - lastSmsDigest < smsDigestMs) return;
+  if (!modemReadyForSMS()) return;
+  auto admins = adminPhoneList();
+  if (admins.size() == 0 && modemCfg.adminPhones.length()) admins.push_back(String(modemCfg.adminPhones.c_str()));
+  if (admins.size() == 0) { q.clear(); return; }
+  if (atEngine.pending() + admins.size() > AT_QUEUE_LEN) return;          // retry next pass
+  char digest[161];
+  int cnt = outbox.buildDigest(digest, sizeof(digest));
+  lastSmsDigest = millis();
+  Serial.printf("SMS digest (%d events, %u admins)\n", cnt, (unsigned)admins.size());
+  for (auto &num : admins) {
+    String n = normalizePhone(num);
+    if (!sendSMS(n, String(digest))) Serial.println("SMS FAILED to " + n);
+  }
+}
+
+void outboxPump() { outboxMqttWorker(); outboxBleWorker(); outboxSmsWorker(); evlog.tick(millis()); }
+
+String outboxStatsText() { char buf[200]; outbox.statsText(buf, sizeof(buf)); return String(buf); }
+String evlogStatsText() { char buf[220]; evlog.statsText(buf, sizeof(buf)); return String(buf); }
+
+// Route spec "<prefix>:<A|S|D>:<channels>" with '/' standing in for '|' in the prefix,
+// e.g. "EVT/INQ/:D:MB" or "ERR/:A:MBS". Channels: M=MQTT B=BLE S=SMS, "-" = none.
+bool outboxApplyRouteSpec(const String &spec) {
+  int c1 = spec.indexOf(':'), c2 = spec.lastIndexOf(':');
+  if (c1 < 0 || c2 != c1 + 2) return false;
+  String prefix = spec.substring(0, c1); prefix.replace('/', '|');
+  uint8_t prio; if (!outboxParsePrio(spec.charAt(c1 + 1), prio)) return false;
+  return outbox.setRoute(prefix.c_str(), prio, outboxParseChans(spec.substring(c2 + 1).c_str()));
+}
+void outboxLoadRoutes() {
+  outbox.defaultRoutes();
+  String all = prefs.getString("ob_routes", ""); int p = 0;
+  while (p < (int)all.length()) {
+    int e = all.indexOf(';', p); if (e < 0) e = all.length();
+    String spec = all.substring(p, e); spec.trim();
+    if (spec.length() && !outboxApplyRouteSpec(spec)) Serial.println("Bad outbox route: " + spec);
+    p = e + 1;
+  }
+  smsDigestMs = prefs.getULong("sms_digest_ms", SMS_DIGEST_DEFAULT_MS);
+}
+// OUTBOX_ROUTE on the modem task: DEFAULT, or a spec applied and added to the persisted list
+void outboxRouteCmd(const String &val) {
+  // persisted as a ';' list and re-applied on boot on top of the defaults
+  if (val == "DEFAULT") { prefs.putString("ob_routes", ""); outboxLoadRoutes(); }
+  else if (outboxApplyRouteSpec(val)) { String all = prefs.getString("ob_routes", ""); prefs.putString("ob_routes", all.length() ? all + ";" + val : val); }
+  else publishStatusMsg("ERR|OUTBOX_ROUTE|BAD_SPEC");
 }
 
 void broadcastStatus(const String &msg) { publishStatusMsg(msg); }
@@ -1029,15 +1694,18 @@ bool processSystemConfigJson(const String &payload) {
   return true;
 }
 
-bool processSystemConfigSms(const String &smsBody, const String &fromNumber) {
+// Keys that change who may send commands (authMayChangeKeys)
+static bool cfgSecurityKey(const String &key) {
+  return key == "AP" || key == "ADMIN_PHONES" || key == "TOK" || key == "TOK_LORA" || key == "TOK_BT" || key == "TOK_MQ" ||
+         key == "RECOV" || key == "AUTH_SIG";
+}
+
+// auth: what verifyTokenForSrc found -- an admin SMS, the recovery token, a source token
+// or a valid signature may all configure; a source token only the operational keys
+bool processSystemConfigSms(const String &smsBody, const String &fromNumber, AuthResult auth) {
   String sender = normalizePhone(fromNumber);
-  bool allowed = isAdminNumber(sender);
-  String rec = extractKeyVal(smsBody, "RECOV");
-  if (!allowed && rec.length() && rec == sysConfig.recoveryTok) {
-    allowed = true;
-    Serial.println("Recovery token used by " + sender);
-  }
-  if (!allowed) { Serial.printf("Unauthorized config SMS from %s ignored\n", sender.c_str()); return false; }
+  if (!authOk(auth)) { Serial.printf("Unauthorized config from %s ignored (%s)\n", sender.length() ? sender.c_str() : "-", authResultName(auth)); return false; }
+  if (auth == AUTH_OK_RECOV) Serial.println("Recovery token used by " + sender);
   String body = smsBody; if (body.startsWith("S|")) body = body.substring(2); body.trim();
   int pos = 0;
   while (pos < (int)body.length()) {
@@ -1045,7 +1713,11 @@ bool processSystemConfigSms(const String &smsBody, const String &fromNumber) {
     String pair = (comma == -1)? body.substring(pos) : body.substring(pos, comma);
     int eq = pair.indexOf('='); if (eq > 0) {
       String key = pair.substring(0, eq); key.trim(); String val = pair.substring(eq+1); val.trim();
-      if (key == "MS") sysConfig.mqttServer = val;
+      if (cfgSecurityKey(key) && !authMayChangeKeys(auth)) {
+        Serial.printf("Config key %s refused (%s)\n", key.c_str(), authResultName(auth));
+        publishStatusIfAvailable(String("ERR|CFG|DENIED|K=") + key);
+      }
+      else if (key == "MS") sysConfig.mqttServer = val;
       else if (key == "MP") sysConfig.mqttPort = val.toInt();
       else if (key == "MU") sysConfig.mqttUser = val;
       else if (key == "MW") sysConfig.mqttPass = val;
@@ -1066,6 +1738,39 @@ bool processSystemConfigSms(const String &smsBody, const String &fromNumber) {
       else if (key == "TOK_LORA") prefs.putString("tok_lora", val);
       else if (key == "TOK_BT") prefs.putString("tok_bt", val);
       else if (key == "TOK_MQ") prefs.putString("tok_mq", val);
+      else if (key == "PUMP_CAP") { long c = val.toInt(); if (c >= 1 && c <= 255) { pumpCapacity = (uint16_t)c; prefs.putUInt("pump_cap", pumpCapacity); } else publishStatusIfAvailable("ERR|PUMP_CAP|RANGE"); }
+      else if (key == "FLOW") {
+        // per-node flow weights "<node>:<w>;<node>:<w>", merged into the table; DEFAULT clears it
+        if (val == "DEFAULT") { nodeFlow.n = 0; prefs.putString("flow_w", ""); }
+        else if (nodeFlow.parse(wireSpan(val.c_str(), val.length()))) { char b[ZR_FLOW_MAX * 10]; nodeFlow.text(b, sizeof(b)); prefs.putString("flow_w", b); }
+        else publishStatusIfAvailable("ERR|FLOW|BAD_SPEC");
+      }
+      else if (key == "PLAN_MODE") { planMode = val.toInt() != 0; prefs.putBool("plan_mode", planMode); }
+      else if (key == "LORA_BIN") { loraBinaryEnabled = val.toInt() != 0; prefs.putBool("lora_bin", loraBinaryEnabled); }
+      else if (key == "PERF_STATS") { publishStatusIfAvailable(String("STATUS|PERF|") + perfStatsText()); if (val == "RESET") perf.reset(millis()); }
+      else if (key == "TASK_STATS") taskStatsPublish(val == "RESET");
+      else if (key == "HEAP_STATS") publishStatusIfAvailable(String("STATUS|HEAP|") + heapStatsText());
+      else if (key == "STATE_SNAP") stateSnapReport();
+      else if (key == "TIME_STATS") publishStatusIfAvailable(String("STATUS|TIME|") + timeStatsText());
+      else if (key == "AUTH_SIG") prefs.putString("auth_sig", val == "-" ? "" : val.c_str());   // L/B/M/U: plain tokens refused; applied by saveSystemConfig below
+      else if (key == "AUTH_STATS") {
+        if (val == "BENCH") { if (onModemTask()) authBench(); else modemPost(MQ_AUTH_BENCH, ""); }   // off the ctrl task
+        else publishStatusIfAvailable(String("STATUS|AUTH|") + authStatsText());
+        if (val == "RESET") authCtx.stats.reset();
+      }
+      else if (key == "TIME_SYNC") timeSyncRequest();
+      else if (key == "NVS_STATS") publishStatusIfAvailable(String("STATUS|NVS|") + nvsStatsText());
+      else if (key == "NODE_SWEEP") nodeSweep(val);
+      else if (key == "NODE_POWER") nodePowerSet(val);
+      else if (key == "NODE_CAL") nodeCalibrate(val);
+      else if (key == "TELE_STATS") publishStatusIfAvailable(String("STATUS|TELE|") + teleStatsText());
+      else if (key == "TS_STATS") publishStatusIfAvailable(String("STATUS|TS|") + teleSeriesStatsText());
+      else if (key == "TS_QUERY") teleSeriesQuery(val);
+      else if (key == "RADIO_STATS") publishStatusIfAvailable(String("STATUS|RADIO|") + radioStatsText());
+      else if (key == "EVLOG_STATS") publishStatusIfAvailable(String("STATUS|EVLOG|") + evlogStatsText());
+      else if (key == "OUTBOX_STATS") publishStatusIfAvailable(String("STATUS|OUTBOX|") + outboxStatsText());
+      else if (key == "SMS_DIGEST_S") { smsDigestMs = (uint32_t)(val.toInt() * 1000UL); prefs.putULong("sms_digest_ms", smsDigestMs); }
+      else if (key == "OUTBOX_ROUTE") { if (onModemTask()) outboxRouteCmd(val); else modemPost(MQ_ROUTE, val.c_str()); }
             else if (key == "MODE") {
         String v = val; v.trim(); v.toUpperCase();
         if (v == "MAN" || v == "MANUAL") enterManualMode();
@@ -1094,8 +1799,9 @@ bool processSystemConfigSms(const String &smsBody, const String &fromNumber) {
             int node = param.substring(0,p1).toInt();
             int valve = param.substring(p1+1, p2).toInt();
             String action = param.substring(p2+1);
-            if (action == "OPEN") { sendCmdWithAck("OPEN", node, currentScheduleId, valve, 0); publishStatusIfAvailable("ACK|MANUAL|VALVE|OPEN"); }
-            else { sendCmdWithAck("CLOSE", node, currentScheduleId, valve, 0); publishStatusIfAvailable("ACK|MANUAL|VALVE|CLOSE"); }
+            // ACK/ERR is published from onManualValveDone once the node answers
+            const char *type = (action == "OPEN") ? "OPEN" : "CLOSE";
+            if (loraTxnStart(type, node, currentScheduleId.c_str(), valve, 0, onManualValveDone, TXN_OWNER_MANUAL, 0) < 0) publishStatusIfAvailable("ERR|MANUAL|VALVE|BUSY");
           } else publishStatusIfAvailable("ERR|MANUAL|VALVE|BAD_FORMAT");
         } else if (cmd == "STATUS") {
           publishStatusIfAvailable(String("STATUS|MODE|") + (manualMode ? "MANUAL" : "SCHEDULE") + String("|RUNNING|") + (scheduleRunning ? "1":"0"));
@@ -1119,45 +1825,66 @@ bool processSystemConfigSms(const String &smsBody, const String &fromNumber) {
 }
 
 // ---------- Compact parser & JSON schedule handling ----------
+// weekday bit (Sun=0) for MON..SUN, case-insensitive; -1 if unknown
+int weekdayBit(WireSpan d) {
+  static const char *names[7] = {"SUN","MON","TUE","WED","THU","FRI","SAT"};
+  d = d.trim(); if (d.n != 3) return -1;
+  for (int w = 0; w < 7; ++w) {
+    bool m = true;
+    for (int i = 0; i < 3 && m; ++i) m = toupper((unsigned char)d.p[i]) == names[w][i];
+    if (m) return w;
+  }
+  return -1;
+}
+
 Schedule parseCompactSchedule(const String &payload) {
   Schedule s; s.id=""; s.rec='O'; s.start_epoch=0; s.timeStr=""; s.weekday_mask=0; s.seq.clear();
   s.pump_on_before_ms = PUMP_ON_LEAD_DEFAULT_MS; s.pump_off_after_ms = PUMP_OFF_DELAY_DEFAULT_MS; s.enabled=true; s.next_run_epoch=0; s.ts = 0;
-  int p = payload.indexOf("SCH|"); String body = (p>=0)? payload.substring(p+4): payload; body.trim();
-  int pos=0;
-  while (pos < (int)body.length()) {
-    int comma = body.indexOf(',', pos);
-    String token = (comma==-1) ? body.substring(pos) : body.substring(pos, comma);
-    token.trim();
-    int eq = token.indexOf('=');
-    if (eq>0) {
-      String k = token.substring(0, eq); String v = token.substring(eq+1);
-      k.trim(); v.trim();
-      if (k == "ID") s.id = v;
-      else if (k == "REC") s.rec = v.length()? v.charAt(0) : 'O';
-      else if (k == "T") s.timeStr = v;
-      else if (k == "SEQ") {
-        String seqs = v; int spos=0;
-        while (spos < (int)seqs.length()) {
-          int semi = seqs.indexOf(';', spos);
-          String pair = (semi==-1) ? seqs.substring(spos) : seqs.substring(spos, semi);
+  WireSpan body = wireSpan(payload.c_str(), payload.length());
+  int p = payload.indexOf("SCH|"); if (p >= 0) body = body.sub(p + 4);
+  char tmp[64];
+  bool inWd = false;
+  WireKvIter it(body); WireSpan k, v;
+  while (it.next(k, v)) {
+    if (k.empty()) { // bare token: continuation of a WD=MON,TUE,... list
+      int b = inWd ? weekdayBit(v) : -1; if (b >= 0) s.weekday_mask |= (1<<b);
+      continue;
+    }
+    inWd = false;
+    if (k.eq("ID")) { v.copyTo(tmp, sizeof(tmp)); s.id = tmp; }
+    else if (k.eq("REC")) s.rec = v.n ? v.p[0] : 'O';
+    else if (k.eq("T")) { v.copyTo(tmp, sizeof(tmp)); s.timeStr = tmp; }
+    else if (k.eq("SEQ")) {
+      // ';' separates groups run one after another, '+' joins steps that run together: 1:60;2:60+3:60
+      // A moisture-feedback step adds @<target %>[/<min s>], the time becoming its cap: 4:600@35/120
+      WireSpan rest = v;
+      while (rest.n) {
+        int semi = rest.indexOf(';');
+        WireSpan grp = semi < 0 ? rest : rest.sub(0, semi);
+        bool first = true;
+        while (grp.n) {
+          int plus = grp.indexOf('+');
+          WireSpan pair = plus < 0 ? grp : grp.sub(0, plus);
           int colon = pair.indexOf(':');
-          if (colon>0) { SeqStep st; st.node_id = pair.substring(0, colon).toInt(); st.duration_ms = (uint32_t)pair.substring(colon+1).toInt() * 1000UL; s.seq.push_back(st); }
-          if (semi==-1) break; spos = semi+1;
-        }
-      } else if (k == "WD") {
-        String tmp = v; tmp.toUpperCase(); int sp=0;
-        while (sp < (int)tmp.length()) {
-          int cm = tmp.indexOf(',', sp);
-          String d = (cm==-1)? tmp.substring(sp) : tmp.substring(sp, cm); d.trim();
-          if (d=="MON") s.weekday_mask |= (1<<1); else if (d=="TUE") s.weekday_mask|=(1<<2); else if (d=="WED") s.weekday_mask|=(1<<3);
-          else if (d=="THU") s.weekday_mask|=(1<<4); else if (d=="FRI") s.weekday_mask|=(1<<5); else if (d=="SAT") s.weekday_mask|=(1<<6); else if (d=="SUN") s.weekday_mask|=(1<<0);
-          if (cm==-1) break; sp = cm+1;
+          if (colon > 0) {
+            SeqStep st; st.node_id = (int)pair.sub(0, colon).toLong(); st.duration_ms = (uint32_t)pair.sub(colon+1).toLong() * 1000UL; st.par = !first;
+            int at = pair.indexOf('@');
+            if (at > colon) {
+              WireSpan fb = pair.sub(at + 1); int slash = fb.indexOf('/'); long tg = fb.toLong(0);
+              st.target = (uint8_t)(tg < 0 ? 0 : tg > 100 ? 100 : tg);
+              if (slash > 0) st.min_ms = fb.sub(slash + 1).toU32() * 1000UL;
+            }
+            s.seq.push_back(st); first = false;
+          }
+          if (plus < 0) break; grp = grp.sub(plus + 1);
         }
-      } else if (k == "PB") s.pump_on_before_ms = (uint32_t)v.toInt();
-      else if (k == "PA") s.pump_off_after_ms = (uint32_t)v.toInt();
-      else if (k == "TS") s.ts = (uint32_t)v.toInt();
-    }
-    if (comma==-1) break; pos = comma+1;
+        if (semi < 0) break; rest = rest.sub(semi + 1);
+      }
+    } else if (k.eq("WD")) {
+      inWd = true; int b = weekdayBit(v); if (b >= 0) s.weekday_mask |= (1<<b);
+    } else if (k.eq("PB")) s.pump_on_before_ms = v.toU32();
+    else if (k.eq("PA")) s.pump_off_after_ms = v.toU32();
+    else if (k.eq("TS")) s.ts = v.toU32();
   }
   if (s.rec == 'O' && s.timeStr.length()) {
     int year=0,mon=0,mday=0,hour=0,min=0,sec=0;
@@ -1170,17 +1897,17 @@ Schedule parseCompactSchedule(const String &payload) {
   return s;
 }
 
-bool validateAndLoadScheduleFromJson(const String &json) {
+bool validateAndLoadScheduleFromJson(const String &json, const String &src) {
   StaticJsonDocument<4096> scheduleDoc; scheduleDoc.clear();
   DeserializationError err = deserializeJson(scheduleDoc, json);
   if (err) { Serial.printf("JSON parse error: %s\n", err.c_str()); return false; }
   if (!scheduleDoc.containsKey("schedule_id") || !scheduleDoc.containsKey("sequence")) { Serial.println("JSON missing keys"); return false; }
-  Schedule s; s.seq.clear();
-  s.id = String((const char*)scheduleDoc["schedule_id"].as<const char*>());
+  Schedule s; s.seq.clear(); s.weekday_mask = 0; s.enabled = true; s.next_run_epoch = 0;
+  s.id = scheduleDoc["schedule_id"].as<const char*>();
   String recurrence = String((const char*)(scheduleDoc["recurrence"] | ""));
   if (recurrence.length()) { if (recurrence.startsWith("d")||recurrence.startsWith("D")) s.rec='D'; else if (recurrence.startsWith("w")||recurrence.startsWith("W")) s.rec='W'; else s.rec='O'; }
   else s.rec='O';
-  s.timeStr = scheduleDoc.containsKey("start_time") ? String((const char*)scheduleDoc["start_time"].as<const char*>()) : "";
+  s.timeStr = scheduleDoc.containsKey("start_time") ? scheduleDoc["start_time"].as<const char*>() : "";
   s.start_epoch = scheduleDoc.containsKey("start_epoch") ? (time_t)(scheduleDoc["start_epoch"].as<long long>()) : 0;
   s.pump_on_before_ms = scheduleDoc.containsKey("pump_on_before_ms") ? scheduleDoc["pump_on_before_ms"].as<uint32_t>() : PUMP_ON_LEAD_DEFAULT_MS;
   s.pump_off_after_ms = scheduleDoc.containsKey("pump_off_after_ms") ? scheduleDoc["pump_off_after_ms"].as<uint32_t>() : PUMP_OFF_DELAY_DEFAULT_MS;
@@ -1193,32 +1920,36 @@ bool validateAndLoadScheduleFromJson(const String &json) {
       else if (d=="THU") s.weekday_mask |= (1<<4); else if (d=="FRI") s.weekday_mask |= (1<<5); else if (d=="SAT") s.weekday_mask |= (1<<6); else if (d=="SUN") s.weekday_mask |= (1<<0);
     }
   }
-  JsonArray arr = scheduleDoc["sequence"].as<JsonArray>();
-  for (JsonVariant v : arr) {
+  // an element that is itself an array is a group of steps that run together
+  auto addStep = [&s](JsonVariant v, bool par) {
     SeqStep st; st.node_id = v["node_id"].as<int>(); if (v["duration_ms"]) st.duration_ms = v["duration_ms"].as<uint32_t>(); else if (v["duration_s"]) st.duration_ms = v["duration_s"].as<uint32_t>()*1000; else st.duration_ms = 0;
-    s.seq.push_back(st);
+    st.target = (uint8_t)constrain(v["target_moisture"] | 0, 0, 100);   // feedback step: duration is the cap
+    if (v["min_duration_ms"]) st.min_ms = v["min_duration_ms"].as<uint32_t>(); else if (v["min_duration_s"]) st.min_ms = v["min_duration_s"].as<uint32_t>()*1000;
+    st.par = par; s.seq.push_back(st);
+  };
+  JsonArray arr = scheduleDoc["sequence"].as<JsonArray>();
+  for (JsonVariant g : arr) {
+    if (!g.is<JsonArray>()) { addStep(g, false); continue; }
+    bool first = true;
+    for (JsonVariant v : g.as<JsonArray>()) { addStep(v, !first); first = false; }
   }
-  if (!saveScheduleFile(s)) Serial.println("Warning: failed saving JSON schedule");
-  bool found=false; for (size_t i=0;i<schedules.size();++i) if (schedules[i].id == s.id) { schedules[i]=s; found=true; break; }
-  if (!found) schedules.push_back(s);
+  if (!ingestSchedule(s, src)) return true;     // stale / over capacity: already answered
   if (!scheduleLoaded) { seq.clear(); for (auto &st: s.seq) seq.push_back(st); currentScheduleId = s.id; pumpOnBeforeMs = s.pump_on_before_ms; pumpOffAfterMs = s.pump_off_after_ms; scheduleLoaded=true; currentStepIndex=-1; scheduleStartEpoch = s.start_epoch; }
   return true;
 }
 
-bool saveCompactScheduleToMultipleFilesAndLoad(const String &compact) {
+bool saveCompactScheduleToMultipleFilesAndLoad(const String &compact, const String &src) {
   Schedule s = parseCompactSchedule(compact);
   if (s.id.length() == 0) { Serial.println("Missing ID"); return false; }
-  if (!saveScheduleFile(s)) Serial.println("Warning: failed saving schedule file");
-  bool found=false; for (size_t i=0;i<schedules.size();++i) if (schedules[i].id == s.id) { schedules[i] = s; found=true; break; }
-  if (!found) schedules.push_back(s);
+  if (!ingestSchedule(s, src)) return true;     // stale / over capacity: already answered
   if (!scheduleLoaded) { seq.clear(); for (auto &st: s.seq) seq.push_back(st); currentScheduleId = s.id; pumpOnBeforeMs = s.pump_on_before_ms; pumpOffAfterMs = s.pump_off_after_ms; scheduleLoaded=true; currentStepIndex=-1; scheduleStartEpoch = s.start_epoch; }
   Serial.printf("Compact schedule saved id=%s seq=%d\n", s.id.c_str(), (int)s.seq.size());
   return true;
 }
 
 // ---------- Scheduler helpers ----------
-bool parseTimeHHMM(const String &t, int &hour, int &minute) {
-  hour = 0; minute = 0; int res = sscanf(t.c_str(), "%d:%d", &hour, &minute); return res==2;
+bool parseTimeHHMM(const char *t, int &hour, int &minute) {
+  hour = 0; minute = 0; int res = sscanf(t, "%d:%d", &hour, &minute); return res==2;
 }
 time_t nextWeekdayOccurrence(time_t now, uint8_t weekday_mask, int hour, int minute) {
   struct tm tmnow; localtime_r(&now,&tmnow); int today = tmnow.tm_wday;
@@ -1248,13 +1979,301 @@ time_t computeNextRunEpoch(const Schedule &s, time_t now) {
   return 0;
 }
 
+// ---------- Time service ----------
+// Nothing here blocks. The modem task runs the sync as a state machine -- AT+QNTP
+// through the AT engine, SNTP over WiFi when the modem has no answer -- and hands the
+// offsets to TimeDiscipline (include/time_service.h): small corrections are slewed,
+// large ones stepped. Every TS_RTC_CHECK_MS the DS3231 is read as well: its
+// drift-corrected time is used once the network has been away long enough for it to
+// be the better source, and a disagreement beyond DRIFT_THRESHOLD_S brings the next
+// network sync forward. The scheduler reads schedNow() and the timeSet / timeTrusted
+// flags, never the sources.
+const uint32_t TS_RETRY_MS = 5UL * 60UL * 1000UL;        // after a failed sync
+const uint32_t TS_RTC_CHECK_MS = 10UL * 60UL * 1000UL;
+const uint32_t TS_MODEM_ERR_MS = 1500;                   // QNTP: whole seconds plus URC latency
+const uint32_t TS_SNTP_RESEND_MS = 2000;
+const uint16_t TS_NTP_LOCAL_PORT = 4123;
+enum TimeSyncState : uint8_t { TSY_IDLE, TSY_MODEM, TSY_WIFI, TSY_SNTP };
+TimeDiscipline timeDisc;                  // modem task (setup() before the tasks run)
+MonoEpoch schedMono;                      // ctrl task
+volatile bool timeSet = false, timeTrusted = false;   // published for the ctrl task
+volatile bool timeSyncRequested = false;
+uint8_t tsState = TSY_IDLE;
+uint32_t tsNextSyncMs = 0, tsPhaseMs = 0, tsSentMs = 0;
+bool tsFailing = false;
+WiFiUDP tsUdp;
+uint8_t tsReq[48];
+
+// Scheduler clock (ctrl task): epoch seconds that never go backwards
+time_t schedNow() { return (time_t)(schedMono.now(epochNowMs()) / 1000); }
+
+int8_t rtcAgingRead() {
+  WireRTC.beginTransmission(0x68); WireRTC.write(0x10);
+  if (WireRTC.endTransmission() != 0 || WireRTC.requestFrom(0x68, 1) != 1) return 0;
+  return (int8_t)WireRTC.read();
+}
+void rtcAgingWrite(int8_t v) { WireRTC.beginTransmission(0x68); WireRTC.write(0x10); WireRTC.write((uint8_t)v); WireRTC.endTransmission(); }
+// RTC register time, mid-second (it counts whole ones)
+int64_t rtcReadMs() { return (int64_t)rtc.now().unixtime() * 1000 + 500; }
+
+void timeFlagsUpdate() { timeSet = timeDisc.set(); timeTrusted = timeDisc.trusted(millis()); }
+// Epoch s for checks that must not run on a guessed clock (signed-command window), 0 without one
+uint32_t trustedNowS() { return timeTrusted ? (uint32_t)(epochNowMs() / 1000) : 0; }
+// ref - clock = offsetMs, good to +-errMs
+void timeApply(uint8_t src, int64_t offsetMs, uint32_t errMs) {
+  uint8_t a = timeDisc.sample(src, offsetMs, errMs, millis());
+  if (a == TSA_STEP) {
+    int64_t t = epochNowMs() + offsetMs;
+    struct timeval tv; tv.tv_sec = (time_t)(t / 1000); tv.tv_usec = (suseconds_t)(t % 1000) * 1000;
+    if (settimeofday(&tv, nullptr) != 0) Serial.println("Time: settimeofday failed");
+    publishStatusf("EVT|TIME|STEP|SRC=%s|D_S=%ld", timeSourceName(src), (long)(offsetMs / 1000));
+  } else if (a == TSA_SLEW) {
+    struct timeval d; d.tv_sec = (time_t)(offsetMs / 1000); d.tv_usec = (suseconds_t)(offsetMs % 1000) * 1000;
+    if (adjtime(&d, nullptr) != 0) Serial.println("Time: adjtime failed");
+  }
+  if (a != TSA_KEEP) Serial.printf("Time: %s %ld ms from %s\n", a == TSA_STEP ? "step" : "slew", (long)offsetMs, timeSourceName(src));
+  timeFlagsUpdate();
+}
+
+void rtcStateSave() {
+  prefs.putULong("rtc_set_s", timeDisc.rtcSetS); prefs.putInt("rtc_ppb", timeDisc.rtcPpb); prefs.putBool("rtc_known", timeDisc.rtcRateKnown);
+}
+// Boot: the DS3231 sets the clock until the network answers (not after a power loss)
+void timeInit(bool rtcLost) {
+  if (!rtcAvailable) return;
+  timeDisc.rtcAging = timeDisc.agingWant = rtcAgingRead();
+  if (rtcLost) { timeDisc.rtcSetS = 0; rtcStateSave(); return; }
+  timeDisc.rtcSetS = prefs.getULong("rtc_set_s", 0); timeDisc.rtcPpb = prefs.getInt("rtc_ppb", 0); timeDisc.rtcRateKnown = prefs.getBool("rtc_known", false);
+  int64_t r = timeDisc.rtcCorrect(rtcReadMs());
+  timeApply(TSRC_RTC, r - epochNowMs(), timeDisc.rtcErrMs(r));
+}
+
+// A network time arrived: discipline the clock, then the RTC against the same reference
+void timeNetSample(uint8_t src, int64_t offsetMs, uint32_t errMs) {
+  int64_t ref = epochNowMs() + offsetMs;
+  bool first = !timeDisc.syncs;
+  timeApply(src, offsetMs, errMs);
+  if (first || tsFailing) publishStatusf("EVT|NTP_SYNC|%s_OK", src == TSRC_NTP ? "WIFI" : "MODEM");
+  tsFailing = false; tsState = TSY_IDLE; tsNextSyncMs = millis() + SYNC_CHECK_INTERVAL_MS;
+  prefs.putULong("last_ntp_sync", (unsigned long)(ref / 1000));
+  if (!rtcAvailable || !timeDisc.rtcCheck(rtcReadMs(), ref)) return;
+  bool trim = timeDisc.agingWant != timeDisc.rtcAging;
+  if (trim) rtcAgingWrite(timeDisc.agingWant);
+  rtc.adjust(DateTime((uint32_t)((ref + 500) / 1000)));
+  timeDisc.rtcWritten((uint32_t)(ref / 1000)); rtcStateSave();
+  publishStatusf("EVT|TIME|RTC_SET|PPB=%s%ld|AGING=%d%s", timeDisc.rtcRateKnown ? "" : "?", (long)timeDisc.rtcPpb, timeDisc.rtcAging, trim ? "|TRIMMED" : "");
+}
+void timeSyncFail() {
+  timeDisc.fails++; tsState = TSY_IDLE; tsNextSyncMs = millis() + TS_RETRY_MS;
+  if (!tsFailing) publishStatusMsg("ERR|NTP_SYNC_FAIL");
+  tsFailing = true;
+}
+
+void timeWifiStart() { WiFi.mode(WIFI_STA); WiFi.begin(WIFI_SSID, WIFI_PASS); tsState = TSY_WIFI; tsPhaseMs = millis(); }
+void timeWifiStop() { tsUdp.stop(); WiFi.disconnect(true); WiFi.mode(WIFI_OFF); }
+void timeSntpSend() {
+  sntpRequest(tsReq, epochNowMs());
+  if (tsUdp.beginPacket(ntpServer, 123)) { tsUdp.write(tsReq, sizeof(tsReq)); tsUdp.endPacket(); }
+  tsSentMs = millis();
+}
+
+void onQntpDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+  // +QNTP: <err>,"YYYY/MM/DD,hh:mm:ss+zz" -- err 0 = synced; the time is taken as UTC
+  WireSpan l; uint32_t s; int q = -1;
+  if (res == AT_OK && atFindLine(resp, len, "+QNTP:", l) && l.sub(6).trim().startsWith("0,") && (q = l.indexOf('"')) >= 0 &&
+      tsParseDateTime(l.p + q + 1, l.n - q - 1, s)) {
+    timeNetSample(TSRC_MODEM, (int64_t)s * 1000 - epochNowMs(), TS_MODEM_ERR_MS);
+    return;
+  }
+  Serial.printf("Modem NTP failed (%s), trying WiFi\n", atResultName(res));
+  timeWifiStart();
+}
+void timeSyncStart() {
+  if (AT_QUEUE_LEN - atEngine.pending() >= 3) {
+    String setPdp = String("AT+QICSGP=1,1,\"") + modemCfg.apn.c_str() + String("\",\"\",\"\",1");
+    atEngine.submit(setPdp.c_str(), 4000);
+    atEngine.submit("AT+QIACT=1", 10000);                   // ERROR when already active: harmless
+    if (atEngine.submit((String("AT+QNTP=1,\"") + ntpServer + String("\"")).c_str(), 15000, onQntpDone, nullptr, "+QNTP:")) { tsState = TSY_MODEM; return; }
+  }
+  timeWifiStart();
+}
+
+// DS3231 vs the clock
+void timeRtcPoll() {
+  static uint32_t lastMs = 0;
+  if (!rtcAvailable || (lastMs && millis() - lastMs < TS_RTC_CHECK_MS)) return;
+  lastMs = millis();
+  int64_t r = timeDisc.rtcCorrect(rtcReadMs()), off = r - epochNowMs();
+  if (timeDisc.trusted(millis()) && (off < 0 ? -off : off) > (int64_t)DRIFT_THRESHOLD_S * 1000) {
+    publishStatusf("EVT|TIME|RTC_DRIFT|D_S=%ld", (long)(off / 1000));   // one of them is wrong: ask the network
+    if (tsState == TSY_IDLE) tsNextSyncMs = millis();
+    return;
+  }
+  timeApply(TSRC_RTC, off, timeDisc.rtcErrMs(r));        // kept unless the clock is known worse than the RTC
+}
+
+// modem task, every pass
+void timeSyncPoll() {
+  uint32_t now = millis();
+  switch (tsState) {
+    case TSY_IDLE:
+      if (timeSyncRequested || (int32_t)(now - tsNextSyncMs) >= 0) { timeSyncRequested = false; timeSyncStart(); }
+      break;
+    case TSY_MODEM:                                          // onQntpDone moves on
+      break;
+    case TSY_WIFI:
+      if (WiFi.status() == WL_CONNECTED) { tsUdp.begin(TS_NTP_LOCAL_PORT); timeSntpSend(); tsState = TSY_SNTP; tsPhaseMs = now; }
+      else if (now - tsPhaseMs >= (uint32_t)WIFI_CONNECT_TIMEOUT_MS) { timeWifiStop(); timeSyncFail(); }
+      break;
+    case TSY_SNTP: {
+      int n = tsUdp.parsePacket();
+      if (n > 0) {
+        uint8_t rep[48]; int got = tsUdp.read(rep, sizeof(rep)); int64_t t4 = epochNowMs(), off; uint32_t rtt;
+        tsUdp.flush();
+        if (got == (int)sizeof(rep) && sntpParse(rep, sizeof(rep), tsReq, t4, off, rtt)) { timeWifiStop(); timeNetSample(TSRC_NTP, off, rtt / 2 + 20); break; }
+      }
+      if (now - tsPhaseMs >= (uint32_t)NTP_TIMEOUT_MS) { timeWifiStop(); timeSyncFail(); }
+      else if (now - tsSentMs >= TS_SNTP_RESEND_MS) timeSntpSend();      // datagram lost
+      break;
+    }
+  }
+  timeRtcPoll();
+  timeFlagsUpdate();
+}
+
+void timeSyncRequest() { timeSyncRequested = true; }
+String timeStatsText() {
+  static const char *st[] = { "IDLE", "MODEM", "WIFI", "SNTP" };
+  char b[240]; int n = timeDisc.text(millis(), b, sizeof(b));
+  if (n > 0 && n < (int)sizeof(b)) snprintf(b + n, sizeof(b) - n, ",SYNC=%s,HOLDS=%lu,REBASES=%lu", st[tsState], (unsigned long)schedMono.holds, (unsigned long)schedMono.rebases);
+  return String(b);
+}
+
+// ---------- Schedule timer index ----------
+// schedTimers holds each enabled schedule's next_run_epoch keyed by its slot in
+// `schedules` (slots are stable: schedules are only appended or replaced in place).
+// The loop checks only the head, so a trigger fires in the second it is due.
+// Timers run on schedNow() (time service), which slews small corrections and never
+// goes backwards, so a correction can neither fire a run twice nor skip one. A forward
+// step (first sync after boot, a large correction) re-arms all timers: when the clock
+// was trusted before it -- or the step is small -- each schedule fires once for what
+// the step skipped over, otherwise they recompute from the new time. A backward jump
+// only shows up when MonoEpoch gave up holding (the old time was wrong).
+#define SCHED_JUMP_TOL_S   30      // wall clock vs millis() disagreement treated as a jump
+#define SCHED_CATCHUP_S    600     // from an untrusted clock, forward jumps up to this still catch up
+ClockJumpDetector schedClock;
+
+void schedTimerArm(size_t i, time_t from) {
+  Schedule &s = schedules[i];
+  s.next_run_epoch = computeNextRunEpoch(s, from);
+  if (!schedTimers.set((uint16_t)i, s.next_run_epoch > 0 ? (uint32_t)s.next_run_epoch : 0))
+    Serial.printf("WARN: schedule %s not armed (more than %d schedules)\n", s.id.c_str(), TIMER_HEAP_MAX);
+}
+void schedTimersRebuild(time_t from) {
+  schedTimers.clear();
+  for (size_t i = 0; i < schedules.size(); ++i) schedTimerArm(i, from);
+}
+// Index in `schedules`, -1 when unknown (hash first, then bytes)
+int schedFind(const char *id) {
+  uint32_t h = fixedHash(id);
+  for (size_t i = 0; i < schedules.size(); ++i) if (schedules[i].idHash == h && schedules[i].id == id) return (int)i;
+  return -1;
+}
+// Adds or replaces a schedule and re-arms its timer; a persisted sequence is not kept in RAM
+void schedUpsert(const Schedule &s, bool persisted) {
+  int f = schedFind(s.id); size_t i = f < 0 ? schedules.size() : (size_t)f;
+  if (i == schedules.size()) schedules.push_back(s); else schedules[i] = s;
+  schedules[i].idHash = fixedHash(s.id);
+  if (persisted) std::vector<SeqStep>().swap(schedules[i].seq);
+  schedTimerArm(i, schedNow());
+}
+
+// ---------- Schedule versions & patches ----------
+// A schedule's version is a content hash (include/sched_patch.h). Full updates carrying
+// an older TS than the stored one are rejected, identical ones only store the newer TS
+// (record-only, the steps stay as they are), and SCHP| patches edit steps against a
+// named base version.
+String schedVersionHex(uint16_t v) { char b[8]; snprintf(b, sizeof(b), "%04x", v); return String(b); }
+
+// Publishes the outcome itself; false only when nothing was accepted (stale, over pump capacity)
+bool ingestSchedule(Schedule &s, const String &src) {
+  int g = scheduleCapacityGroup(s.seq);
+  if (g >= 0) { publishStatusMsg(String("ERR|SCH|CAPACITY|S=") + s.id + "|G=" + String(g) + "|CAP=" + String(pumpCapacity)); return false; }
+  int i = schedFind(s.id);
+  if (i >= 0) {
+    Schedule &cur = schedules[i];
+    if (s.ts && cur.ts && s.ts < cur.ts) {
+      publishStatusMsg(String("ERR|SCH|STALE|S=") + s.id + "|TS=" + String(cur.ts) + "|V=" + schedVersionHex(scheduleVersion(cur)));
+      return false;
+    }
+    uint16_t v = scheduleVersion(s);
+    if (v == scheduleVersion(cur)) {
+      // newer stamp, same content: only the record is rewritten, so a reboot still rejects older ones
+      if (s.ts > cur.ts && !saveScheduleTs(cur, s.ts)) { publishStatusMsg(String("ERR|SCH|SAVE|S=") + s.id); return false; }
+      publishStatusMsg(String("EVT|SCH|UNCHANGED|S=") + s.id + "|V=" + schedVersionHex(v));
+      return true;
+    }
+  }
+  uint16_t v = scheduleVersion(s);
+  bool saved = saveScheduleRecord(s);
+  if (!saved) Serial.println("Warning: failed saving schedule to DB");
+  schedUpsert(s, saved);
+  broadcastStatus(String("EVT|SCH|SAVED|S=") + s.id + "|V=" + schedVersionHex(v) + "|SRC=" + src);
+  return true;
+}
+
+// SCHP|ID=<id>,BASE=<ver>,TS=<n>,OPS=<ops>[,T=HH:MM][,PB=ms][,PA=ms]
+void applySchedulePatch(const String &payload, const String &src) {
+  WireSpan body = wireSpan(payload.c_str(), payload.length());
+  int p = payload.indexOf("SCHP|"); if (p >= 0) body = body.sub(p + 5);
+  char id[SDB_ID_MAX] = ""; char tmp[16]; WireSpan ops = wireSpan(""), base = wireSpan(""), t = wireSpan("");
+  uint32_t ts = 0; long pb = -1, pa = -1;
+  WireKvIter it(body); WireSpan k, v;
+  while (it.next(k, v)) {
+    if (k.eq("ID")) v.copyTo(id, sizeof(id));
+    else if (k.eq("BASE")) base = v;
+    else if (k.eq("TS")) ts = v.toU32();
+    else if (k.eq("OPS")) ops = v;
+    else if (k.eq("T")) t = v;
+    else if (k.eq("PB")) pb = v.toLong(-1);
+    else if (k.eq("PA")) pa = v.toLong(-1);
+  }
+  int i = schedFind(id);
+  if (i < 0) { publishStatusMsg(String("ERR|SCHP|UNKNOWN|S=") + id); return; }
+  Schedule cur = schedules[i];
+  uint16_t v0 = scheduleVersion(cur);
+  String tag = String("|S=") + id + "|V=" + schedVersionHex(v0);
+  if (ts && cur.ts && ts <= cur.ts) { publishStatusMsg(String("ERR|SCHP|STALE") + tag + "|TS=" + String(cur.ts)); return; }
+  base.copyTo(tmp, sizeof(tmp));
+  if (base.n && strtoul(tmp, nullptr, 16) != v0) { publishStatusMsg(String("ERR|SCHP|BASE") + tag); return; }
+  if (!scheduleSteps(cur, cur.seq)) { publishStatusMsg(String("ERR|SCHP|READ") + tag); return; }
+  SdbStep steps[SDB_STEPS_MAX]; uint16_t n = packSteps(cur.seq, steps); uint8_t en = cur.enabled ? 1 : 0;
+  int bad = schedPatchApply(ops, steps, n, SDB_STEPS_MAX, en);
+  if (bad >= 0) { publishStatusMsg(String("ERR|SCHP|OP") + tag + "|AT=" + String(bad)); return; }
+  cur.seq.clear();
+  for (uint16_t k2 = 0; k2 < n; ++k2) cur.seq.push_back(seqStepFromSdb(steps[k2]));
+  int g = scheduleCapacityGroup(cur.seq);
+  if (g >= 0) { publishStatusMsg(String("ERR|SCHP|CAPACITY") + tag + "|G=" + String(g) + "|CAP=" + String(pumpCapacity)); return; }
+  cur.enabled = en != 0;
+  if (t.n) { t.copyTo(tmp, sizeof(tmp)); cur.timeStr = tmp; }
+  if (pb >= 0) cur.pump_on_before_ms = (uint32_t)pb;
+  if (pa >= 0) cur.pump_off_after_ms = (uint32_t)pa;
+  if (ts) cur.ts = ts;
+  uint16_t v1 = scheduleVersion(cur);
+  if (v1 != v0) { bool saved = saveScheduleRecord(cur); if (!saved) Serial.println("Warning: failed saving schedule to DB"); schedUpsert(cur, saved); }
+  else if (cur.ts != schedules[i].ts && !saveScheduleTs(schedules[i], cur.ts)) { publishStatusMsg(String("ERR|SCHP|SAVE") + tag); return; }
+  publishStatusMsg(String("ACK|SCHP|S=") + id + "|V=" + schedVersionHex(v1) + "|TS=" + String(cur.ts) + "|SRC=" + src);
+}
+
 // ---------- Broadcast & status ---------- (already implemented above)
 
 // ---------- Scheduler execution ----------
+bool pumpOn = false;
 void setPump(bool on) {
   pinMode(PUMP_PIN, OUTPUT);
   if (PUMP_ACTIVE_HIGH) digitalWrite(PUMP_PIN, on?HIGH:LOW); else digitalWrite(PUMP_PIN, on?LOW:HIGH);
   Serial.printf("Pump %s\n", on?"ON":"OFF");
+  if (on != pumpOn) { pumpOn = on; publishStatusMsg(on ? "EVT|PUMP|ON" : "EVT|PUMP|OFF"); }
 }
 
 // ---- Manual mode helpers ----
@@ -1266,6 +2285,118 @@ void setManualActivity() {
 void publishStatusIfAvailable(const String &s) {
   publishStatusMsg(s);
 }
+void publishStatusIfAvailable(const char *s) { publishStatusMsg(s); }
+
+// ---------- Schedule runner (state machine) ----------
+// runScheduleLoop() advances one state per call; valve commands go through the LoRa
+// transaction table and their results are picked up on a later pass of the ctrl task,
+// which never waits on the modem, BLE or display.
+enum RunState : uint8_t {
+  RS_IDLE,              // nothing running
+  RS_START_OPEN,        // OPENs in flight for the first group
+  RS_PUMP_LEAD,         // first valve(s) open, pump on, waiting pumpOnBeforeMs
+  RS_STEP,              // valves timing, one group at a time (ZoneRunner)
+  RS_PLAN_PUSH,         // node-local run: PLANs in flight
+  RS_PLAN_RUN,          // node-local run: nodes time their valves, controller follows the clock
+  RS_PUMP_TAIL,         // sequence exhausted, waiting pumpOffAfterMs
+  RS_STOP_PUMP_TAIL,    // manual override: waiting pumpOffAfterMs
+  RS_STOP_CLOSE_WAIT,   // manual override: pump off, waiting LAST_CLOSE_DELAY_MS
+  RS_STOP_CLOSING       // manual override: CLOSE(s) in flight
+};
+RunState runState = RS_IDLE;
+unsigned long runPhaseStart = 0;  // start of timed phases (pump lead/tail, close wait)
+int runStopPending = 0;           // manual-override CLOSEs still outstanding
+
+void onRunOpenDone(const LoraTxn &t, bool acked) {
+  int32_t lat = zones.opened((uint16_t)t.tag, acked, millis());
+  if (lat >= 0) perf.stepMoved((uint32_t)lat);
+  if (acked && zones.timing) publishStatusf("EVT|STEP|MOVE|I=%d", t.tag);
+}
+void onRunCloseDone(const LoraTxn &t, bool acked) { if (!acked) Serial.printf("WARN: CLOSE not acked node %d idx %d\n", t.node, t.idx); }
+void onRunMcastCloseDone(const LoraMcast &m) { for (int32_t n = m.pending.next(0); n >= 0; n = m.pending.next(n + 1)) Serial.printf("WARN: CLOSE not acked node %ld\n", (long)n); }
+void onStopCloseDone(const LoraTxn &t, bool acked) {
+  if (!acked) Serial.println("WARN: manual close ACK failed");
+  if (runStopPending > 0) runStopPending--;
+}
+
+void runClose(int i, LoraTxnCallback cb) {
+  if (i < 0 || i >= (int)seq.size()) return;
+  if (loraTxnStart("CLOSE", seq[i].node_id, currentScheduleId.c_str(), i, 0, cb, TXN_OWNER_SCHED, i) >= 0 && cb == onStopCloseDone) runStopPending++;
+}
+// ---------- Moisture feedback ----------
+// Steps with a target end once the node reads it (after their minimum) and are skipped
+// when it already does; readings come from nodeTele, a STATUS fills in when none arrive.
+int fbReading(int node, uint32_t nowMs, uint32_t &ageMs) {
+  NodeTeleTable::Entry *x = nodeTele.find((uint16_t)node);
+  if (!x || !x->full) return -1;
+  ageMs = nowMs - x->atMs; return fbMoisture(x->t);
+}
+void onFbPollDone(const LoraTxn &t, bool acked) { if (!acked) Serial.printf("WARN: feedback STATUS not acked node %d\n", t.node); }   // telemetry lands in nodeTele
+// RS_STEP pass: ends steps whose target is reached, polls nodes gone quiet
+void fbPoll(uint32_t nowMs) {
+  if (!runFb.any() || !zones.timing) return;
+  for (uint16_t i = 0; i < zones.n; ++i) {
+    if (zones.st[i] != ZS_OPEN || !runFb.active(i)) continue;
+    uint32_t age = 0, ran = nowMs - zones.startMs[i]; int m = fbReading(seq[i].node_id, nowMs, age);
+    bool fresh = m >= 0 && age < ran;                // taken since the valve opened
+    if (fresh && runFb.reached(i, ran, m)) {
+      zones.cut(i, nowMs);
+      publishStatusf("EVT|FB|EARLY|I=%u|N=%d|M=%d|RAN_S=%lu", i, seq[i].node_id, m, (unsigned long)(ran / 1000));
+    } else if ((!fresh || age >= FB_POLL_MS) && runFb.pollDue(i, nowMs))
+      loraTxnStart("STATUS", seq[i].node_id, currentScheduleId.c_str(), i, 0, onFbPollDone, TXN_OWNER_SCHED, -1);
+  }
+}
+
+// Valve commands for ZoneRunner::poll(); false leaves the step queued for the next pass
+struct RunValves {
+  bool skip(uint16_t i) {
+    uint32_t age = 0; int m = runFb.active(i) ? fbReading(seq[i].node_id, millis(), age) : -1;
+    if (!runFb.skipAtStart(i, m, age)) return false;
+    publishStatusf("EVT|FB|SKIP|I=%u|N=%d|M=%d", i, seq[i].node_id, m);
+    return true;
+  }
+  bool open(uint16_t i) {
+    Serial.printf("Attempt OPEN idx %u node %d\n", i, seq[i].node_id);
+    uint32_t failsafeMs = seq[i].duration_ms + (zones.timing ? 0 : pumpOnBeforeMs) + STEP_FAILSAFE_MARGIN_MS;
+    return loraTxnStart("OPEN", seq[i].node_id, currentScheduleId.c_str(), i, failsafeMs, onRunOpenDone, TXN_OWNER_SCHED, i) >= 0;
+  }
+  bool close(uint16_t i) { return loraTxnStart("CLOSE", seq[i].node_id, currentScheduleId.c_str(), i, 0, onRunCloseDone, TXN_OWNER_SCHED, i) >= 0; }
+} runValves;
+// Distinct nodes of the running sequence
+std::vector<int> runNodes() {
+  std::vector<int> v;
+  for (auto &st : seq) { bool dup = false; for (int n : v) if (n == st.node_id) { dup = true; break; } if (!dup) v.push_back(st.node_id); }
+  return v;
+}
+// CLOSE every step whose valve may be open; node-local runs: a CLOSE without a step
+// index per node, which also drops its plan
+void runCloseLive(LoraTxnCallback cb) {
+  if (planActive) {
+    for (int nd : runNodes())
+      if (loraTxnStart("CLOSE", nd, currentScheduleId.c_str(), -1, 0, cb, TXN_OWNER_SCHED, -1) >= 0 && cb == onStopCloseDone) runStopPending++;
+    return;
+  }
+  for (size_t i = 0; i < seq.size(); ++i) if (zones.live((uint16_t)i)) runClose((int)i, cb);
+}
+
+uint16_t zoneSteps(const std::vector<SeqStep> &sq, ZoneStep *out) {
+  uint16_t n = sq.size() < ZR_MAX ? (uint16_t)sq.size() : ZR_MAX;
+  for (uint16_t i = 0; i < n; ++i) {
+    out[i].node = (uint16_t)sq[i].node_id; out[i].weight = nodeFlow.weight(out[i].node); out[i].par = sq[i].par; out[i].durMs = sq[i].duration_ms;
+    out[i].target = sq[i].target; out[i].minMs = sq[i].min_ms;
+  }
+  return n;
+}
+// Group (0-based) whose combined flow exceeds the pump capacity, -1 if the sequence fits
+int scheduleCapacityGroup(const std::vector<SeqStep> &sq) { ZoneStep zs[ZR_MAX]; uint16_t n = zoneSteps(sq, zs); return zoneCheckCapacity(zs, n, pumpCapacity); }
+
+void runFinish(const char *evt) {
+  if (runFb.any()) { char b[120]; runFb.text(zones, pumpCapacity, b, sizeof(b)); publishStatusf("EVT|FB|RUN|S=%s|%s", currentScheduleId.c_str(), b); }
+  runState = RS_IDLE; zones.clear(); runFb.clear(); planActive = false;
+  scheduleRunning = false; scheduleLoaded = false;   // run once per trigger
+  currentStepIndex = -1; saveProgressIndex();
+  if (evt) publishStatusMsg(evt);
+}
 
 // Enter manual mode: stop any running schedule cleanly (respect pumpOffAfterMs & LAST_CLOSE_DELAY_MS)
 void enterManualMode() {
@@ -1273,37 +2404,16 @@ void enterManualMode() {
   Serial.println("Switching to MANUAL mode");
   publishStatusIfAvailable("EVT|MODE|MANUAL");
 
-  // If a schedule is running, stop it cleanly
-  if (scheduleRunning) {
+  // If a schedule is running, hand it to the runner's stop states (finishes in runScheduleLoop)
+  if (runState != RS_IDLE && runState < RS_STOP_PUMP_TAIL) {
     publishStatusIfAvailable("EVT|MANUAL_OVERRIDE|STOPPING");
-    // wait pump off lead time then stop pump
-    delay(pumpOffAfterMs);
-    setPump(false);
-    // Wait LAST_CLOSE_DELAY_MS while servicing modem/display (avoid blocking forever)
-    unsigned long waitStart = millis();
-    while (millis() - waitStart < LAST_CLOSE_DELAY_MS) {
-      modemBackgroundRead();
-      displayLoop();
-      delay(50);
-    }
-    // close currently open valve (best-effort)
-    if (currentStepIndex >= 0 && currentStepIndex < (int)seq.size()) {
-      int lastNode = seq[currentStepIndex].node_id;
-      bool ok = sendCmdWithAck("CLOSE", lastNode, currentScheduleId, currentStepIndex, 0);
-      if (!ok) Serial.println("WARN: manual close ACK failed");
-    }
-    scheduleRunning = false;
-    currentStepIndex = -1;
-    prefs.putInt("active_index", currentStepIndex);
-    publishStatusIfAvailable("EVT|MANUAL_OVERRIDE|STOPPED");
+    loraTxnCancelOwner(TXN_OWNER_SCHED);   // interrupted OPENs stay live in `zones` and get a CLOSE
+    runPhaseStart = millis(); runState = RS_STOP_PUMP_TAIL;
   }
 
   manualMode = true;
   prefs.putBool(PREF_MANUAL_MODE, true);
   setManualActivity();
-  // update display quickly
-  disp_status_line = "MODE: MANUAL";
-  displayLoop();
 }
 
 // Exit manual mode (do NOT auto-start schedules)
@@ -1313,34 +2423,217 @@ void exitManualMode() {
   publishStatusIfAvailable("EVT|MODE|SCHEDULE");
   manualMode = false;
   prefs.putBool(PREF_MANUAL_MODE, false);
-  disp_status_line = "MODE: SCHEDULE";
-  displayLoop();
 }
 
-// Immediate emergency stop (no delays): close valves and stop pump
+// Immediate emergency stop (no delays): pump off, one multicast CLOSE to every binary-capable
+// step node plus unicast CLOSEs for the rest. DONE is published once all of them have
+// completed (acked or retries exhausted).
+size_t estopNext = 0;        // next unicast node still to be queued
+int estopPending = 0;        // CLOSEs (unicast or multicast) queued but not completed
+int estopFailed = 0;
+FixedStr<SDB_ID_MAX> estopSchedId;
+std::vector<int> estopNodes;
+
+void estopLaunchMore();
+void onEstopDone(const LoraTxn &t, bool acked) {
+  if (!acked) { estopFailed++; publishStatusf("ERR|EMERGENCY_STOP|NO_ACK|N=%d", t.node); }
+  if (estopPending > 0) estopPending--;
+  estopLaunchMore();
+}
+void onEstopMcastDone(const LoraMcast &m) {
+  for (int32_t n = m.pending.next(0); n >= 0; n = m.pending.next(n + 1)) { estopFailed++; publishStatusf("ERR|EMERGENCY_STOP|NO_ACK|N=%ld", (long)n); }
+  if (estopPending > 0) estopPending--;
+  estopLaunchMore();
+}
+void estopLaunchMore() {
+  while (estopNext < estopNodes.size()) {
+    if (loraTxnStart("CLOSE", estopNodes[estopNext], estopSchedId.c_str(), (int)estopNext, 0, onEstopDone, TXN_OWNER_ESTOP, 0) < 0) return;  // resumes on next completion
+    estopNext++; estopPending++;
+  }
+  if (estopPending == 0) {
+    publishStatusIfAvailable(estopFailed ? String("EVT|EMERGENCY_STOP|DONE|FAILED=") + String(estopFailed) : String("EVT|EMERGENCY_STOP|DONE"));
+    estopNodes.clear();
+  }
+}
+
 void emergencyStopAll() {
   Serial.println("EMERGENCY STOP: immediate");
   publishStatusIfAvailable("EVT|EMERGENCY_STOP|START");
-  #ifdef VALVE_PINS
-    for (int i = 0; i < NUM_VALVES; ++i) {
-      if (VALVE_PINS[i] >= 0) {
-        pinMode(VALVE_PINS[i], OUTPUT);
-        if (VALVE_ACTIVE_HIGH[i]) digitalWrite(VALVE_PINS[i], LOW);
-        else digitalWrite(VALVE_PINS[i], HIGH);
-      }
+  setPump(false);
+  loraTxnCancelOwner(TXN_OWNER_SCHED);
+  loraTxnCancelOwner(TXN_OWNER_ESTOP);   // a repeated stop restarts the sweep
+  // best-effort: close all nodes referenced by seq
+  std::vector<int> nodes; for (auto &st : seq) nodes.push_back(st.node_id);
+  estopSchedId = currentScheduleId; estopNext = 0; estopPending = 0; estopFailed = 0;
+  if (loraMcastStart(LC_CLOSE, nodes, estopSchedId.c_str(), nullptr, onEstopMcastDone, TXN_OWNER_ESTOP, estopNodes) >= 0) estopPending++;
+  runFinish(nullptr);
+  estopLaunchMore();
+}
+// Fleet status sweep: NODE_SWEEP=ALL | <a>-<b> | <n>;<n>;...  ALL = every node known to
+// speak binary. One multicast STATUS covers the binary nodes (each answer is published
+// as a STAT line), the rest get a unicast STATUS; EVT|SWEEP|DONE reports who was missing.
+int sweepPending = 0, sweepOk = 0;
+String sweepMissing;
+void sweepSettle() {
+  if (sweepPending > 0 && --sweepPending > 0) return;
+  publishStatusIfAvailable(String("EVT|SWEEP|DONE|OK=") + String(sweepOk) + (sweepMissing.length() ? "|MISS=" + sweepMissing : String("")));
+}
+void sweepMiss(long node) { if (sweepMissing.length()) sweepMissing += ";"; sweepMissing += String(node); }
+void onSweepNode(const LoraMcast &m, const LoraFrame &ack) {
+  sweepOk++;
+  LoraFrame st = ack; st.kind = LF_STAT;
+  char text[200]; loraFrameToText(st, text, sizeof(text));
+  publishStatusIfAvailable(String(text) + "|SRC=SWEEP");
+}
+void onSweepDone(const LoraMcast &m) { for (int32_t n = m.pending.next(0); n >= 0; n = m.pending.next(n + 1)) sweepMiss(n); sweepSettle(); }
+void onSweepUnicastDone(const LoraTxn &t, bool acked) { if (acked) sweepOk++; else sweepMiss(t.node); sweepSettle(); }
+bool nodeSweep(const String &spec) {
+  if (sweepPending > 0) { publishStatusIfAvailable("ERR|SWEEP|BUSY"); return false; }
+  std::vector<int> nodes, rest;
+  if (spec == "ALL") for (int i = 0; i < binNodeCount; ++i) nodes.push_back(binNodes[i]);
+  else {
+    WireSpan all = wireSpan(spec.c_str(), spec.length()), part = all;
+    while (all.n) {
+      int semi = all.indexOf(';'); part = (semi < 0 ? all : all.sub(0, (uint16_t)semi)).trim();
+      all = semi < 0 ? wireSpan("") : all.sub((uint16_t)(semi + 1));
+      int dash = part.indexOf('-');
+      long a = (dash < 0 ? part : part.sub(0, (uint16_t)dash)).toLong(-1), b = dash < 0 ? a : part.sub((uint16_t)(dash + 1)).toLong(-1);
+      if (a <= 0 || b < a || b - a >= LORA_GROUP_BYTES * 8) { publishStatusIfAvailable("ERR|SWEEP|BAD_SPEC"); return false; }
+      for (long n = a; n <= b; ++n) nodes.push_back((int)n);
     }
-  #else
-    // best-effort: close all nodes referenced by seq
-    for (size_t i = 0; i < seq.size(); ++i) {
-      sendCmdWithAck("CLOSE", seq[i].node_id, currentScheduleId, (int)i, 0);
+  }
+  if (nodes.empty()) { publishStatusIfAvailable("ERR|SWEEP|NO_NODES"); return false; }
+  sweepOk = 0; sweepMissing = ""; sweepPending = 1;            // held until everything is queued
+  if (loraMcastStart(LC_STATUS, nodes, "SWEEP", onSweepNode, onSweepDone, TXN_OWNER_MANUAL, rest) >= 0) sweepPending++;
+  for (int n : rest) {
+    if (loraTxnStart("STATUS", n, "SWEEP", 0, 0, onSweepUnicastDone, TXN_OWNER_MANUAL, 0) >= 0) sweepPending++;
+    else sweepMiss(n);
+  }
+  sweepSettle();
+  return true;
+}
+
+// Node power mode: NODE_POWER=<node>:<wake ms> (0 = always listening) sends POWER to the
+// node; its ACK carries the new cadence and updates nodeWake. NODE_POWER=LIST reports the table.
+void onNodePowerDone(const LoraTxn &t, bool acked) {
+  if (!acked && t.durMs) nodeWake.set((uint16_t)t.node, t.durMs);   // it may have switched anyway: keep using the long preamble
+  publishStatusIfAvailable(String(acked ? "ACK" : "ERR") + "|POWER|N=" + String(t.node) + "|WAKE=" + String(nodeWake.wakeMs((uint16_t)t.node)) + (acked ? "" : "|NO_ACK"));
+}
+bool nodePowerSet(const String &spec) {
+  if (spec == "" || spec == "LIST") {
+    char b[NODE_WAKE_SLOTS * 12]; nodeWake.text(b, sizeof(b));
+    publishStatusIfAvailable(String("STATUS|POWER|") + (b[0] ? b : "NONE") + ",MAX_LAT_MS=" + String(nodeWake.maxWakeMs() + LORA_ACK_TIMEOUT_MS));
+    return true;
+  }
+  int c = spec.indexOf(':');
+  long node = c > 0 ? spec.substring(0, c).toInt() : 0, ms = c > 0 ? spec.substring(c + 1).toInt() : -1;
+  if (node <= 0 || ms < 0 || ms > NODE_WAKE_MAX_MS) { publishStatusIfAvailable("ERR|POWER|BAD_SPEC"); return false; }
+  if (loraTxnStart("POWER", (int)node, "POWER", 0, (uint32_t)ms, onNodePowerDone, TXN_OWNER_MANUAL, 0) < 0) { publishStatusIfAvailable("ERR|POWER|BUSY"); return false; }
+  return true;
+}
+
+// Soil sensor calibration: NODE_CAL=<node>:<valve>:DRY|WET|DEFAULT. The node takes its
+// current filtered reading as that point (probe in dry soil / water first).
+void onNodeCalDone(const LoraTxn &t, bool acked) {
+  static const char *pts[] = { "DEFAULT", "DRY", "WET" };
+  publishStatusIfAvailable(String(acked ? "ACK" : "ERR") + "|CAL|N=" + String(t.node) + "|V=" + String(t.idx) + "|" + pts[t.durMs % 3] + (acked ? "" : "|NO_ACK"));
+}
+bool nodeCalibrate(const String &spec) {
+  int c1 = spec.indexOf(':'), c2 = c1 > 0 ? spec.indexOf(':', c1 + 1) : -1;
+  long node = c1 > 0 ? spec.substring(0, c1).toInt() : 0, valve = c2 > 0 ? spec.substring(c1 + 1, c2).toInt() : 0;
+  String pt = c2 > 0 ? spec.substring(c2 + 1) : String(""); pt.toUpperCase();
+  uint32_t point = pt == "DRY" ? 1 : pt == "WET" ? 2 : pt == "DEFAULT" ? 0 : 3;
+  if (node <= 0 || valve < 1 || valve > LORA_MAX_VALVES || point > 2) { publishStatusIfAvailable("ERR|CAL|BAD_SPEC"); return false; }
+  if (loraTxnStart("CAL", (int)node, "CAL", (int)valve, point, onNodeCalDone, TXN_OWNER_MANUAL, 0) < 0) { publishStatusIfAvailable("ERR|CAL|BUSY"); return false; }
+  return true;
+}
+
+// ---------- Node-local runs (PLAN) ----------
+// When every node of a run advertises LORA_CAP_PLAN the run is pushed as PLANs and the
+// nodes time their own valves (node_plan.h). The controller follows the same timeline:
+// pump on once a first-group valve reports open, progress from the clock, a live OPEN
+// for a step whose AUTO_OPENED is overdue, pump off at the end, TIME beacons meanwhile.
+// If a PLAN goes unacknowledged the run falls back to live OPEN / CLOSE.
+int planPushPending = 0, planPushFailed = 0;
+bool planPumpOn = false;
+unsigned long planBeaconMs = 0;
+
+void onPlanPushDone(const LoraTxn &t, bool acked) {
+  if (planPushPending > 0) planPushPending--;
+  if (!acked) { planPushFailed++; Serial.printf("WARN: PLAN not acked by node %d\n", t.node); }
+}
+void planStepOpened(uint16_t i, int32_t lat) {
+  if (lat >= 0) perf.stepMoved((uint32_t)lat);
+  publishStatusf("EVT|STEP|MOVE|I=%u|PLAN=1", i);
+}
+void onPlanNudgeDone(const LoraTxn &t, bool acked) {
+  if (!planActive || t.tag < 0 || t.tag >= planRun.n) return;
+  if (acked) planStepOpened((uint16_t)t.tag, planRun.report((uint16_t)t.tag, true, epochNowMs()));
+  else { planRun.st[t.tag] = PW_MISSED; planRun.missed++; }
+}
+// AUTO_OPENED / AUTO_CLOSED from a node running its plan
+void planOnReport(const LoraFrame &f) {
+  if (!planActive || f.idx < 0 || f.idx >= planRun.n || planRun.node[f.idx] != f.node) return;
+  if (f.schedHash != loraSchedHash(currentScheduleId.c_str())) return;
+  if (f.kind == LF_AUTO_OPENED) planStepOpened((uint16_t)f.idx, planRun.report((uint16_t)f.idx, true, epochNowMs()));
+  else planRun.report((uint16_t)f.idx, false, epochNowMs());
+}
+
+// Pushes the run as PLANs; false = run it live (mode off, clock unset, a node without
+// the capability, too many windows for one frame or too few free transaction slots)
+bool planStart(const ZoneStep *zs, uint16_t n) {
+  if (!planMode || epochNowMs() < NODE_EPOCH_MIN_MS) return false;
+  std::vector<int> nodes = runNodes();
+  if ((int)nodes.size() > LORA_TXN_MAX - loraTxnInFlight()) return false;
+  uint32_t lead = NODE_PLAN_LEAD_MS;
+  for (int nd : nodes) { if (!nodeCanPlan(nd)) return false; lead += LORA_ACK_TIMEOUT_MS + nodeWake.wakeMs((uint16_t)nd); }
+  if (!planRun.build(zs, n, pumpCapacity, pumpOnBeforeMs)) return false;
+  LoraPlanWin w[LORA_PLAN_MAX];
+  for (int nd : nodes) if (planRun.slice((uint16_t)nd, w, LORA_PLAN_MAX) > LORA_PLAN_MAX) return false;
+  planRun.t0 = epochNowMs() + lead;
+  planPushPending = planPushFailed = 0;
+  for (int nd : nodes) if (loraTxnStart("PLAN", nd, currentScheduleId.c_str(), -1, 0, onPlanPushDone, TXN_OWNER_SCHED, nd) >= 0) planPushPending++; else planPushFailed++;
+  planActive = true; planPumpOn = false; planBeaconMs = millis();
+  publishStatusf("EVT|PLAN|PUSH|S=%s|NODES=%u|IN_MS=%lu", currentScheduleId.c_str(), (unsigned)nodes.size(), (unsigned long)lead);
+  return true;
+}
+// Some node did not take its PLAN: drop every node's plan (multicast CLOSE, sent before
+// any unicast) and run live
+void planFallback() {
+  std::vector<int> rest;
+  publishStatusf("EVT|PLAN|FALLBACK|S=%s|MISS=%d", currentScheduleId.c_str(), planPushFailed);
+  loraMcastStart(LC_CLOSE, runNodes(), currentScheduleId.c_str(), nullptr, onRunMcastCloseDone, TXN_OWNER_SCHED, rest);
+  for (int nd : rest) loraTxnStart("CLOSE", nd, currentScheduleId.c_str(), -1, 0, onRunCloseDone, TXN_OWNER_SCHED, -1);
+  planActive = false;
+  zones.poll(millis(), runValves); runState = RS_START_OPEN;
+}
+// RS_PLAN_RUN pass; true when the run ended
+bool planRunPoll(unsigned long nowMs) {
+  int64_t now = epochNowMs();
+  if (nowMs - planBeaconMs >= NODE_BEACON_MS) { planBeaconMs = nowMs; loraBeaconDue = true; }
+  int i = planRun.overdue(now, NODE_PLAN_REPORT_MS + nodeWake.maxWakeMs());
+  if (i >= 0 && loraTxnStart("OPEN", planRun.node[i], currentScheduleId.c_str(), i, (uint32_t)(planRun.closeAt(i) - now), onPlanNudgeDone, TXN_OWNER_SCHED, i) >= 0) {
+    planRun.st[i] = PW_NUDGED; planRun.late++;
+    publishStatusf("EVT|PLAN|LATE|I=%d|N=%u", i, planRun.node[i]);
+  }
+  for (uint16_t k = 0; k < planRun.n; ++k)
+    if (planRun.st[k] == PW_PENDING && now >= planRun.closeAt(k)) { planRun.st[k] = PW_MISSED; planRun.missed++; publishStatusf("EVT|PLAN|NO_REPORT|I=%u", k); }
+  if (!planPumpOn) {
+    if (planRun.startFailed()) { runCloseLive(onRunCloseDone); runFinish(nullptr); publishStatusMsg("ERR|no_start_node_opened"); return true; }
+    if (now >= planRun.pumpAt() && planRun.started()) {
+      setPump(true); planPumpOn = true;
+      publishStatusf("EVT|START|S=%s|PLAN=1", currentScheduleId.c_str());
     }
-  #endif
+  }
+  int cur = planRun.current(now);
+  if (cur >= 0 && cur != currentStepIndex) { currentStepIndex = cur; saveProgressIndex(); }
+  if (now < planRun.endAt()) return false;
   setPump(false);
-  scheduleRunning = false;
-  currentStepIndex = -1;
-  prefs.putInt("active_index", currentStepIndex);
-  publishStatusIfAvailable("EVT|EMERGENCY_STOP|DONE");
+  publishStatusf("EVT|PLAN|DONE|S=%s|REPORTS=%lu|LATE=%lu|MISSED=%lu", currentScheduleId.c_str(), (unsigned long)planRun.reports, (unsigned long)planRun.late, (unsigned long)planRun.missed);
+  runFinish("EVT|SCHEDULE_COMPLETE");
+  return true;
 }
+
 void manualInactivityCheck() {
   if (!manualMode) return;
   if (MANUAL_INACTIVITY_MS == 0) return;
@@ -1353,123 +2646,136 @@ void manualInactivityCheck() {
 
 
 void startScheduleIfDue() {
-   if (manualMode) {
-    Serial.println("Manual mode active; not starting schedule");
-    return;
-  }
+  if (manualMode) return;
   if (!scheduleLoaded) return;
-  if (scheduleRunning) return;
+  if (runState != RS_IDLE) return;
   if (seq.size()==0) return;
   time_t now = time(nullptr); if (now == (time_t)-1) return;
-  int startIndex = -1;
-  for (size_t i=0;i<seq.size();++i) {
-    int node = seq[i].node_id;
-    uint32_t dur = seq[i].duration_ms;
-    Serial.printf("Attempt OPEN idx %u node %d\n", (unsigned)i, node);
-    if (sendCmdWithAck("OPEN", node, currentScheduleId, (int)i, dur)) { startIndex = (int)i; break; }
-  }
-  if (startIndex < 0) { publishStatusMsg("ERR|no_start_node_opened"); return; }
-  for (size_t i=0;i<seq.size();++i) {
-    if ((int)i == startIndex) continue;
-    sendCmdWithAck("CLOSE", seq[i].node_id, currentScheduleId, (int)i, 0);
-  }
-  setPump(true); delay(pumpOnBeforeMs);
-  scheduleRunning = true; currentStepIndex = startIndex; stepStartMillis = millis();
-  prefs.putInt("active_index", currentStepIndex);
-  publishStatusMsg(String("EVT|START|S=") + currentScheduleId);
+  ZoneStep zs[ZR_MAX];
+  if (seq.size() > ZR_MAX || !zones.begin(zs, zoneSteps(seq, zs), pumpCapacity)) { runFinish(nullptr); publishStatusf("ERR|SCH|TOO_LONG|S=%s", currentScheduleId.c_str()); return; }
+  scheduleRunning = true; currentStepIndex = -1;
+  runFb.begin(zs, zones.n);
+  if (!runFb.any() && planStart(zs, zones.n)) { runState = RS_PLAN_PUSH; return; }   // feedback needs the controller in the loop
+  zones.poll(millis(), runValves); runState = RS_START_OPEN;
 }
 
 void stopScheduleAndCleanup() {
-  if (currentStepIndex >=0 && currentStepIndex < (int)seq.size()) sendCmdWithAck("CLOSE", seq[currentStepIndex].node_id, currentScheduleId, currentStepIndex, 0);
-  setPump(false); scheduleRunning=false; currentStepIndex=-1; prefs.putInt("active_index", currentStepIndex); publishStatusMsg("EVT|SCHEDULE_STOPPED");
+  loraTxnCancelOwner(TXN_OWNER_SCHED);
+  runCloseLive(onRunCloseDone);
+  setPump(false); runFinish("EVT|SCHEDULE_STOPPED");
 }
 
 void runScheduleLoop() {
-  // If manual mode engaged while scheduleRunning, halt schedule progression
-  if (manualMode && scheduleRunning) {
-    Serial.println("runScheduleLoop: manualMode active, halting schedule progression");
-    return;
-  }
-  if (!scheduleRunning) { startScheduleIfDue(); return; }
-  if (currentStepIndex < 0 || currentStepIndex >= (int)seq.size()) {
-    delay(pumpOffAfterMs);
-    setPump(false);
-    scheduleRunning=false;
-    publishStatusMsg("EVT|SCHEDULE_COMPLETE");
-    currentStepIndex = -1; prefs.putInt("active_index", currentStepIndex); return;
-  }
-  SeqStep &step = seq[currentStepIndex];
-  if (millis() - stepStartMillis >= step.duration_ms) {
-    int nextIdx = -1;
-    for (int cand = currentStepIndex+1; cand < (int)seq.size(); ++cand) {
-      if (sendCmdWithAck("OPEN", seq[cand].node_id, currentScheduleId, cand, seq[cand].duration_ms)) { nextIdx = cand; break; }
-    }
-    sendCmdWithAck("CLOSE", step.node_id, currentScheduleId, currentStepIndex, 0);
-    if (nextIdx >= 0) {
-      currentStepIndex = nextIdx; prefs.putInt("active_index", currentStepIndex); stepStartMillis = millis(); publishStatusMsg(String("EVT|STEP|MOVE|I=")+String(currentStepIndex));
-    } else {
-      setPump(false); scheduleRunning=false; publishStatusMsg("EVT|SCHEDULE_COMPLETE|NO_NEXT");
-      currentStepIndex = -1; prefs.putInt("active_index", currentStepIndex);
+  unsigned long now = millis();
+  switch (runState) {
+    case RS_IDLE:
+      startScheduleIfDue();
+      return;
+
+    case RS_START_OPEN:
+      zones.poll(now, runValves);
+      if (!zones.settled()) return;
+      if (zones.current() >= 0) {
+        // close every other step's node (unless one of its steps is open) in one multicast, then pump lead
+        std::vector<int> idle, rest;
+        for (size_t i = 0; i < seq.size(); ++i) {
+          bool busy = false;
+          for (size_t j = 0; j < seq.size() && !busy; ++j) busy = zones.live((uint16_t)j) && seq[j].node_id == seq[i].node_id;
+          if (!busy) idle.push_back(seq[i].node_id);
+        }
+        loraMcastStart(LC_CLOSE, idle, currentScheduleId.c_str(), nullptr, onRunMcastCloseDone, TXN_OWNER_SCHED, rest);
+        for (int nd : rest) for (size_t i = 0; i < seq.size(); ++i) if (seq[i].node_id == nd) { runClose((int)i, onRunCloseDone); break; }
+        currentStepIndex = zones.current(); saveProgressIndex();
+        setPump(true); runPhaseStart = now; runState = RS_PUMP_LEAD;
+      } else if (zones.finished()) {
+        bool wet = zones.count(ZS_SKIPPED) && !zones.count(ZS_FAILED);   // every step skipped on moisture
+        runFinish(wet ? "EVT|SCHEDULE_COMPLETE|SKIPPED" : nullptr); if (!wet) publishStatusMsg("ERR|no_start_node_opened");
+      }
+      return;
+
+    case RS_PUMP_LEAD:
+      if (now - runPhaseStart < pumpOnBeforeMs) return;
+      zones.startTimers(now); runState = RS_STEP;
+      publishStatusf("EVT|START|S=%s", currentScheduleId.c_str());
+      break;
+
+    case RS_STEP: {
+      fbPoll(now);
+      zones.poll(now, runValves);
+      if (zones.finished()) { runPhaseStart = now; runState = RS_PUMP_TAIL; return; }   // pump off after pumpOffAfterMs (PA)
+      int cur = zones.current();
+      if (cur >= 0 && cur != currentStepIndex) { currentStepIndex = cur; saveProgressIndex(); }
+      break;
     }
+
+    case RS_PLAN_PUSH:
+      if (planPushPending > 0) return;
+      if (planPushFailed) planFallback(); else runState = RS_PLAN_RUN;
+      return;
+
+    case RS_PLAN_RUN:
+      if (planRunPoll(now)) return;
+      break;
+
+    case RS_PUMP_TAIL:
+      if (now - runPhaseStart < pumpOffAfterMs) return;
+      setPump(false); runFinish("EVT|SCHEDULE_COMPLETE");
+      return;
+
+    case RS_STOP_PUMP_TAIL:
+      if (now - runPhaseStart < pumpOffAfterMs) return;
+      setPump(false); runPhaseStart = now; runState = RS_STOP_CLOSE_WAIT;
+      return;
+
+    case RS_STOP_CLOSE_WAIT:
+      if (now - runPhaseStart < LAST_CLOSE_DELAY_MS) return;
+      // close open valves (best-effort), plus candidates whose OPEN may have landed
+      runStopPending = 0;
+      runCloseLive(onStopCloseDone);
+      runState = RS_STOP_CLOSING;
+      return;
+
+    case RS_STOP_CLOSING:
+      if (runStopPending > 0) return;
+      runFinish("EVT|MANUAL_OVERRIDE|STOPPED");
+      return;
   }
   if (millis() - lastProgressSave > SAVE_PROGRESS_INTERVAL_MS) {
-    prefs.putString("active_schedule", currentScheduleId);
-    prefs.putInt("active_index", currentStepIndex);
+    nvj.putString("active_schedule", currentScheduleId.c_str(), millis());
+    saveProgressIndex();
     lastProgressSave = millis();
   }
 }
 
-// ---------- NTP/RTC ----------
-bool connectWiFiOnce() {
-  if (WiFi.status() == WL_CONNECTED) return true;
-  WiFi.mode(WIFI_STA); WiFi.begin(WIFI_SSID, WIFI_PASS);
-  unsigned long start = millis();
-  while (WiFi.status() != WL_CONNECTED && millis() - start < WIFI_CONNECT_TIMEOUT_MS) { delay(200); Serial.print("."); }
-  Serial.println();
-  return WiFi.status() == WL_CONNECTED;
-}
-void disconnectWiFiOnce() { WiFi.disconnect(true); WiFi.mode(WIFI_OFF); delay(100); }
-
-bool oneShotNtpSyncAndSetRTC() {
-  // Try modem first (no WiFi required)
-  if (modemNtpSyncAndSetRTC()) {
-    Serial.println("NTP sync via modem OK");
-    publishStatusMsg("EVT|NTP_SYNC|MODEM_OK");
-    return true;
+// Fires the earliest due schedule (see Schedule timer index)
+void schedTimerPoll() {
+  static bool wasTrusted = false;
+  time_t now = schedNow(); int32_t jump;
+  if (schedClock.check((uint32_t)now, millis(), SCHED_JUMP_TOL_S, jump)) {
+    bool catchUp = jump > 0 && (wasTrusted || jump <= SCHED_CATCHUP_S);
+    Serial.printf("Clock jump %ld s, re-arming %u schedule timers\n", (long)jump, (unsigned)schedules.size());
+    publishStatusf("EVT|SCH|CLOCK_JUMP|D=%ld%s", (long)jump, catchUp ? "|CATCHUP=1" : "");
+    schedTimersRebuild(catchUp ? now - jump : now);
   }
-
-  Serial.println("Modem NTP failed; trying WiFi fallback...");
-
-  if (!connectWiFiOnce()) return false;
-  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-  struct tm timeinfo; unsigned long tstart = millis(); bool gotTime = false;
-  while ((millis() - tstart) < NTP_TIMEOUT_MS) {
-    if (getLocalTime(&timeinfo, 2000)) { gotTime = true; break; }
-    delay(200);
+  wasTrusted = timeTrusted;
+  // Triggers are held while manual mode is active or a run is in progress (seq is shared with the runner),
+  // and until some source has set the clock
+  if (!timeSet || manualMode || runState != RS_IDLE || schedTimers.empty() || (uint32_t)now < schedTimers.topDue()) return;
+  size_t i = schedTimers.topKey(); Schedule &sch = schedules[i];
+  if (!scheduleSteps(sch, seq)) {
+    publishStatusf("ERR|SCH|READ|S=%s", sch.id.c_str());
+    if (sch.rec == 'O') sch.enabled = false;
+    schedTimerArm(i, now + 1); return;
   }
-  if (!gotTime) { disconnectWiFiOnce(); return false; }
-  time_t now = time(nullptr);
-  DateTime dt((uint32_t)now);
-  if (rtcAvailable) rtc.adjust(dt);
-  prefs.putULong("last_ntp_sync", (unsigned long)now);
-  disconnectWiFiOnce();
-  publishStatusMsg("EVT|NTP_SYNC|WIFI_OK");
-  return true;
-}
-
-
-void checkRtcDriftAndSync() {
-  static unsigned long lastSyncCheckMillis = 0;
-  if (millis() - lastSyncCheckMillis < SYNC_CHECK_INTERVAL_MS) return;
-  lastSyncCheckMillis = millis();
-  if (!rtcAvailable) { Serial.println("RTC not available; skipping drift check"); return; }
-  DateTime rtcTime = rtc.now(); time_t rtcEpoch = rtcTime.unixtime();
-  time_t sysEpoch = time(nullptr);
-  if (sysEpoch <= 0) { oneShotNtpSyncAndSetRTC(); return; }
-  long diff = (long)sysEpoch - (long)rtcEpoch; long absdrift = diff>=0?diff:-diff;
-  if ((uint32_t)absdrift > DRIFT_THRESHOLD_S) {
-    if (oneShotNtpSyncAndSetRTC()) publishStatusMsg("EVT|NTP_SYNC|OK"); else publishStatusMsg("ERR|NTP_SYNC_FAIL");
+  currentScheduleId = sch.id;
+  pumpOnBeforeMs = sch.pump_on_before_ms; pumpOffAfterMs = sch.pump_off_after_ms;
+  scheduleStartEpoch = sch.next_run_epoch; scheduleLoaded = true; currentStepIndex = -1;
+  publishStatusf("EVT|SCH|TRIGGER|S=%s", sch.id.c_str());
+  if (sch.rec == 'O') {   // persist so a reboot does not run it again
+    sch.enabled = false;
+    Schedule done = sch; done.seq = seq; saveScheduleRecord(done);
   }
+  schedTimerArm(i, now + 1);
 }
 
 // BLE callbacks
@@ -1485,12 +2791,12 @@ class ControllerBLECallbacks : public BLECharacteristicCallbacks {
 
     if (payload.length() == 0) return;
 
-    // ensure SRC tag present for later processing
-    if (payload.indexOf("SRC=") < 0) payload += String(",SRC=BT");
+    // transport tag last: the last SRC= is the one auth trusts
+    payload += String(",SRC=BT");
 
     // enqueue and process normally
     enqueueIncoming(payload);
-    publishStatusMsg(String("EVT|INQ|ENQ|SRC=BT"));
+    publishStatusMsg("EVT|INQ|ENQ|SRC=BT");
 
     // Build an acknowledgment. Prefer to echo MID if present.
     String mid = extractKeyVal(payload, "MID"); // uses your existing helper
@@ -1604,83 +2910,275 @@ void initBLE() {
 }
 
 
+// ---------- State snapshot (retained MQTT) ----------
+// The ctrl task rebuilds a StateSnap every SNAP_CHECK_MS and hands it to the modem task
+// when its hash changed, at most every SNAP_MIN_MS. The modem task publishes the newest
+// one retained on MQTT_TOPIC_STATE (AT+QMTPUBEX, so the size is not bound by AT_CMD_MAX):
+// a dashboard that subscribes gets the whole picture at once, and the EVT| statuses on
+// MQTT_TOPIC_STATUS are the deltas in between. STATE_SNAP forces a republish.
+const uint32_t SNAP_CHECK_MS = 1000;
+const uint32_t SNAP_MIN_MS = 5000;          // coalesces bursts (a run starting, a sweep)
+const uint32_t SNAP_RETRY_MS = 30000;       // after a failed publish, unless a newer one comes
+const uint32_t SNAP_UP_S = 3600;            // node counts as up when heard within this
+StateSnap stateSnap;                        // ctrl task
+uint32_t snapHash = 0, snapBuilt = 0;       // last handed to the modem task
+bool snapForce = false;
+char snapOut[SNAP_JSON_MAX + 24];           // modem task; QMTPUBEX reads it after the prompt
+uint16_t snapLen = 0;
+bool snapBusy = false, snapPending = false;
+uint32_t snapFailMs = 0, snapSent = 0, snapFails = 0, snapBytes = 0;
+
+void stateSnapBuild(StateSnap &s) {
+  s.clear();
+  int64_t now = epochNowMs(); uint32_t ms = millis();
+  s.t = now >= NODE_EPOCH_MIN_MS ? (uint32_t)(now / 1000) : 0;
+  s.c.mode = manualMode ? 'M' : 'S'; s.c.pump = pumpOn;
+  s.c.running = scheduleRunning; s.c.plan = planActive;
+  if (scheduleRunning) {
+    snprintf(s.c.sched, sizeof(s.c.sched), "%s", currentScheduleId.c_str());
+    int i = currentStepIndex;
+    s.c.step = i; s.c.steps = seq.size(); s.c.open = zones.count(ZS_OPEN);
+    if (planActive && i >= 0 && i < planRun.n) { s.c.stepEndKey = planRun.closeAt(i); s.endS = (uint32_t)(s.c.stepEndKey / 1000); }
+    else if (i >= 0 && i < zones.n && zones.st[i] == ZS_OPEN && zones.timing) {
+      uint32_t end = zones.startMs[i] + zones.s[i].durMs; s.c.stepEndKey = end;   // millis(): stable while the step runs
+      if (s.t) s.endS = (uint32_t)((now + (int32_t)(end - ms)) / 1000);
+    }
+  }
+  s.c.mqtt = mqttAvailable; s.c.cell = modemRegistered; s.c.backlog = !evlog.idle();
+  uint32_t tx = perf.acked + perf.failed; s.ackPct = tx ? (uint8_t)(perf.acked * 100ULL / tx) : 100;
+  for (uint8_t i = 0; i < nodeTele.n && s.c.nodes < SNAP_NODES; ++i) {
+    const NodeTeleTable::Entry &e = nodeTele.e[i]; uint8_t k = s.c.nodes++;
+    uint32_t ageS = (ms - e.atMs) / 1000;
+    s.n[k].node = e.node; s.n[k].batt = e.t.battPct; s.n[k].moist = fbMoisture(e.t); s.n[k].valves = e.t.valveOpen;
+    s.n[k].flags = (e.full ? SNF_FULL : 0) | (ageS <= SNAP_UP_S ? SNF_UP : 0);
+    s.rssi[k] = e.rssi; s.heard[k] = s.t > ageS ? s.t - ageS : 0;
+  }
+}
+
+// ctrl task: hand a changed snapshot to the modem task (mailbox keeps only the newest)
+void stateSnapPoll() {
+  static uint32_t checkMs = 0, handedMs = 0;
+  static char js[SNAP_JSON_MAX];
+  uint32_t now = millis();
+  if (!snapForce && now - checkMs < SNAP_CHECK_MS) return;
+  checkMs = now;
+  stateSnapBuild(stateSnap);
+  uint32_t h = stateSnap.hash();
+  if (!snapForce && (h == snapHash || now - handedMs < SNAP_MIN_MS)) return;
+  if (stateSnap.json(js, sizeof(js)) < 0) return;
+  xQueueOverwrite(snapQ, js);
+  snapHash = h; handedMs = now; snapForce = false; snapBuilt++;
+}
+
+void onSnapPublishDone(void *, AtResult res, const char *resp, uint16_t len) {
+  WireSpan l;
+  bool ok = res == AT_OK && atFindLine(resp, len, "+QMTPUB:", l) && l.contains(",0,0");
+  snapBusy = false;
+  if (ok) { snapPending = false; snapSent++; return; }
+  snapFails++; snapFailMs = millis();
+  Serial.printf("State snapshot publish failed (%s)\n", atResultName(res));
+}
+// modem task: publish the newest snapshot; "seq" is the last EVT SEQ handed out, so
+// statuses with a higher one are newer than this picture
+void stateSnapPump() {
+  if (snapBusy || !mqttAvailable) return;
+  static char js[SNAP_JSON_MAX];
+  if (xQueueReceive(snapQ, js, 0) == pdTRUE) {
+    int n = snprintf(snapOut, sizeof(snapOut), "{\"seq\":%lu,%s", (unsigned long)evSeqAlloc.last, js + 1);
+    snapLen = n < (int)sizeof(snapOut) ? n : sizeof(snapOut) - 1;
+    snapPending = true; snapFailMs = 0;
+  }
+  if (!snapPending || (snapFailMs && millis() - snapFailMs < SNAP_RETRY_MS)) return;
+  char cmd[80]; snprintf(cmd, sizeof(cmd), "AT+QMTPUBEX=0,0,0,1,\"%s\",%u", MQTT_TOPIC_STATE, snapLen);
+  snapBusy = atEngine.submitData(cmd, (const uint8_t *)snapOut, snapLen, 15000, onSnapPublishDone, nullptr, "+QMTPUB:");
+  if (snapBusy) snapBytes += snapLen;
+}
+// STATE_SNAP: republish on the next ctrl pass, report the counters
+void stateSnapReport() {
+  snapForce = true;
+  publishStatusf("STATUS|STATE|H=%08lx,BUILT=%lu,SENT=%lu,FAIL=%lu,BYTES=%lu,PENDING=%u", (unsigned long)snapHash, (unsigned long)snapBuilt,
+                 (unsigned long)snapSent, (unsigned long)snapFails, (unsigned long)snapBytes, snapPending ? 1 : 0);
+}
+
+// ---------- Task bodies ----------
+// One status per task (a combined line would not fit OB_MSG_MAX) plus the queue line.
+// CPU load is measured by each task around its own pass (the Arduino core builds
+// FreeRTOS without run-time stats); STACK is the unused part of its stack in bytes.
+void taskStatsPublish(bool reset) {
+  char b[96];
+  for (uint8_t i = 0; i < TK_COUNT; ++i) {
+    TaskMeter &m = taskMeters[i];
+    m.stackFree = taskHandles[i] ? uxTaskGetStackHighWaterMark(taskHandles[i]) : 0;
+    m.text(millis(), b, sizeof(b)); publishStatusIfAvailable(String("STATUS|TASK|") + b);
+    if (reset) m.reset(millis());
+  }
+  snprintf(b, sizeof(b), "STATUS_Q=%u/%u,STATUS_DROPS=%lu", statusQ ? (unsigned)uxQueueMessagesWaiting(statusQ) : 0,
+           STATUS_Q_LEN, (unsigned long)statusQDrops);
+  publishStatusIfAvailable(String("STATUS|TASKS|") + b);
+}
+
+// ctrl task: hand the UI what it shows; wakes it only when something changed
+void runViewPublish() {
+  static RunView last;
+  RunView v; memset(&v, 0, sizeof(v));
+  v.running = scheduleRunning; v.manual = manualMode; v.node = -1;
+  if (currentStepIndex >= 0 && currentStepIndex < (int)seq.size()) {
+    v.node = seq[currentStepIndex].node_id;
+    uint16_t open = zones.count(ZS_OPEN); v.alsoOpen = open > 1 ? open - 1 : 0;
+  }
+  snprintf(v.schedId, sizeof(v.schedId), "%s", currentScheduleId.c_str());
+  if (memcmp(&v, &last, sizeof(v)) == 0) return;
+  last = v;
+  xQueueOverwrite(runViewQ, &v);
+  xEventGroupSetBits(ctrlEvents, EV_UI_REFRESH);
+}
+
+void radioTask(void *) {
+  for (;;) {
+    uint32_t t0 = micros();
+    { RadioGuard g; Radio.IrqProcess(); }     // dispatches OnTxDone/OnRxDone
+    taskMeters[TK_RADIO].pass(micros() - t0);
+    vTaskDelay(1);
+  }
+}
+
+// Actuation: woken by a received packet or command, otherwise every CTRL_TICK_MS
+void ctrlTask(void *) {
+  for (;;) {
+    xEventGroupWaitBits(ctrlEvents, EV_RADIO_RX | EV_INCOMING, pdTRUE, pdFALSE, pdMS_TO_TICKS(CTRL_TICK_MS));
+    uint32_t t0 = micros();
+    loraTxnPoll();
+    radioDispatch();
+    // process one queued incoming message per pass
+    static char iq[INQ_MSG_MAX + 1]; bool more = false;
+    if (dequeueIncoming(iq, sizeof(iq), more)) { Serial.printf("Processing queued incoming: %s\n", iq); processIncomingScheduleString(String(iq)); }
+    if (more) xEventGroupSetBits(ctrlEvents, EV_INCOMING);
+    runScheduleLoop();
+    schedTimerPoll();
+    nvsJournalPoll();
+    heapPoll();
+    manualInactivityCheck();
+    runViewPublish();
+    stateSnapPoll();
+    uint32_t us = micros() - t0;
+    perf.loopDone(us); taskMeters[TK_CTRL].pass(us);
+  }
+}
+
+// Modem, outbox and clock: AT engine callbacks and the time sync state machine, away from valve timing
+void modemTask(void *) {
+  ModemMsg m;
+  for (;;) {
+    bool got = xQueueReceive(statusQ, &m, pdMS_TO_TICKS(MODEM_TICK_MS)) == pdTRUE;
+    uint32_t t0 = micros();
+    xQueueReceive(modemCfgQ, &modemCfg, 0);   // config changed on the ctrl task
+    for (; got; got = xQueueReceive(statusQ, &m, 0) == pdTRUE) {
+      if (m.kind == MQ_ROUTE) outboxRouteCmd(String(m.text));
+      else if (m.kind == MQ_AUTH_BENCH) authBench();
+      else statusPost(m.text);
+    }
+    modemBackgroundRead();
+    modemHealthPoll();
+    outboxPump();
+    stateSnapPump();
+    timeSyncPoll();
+    taskMeters[TK_MODEM].pass(micros() - t0);
+  }
+}
+
+void uiTask(void *) {
+  RunView v;
+  for (;;) {
+    xEventGroupWaitBits(ctrlEvents, EV_UI_REFRESH, pdTRUE, pdFALSE, pdMS_TO_TICKS(DISPLAY_REFRESH_MS));
+    uint32_t t0 = micros();
+    if (xQueuePeek(runViewQ, &v, 0) == pdTRUE) displayLoop(v);
+    taskMeters[TK_UI].pass(micros() - t0);
+  }
+}
+
+// Queues and locks exist from the start of setup(); until tasksStart() everything runs
+// inline on the setup task (publishStatusMsg posts to the outbox directly).
+void tasksInit() {
+  outboxOwner = xTaskGetCurrentTaskHandle();
+  ctrlEvents = xEventGroupCreate();
+  radioLock = xSemaphoreCreateMutex();
+  inqLock = xSemaphoreCreateMutex();
+  statusQ = xQueueCreate(STATUS_Q_LEN, sizeof(ModemMsg));
+  runViewQ = xQueueCreate(1, sizeof(RunView));
+  snapQ = xQueueCreate(1, SNAP_JSON_MAX);
+  modemCfgQ = xQueueCreate(1, sizeof(ModemCfg));
+}
+void tasksStart() {
+  static const struct { TaskFunction_t fn; const char *name; uint32_t stack; UBaseType_t prio; uint8_t core; } spec[TK_COUNT] = {
+    { radioTask, "RADIO", 3072, 5, TASK_RADIO_CORE },
+    { ctrlTask, "CTRL", 12288, 4, TASK_CTRL_CORE },      // schedule JSON is parsed here
+    { modemTask, "MODEM", 8192, 3, TASK_MODEM_CORE },
+    { uiTask, "UI", 4096, 1, TASK_UI_CORE },
+  };
+  for (uint8_t i = 0; i < TK_COUNT; ++i) {
+    taskMeters[i].begin(spec[i].name, spec[i].core, millis());
+    if (xTaskCreatePinnedToCore(spec[i].fn, spec[i].name, spec[i].stack, nullptr, spec[i].prio, &taskHandles[i], spec[i].core) != pdPASS)
+      Serial.printf("Task %s: create failed\n", spec[i].name);
+  }
+  if (taskHandles[TK_MODEM]) outboxOwner = taskHandles[TK_MODEM];
+}
+
 void setup() {
   Serial.begin(115200); delay(200);
+  tasksInit();
   initStorage(); prefs.begin("irrig", false);
+  nvsInit();
   displayInitHeltec();
   loadSystemConfig();
+  outboxLoadRoutes();
+  evlogInit();
+  teleSeries.begin(LittleFS);
     // load persisted manual mode & timeout
   manualMode = prefs.getBool(PREF_MANUAL_MODE, false);
   MANUAL_INACTIVITY_MS = prefs.getULong(PREF_MANUAL_TIMEOUT_MS, 0);
+  loraBinaryEnabled = prefs.getBool("lora_bin", true);
+  pumpCapacity = (uint16_t)prefs.getUInt("pump_cap", 1);
+  planMode = prefs.getBool("plan_mode", true);
+  { String fw = prefs.getString("flow_w", ""); nodeFlow.parse(wireSpan(fw.c_str(), fw.length())); }
+  { String nw = prefs.getString("node_wake", ""); nodeWake.parse(wireSpan(nw.c_str(), nw.length())); }
   if (manualMode) {
     Serial.println("BOOT: Starting in MANUAL mode (schedules disabled)");
     publishStatusIfAvailable("EVT|MODE|MANUAL|BOOT");
   }
-  if (!LittleFS.exists("/schedules")) LittleFS.mkdir("/schedules");
-  loadAllSchedulesFromFS();
 
   // Initialize dedicated RTC I2C bus
   WireRTC.begin(RTC_SDA, RTC_SCL, 100000); // SDA=41, SCL=42, 100kHz
   delay(20);
   rtcAvailable = rtc.begin(&WireRTC);  // use custom I2C for DS3231
+  bool rtcLost = false;
   if (rtcAvailable) {
     Serial.println("RTC detected on WireRTC");
     if (rtc.lostPower()) {
       Serial.println("RTC lost power; setting from compile time");
       rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
+      rtcLost = true;
     }
   } else {
     Serial.println("RTC not detected on WireRTC bus");
   }
+  timeInit(rtcLost);          // clock from the RTC; the modem task syncs with the network
+  loadAllSchedulesFromFS();
 
   loraInit();
+  logFrameAirtimeReport();
   modemInit();
-  // try modem NTP at boot (best-effort)
-  if (modemNtpSyncAndSetRTC()) {
-    Serial.println("Boot: modem NTP OK");
-  } else {
-    Serial.println("Boot: modem NTP failed (will fall back as needed)");
-  }
   modemConfigureAndConnectMQTT();
   initBLE();
-  lastStatusPublish = millis();
+  tasksStart();
   Serial.println("Setup complete");
 }
 
-unsigned long lastSchedulerCheck = 0;
-void loop() {
-  modemBackgroundRead();
-  handleLoRaIncoming();
-  // process one queued incoming message
-  String iq; if (dequeueIncoming(iq)) { Serial.println("Processing queued incoming: " + iq); processIncomingScheduleString(iq); }
-  runScheduleLoop();
-  if (millis() - lastSchedulerCheck > 5000) {
-  // Do not trigger schedules while manual mode is active
-  if (manualMode) { lastSchedulerCheck = millis(); }
-  else {
-    time_t now = time(nullptr);
-    for (auto &sch : schedules) {
-      if (!sch.enabled) continue;
-      if (sch.next_run_epoch == 0) sch.next_run_epoch = computeNextRunEpoch(sch, now);
-      if (sch.next_run_epoch > 0 && now >= sch.next_run_epoch) {
-        currentScheduleId = sch.id; seq.clear(); for (auto &st: sch.seq) seq.push_back(st);
-        pumpOnBeforeMs = sch.pump_on_before_ms; pumpOffAfterMs = sch.pump_off_after_ms;
-        scheduleStartEpoch = sch.next_run_epoch; scheduleLoaded = true; currentStepIndex = -1;
-        publishStatusMsg(String("EVT|SCH|TRIGGER|S=") + sch.id);
-        if (sch.rec == 'O') sch.enabled = false;
-        sch.next_run_epoch = computeNextRunEpoch(sch, now + 1);
-        break;
-      }
-    }
-    lastSchedulerCheck = millis();
-  }
-}
+// ---------- Run metrics ----------
+String perfStatsText() { char buf[320]; perf.text(millis(), buf, sizeof(buf)); return String(buf); }
 
-  checkRtcDriftAndSync();
-  //if (millis() - lastStatusPublish > statusPublishInterval) { publishStatusMsg(String("EVT|RUN|S=") + (scheduleRunning?String("1"):String("0"))); lastStatusPublish = millis(); } // need to fix ++++++++++++++++++++
-  manualInactivityCheck();
-  displayLoop();
-  delay(20);
+// Everything runs in the tasks started at the end of setup()
+void loop() {
+  vTaskDelete(nullptr);
 }
 
 /* End of file */
@@ -4,6 +4,9 @@
   - Uses Heltec Radio driver (LoRaWan_APP.h) same pattern as Main Controller
   - Reports battery %, battery voltage, solar voltage, optional current
   - Handles CMD|MID=...|OPEN/CLOSE/STATUS and replies ACK|MID=...|...|OK|...
+  - Also accepts binary v1 frames (include/lora_frame.h) and answers in kind
+  - Optional low-power mode (POWER command, include/node_power.h): radio RX duty cycle,
+    MCU light sleep between events, display off until the button is pressed
 */
 
 #include <Arduino.h>
@@ -13,6 +16,15 @@
 #include <vector>
 #include "LoRaWan_APP.h"   // Heltec radio driver (Radio.Init, Radio.Send, RadioEvents)
 #include <Wire.h>
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "include/wire_proto.h"  // shared zero-copy frame tokenizer
+#include "include/lora_frame.h"  // binary frame codec (ASCII stays as fallback)
+#include "include/node_power.h"  // wake cadence, awake-time / current accounting
+#include "include/adc_sampler.h" // timer-driven oversampling, median/EMA snapshot, soil calibration
+#include "include/tele_delta.h"  // change-driven STAT: deadbands, keyframe/delta, adaptive interval
+#include "include/node_plan.h"   // node-local schedule windows on the controller's clock
 
 // ---------------- Display (Heltec) ----------------
 // Use Heltec constructor that matches the installed HT_SSD1306Wire.h
@@ -23,6 +35,7 @@ static SSD1306Wire display(0x3c, 500000, SDA_OLED, SCL_OLED, GEOMETRY_128_64, RS
 #define LORA_CS   18
 #define LORA_RST  14
 #define LORA_DIO0 26
+#define LORA_DIO1 14   // SX1262 IRQ line on the Heltec V3: light-sleep wake source
 
 // LoRa params used below (copied from main controller to match radio config)
 #define RF_FREQUENCY         865000000 // Hz
@@ -67,30 +80,53 @@ const float SOL_DIVIDER_RATIO = 4.0f;
 const float BATTERY_MAX_VOLT = 4.20f;
 const float BATTERY_MIN_VOLT = 3.30f;
 
+// Default soil calibration; CAL replaces it per valve (prefs "cal1".."cal4")
 const int SOIL_DRY_RAW = 3400;
 const int SOIL_WET_RAW = 1600;
 
+// Background sampling: every channel once per tick, one filtered snapshot per ADC_MEDIAN ticks
+const uint32_t ADC_TICK_MS = 100;
+const unsigned long ADC_LP_REFRESH_MS = 60000;   // low-power mode: refresh burst on wake when older
+
 // Button
 #define BUTTON_PIN 0
 #define DEBOUNCE_MS 50
 
 // Display refresh
 const unsigned long DISPLAY_REFRESH_MS = 1000;
+const unsigned long DISPLAY_AWAKE_MS = 30000;   // low-power mode: display stays on this long after a press
 
 // Vext pin (display Vext control) — define a safe default; change if your board uses other pin
 #define Vext 16
 
 // -------------------- GLOBALS --------------------
-// Optional: periodic telemetry interval (ms) and last send timestamp
-const unsigned long TELEMETRY_INTERVAL_MS = 5 * 60 * 1000UL; // 5 minutes
-unsigned long lastTelemetryMs = 0;
+// Telemetry: checked every teleDelta.intervalMs() (30 s .. 10 min), sent only when
+// something moved past its deadband or the heartbeat is due
+TeleDelta teleDelta;
+unsigned long nextTeleCheckMs = 0;
 
 Preferences prefs;
 int NODE_ID = DEFAULT_NODE_ID;
 
 String lastSchedId = "";
+uint16_t lastSchedHash = 0;
 int lastSeqIndex = -1;
 uint32_t lastCmdMid = 0;
+bool useBinaryFrames = false;   // switched on once the controller talks binary to us
+
+// Node-local run: windows pushed by PLAN, timed on the controller's clock (PLAN / TIME beacons)
+EpochClock epochClock;
+NodePlan plan;
+
+// Low-power mode: 0 = radio always in RX, else the radio samples the channel every
+// wakeMs and the MCU light-sleeps between events (pref "wake_ms", set by POWER)
+uint32_t wakeMs = 0;
+PowerMeter pwr;
+unsigned long awakeSinceUs = 0;
+unsigned long lastPowerReportMs = 0;
+const unsigned long POWER_REPORT_MS = 3600000UL;
+bool displayOn = true;
+unsigned long displayOffAtMs = 0;
 
 volatile bool buttonPressed = false;
 unsigned long lastButtonMs = 0;
@@ -107,6 +143,7 @@ char rxpacket[BUFFER_SIZE];
 static RadioEvents_t RadioEvents; // defined in LoRaWan_APP.h
 
 // Forward declarations
+struct NodeCmd;                // parsed command (see ACK builder below)
 void OnTxDone(void);
 void OnTxTimeout(void);
 void OnRxDone(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr);
@@ -134,9 +171,40 @@ void setValveState(int vidx, bool on) {
 }
 
 // -------------------- ADC helpers --------------------
+// Readings come from the sampler's last snapshot (constant time, no conversion here)
+AdcSampler adc;
+SoilCal soilCal[VALVE_COUNT];
+esp_timer_handle_t adcTimer = nullptr;
+
 int readAdcRaw(int pin) {
   if (pin < 0) return 0;
-  return analogRead(pin);
+  return adc.rawForPin(pin);
+}
+int adcReadPin(int pin) { return analogRead(pin); }
+void adcTimerCb(void *) { adc.tick(adcReadPin, millis()); }
+
+void adcInit() {
+  for (int i = 0; i < VALVE_COUNT; ++i) {
+    adc.add(SOIL_SENSOR_PIN[i]);
+    char key[8]; snprintf(key, sizeof(key), "cal%d", i + 1);
+    soilCal[i] = SoilCal::unpack(prefs.getUInt(key, ((uint32_t)SOIL_DRY_RAW << 16) | SOIL_WET_RAW));
+  }
+  adc.add(BATTERY_ADC_PIN); adc.add(SOLAR_ADC_PIN); adc.add(SOLAR_CURRENT_PIN);
+  adc.burst(adcReadPin, millis());     // first snapshot before anything is reported
+  esp_timer_create_args_t args = {};
+  args.callback = adcTimerCb; args.name = "adc";
+  esp_timer_create(&args, &adcTimer);
+  Serial.printf("ADC sampler: %u channels, snapshot every %lu ms\n", adc.n, (unsigned long)(ADC_TICK_MS * ADC_MEDIAN));
+}
+// Periodic sampling in always-listening mode; a duty-cycled node refreshes in bursts
+// (adcRefreshPoll) so the timer does not keep waking it
+void adcTimerRun(bool on) {
+  if (!adcTimer) return;
+  esp_timer_stop(adcTimer);
+  if (on) esp_timer_start_periodic(adcTimer, ADC_TICK_MS * 1000ULL);
+}
+void adcRefreshPoll() {
+  if (wakeMs && adc.ageMs(millis()) >= ADC_LP_REFRESH_MS) adc.burst(adcReadPin, millis());
 }
 float adcToVoltage(int raw) { return ((float)raw / (float)ADC_MAX) * ADC_REF_VOLTAGE; }
 float readBatteryVoltage() {
@@ -160,61 +228,130 @@ float readSolarCurrent_mA() {
   float iA = (v_mV - vzero_mV) / sensitivity_mV_per_A;
   return iA * 1000.0f;
 }
-int moisturePercentFromRaw(int raw, int dryRaw = SOIL_DRY_RAW, int wetRaw = SOIL_WET_RAW) {
-  if (raw <= 0) return 0;
-  if (raw >= dryRaw) return 0;
-  if (raw <= wetRaw) return 100;
-  float pct = (float)(dryRaw - raw) / (float)(dryRaw - wetRaw) * 100.0f;
-  if (pct < 0) pct = 0; if (pct > 100) pct = 100;
-  return (int)round(pct);
+// Soil moisture of a valve's sensor through its calibration
+int moisturePercent(int vidx) {
+  if (vidx < 0 || vidx >= VALVE_COUNT || SOIL_SENSOR_PIN[vidx] < 0) return 0;
+  return soilCal[vidx].percent((uint16_t)readAdcRaw(SOIL_SENSOR_PIN[vidx]));
 }
 
 // -------------------- Telemetry builder --------------------
-// Now includes only the per-valve soil sensor (single sensor) when available.
+// Built from the ADC snapshot; shared by the binary TLV encoder and the ASCII fallback.
 // Soil field key: M{valve} e.g. M1=65
-String buildTelemetryExtra() {
-  String extra = "";
-  for (int i = 0; i < VALVE_COUNT; ++i) {
+void fillTelemetry(LoraTelemetry &t) {
+  loraTelemetryClear(t);
+  unsigned long now = millis();
+  for (int i = 0; i < VALVE_COUNT && i < LORA_MAX_VALVES; ++i) {
     if (VALVE_PINS[i] < 0) continue;
-    extra += String("VALVE") + String(i+1) + "=" + (valveOpen[i] ? "OPEN" : "CLOSED");
-    unsigned long vt = 0;
-    if (valveOpen[i] && valveOpenUntilMs[i] > millis()) vt = valveOpenUntilMs[i] - millis();
-    extra += String(",VT") + String(i+1) + "=" + String(vt);
-
+    t.valvePresent |= (1<<i);
+    if (valveOpen[i]) {
+      t.valveOpen |= (1<<i);
+      if (valveOpenUntilMs[i] > now) t.vtMs[i] = valveOpenUntilMs[i] - now;
+    }
     // single soil sensor per valve
     int sPin = SOIL_SENSOR_PIN[i];
-    if (sPin >= 0) {
-      int raw = readAdcRaw(sPin);
-      int perc = moisturePercentFromRaw(raw);
-      extra += String(",M") + String(i+1) + "=" + String(perc);
-    }
-    extra += String(",");
+    if (sPin >= 0) { t.moistPresent |= (1<<i); t.moist[i] = (uint8_t)moisturePercent(i); }
   }
-  if (extra.endsWith(",")) extra.remove(extra.length()-1);
-
   float battV = readBatteryVoltage();
-  float battPct = batteryPctFromVoltage(battV);
-  extra += String(",BATT=") + String((int)round(battPct)) + String(",BV=") + String(battV, 2);
-
+  t.battPct = (int16_t)round(batteryPctFromVoltage(battV));
+  t.bvMv = (uint16_t)round(battV * 1000.0f);
   float sVolt = (SOLAR_ADC_PIN >= 0) ? readSolarVoltage() : 0.0f;
-  extra += String(",SOLV=") + String(sVolt, 2);
+  t.solvMv = (uint16_t)round(sVolt * 1000.0f);
   float sCur = (SOLAR_CURRENT_PIN >= 0) ? readSolarCurrent_mA() : -1.0f;
-  if (sCur >= 0) extra += String(",SOLI=") + String((int)round(sCur));
-  return extra;
+  if (sCur >= 0) t.soliMa = (int32_t)round(sCur);
+  if (wakeMs) t.awakePm = (int16_t)pwr.awakePm();
 }
 
-// send periodic telemetry STAT message: "STAT|N=<node>|<telemetry...>"
-void sendPeriodicTelemetry() {
+String buildTelemetryExtra() {
+  LoraTelemetry t; fillTelemetry(t);
+  char buf[192]; loraTelemetryText(t, buf, sizeof(buf));
+  return String(buf);
+}
+
+// encode and send a binary frame (every frame advertises our wake cadence)
+void sendFrameRadio(const LoraFrame &frame) {
+  LoraFrame f = frame; f.wakeMs = (int32_t)wakeMs;
+  size_t n = loraEncode(f, (uint8_t *)txpacket, BUFFER_SIZE);
+  if (n == 0) { Serial.println("[Radio TX] frame too large"); return; }
+  Radio.Send((uint8_t *)txpacket, n);
+  char dbgText[200]; loraFrameToText(f, dbgText, sizeof(dbgText));
+  Serial.printf("[Radio TX bin %u B] %s\n", (unsigned)n, dbgText);
+}
+
+// Telemetry check: binary nodes send a delta / keyframe STAT when TeleDelta says so;
+// the ASCII fallback follows the same decisions but always sends the full block
+// ("STAT|N=<node>|<telemetry...>"). force: report now (button).
+void sendPeriodicTelemetry(bool force) {
+  LoraTelemetry cur; fillTelemetry(cur);
+  LoraFrame f; loraFrameClear(f);
+  bool due = teleDelta.poll(cur, millis(), force, f);
+  nextTeleCheckMs = millis() + teleDelta.intervalMs(cur);
+  if (!due) return;
+  if (useBinaryFrames) {
+    f.kind = LF_STAT; f.node = NODE_ID;
+    sendFrameRadio(f);
+    return;
+  }
   String extra = buildTelemetryExtra();
-  String msg = String("STAT|N=") + String(NODE_ID) + String("|") + extra;
+  String msg = String("STAT|N=") + String(NODE_ID) + String("|") + extra + String(",WAKE=") + String(wakeMs);
   sendLoRaPacketRadio(msg);
 }
 
 // -------------------- ACK builder --------------------
-void sendAck(uint32_t mid, const String &type, int node, const String &sched, int seqIndex, const String &extra = "") {
-  String kv = String("N=") + String(node) + String(",S=") + safeField(sched) + String(",I=") + String(seqIndex);
-  String msg = String("ACK|MID=") + String(mid) + String("|") + type + String("|") + kv + String("|OK");
-  if (extra.length()) msg += String("|") + extra;
+// Parsed command, independent of the wire format it arrived in
+struct NodeCmd {
+  bool binary;
+  uint32_t mid;
+  uint8_t code;          // LoraCmdCode
+  char type[16];         // original ASCII type (echoed for unknown commands)
+  int node;
+  char sched[32];
+  uint16_t schedHash;
+  int idx;
+  uint32_t tMs;
+  uint8_t targets;       // valve bitmask
+  bool group;            // arrived as a multicast
+  bool broadcast;        // node 0 without targets (TIME): nobody answers
+  uint32_t replyDelayMs; // multicast: our reply slot, counted from reception
+  int64_t epochMs;       // controller clock stamp (PLAN / TIME), 0 when absent
+  int64_t planT0Ms;
+  uint8_t planN;
+  LoraPlanWin plan[LORA_PLAN_MAX];
+};
+
+// Multicast ACK held until this node's slot comes up (sent from loop())
+struct DeferredAck { bool armed; NodeCmd c; uint8_t code; const char *note; unsigned long dueMs; };   // note: literals only
+DeferredAck deferredAck;
+
+// Replies in the same format the command arrived in. ASCII ACKs advertise FMT=B1
+// so the controller can switch this node to binary frames.
+void sendAck(const NodeCmd &c, uint8_t code, bool withTele, const char *note = "") {
+  if (c.replyDelayMs) {
+    deferredAck.armed = true; deferredAck.c = c; deferredAck.c.replyDelayMs = 0; deferredAck.code = code; deferredAck.note = note;
+    deferredAck.dueMs = millis() + c.replyDelayMs;
+    return;
+  }
+  bool err = strncmp(note, "ERR", 3) == 0;
+  if (c.binary) {
+    LoraFrame f; loraFrameClear(f);
+    f.kind = LF_ACK; f.code = code; f.status = err ? 1 : 0; f.caps = LORA_CAP_BIN1 | LORA_CAP_PLAN;
+    f.mid = c.mid; f.node = NODE_ID; f.schedHash = c.schedHash; f.idx = c.idx;
+    if (code == LC_SETID && !err) f.newId = NODE_ID;
+    if (withTele) {
+      f.hasTele = true; fillTelemetry(f.tele);
+      if (code == LC_OPEN || code == LC_CLOSE || code == LC_EMERGENCY) {
+        // valve state and the commanded valves' soil only; STATUS / PING keep the full block
+        f.hasMeta = true; f.teleFields = TF_VALVES | TF_MOIST;
+        if (code != LC_EMERGENCY && c.targets) f.tele.moistPresent &= c.targets;
+      }
+    }
+    sendFrameRadio(f);
+    return;
+  }
+  const char *type = (code == LC_UNKNOWN) ? c.type : loraCmdName(code);
+  String extra = withTele ? buildTelemetryExtra() : String(note);
+  String kv = String("N=") + String(NODE_ID) + String(",S=") + safeField(c.sched) + String(",I=") + String(c.idx);
+  String msg = String("ACK|MID=") + String(c.mid) + String("|") + type + String("|") + kv + String("|OK");
+  msg += String("|") + extra + (extra.length() ? ",FMT=B1" : "FMT=B1") + String(",WAKE=") + String(wakeMs);
   // send via Radio driver
   snprintf(txpacket, BUFFER_SIZE, "%s", msg.c_str());
   Radio.Send((uint8_t *)txpacket, strlen(txpacket));
@@ -222,90 +359,61 @@ void sendAck(uint32_t mid, const String &type, int node, const String &sched, in
 }
 
 // -------------------- CMD parsing --------------------
-// Robust parser: expects at least "CMD|MID=...|TYPE|kv..."
-bool parseCmd(const String &msg, uint32_t &outMid, String &outType, int &outN, String &outS, int &outI, uint32_t &outT, String &outVraw) {
-  outMid = 0; outType=""; outN=-1; outS=""; outI=-1; outT=0; outVraw="";
-  String s = msg; s.trim();
-  if (!s.startsWith("CMD|")) return false;
-  std::vector<String> parts;
-  int start = 0;
-  for (int i = 0; i < (int)s.length(); ++i) {
-    if (s[i] == '|') { parts.push_back(s.substring(start, i)); start = i + 1; }
-  }
-  parts.push_back(s.substring(start));
-  if (parts.size() < 4) return false;
-  String midPart = parts[1];
-  if (!midPart.startsWith("MID=")) return false;
-  outMid = (uint32_t)midPart.substring(4).toInt();
-  outType = parts[2];
-  // rebuild remaining KV part
-  String kv = parts[3];
-  for (size_t i = 4; i < parts.size(); ++i) kv += String("|") + parts[i];
-
-  int pos = 0;
-  while (pos < (int)kv.length()) {
-    int comma = kv.indexOf(',', pos);
-    String token = (comma == -1) ? kv.substring(pos) : kv.substring(pos, comma);
-    token.trim();
-    int eq = token.indexOf('=');
-    if (eq > 0) {
-      String k = token.substring(0, eq); String v = token.substring(eq+1);
-      k.trim(); v.trim();
-      if (k == "N") outN = v.toInt();
-      else if (k == "S") outS = v;
-      else if (k == "I") outI = v.toInt();
-      else if (k == "T") { unsigned long t = (unsigned long)v.toInt(); if (t>0 && t<=86400) t = t*1000UL; outT = t; }
-      else if (k == "V") outVraw = v;
-    }
-    if (comma == -1) break;
-    pos = comma + 1;
-  }
-  return true;
+// Zero-copy parser: expects at least "CMD|MID=...|TYPE|kv..."; spans point into msg.
+// T stays raw here -- its unit depends on the command (see decodeCmd).
+bool parseCmd(WireSpan msg, WireCmd &out) {
+  return wireParseFrame(msg, "CMD", out);
 }
 
-std::vector<int> parseValveSelector(const String &vraw) {
-  std::vector<int> res;
-  if (vraw.length() == 0) return res;
-  String s = vraw; s.trim(); s.toUpperCase();
-  if (s == "ALL") { for (int i=0;i<VALVE_COUNT;i++) if (VALVE_PINS[i]>=0) res.push_back(i); return res; }
-  int pos=0;
-  while (pos < (int)s.length()) {
-    int comma = s.indexOf(',', pos);
-    String token = (comma == -1) ? s.substring(pos) : s.substring(pos, comma);
-    token.trim();
+// Valve selector "1", "1,3", "2-4" or "ALL" -> bitmask of valve indexes (bit 0 = valve 1)
+uint8_t parseValveSelector(WireSpan vraw) {
+  uint8_t mask = 0;
+  vraw = vraw.trim();
+  if (vraw.empty()) return 0;
+  if (vraw.n == 3 && toupper((unsigned char)vraw.p[0]) == 'A' && toupper((unsigned char)vraw.p[1]) == 'L' && toupper((unsigned char)vraw.p[2]) == 'L') {
+    for (int i=0;i<VALVE_COUNT;i++) if (VALVE_PINS[i]>=0) mask |= (1<<i);
+    return mask;
+  }
+  WireSpan rest = vraw;
+  while (rest.n) {
+    int comma = rest.indexOf(',');
+    WireSpan token = (comma < 0 ? rest : rest.sub(0, comma)).trim();
     int dash = token.indexOf('-');
-    if (dash == -1) {
-      int v = token.toInt(); if (v>=1 && v<=VALVE_COUNT && VALVE_PINS[v-1]>=0) res.push_back(v-1);
+    if (dash < 0) {
+      int v = (int)token.toLong(); if (v>=1 && v<=VALVE_COUNT && VALVE_PINS[v-1]>=0) mask |= (1<<(v-1));
     } else {
-      int a = token.substring(0,dash).toInt(); int b = token.substring(dash+1).toInt();
+      int a = (int)token.sub(0,dash).toLong(); int b = (int)token.sub(dash+1).toLong();
       if (a<1) a=1; if (b>VALVE_COUNT) b=VALVE_COUNT;
-      for (int k=a;k<=b;++k) if (VALVE_PINS[k-1]>=0) res.push_back(k-1);
+      for (int k=a;k<=b;++k) if (VALVE_PINS[k-1]>=0) mask |= (1<<(k-1));
     }
-    if (comma == -1) break;
-    pos = comma + 1;
+    if (comma < 0) break;
+    rest = rest.sub(comma + 1);
   }
-  // dedupe
-  std::vector<int> uniq;
-  for (int x: res) { bool f=false; for (int y: uniq) if (x==y) {f=true; break;} if(!f) uniq.push_back(x); }
-  return uniq;
+  return mask;
 }
 
 // -------------------- RADIO: OnTx/OnRx handlers --------------------
+// Back to receive: continuous, or the SX126x RX duty cycle in low-power mode
+// (window / sleep in 15.625 us RTC steps; the controller's long preamble spans the sleep)
+void radioListen() {
+  if (!wakeMs) { Radio.Rx(0); return; }
+  Radio.SetRxDutyCycle((uint32_t)NODE_RX_WINDOW_MS * 64, (wakeMs - NODE_RX_WINDOW_MS) * 64);
+}
 void OnTxDone(void) {
   Serial.println("[Radio] TX done");
-  Radio.Rx(0);
+  radioListen();
 }
 void OnTxTimeout(void) {
   Serial.println("[Radio] TX timeout");
-  Radio.Rx(0);
+  radioListen();
 }
 void OnRxDone(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr) {
   if (size >= (int)sizeof(rxpacket)) size = sizeof(rxpacket)-1;
   memcpy(rxpacket, payload, size);
   rxpacket[size] = '\0';
-  Serial.printf("[Radio] RX %d bytes RSSI=%d SNR=%d => %s\n", size, rssi, snr, rxpacket);
+  Serial.printf("[Radio] RX %d bytes RSSI=%d SNR=%d => %s\n", size, rssi, snr, loraIsBinary((uint8_t *)rxpacket, size) ? "(binary)" : rxpacket);
   handleRadioPayload(rxpacket, size);
-  Radio.Rx(0);
+  radioListen();
 }
 
 // send using Radio.Send (non-blocking)
@@ -315,73 +423,186 @@ void sendLoRaPacketRadio(const String &msg) {
   Serial.printf("[Radio TX] %s\n", txpacket);
 }
 
-// process radio payload (string)
+// decode either wire format into a NodeCmd
+bool decodeCmd(const char *payload, uint16_t size, NodeCmd &c) {
+  memset(&c, 0, sizeof(c)); c.node = -1; c.idx = -1;
+  if (loraIsBinary((const uint8_t *)payload, size)) {
+    LoraFrame f;
+    if (!loraDecode((const uint8_t *)payload, size, f) || f.kind != LF_CMD) return false;
+    c.binary = true; c.mid = f.mid; c.code = f.code; snprintf(c.type, sizeof(c.type), "%s", loraCmdName(f.code));
+    c.node = (int)f.node; c.schedHash = f.schedHash; c.idx = f.idx; c.tMs = f.durMs;
+    c.epochMs = f.epochMs; c.planT0Ms = f.planT0Ms; c.planN = f.planN; memcpy(c.plan, f.plan, sizeof(c.plan));
+    if (f.node == LORA_NODE_GROUP && !f.targets.nbytes) { c.broadcast = true; c.node = -1; }
+    if (f.node == LORA_NODE_GROUP && f.targets.nbytes) {
+      // multicast: answer in slot <rank among the targets>, or ignore it if we are not addressed
+      int rank = f.targets.rank(NODE_ID);
+      c.group = true; c.node = rank < 0 ? -2 : NODE_ID;
+      if (rank >= 0) c.replyDelayMs = LORA_SLOT_GUARD_MS + (uint32_t)rank * f.slotMs;
+    }
+    c.targets = f.valveSel;
+    for (int i = 0; i < VALVE_COUNT; ++i) if (VALVE_PINS[i] < 0) c.targets &= ~(1<<i);
+    snprintf(c.sched, sizeof(c.sched), "#%04X", f.schedHash);
+    return true;
+  }
+  WireSpan msg = wireSpan(payload, size).trim();
+  WireCmd cmd;
+  if (!parseCmd(msg, cmd)) return false;
+  c.mid = cmd.mid; c.node = cmd.node; c.idx = cmd.idx; c.tMs = cmd.t;
+  cmd.type.copyTo(c.type, sizeof(c.type));
+  cmd.sched.copyTo(c.sched, sizeof(c.sched));
+  c.schedHash = loraSchedHash(cmd.sched.p, cmd.sched.n);
+  c.targets = parseValveSelector(cmd.v);
+  c.code = loraCmdFromName(cmd.type);
+  // T is seconds when small (<= 1 day), otherwise already milliseconds; POWER's T is always ms, CAL's a point
+  if (c.code != LC_POWER && c.code != LC_CAL && c.tMs > 0 && c.tMs <= 86400) c.tMs = c.tMs * 1000UL;
+  if (cmd.type.eq("DETAIL") || cmd.type.eq("INFO")) c.code = LC_STATUS;
+  else if (cmd.type.eq("FORCE_CLOSE")) c.code = LC_EMERGENCY;
+  else if (cmd.type.eq("PINGREQ")) c.code = LC_PING;
+  return true;
+}
+
+// process radio payload (parsed in place, no String copies)
 void handleRadioPayload(const char *payload, uint16_t size) {
-  String msg = String(payload);
-  msg.trim();
-  if (msg.length() == 0) return;
-  Serial.println(String("[RADIO PAYLOAD] ") + msg);
-
-  uint32_t mid=0; String type; int n=-1; String sched=""; int idx=-1; uint32_t t_ms=0; String vraw="";
-  if (parseCmd(msg, mid, type, n, sched, idx, t_ms, vraw)) {
-    Serial.printf("Parsed CMD MID=%u TYPE=%s N=%d V=%s S=%s I=%d T=%lu\n", (unsigned)mid, type.c_str(), n, vraw.c_str(), sched.c_str(), idx, (unsigned long)t_ms);
-    if (n == NODE_ID || n == -1) {
-      lastCmdMid = mid; lastSchedId = sched; lastSeqIndex = idx;
-      std::vector<int> targets = parseValveSelector(vraw);
-      if (targets.size() == 0 && VALVE_PINS[0] >= 0) targets.push_back(0);
-      if (type == "OPEN") {
-        for (int vidx : targets) {
-          setValveState(vidx, true);
-          if (t_ms > 0) valveOpenUntilMs[vidx] = millis() + t_ms; else valveOpenUntilMs[vidx] = 0;
-        }
-        // reply ACK including that valve's soil data (if present) via buildTelemetryExtra()
-        sendAck(mid, "OPEN", NODE_ID, sched, idx, buildTelemetryExtra());
-      } else if (type == "CLOSE") {
-        for (int vidx : targets) {
-          setValveState(vidx, false);
-          valveOpenUntilMs[vidx] = 0;
-        }
-        sendAck(mid, "CLOSE", NODE_ID, sched, idx, buildTelemetryExtra());
-      } else if (type == "STATUS" || type == "DETAIL" || type == "INFO") {
-        String tele = buildTelemetryExtra();
-        sendAck(mid, "STATUS", NODE_ID, sched, idx, tele);
-      }  // new: emergency immediate close command (no delays)
-      else if (type == "EMERGENCY" || type == "FORCE_CLOSE") {
-        // close all valves immediately and clear timers
-        for (int v=0; v<VALVE_COUNT; ++v) {
-          if (VALVE_PINS[v] >= 0) {
-            setValveState(v, false);
-            valveOpenUntilMs[v] = 0;
-          }
-        }
-        // persist last known state if you want (not necessary)
-        sendAck(mid, "EMERGENCY", NODE_ID, sched, idx, buildTelemetryExtra());
+  if (size == 0) return;
+  NodeCmd c;
+  if (!decodeCmd(payload, size, c)) {
+    Serial.println("Radio payload not recognized as CMD.");
+    return;
+  }
+  Serial.printf("Parsed CMD%s MID=%u TYPE=%s N=%d S=%s I=%d T=%lu V=0x%02X\n", c.binary ? "(bin)" : "", (unsigned)c.mid, c.type, c.node, c.sched, c.idx, (unsigned long)c.tMs, c.targets);
+  if (!(c.node == NODE_ID || c.node == -1)) {
+    if (c.group) Serial.printf("Multicast %s not addressed to node %d\n", c.type, NODE_ID);
+    else Serial.printf("CMD for node %d ignoring (this node=%d)\n", c.node, NODE_ID);
+    return;
+  }
+  if (c.binary && !useBinaryFrames) { useBinaryFrames = true; teleDelta.keyWanted = true; }   // deltas start from a binary keyframe
+  if (c.epochMs) {
+    epochClock.sync(c.epochMs, millis());
+    Serial.printf("Clock sync #%lu, step %ld ms\n", (unsigned long)epochClock.syncs, (long)epochClock.lastStepMs);
+  }
+  if (c.broadcast) { if (c.code != LC_TIMESYNC) Serial.printf("Broadcast %s ignored\n", c.type); return; }
+  // a live OPEN / CLOSE for one of the plan's steps only settles that window; anything else overrides the plan
+  if (plan.active() && (c.code == LC_OPEN || c.code == LC_CLOSE || c.code == LC_EMERGENCY) &&
+      (c.code == LC_EMERGENCY || !plan.mark(c.schedHash, c.idx, c.code == LC_OPEN))) {
+    Serial.printf("%s overrides the local plan\n", c.type);
+    plan.cancel();
+  }
+  if (c.group && (c.code == LC_SETID || c.code == LC_POWER || c.code == LC_CAL)) { Serial.printf("%s ignored in a multicast\n", c.type); return; }
+  lastCmdMid = c.mid; lastSchedId = c.sched; lastSchedHash = c.schedHash; lastSeqIndex = c.idx;
+  uint8_t targets = c.targets;
+  if (targets == 0 && VALVE_PINS[0] >= 0) targets = 1;
+  switch (c.code) {
+    case LC_OPEN:
+      for (int vidx = 0; vidx < VALVE_COUNT; ++vidx) {
+        if (!(targets & (1<<vidx))) continue;
+        setValveState(vidx, true);
+        if (c.tMs > 0) valveOpenUntilMs[vidx] = millis() + c.tMs; else valveOpenUntilMs[vidx] = 0;
       }
-      // new: a simple ping/health check
-      else if (type == "PING" || type == "PINGREQ") {
-        sendAck(mid, "PONG", NODE_ID, sched, idx, buildTelemetryExtra());
+      // reply ACK including that valve's soil data (if present)
+      sendAck(c, LC_OPEN, true);
+      break;
+    case LC_CLOSE:
+      for (int vidx = 0; vidx < VALVE_COUNT; ++vidx) {
+        if (!(targets & (1<<vidx))) continue;
+        setValveState(vidx, false);
+        valveOpenUntilMs[vidx] = 0;
       }
-      // new: allow remote set of node id -> CMD|MID=...|SETID|N=<newid>
-      else if (type == "SETID") {
-        // outN already parsed from KV; if outN valid and not zero
-        if (n > 0) {
-          NODE_ID = n;
-          prefs.putInt("node_id", NODE_ID);
-          Serial.printf("SETID: persisted new NODE_ID=%d\n", NODE_ID);
-          sendAck(mid, "SETID", NODE_ID, sched, idx, String("NEWID=")+String(NODE_ID));
-        } else {
-          sendAck(mid, "SETID", NODE_ID, sched, idx, "ERR_BAD_ID");
+      sendAck(c, LC_CLOSE, true);
+      break;
+    case LC_STATUS:
+      sendAck(c, LC_STATUS, true);
+      break;
+    case LC_EMERGENCY:
+      // emergency immediate close command (no delays): close all valves and clear timers
+      for (int v=0; v<VALVE_COUNT; ++v) {
+        if (VALVE_PINS[v] >= 0) {
+          setValveState(v, false);
+          valveOpenUntilMs[v] = 0;
         }
       }
-      else {
-        sendAck(mid, type, NODE_ID, sched, idx, "ERR_UNKNOWN");
+      sendAck(c, LC_EMERGENCY, true);
+      break;
+    case LC_PING:
+      // simple ping/health check
+      sendAck(c, LC_PONG, true);
+      break;
+    case LC_SETID:
+      // allow remote set of node id -> CMD|MID=...|SETID|N=<newid>
+      if (c.node > 0) {
+        NODE_ID = c.node;
+        prefs.putInt("node_id", NODE_ID);
+        Serial.printf("SETID: persisted new NODE_ID=%d\n", NODE_ID);
+        char note[24]; snprintf(note, sizeof(note), "NEWID=%d", NODE_ID);
+        sendAck(c, LC_SETID, false, note);
+      } else {
+        sendAck(c, LC_SETID, false, "ERR_BAD_ID");
       }
-    } else {
-      Serial.printf("CMD for node %d ignoring (this node=%d)\n", n, NODE_ID);
+      break;
+    case LC_POWER:
+      // CMD|MID=...|POWER|N=<id>,T=<wake ms>; the ACK goes out in the old mode, TxDone re-arms RX in the new one
+      setWakeMs(c.tMs);
+      sendAck(c, LC_POWER, false);
+      break;
+    case LC_PLAN: {
+      // CMD PLAN (binary only): this node's windows of a schedule run, T0 on the controller's clock
+      if (!epochClock.valid) { sendAck(c, LC_PLAN, false, "ERR_NO_CLOCK"); break; }
+      plan.load(c.schedHash, c.planT0Ms, c.plan, c.planN);
+      Serial.printf("Plan %s: %u window(s), first in %ld ms\n", c.sched, plan.n, (long)plan.untilNext(epochClock.now(millis())));
+      static char note[12]; snprintf(note, sizeof(note), "PLAN=%u", plan.n);
+      sendAck(c, LC_PLAN, false, note);
+      break;
     }
-  } else {
-    Serial.println("Radio payload not recognized as CMD.");
+    case LC_CAL: {
+      // CMD|MID=...|CAL|N=<id>,I=<valve>,T=<1 dry | 2 wet | 0 defaults>: the current
+      // filtered reading of that valve's sensor becomes the calibration point
+      int v = c.idx - 1;
+      if (v < 0 || v >= VALVE_COUNT || SOIL_SENSOR_PIN[v] < 0) { sendAck(c, LC_CAL, false, "ERR_NO_SENSOR"); break; }
+      if (c.tMs > 2) { sendAck(c, LC_CAL, false, "ERR_BAD_POINT"); break; }
+      SoilCal k = soilCal[v]; uint16_t raw = (uint16_t)readAdcRaw(SOIL_SENSOR_PIN[v]);
+      if (c.tMs == 0) { k.dry = SOIL_DRY_RAW; k.wet = SOIL_WET_RAW; }
+      else if (c.tMs == 1) k.dry = raw; else k.wet = raw;
+      if (!k.valid()) { sendAck(c, LC_CAL, false, "ERR_SAME_POINT"); break; }
+      soilCal[v] = k;
+      char key[8]; snprintf(key, sizeof(key), "cal%d", v + 1); prefs.putUInt(key, k.pack());
+      static char note[32]; snprintf(note, sizeof(note), "CAL%d=%u:%u", v + 1, k.dry, k.wet);
+      Serial.printf("Soil calibration valve %d: dry=%u wet=%u\n", v + 1, k.dry, k.wet);
+      sendAck(c, LC_CAL, false, note);
+      break;
+    }
+    default:
+      sendAck(c, LC_UNKNOWN, false, "ERR_UNKNOWN");
+      break;
+  }
+}
+
+// -------------------- Local plan --------------------
+// Opens a window's valves with the valve timer set to its end and reports AUTO_OPENED;
+// the auto-close in loop() reports AUTO_CLOSED for the same step.
+struct PlanValves {
+  void open(uint8_t w, uint32_t keepMs) {
+    const LoraPlanWin &pw = plan.w[w];
+    uint8_t targets = pw.valves; if (targets == 0 && VALVE_PINS[0] >= 0) targets = 1;
+    for (int v = 0; v < VALVE_COUNT; ++v) {
+      if (!(targets & (1<<v)) || VALVE_PINS[v] < 0) continue;
+      setValveState(v, true);
+      valveOpenUntilMs[v] = millis() + keepMs;
+    }
+    lastSchedHash = plan.schedHash; lastSeqIndex = pw.idx;
+    char id[8]; snprintf(id, sizeof(id), "#%04X", plan.schedHash); lastSchedId = id;
+    Serial.printf("Plan step %u open for %lu ms\n", pw.idx, (unsigned long)keepMs);
+    LoraFrame f; loraFrameClear(f);
+    f.kind = LF_AUTO_OPENED; f.node = NODE_ID; f.schedHash = plan.schedHash; f.idx = pw.idx;
+    f.hasTele = true; fillTelemetry(f.tele);
+    f.tele.moistPresent &= targets;
+    f.hasMeta = true; f.teleFields = TF_VALVES | TF_MOIST;
+    sendFrameRadio(f);
+    lastDisplayMs = 0;
   }
+};
+void planPoll() {
+  if (!epochClock.valid) return;
+  PlanValves pv;
+  plan.poll(epochClock.now(millis()), pv);
 }
 
 // -------------------- Display (Heltec) --------------------
@@ -409,8 +630,18 @@ String formatTimeShort() {
   return String(buf);
 }
 
+// Low-power mode keeps the panel (and its Vext rail) off unless the button woke it
+void displaySetOn(bool on) {
+  if (on == displayOn) return;
+  displayOn = on;
+  if (on) { VextON(); delay(20); display.init(); display.setFont(ArialMT_Plain_10); lastDisplayMs = 0; }
+  else { display.displayOff(); VextOFF(); }
+}
+
 void displayLoop() {
   unsigned long nowMs = millis();
+  if (wakeMs && displayOn && (long)(nowMs - displayOffAtMs) >= 0) displaySetOn(false);
+  if (!displayOn) return;
   if (nowMs - lastDisplayMs < DISPLAY_REFRESH_MS) return;
   lastDisplayMs = nowMs;
 
@@ -481,11 +712,80 @@ void loraInit() {
                     LORA_SYMBOL_TIMEOUT, LORA_FIX_LENGTH_PAYLOAD_ON,
                     0, true, 0, 0, LORA_IQ_INVERSION_ON, true);
 
-  Radio.Rx(0);
+  radioListen();
 
   Serial.println("Heltec Radio LoRa init OK (Node)");
 }
 
+// -------------------- Power (duty cycle / light sleep) --------------------
+// radio.c: set by the DIO1 edge ISR, consumed by Radio.IrqProcess(). An IRQ that woke us
+// from light sleep raised DIO1 while edge detection was off, so it is re-flagged by hand.
+extern "C" { extern volatile bool IrqFired; }
+
+void setWakeMs(uint32_t ms) {
+  if (ms > NODE_WAKE_MAX_MS) ms = NODE_WAKE_MAX_MS;
+  if (ms && ms < 4 * NODE_RX_WINDOW_MS) ms = 4 * NODE_RX_WINDOW_MS;
+  if (ms != wakeMs) { wakeMs = ms; prefs.putUInt("wake_ms", wakeMs); pwr.reset(); awakeSinceUs = micros(); lastPowerReportMs = millis(); }
+  Serial.printf("Power mode: %s (wake %lu ms)\n", wakeMs ? "duty-cycled" : "always listening", (unsigned long)wakeMs);
+  if (wakeMs) displayOffAtMs = millis() + DISPLAY_AWAKE_MS; else displaySetOn(true);
+  adcTimerRun(!wakeMs);
+}
+
+// Time until loop() has something to do on its own: valve deadline, deferred ACK,
+// telemetry, ADC refresh or the power report
+uint32_t msUntilNextEvent() {
+  unsigned long now = millis();
+  long next = (long)(nextTeleCheckMs - now);
+  auto earlier = [&next](long d) { if (d < next) next = d; };
+  for (int i=0;i<VALVE_COUNT;i++) if (VALVE_PINS[i] >= 0 && valveOpen[i] && valveOpenUntilMs[i] > 0) earlier((long)(valveOpenUntilMs[i] - now));
+  if (deferredAck.armed) earlier((long)(deferredAck.dueMs - now));
+  earlier((long)(ADC_LP_REFRESH_MS - adc.ageMs(now)));
+  earlier((long)(lastPowerReportMs + POWER_REPORT_MS - now));
+  int64_t planIn = plan.n ? plan.untilNext(epochClock.now(now)) : -1;
+  if (planIn >= 0) earlier(planIn > 0x7FFFFFFF ? 0x7FFFFFFF : (long)planIn);
+  return next < 0 ? 0 : (uint32_t)next;
+}
+
+// Light sleep until the next event (RTC timer), a radio IRQ (DIO1 high) or the button.
+// millis() keeps counting across light sleep, so valve timers stay exact; the valve
+// outputs are latched while asleep.
+void powerSleep() {
+  uint32_t ms = msUntilNextEvent();
+  if (ms < 5 || digitalRead(LORA_DIO1) == HIGH) return;
+  unsigned long t0 = micros();
+  pwr.awake(t0 - awakeSinceUs);
+  for (int i=0;i<VALVE_COUNT;i++) if (VALVE_PINS[i] >= 0) gpio_hold_en((gpio_num_t)VALVE_PINS[i]);
+  Serial.flush();
+  gpio_intr_disable((gpio_num_t)LORA_DIO1); gpio_intr_disable((gpio_num_t)BUTTON_PIN);
+  gpio_wakeup_enable((gpio_num_t)LORA_DIO1, GPIO_INTR_HIGH_LEVEL);
+  gpio_wakeup_enable((gpio_num_t)BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+  esp_light_sleep_start();
+  awakeSinceUs = micros();
+  pwr.slept(awakeSinceUs - t0);
+  // back to the edge interrupts the radio driver and buttonISR were attached with
+  gpio_wakeup_disable((gpio_num_t)LORA_DIO1); gpio_wakeup_disable((gpio_num_t)BUTTON_PIN);
+  gpio_set_intr_type((gpio_num_t)LORA_DIO1, GPIO_INTR_POSEDGE); gpio_set_intr_type((gpio_num_t)BUTTON_PIN, GPIO_INTR_NEGEDGE);
+  gpio_intr_enable((gpio_num_t)LORA_DIO1); gpio_intr_enable((gpio_num_t)BUTTON_PIN);
+  for (int i=0;i<VALVE_COUNT;i++) if (VALVE_PINS[i] >= 0) gpio_hold_dis((gpio_num_t)VALVE_PINS[i]);
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) pwr.wakeTimer++;
+  else if (digitalRead(BUTTON_PIN) == LOW) { pwr.wakeButton++; lastButtonMs = millis(); buttonPressed = true; }
+  else pwr.wakeRadio++;
+  if (digitalRead(LORA_DIO1) == HIGH) IrqFired = true;
+}
+
+// Hourly "[Power] T=..,AWAKE=..%,AVG_UA=.." line (estimate, see NODE_I_* in node_power.h)
+void powerReportPoll() {
+  if (millis() - lastPowerReportMs < POWER_REPORT_MS) return;
+  lastPowerReportMs = millis();
+  if (!wakeMs) return;
+  pwr.awake(micros() - awakeSinceUs); awakeSinceUs = micros();
+  char buf[160]; pwr.text(nodeRxPm(wakeMs), buf, sizeof(buf));
+  Serial.printf("[Power] %s\n", buf);
+  pwr.reset();
+}
+
 // -------------------- Setup / Loop --------------------
 void setup() {
   Serial.begin(115200);
@@ -494,6 +794,7 @@ void setup() {
   prefs.begin("nodecfg", false);
   NODE_ID = prefs.getInt("node_id", DEFAULT_NODE_ID);
   Serial.printf("Node ID = %d\n", NODE_ID);
+  wakeMs = prefs.getUInt("wake_ms", 0);
 
   // initialize valve pins (closed)
   for (int i=0;i<VALVE_COUNT;i++) {
@@ -509,6 +810,7 @@ void setup() {
   }
 
   analogReadResolution(12);
+  adcInit();
 
   // button
   pinMode(BUTTON_PIN, INPUT_PULLUP);
@@ -519,25 +821,38 @@ void setup() {
 
   // LoRa using radio driver
   loraInit();
+  setWakeMs(wakeMs);                // display goes dark after DISPLAY_AWAKE_MS; starts the ADC timer when always listening
+  awakeSinceUs = micros();
 
   Serial.println("Node setup complete.");
 }
 
 void loop() {
-  // Manual button toggles valve1 for quick test
+  adcRefreshPoll();          // low-power mode: snapshot is refreshed before anything reads it
+  Radio.IrqProcess();        // dispatches OnTxDone/OnRxDone
+  if (deferredAck.armed && (long)(millis() - deferredAck.dueMs) >= 0) {
+    deferredAck.armed = false;
+    sendAck(deferredAck.c, deferredAck.code, deferredAck.note[0] == 0, deferredAck.note);
+  }
+  // Manual button toggles valve1 for quick test; in low-power mode a press on the
+  // dark display only lights it up
   if (buttonPressed) {
     buttonPressed = false;
-    if (VALVE_PINS[0] >= 0) {
+    bool wasDark = !displayOn;
+    if (wakeMs) { displaySetOn(true); displayOffAtMs = millis() + DISPLAY_AWAKE_MS; }
+    if (!wasDark && VALVE_PINS[0] >= 0) {
       setValveState(0, !valveOpen[0]);
       valveOpenUntilMs[0] = 0;
-      String extra = buildTelemetryExtra();
       // send STAT via Radio
-      sendLoRaPacketRadio(String("STAT|N=") + String(NODE_ID) + String("|") + extra);
+      sendPeriodicTelemetry(true);
       // force display update
       lastDisplayMs = 0;
     }
   }
 
+  // Local plan: open due windows (closed by the valve timers below)
+  if (plan.n) planPoll();
+
   // Auto-close per valve timers
   unsigned long now = millis();
   for (int i=0;i<VALVE_COUNT;i++) {
@@ -546,29 +861,35 @@ void loop() {
       setValveState(i, false);
       valveOpenUntilMs[i] = 0;
       // notify controller of auto-close (no MID)
-      String extra = String("AUTO_CLOSED|N=") + String(NODE_ID) + String("|S=") + safeField(lastSchedId) + String(",I=") + String(lastSeqIndex);
-      extra += String(",VALVE") + String(i+1) + "=CLOSED";
-      float battV = readBatteryVoltage();
-      extra += String(",BATT=") + String((int)round(batteryPctFromVoltage(battV))) + String(",BV=") + String(battV,2);
-
-      // include ONLY the soil sensor for this valve if present
-      int sPin = SOIL_SENSOR_PIN[i];
-      if (sPin >= 0) {
-        int raw = readAdcRaw(sPin);
-        extra += String(",M") + String(i+1) + "=" + String(moisturePercentFromRaw(raw));
+      if (useBinaryFrames) {
+        LoraFrame f; loraFrameClear(f);
+        f.kind = LF_AUTO_CLOSED; f.node = NODE_ID; f.schedHash = lastSchedHash; f.idx = lastSeqIndex;
+        f.hasTele = true; fillTelemetry(f.tele);
+        // include ONLY this valve and its soil sensor (partial: the rest is unchanged)
+        f.tele.valvePresent = (1<<i); f.tele.valveOpen = 0; f.tele.moistPresent &= (1<<i);
+        f.hasMeta = true; f.teleFields = TF_VALVES | TF_MOIST;
+        sendFrameRadio(f);
+      } else {
+        String extra = String("AUTO_CLOSED|N=") + String(NODE_ID) + String("|S=") + safeField(lastSchedId) + String(",I=") + String(lastSeqIndex);
+        extra += String(",VALVE") + String(i+1) + "=CLOSED";
+        float battV = readBatteryVoltage();
+        extra += String(",BATT=") + String((int)round(batteryPctFromVoltage(battV))) + String(",BV=") + String(battV,2);
+
+        // include ONLY the soil sensor for this valve if present
+        int sPin = SOIL_SENSOR_PIN[i];
+        if (sPin >= 0) extra += String(",M") + String(i+1) + "=" + String(moisturePercent(i));
+
+        sendLoRaPacketRadio(extra);
       }
-
-      sendLoRaPacketRadio(extra);
       // refresh display
       lastDisplayMs = 0;
     }
   }
   // periodic telemetry
-  if (millis() - lastTelemetryMs >= TELEMETRY_INTERVAL_MS) {
-    lastTelemetryMs = millis();
-    sendPeriodicTelemetry();
-  }
+  if ((long)(millis() - nextTeleCheckMs) >= 0) sendPeriodicTelemetry(false);
 
   displayLoop();
-  delay(10);
+  powerReportPoll();
+  if (wakeMs && !displayOn && !buttonPressed) powerSleep();
+  else delay(10);
 }
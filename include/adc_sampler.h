@@ -0,0 +1,95 @@
+#pragma once
+// Background ADC sampling for nodes.
+// Every channel (soil sensors, battery, solar) is read once per tick from a periodic
+// timer; after ADC_MEDIAN ticks the window's median rejects spikes, an EMA
+// (weight 1 / 2^ADC_EMA_SHIFT) smooths what is left and the result is published as
+// a snapshot. Readers (ACK / telemetry builders) only copy the last snapshot, so
+// no ADC conversion ever runs in the radio round trip.
+// Snapshots are double-buffered: tick() fills the back buffer and flips `cur`, so a
+// reader on another task sees a complete set as long as it copies faster than one
+// filter period.
+// SoilCal holds the per-channel dry / wet raw points (either direction: capacitive
+// probes read high when dry, resistive ones low).
+// Pure C++, header-only; the ADC read is a template callback (int read(int pin)).
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef ADC_CHANNELS_MAX
+#define ADC_CHANNELS_MAX 8
+#endif
+#ifndef ADC_MEDIAN
+#define ADC_MEDIAN 5             // samples per filter window (odd)
+#endif
+#ifndef ADC_EMA_SHIFT
+#define ADC_EMA_SHIFT 2          // EMA weight 1/4 per window
+#endif
+
+struct AdcSnapshot {
+  uint16_t raw[ADC_CHANNELS_MAX];  // filtered raw counts per channel
+  uint32_t seq;                    // windows published so far (0 = nothing yet)
+  uint32_t atMs;
+};
+
+struct AdcSampler {
+  int16_t pin[ADC_CHANNELS_MAX];
+  uint8_t n = 0;
+  uint16_t win[ADC_CHANNELS_MAX][ADC_MEDIAN];
+  uint8_t fill = 0;
+  uint32_t ema[ADC_CHANNELS_MAX];  // value << 8
+  AdcSnapshot snap[2];
+  volatile uint8_t cur = 0;
+  uint32_t ticks = 0;
+
+  // Channel index for `pin`, -1 for an unused pin (< 0) or a full table
+  int add(int p) {
+    if (p < 0 || n >= ADC_CHANNELS_MAX) return -1;
+    for (uint8_t i = 0; i < n; ++i) if (pin[i] == p) return i;
+    pin[n] = (int16_t)p; return n++;
+  }
+  template <class Read>
+  void tick(Read read, uint32_t nowMs) {
+    for (uint8_t c = 0; c < n; ++c) win[c][fill] = (uint16_t)read(pin[c]);
+    ticks++;
+    if (++fill < ADC_MEDIAN) return;
+    fill = 0;
+    AdcSnapshot &s = snap[cur ^ 1];
+    uint32_t seq = snap[cur].seq;
+    for (uint8_t c = 0; c < n; ++c) {
+      uint32_t m = (uint32_t)median(win[c]) << 8;
+      ema[c] = seq ? ema[c] + (int32_t)(m - ema[c]) / (1 << ADC_EMA_SHIFT) : m;
+      s.raw[c] = (uint16_t)((ema[c] + 128) >> 8);
+    }
+    s.seq = seq + 1; s.atMs = nowMs;
+    cur ^= 1;
+  }
+  // One full window at once (wake-up refresh when no timer ran)
+  template <class Read>
+  void burst(Read read, uint32_t nowMs) { fill = 0; for (uint8_t k = 0; k < ADC_MEDIAN; ++k) tick(read, nowMs); }
+
+  const AdcSnapshot &snapshot() const { return snap[cur]; }
+  uint16_t raw(int ch) const { return ch >= 0 && ch < n ? snap[cur].raw[ch] : 0; }
+  uint16_t rawForPin(int p) const { for (uint8_t i = 0; i < n; ++i) if (pin[i] == p) return snap[cur].raw[i]; return 0; }
+  uint32_t ageMs(uint32_t nowMs) const { return snap[cur].seq ? nowMs - snap[cur].atMs : 0xFFFFFFFFu; }
+
+  static uint16_t median(const uint16_t *w) {
+    uint16_t s[ADC_MEDIAN]; memcpy(s, w, sizeof(s));
+    for (uint8_t i = 1; i < ADC_MEDIAN; ++i) { uint16_t v = s[i]; int8_t j = (int8_t)i - 1; while (j >= 0 && s[j] > v) { s[j + 1] = s[j]; j--; } s[j + 1] = v; }
+    return s[ADC_MEDIAN / 2];
+  }
+};
+
+struct SoilCal {
+  uint16_t dry, wet;
+
+  bool valid() const { return dry != wet; }
+  uint32_t pack() const { return ((uint32_t)dry << 16) | wet; }
+  static SoilCal unpack(uint32_t v) { SoilCal c; c.dry = (uint16_t)(v >> 16); c.wet = (uint16_t)v; return c; }
+  // Percent between the two points, clamped to 0..100; 0 for a missing reading
+  uint8_t percent(uint16_t raw) const {
+    if (raw == 0 || !valid()) return 0;
+    int32_t span = (int32_t)wet - (int32_t)dry, pos = (int32_t)raw - (int32_t)dry;
+    int32_t pct = (pos * 100 + span / 2) / span;
+    return (uint8_t)(pct < 0 ? 0 : pct > 100 ? 100 : pct);
+  }
+};
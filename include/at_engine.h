@@ -0,0 +1,229 @@
+#pragma once
+// Response-terminated AT command engine for the EC200U (any 3GPP modem really).
+// - Commands are queued and sent one at a time; each completes on its final
+//   result code (OK / ERROR / +CME ERROR / +CMS ERROR), on an expected URC
+//   (e.g. "+QMTPUB:" for publish results) or on timeout -- never by spinning
+//   for the full timeout.
+// - "> " prompts are answered with the queued body + Ctrl-Z (AT+CMGS), or with a
+//   caller-owned payload of a stated length, sent verbatim (AT+QMTPUBEX).
+// - Unsolicited result codes (+QMTRECV, +CMTI, +QMTSTAT, ...) are demultiplexed
+//   to registered handlers whether or not a command is in flight.
+// - Line framing runs over a fixed byte ring; lines are handed out as WireSpans
+//   into the ring (a line that wraps is copied once into a scratch buffer).
+// Pure C++, header-only: the sketch supplies the UART writer and the clock.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "wire_proto.h"
+
+#ifndef AT_RX_RING
+#define AT_RX_RING 2048     // raw UART bytes not yet framed
+#endif
+#ifndef AT_LINE_MAX
+#define AT_LINE_MAX 512     // longest line we hand out in one piece
+#endif
+#ifndef AT_QUEUE_LEN
+#define AT_QUEUE_LEN 12
+#endif
+#ifndef AT_CMD_MAX
+#define AT_CMD_MAX 320      // AT+QMTPUB with an inline status payload
+#endif
+#ifndef AT_BODY_MAX
+#define AT_BODY_MAX 172     // one SMS worth of text after the '>' prompt
+#endif
+#ifndef AT_RESP_MAX
+#define AT_RESP_MAX 768     // lines collected for the command in flight
+#endif
+#ifndef AT_URC_MAX
+#define AT_URC_MAX 10
+#endif
+
+// ---------- Line ring ----------
+struct AtLineRing {
+  char buf[AT_RX_RING];
+  uint16_t head = 0, tail = 0;   // head: first unconsumed byte, tail: next write
+  uint16_t scan = 0;             // bytes after head already searched for '\n'
+  uint32_t overflows = 0;
+  char scratch[AT_LINE_MAX];
+
+  uint16_t used() const { return (uint16_t)((tail + AT_RX_RING - head) % AT_RX_RING); }
+  char at(uint16_t off) const { return buf[(head + off) % AT_RX_RING]; }
+  void push(char c) {
+    uint16_t next = (uint16_t)((tail + 1) % AT_RX_RING);
+    if (next == head) { overflows++; return; }
+    buf[tail] = c; tail = next;
+  }
+  void drop(uint16_t n) { head = (uint16_t)((head + n) % AT_RX_RING); scan = scan > n ? scan - n : 0; }
+
+  // Next complete line without CR/LF. Zero-copy unless the line wraps the ring.
+  // A full ring with no newline is flushed as one (truncated) line.
+  bool nextLine(WireSpan &line) {
+    uint16_t n = used();
+    while (scan < n && at(scan) != '\n') scan++;
+    if (scan >= n && n < AT_RX_RING - 1) return false;
+    uint16_t len = scan;                       // excludes '\n'
+    uint16_t start = head;
+    if (start + len <= AT_RX_RING) line = wireSpan(buf + start, len);
+    else {
+      uint16_t l = len < AT_LINE_MAX ? len : AT_LINE_MAX;
+      for (uint16_t i = 0; i < l; ++i) scratch[i] = at(i);
+      line = wireSpan(scratch, l);
+    }
+    drop((uint16_t)(len + (scan < n ? 1 : 0)));
+    scan = 0;
+    while (line.n && (line.p[line.n - 1] == '\r' || line.p[line.n - 1] == ' ')) line.n--;
+    return true;
+  }
+  // True when the unterminated tail is a '>' prompt (CR/LF before it ignored)
+  bool promptPending() {
+    uint16_t n = used(), i = 0;
+    while (i < n && (at(i) == '\r' || at(i) == '\n')) i++;
+    if (i < n && at(i) == '>') { drop((uint16_t)(i + 1)); if (used() && at(0) == ' ') drop(1); return true; }
+    return false;
+  }
+};
+
+// ---------- Engine ----------
+enum AtResult : uint8_t { AT_OK = 0, AT_ERROR, AT_TIMEOUT };
+inline const char *atResultName(AtResult r) { return r == AT_OK ? "OK" : r == AT_ERROR ? "ERROR" : "TIMEOUT"; }
+
+// resp: every line received for the command (echo excluded), '\n'-separated,
+// including the final result code and the awaited URC if any.
+typedef void (*AtCallback)(void *ctx, AtResult res, const char *resp, uint16_t len);
+typedef void (*AtUrcHandler)(WireSpan line);
+typedef void (*AtWriter)(const char *p, size_t n);
+
+struct AtCmd {
+  char cmd[AT_CMD_MAX];
+  char body[AT_BODY_MAX];
+  bool hasBody;
+  const uint8_t *data;  // instead of body: sent as-is, no Ctrl-Z (submitData)
+  uint16_t dataLen;
+  char waitUrc[16];     // complete on this URC prefix instead of the final code
+  uint32_t timeoutMs;
+  AtCallback cb;
+  void *ctx;
+};
+
+struct AtEngine {
+  enum State : uint8_t { IDLE, WAIT_FINAL, WAIT_PROMPT };
+  AtLineRing rx;
+  AtCmd q[AT_QUEUE_LEN];
+  uint8_t qHead = 0, qCount = 0;
+  State state = IDLE;
+  uint32_t deadline = 0;
+  char resp[AT_RESP_MAX];
+  uint16_t respLen = 0;
+  struct { char prefix[16]; AtUrcHandler fn; } urcs[AT_URC_MAX];
+  uint8_t urcCount = 0;
+  AtWriter writer = nullptr;
+  AtUrcHandler trace = nullptr;       // sees every line (logging)
+  uint32_t completed = 0, errors = 0, timeouts = 0, dropped = 0;
+
+  void begin(AtWriter w) { writer = w; }
+  bool onUrc(const char *prefix, AtUrcHandler fn) {
+    if (urcCount >= AT_URC_MAX) return false;
+    size_t l = strlen(prefix); if (l >= sizeof(urcs[0].prefix)) return false;
+    memcpy(urcs[urcCount].prefix, prefix, l + 1); urcs[urcCount].fn = fn; urcCount++;
+    return true;
+  }
+  bool idle() const { return qCount == 0; }
+  uint8_t pending() const { return qCount; }      // includes the command in flight
+  // Longest the queued commands can take (each completes by its own timeout)
+  uint32_t queuedMs() const { uint32_t t = 0; for (uint8_t i = 0; i < qCount; ++i) t += q[(qHead + i) % AT_QUEUE_LEN].timeoutMs; return t; }
+
+  // Queue a command (without "\r\n"). body != nullptr: wait for '>' and send body + Ctrl-Z.
+  bool submit(const char *cmd, uint32_t timeoutMs, AtCallback cb = nullptr, void *ctx = nullptr,
+              const char *waitUrc = nullptr, const char *body = nullptr) {
+    if (qCount >= AT_QUEUE_LEN || strlen(cmd) >= AT_CMD_MAX) { dropped++; return false; }
+    AtCmd &c = q[(qHead + qCount) % AT_QUEUE_LEN];
+    strcpy(c.cmd, cmd);
+    c.hasBody = body != nullptr;
+    c.body[0] = 0; if (body) wireSpan(body).copyTo(c.body, sizeof(c.body));
+    c.waitUrc[0] = 0; if (waitUrc) wireSpan(waitUrc).copyTo(c.waitUrc, sizeof(c.waitUrc));
+    c.data = nullptr; c.dataLen = 0;
+    c.timeoutMs = timeoutMs; c.cb = cb; c.ctx = ctx;
+    qCount++;
+    return true;
+  }
+  // Length-prefixed payload (e.g. AT+QMTPUBEX=...,<len>): data goes out verbatim after
+  // the prompt and must stay valid until cb runs.
+  bool submitData(const char *cmd, const uint8_t *data, uint16_t len, uint32_t timeoutMs, AtCallback cb = nullptr,
+                  void *ctx = nullptr, const char *waitUrc = nullptr) {
+    if (!submit(cmd, timeoutMs, cb, ctx, waitUrc, "")) return false;
+    AtCmd &c = q[(qHead + qCount - 1) % AT_QUEUE_LEN];
+    c.data = data; c.dataLen = len;
+    return true;
+  }
+
+  void feed(const uint8_t *p, size_t n) { for (size_t i = 0; i < n; ++i) rx.push((char)p[i]); }
+  void feed(char c) { rx.push(c); }
+
+  // Frames lines, dispatches URCs / responses, handles prompt and timeouts,
+  // starts the next queued command. Call every loop iteration.
+  void poll(uint32_t nowMs) {
+    if (state == WAIT_PROMPT && rx.promptPending()) {
+      const AtCmd &c = q[qHead];
+      if (writer && c.data) writer((const char *)c.data, c.dataLen);
+      else if (writer) { writer(c.body, strlen(c.body)); writer("\x1A", 1); }
+      state = WAIT_FINAL; deadline = nowMs + c.timeoutMs;
+    }
+    WireSpan line;
+    while (rx.nextLine(line)) {
+      if (line.empty()) continue;
+      if (trace) trace(line);
+      handleLine(line);
+    }
+    if (state != IDLE && (int32_t)(nowMs - deadline) >= 0) finish(AT_TIMEOUT);
+    if (state == IDLE && qCount) start(nowMs);
+  }
+
+  // ---- internals ----
+  void append(WireSpan l) {
+    if (respLen && respLen < AT_RESP_MAX - 1) resp[respLen++] = '\n';
+    uint16_t room = (uint16_t)(AT_RESP_MAX - 1 - respLen);
+    uint16_t n = l.n < room ? l.n : room;
+    memcpy(resp + respLen, l.p, n); respLen += n; resp[respLen] = 0;
+  }
+  static bool isFinalError(WireSpan l) { return l.eq("ERROR") || l.startsWith("+CME ERROR") || l.startsWith("+CMS ERROR"); }
+  void handleLine(WireSpan l) {
+    const AtCmd *c = state != IDLE ? &q[qHead] : nullptr;
+    if (c && c->waitUrc[0] && l.startsWith(c->waitUrc)) { append(l); finish(AT_OK); return; }
+    for (uint8_t i = 0; i < urcCount; ++i) if (l.startsWith(urcs[i].prefix)) { urcs[i].fn(l); return; }
+    if (!c) return;                                    // stray line while idle
+    if (l.startsWith("AT") && l.n >= 2) return;        // command echo
+    if (l.eq("OK")) {
+      append(l);
+      if (!c->waitUrc[0]) finish(AT_OK);               // else keep waiting for the URC
+      return;
+    }
+    if (isFinalError(l)) { append(l); finish(AT_ERROR); return; }
+    append(l);
+  }
+  void start(uint32_t nowMs) {
+    const AtCmd &c = q[qHead];
+    respLen = 0; resp[0] = 0;
+    if (writer) { writer(c.cmd, strlen(c.cmd)); writer("\r\n", 2); }
+    state = c.hasBody ? WAIT_PROMPT : WAIT_FINAL;
+    deadline = nowMs + c.timeoutMs;
+  }
+  void finish(AtResult r) {
+    AtCmd c = q[qHead];                                // callback may submit more
+    qHead = (uint8_t)((qHead + 1) % AT_QUEUE_LEN); qCount--;
+    state = IDLE;
+    completed++; if (r == AT_ERROR) errors++; else if (r == AT_TIMEOUT) timeouts++;
+    if (c.cb) c.cb(c.ctx, r, resp, respLen);
+  }
+};
+
+// Copies the first line starting with `prefix` out of a response block.
+inline bool atFindLine(const char *resp, uint16_t len, const char *prefix, WireSpan &line) {
+  WireSpan all = wireSpan(resp, len); uint16_t pos = 0;
+  while (pos < all.n) {
+    int e = all.indexOf('\n', pos); uint16_t end = e < 0 ? all.n : (uint16_t)e;
+    WireSpan l = all.sub(pos, end - pos);
+    if (l.startsWith(prefix)) { line = l; return true; }
+    pos = (uint16_t)(end + 1);
+  }
+  return false;
+}
@@ -0,0 +1,339 @@
+#pragma once
+// In-RAM authentication context for incoming commands.
+// Built once from the config (admin numbers, tokens) and rebuilt when it changes, so a
+// message costs one pass over its KEY=VAL tokens: no NVS reads, no re-splitting of the
+// admin list. Admin numbers are kept normalized with their FNV-1a hash; each source has
+// its token and the HMAC-SHA256 pads precomputed from it.
+// Signed commands end with
+//   ...,ATS=<epoch s>,NONCE=<any, <= 16 chars>,SIG=<16 hex>
+// SIG = first AUTH_SIG_BYTES of HMAC-SHA256(key, text before ",SIG="), key = the
+// source's token (TOK_BT / TOK_LORA / TOK_MQ setting), else the shared one. Only SRC=
+// and _FROM= (added by the controller's transports) may follow SIG. A signed command is
+// accepted once: ATS within AUTH_WINDOW_S of a trusted clock (without one, of the
+// newest accepted ATS) and its SIG not among the recent ones. Token and SIG compares
+// run in constant time.
+// SRC / _FROM are taken from their last occurrence: transports append their own.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "wire_proto.h"
+#include "fixed_buf.h"
+
+#ifndef AUTH_ADMINS_MAX
+#define AUTH_ADMINS_MAX 8
+#endif
+#ifndef AUTH_PHONE_MAX
+#define AUTH_PHONE_MAX 24        // normalized number incl. NUL
+#endif
+#ifndef AUTH_TOK_MAX
+#define AUTH_TOK_MAX 64          // longer tokens are still hashed whole for HMAC, compared clipped
+#endif
+#ifndef AUTH_CC
+#define AUTH_CC "+91"            // prefixed to bare 10-digit numbers
+#endif
+#ifndef AUTH_SIG_BYTES
+#define AUTH_SIG_BYTES 8
+#endif
+#ifndef AUTH_WINDOW_S
+#define AUTH_WINDOW_S 300
+#endif
+#ifndef AUTH_SEEN_MAX
+#define AUTH_SEEN_MAX 32         // recent SIGs remembered
+#endif
+
+// ---- SHA-256 / HMAC ----
+struct Sha256 {
+  uint32_t h[8];
+  uint8_t buf[64];
+  uint64_t len;
+
+  void init() {
+    static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(h, iv, sizeof(h)); len = 0;
+  }
+  void update(const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    size_t have = (size_t)(len & 63); len += n;
+    if (have) {
+      size_t t = 64 - have < n ? 64 - have : n;
+      memcpy(buf + have, p, t); p += t; n -= t;
+      if (have + t < 64) return;
+      block(buf);
+    }
+    for (; n >= 64; p += 64, n -= 64) block(p);
+    if (n) memcpy(buf, p, n);
+  }
+  void final(uint8_t out[32]) {
+    uint64_t bits = len * 8;
+    size_t have = (size_t)(len & 63);
+    buf[have++] = 0x80;
+    if (have > 56) { memset(buf + have, 0, 64 - have); block(buf); have = 0; }
+    memset(buf + have, 0, 56 - have);
+    for (int i = 0; i < 8; ++i) buf[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    block(buf);
+    for (int i = 0; i < 8; ++i) { out[4 * i] = (uint8_t)(h[i] >> 24); out[4 * i + 1] = (uint8_t)(h[i] >> 16); out[4 * i + 2] = (uint8_t)(h[i] >> 8); out[4 * i + 3] = (uint8_t)h[i]; }
+  }
+  static uint32_t ror(uint32_t x, int r) { return (x >> r) | (x << (32 - r)); }
+  void block(const uint8_t *p) {
+    static const uint32_t k[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; ++i) {
+      uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3), s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; ++i) {
+      uint32_t t1 = hh + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+      uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+  }
+};
+
+// A token with its HMAC inner / outer states after the key block, so a MAC costs the
+// message blocks plus two
+struct AuthKey {
+  FixedStr<AUTH_TOK_MAX> tok;
+  Sha256 in, out;
+  bool set = false;
+
+  void load(const char *k) {
+    tok = k; set = k && *k;
+    if (!set) return;
+    uint8_t kb[64]; memset(kb, 0, sizeof(kb));
+    size_t n = strlen(k);
+    if (n > 64) { Sha256 s; s.init(); s.update(k, n); s.final(kb); } else memcpy(kb, k, n);
+    uint8_t pad[64];
+    for (int i = 0; i < 64; ++i) pad[i] = kb[i] ^ 0x36;
+    in.init(); in.update(pad, 64);
+    for (int i = 0; i < 64; ++i) pad[i] = kb[i] ^ 0x5c;
+    out.init(); out.update(pad, 64);
+  }
+  void mac(const void *p, size_t n, uint8_t d[32]) const {
+    Sha256 s = in; s.update(p, n); s.final(d);
+    Sha256 o = out; o.update(d, 32); o.final(d);
+  }
+};
+
+// Constant time for a given expected length
+inline bool authEqCt(const uint8_t *a, const uint8_t *b, size_t n) {
+  uint8_t d = 0;
+  for (size_t i = 0; i < n; ++i) d |= a[i] ^ b[i];
+  return d == 0;
+}
+inline bool authTokEq(WireSpan got, const char *want) {
+  size_t n = strlen(want);
+  uint8_t d = got.n != n;
+  for (size_t i = 0; i < n; ++i) d |= (uint8_t)((i < got.n ? got.p[i] : 0) ^ want[i]);
+  return d == 0 && n > 0;
+}
+
+// Same rules as the config's admin numbers: trimmed, spaces dropped, one leading 0
+// dropped, AUTH_CC before a bare 10-digit number
+inline size_t authNormPhone(const char *p, size_t n, char *out, size_t cap) {
+  if (!cap) return 0;
+  while (n && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) { p++; n--; }
+  while (n && (p[n - 1] == ' ' || (p[n - 1] >= '\t' && p[n - 1] <= '\r'))) n--;
+  char t[AUTH_PHONE_MAX + 8]; size_t m = 0;
+  for (size_t i = 0; i < n && m < sizeof(t) - 1; ++i) if (p[i] != ' ') t[m++] = p[i];
+  size_t a = m && t[0] == '0' ? 1 : 0;
+  const char *cc = (m - a == 10 && t[a] != '+') ? AUTH_CC : "";
+  int w = snprintf(out, cap, "%s%.*s", cc, (int)(m - a), t + a);
+  return w < 0 ? 0 : ((size_t)w < cap ? (size_t)w : cap - 1);
+}
+
+inline int authHexVal(char c) { return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1; }
+
+enum AuthSrc : uint8_t { AUTH_SHARED, AUTH_SMS, AUTH_BT, AUTH_LORA, AUTH_MQTT, AUTH_SRC_N };   // AUTH_SHARED: any other SRC
+enum AuthResult : uint8_t { AUTH_OK_ADMIN, AUTH_OK_RECOV, AUTH_OK_TOK, AUTH_OK_SIG, AUTH_NONE, AUTH_BAD_TOK, AUTH_BAD_SIG, AUTH_STALE, AUTH_REPLAY,
+                            AUTH_SIG_REQUIRED, AUTH_RESULTS };
+enum AuthPath : uint8_t { AP_SMS, AP_TOK, AP_SIG, AP_N };
+
+inline bool authOk(AuthResult r) { return r <= AUTH_OK_SIG; }
+// Admin numbers, tokens, the recovery token and the signing policy: not with a plain token
+inline bool authMayChangeKeys(AuthResult r) { return r == AUTH_OK_ADMIN || r == AUTH_OK_RECOV || r == AUTH_OK_SIG; }
+inline const char *authResultName(uint8_t r) {
+  static const char *const n[AUTH_RESULTS] = { "OK_ADMIN", "OK_RECOV", "OK_TOK", "OK_SIG", "NONE", "BAD_TOK", "BAD_SIG", "STALE", "REPLAY", "SIG_REQ" };
+  return r < AUTH_RESULTS ? n[r] : "?";
+}
+// Per-source letters for the SIG-required set: L=LORA B=BT M=MQTT U=other, "-" = none
+inline uint8_t authSrcMask(const char *s) {
+  uint8_t m = 0;
+  for (; s && *s; ++s) {
+    if (*s == 'L') m |= 1 << AUTH_LORA; else if (*s == 'B') m |= 1 << AUTH_BT;
+    else if (*s == 'M') m |= 1 << AUTH_MQTT; else if (*s == 'U') m |= 1 << AUTH_SHARED;
+  }
+  return m;
+}
+
+// What one pass over a payload found
+struct AuthMsg {
+  WireSpan src, from, recov, ats, nonce, sig;
+  WireSpan tok[AUTH_SRC_N];     // TOK, -, TOK_BT, TOK_LORA, TOK_MQ
+  uint16_t signedLen;
+  bool tail;                    // something other than SRC / _FROM after SIG
+  AuthSrc s;
+  AuthPath path;
+
+  void scan(const char *p, size_t n) {
+    memset(this, 0, sizeof(*this)); src = wireSpan("UNKNOWN");
+    WireKvIter it(wireSpan(p, n)); WireSpan k, v;
+    while (it.next(k, v)) {
+      if (k.eq("SRC")) src = v;
+      else if (k.eq("_FROM")) from = v;
+      else if (sig.p) tail = true;
+      else if (k.eq("SIG")) {
+        sig = v;
+        const char *q = k.p;
+        while (q > p && (q[-1] == ' ' || q[-1] == '\t')) q--;
+        if (q > p && (q[-1] == ',' || q[-1] == '|')) q--;
+        signedLen = (uint16_t)(q - p);
+      }
+      else if (k.eq("TOK")) tok[AUTH_SHARED] = v;
+      else if (k.eq("TOK_BT")) tok[AUTH_BT] = v;
+      else if (k.eq("TOK_LORA")) tok[AUTH_LORA] = v;
+      else if (k.eq("TOK_MQ")) tok[AUTH_MQTT] = v;
+      else if (k.eq("RECOV")) recov = v;
+      else if (k.eq("ATS")) ats = v;
+      else if (k.eq("NONCE")) nonce = v;
+    }
+    s = src.eq("SMS") ? AUTH_SMS : src.eq("BT") ? AUTH_BT : src.eq("LORA") ? AUTH_LORA : src.eq("MQTT") ? AUTH_MQTT : AUTH_SHARED;
+  }
+};
+
+struct AuthStats {
+  uint32_t n[AUTH_RESULTS];
+  uint32_t pathN[AP_N], usMax[AP_N];
+  uint64_t usSum[AP_N];
+  uint32_t reloads, reloadUs;
+
+  void reset() { memset(this, 0, sizeof(*this)); }
+  void done(AuthResult r, AuthPath p, uint32_t us) {
+    n[r]++; pathN[p]++; usSum[p] += us;
+    if (us > usMax[p]) usMax[p] = us;
+  }
+};
+
+struct AuthCtx {
+  AuthKey key[AUTH_SRC_N];                          // AUTH_SMS unused: the sender number is its credential
+  FixedStr<AUTH_TOK_MAX> recov;
+  char admin[AUTH_ADMINS_MAX][AUTH_PHONE_MAX];
+  uint32_t adminHash[AUTH_ADMINS_MAX];
+  uint8_t admins = 0;
+  uint8_t sigRequired = 0;                          // 1 << AuthSrc: plain tokens refused
+  struct Seen { uint8_t sig[AUTH_SIG_BYTES]; uint32_t ts; } seen[AUTH_SEEN_MAX];
+  uint8_t seenHead = 0, seenN = 0;
+  uint32_t newestTs = 0, floorTs = 0;               // floorTs: newest ATS pushed out of `seen` while still in the window
+  AuthStats stats;
+
+  AuthCtx() { stats.reset(); }
+
+  // "a,b;c": ',' or ';' separated; beyond AUTH_ADMINS_MAX ignored
+  void setAdmins(const char *list) {
+    admins = 0;
+    const char *p = list ? list : "";
+    while (*p && admins < AUTH_ADMINS_MAX) {
+      const char *e = p; while (*e && *e != ',' && *e != ';') e++;
+      char nb[AUTH_PHONE_MAX];
+      if (authNormPhone(p, (size_t)(e - p), nb, sizeof(nb))) { memcpy(admin[admins], nb, sizeof(nb)); adminHash[admins] = fixedHash(nb); admins++; }
+      p = *e ? e + 1 : e;
+    }
+  }
+  bool isAdmin(const char *p, size_t n) const {
+    char nb[AUTH_PHONE_MAX];
+    if (!authNormPhone(p, n, nb, sizeof(nb))) return false;
+    uint32_t h = fixedHash(nb);
+    for (uint8_t i = 0; i < admins; ++i) if (adminHash[i] == h && strcmp(admin[i], nb) == 0) return true;
+    return false;
+  }
+
+  const AuthKey &keyFor(AuthSrc s) const { return key[s].set ? key[s] : key[AUTH_SHARED]; }
+  // SIG over m's signed part checks out (no window / replay state)
+  bool sigValid(const char *p, const AuthMsg &m, uint8_t got[AUTH_SIG_BYTES]) const {
+    if (m.tail || !m.ats.n || !m.nonce.n || m.nonce.n > 16 || m.sig.n != 2 * AUTH_SIG_BYTES) return false;
+    for (uint8_t i = 0; i < AUTH_SIG_BYTES; ++i) {
+      int a = authHexVal(m.sig.p[2 * i]), b = authHexVal(m.sig.p[2 * i + 1]);
+      if (a < 0 || b < 0) return false;
+      got[i] = (uint8_t)(a << 4 | b);
+    }
+    const AuthKey &k = keyFor(m.s);
+    if (!k.set) return false;
+    uint8_t d[32]; k.mac(p, m.signedLen, d);
+    return authEqCt(d, got, AUTH_SIG_BYTES);
+  }
+  // "<text>,SIG=<hex>" for text that already carries ATS / NONCE; returns the length, -1 without a key
+  int sign(AuthSrc s, const char *text, char *out, size_t cap) const {
+    const AuthKey &k = keyFor(s);
+    if (!k.set) return -1;
+    uint8_t d[32]; k.mac(text, strlen(text), d);
+    int w = snprintf(out, cap, "%s,SIG=", text);
+    for (uint8_t i = 0; i < AUTH_SIG_BYTES && w > 0 && (size_t)w + 2 < cap; ++i) w += snprintf(out + w, cap - w, "%02x", d[i]);
+    return w;
+  }
+
+  // nowS: epoch seconds of a trusted clock, 0 when there is none
+  AuthResult check(const char *p, size_t n, uint32_t nowS, AuthMsg &m) {
+    m.scan(p, n);
+    if (m.s == AUTH_SMS) {
+      m.path = AP_SMS;
+      if (!m.from.n) return AUTH_NONE;
+      if (isAdmin(m.from.p, m.from.n)) return AUTH_OK_ADMIN;
+      if (m.recov.n && authTokEq(m.recov, recov)) return AUTH_OK_RECOV;
+      return m.recov.n ? AUTH_BAD_TOK : AUTH_NONE;
+    }
+    if (m.sig.p) {
+      m.path = AP_SIG;
+      uint8_t got[AUTH_SIG_BYTES];
+      if (!sigValid(p, m, got)) return AUTH_BAD_SIG;
+      uint32_t ts = m.ats.toU32();
+      if (nowS && (ts + AUTH_WINDOW_S < nowS || ts > nowS + AUTH_WINDOW_S)) return AUTH_STALE;
+      if (ts + AUTH_WINDOW_S < newestTs || (floorTs && ts <= floorTs)) return AUTH_STALE;
+      for (uint8_t i = 0; i < seenN; ++i) if (authEqCt(seen[i].sig, got, AUTH_SIG_BYTES)) return AUTH_REPLAY;
+      remember(got, ts);
+      return AUTH_OK_SIG;
+    }
+    m.path = AP_TOK;
+    const WireSpan &own = m.tok[m.s];
+    bool any = m.tok[AUTH_SHARED].n || (m.s != AUTH_SHARED && own.n);
+    if (sigRequired & (1 << m.s)) return any ? AUTH_SIG_REQUIRED : AUTH_NONE;
+    if (m.tok[AUTH_SHARED].n && key[AUTH_SHARED].set && authTokEq(m.tok[AUTH_SHARED], key[AUTH_SHARED].tok)) return AUTH_OK_TOK;
+    if (m.s != AUTH_SHARED && own.n && key[m.s].set && authTokEq(own, key[m.s].tok)) return AUTH_OK_TOK;
+    return any ? AUTH_BAD_TOK : AUTH_NONE;
+  }
+  void remember(const uint8_t *sig, uint32_t ts) {
+    uint8_t at;
+    if (seenN < AUTH_SEEN_MAX) at = (uint8_t)((seenHead + seenN++) % AUTH_SEEN_MAX);
+    else {
+      at = seenHead; seenHead = (uint8_t)((seenHead + 1) % AUTH_SEEN_MAX);
+      if (seen[at].ts + AUTH_WINDOW_S >= newestTs && seen[at].ts > floorTs) floorTs = seen[at].ts;
+    }
+    memcpy(seen[at].sig, sig, AUTH_SIG_BYTES); seen[at].ts = ts;
+    if (ts > newestTs) newestTs = ts;
+  }
+
+  // e.g. "ADMINS=2,KEYS=SBLM,NEED_SIG=L,OK_ADMIN=..,..,SIG_REQ=..,SMS_US=avg/max,TOK_US=..,SIG_US=..,RELOADS=..,RELOAD_US=.."
+  int text(char *out, size_t cap) const {
+    char req[8] = ""; uint8_t r = 0;
+    static const char letter[AUTH_SRC_N] = { 'U', 0, 'B', 'L', 'M' };
+    for (uint8_t s = 0; s < AUTH_SRC_N; ++s) if (letter[s] && (sigRequired & (1 << s))) req[r++] = letter[s];
+    req[r] = 0;
+    int w = snprintf(out, cap, "ADMINS=%u,KEYS=%s%s%s%s,NEED_SIG=%s", admins, key[AUTH_SHARED].set ? "S" : "-", key[AUTH_BT].set ? "B" : "-",
+                     key[AUTH_LORA].set ? "L" : "-", key[AUTH_MQTT].set ? "M" : "-", r ? req : "-");
+    for (uint8_t i = 0; i < AUTH_RESULTS && w > 0 && (size_t)w < cap; ++i) w += snprintf(out + w, cap - w, ",%s=%lu", authResultName(i), (unsigned long)stats.n[i]);
+    static const char *const pn[AP_N] = { "SMS", "TOK", "SIG" };
+    for (uint8_t i = 0; i < AP_N && w > 0 && (size_t)w < cap; ++i)
+      w += snprintf(out + w, cap - w, ",%s_US=%lu/%lu", pn[i], (unsigned long)(stats.pathN[i] ? stats.usSum[i] / stats.pathN[i] : 0), (unsigned long)stats.usMax[i]);
+    if (w > 0 && (size_t)w < cap) w += snprintf(out + w, cap - w, ",RELOADS=%lu,RELOAD_US=%lu", (unsigned long)stats.reloads, (unsigned long)stats.reloadUs);
+    return w;
+  }
+};
@@ -63,7 +63,7 @@ const char* ntpServer = "pool.ntp.org";
 const long gmtOffset_sec = 19800;
 const int daylightOffset_sec = 0;
 
-struct SeqStep { int node_id; uint32_t duration_ms; };
+struct SeqStep { int node_id; uint32_t duration_ms; bool par = false; };   // par: runs together with the previous step
 struct Schedule {
   String id; char rec; time_t start_epoch; String timeStr; uint8_t weekday_mask;
   std::vector<SeqStep> seq; uint32_t pump_on_before_ms; uint32_t pump_off_after_ms;
@@ -0,0 +1,213 @@
+#pragma once
+// Append-only, segment-rotated store-and-forward log for status events that could
+// not be delivered over MQTT.
+// - Flash is bounded to EVLOG_SEGMENTS x EVLOG_SEG_BYTES; when full the oldest
+//   undelivered segment is dropped (counted in droppedSegments).
+// - Records are batched in RAM and appended in one write (flush on size, on age,
+//   or before replay catches up with the tail), so LittleFS rewrites its last
+//   block once per batch instead of once per event.
+// - Replay hands records out in order with a token; commit(token) after the
+//   broker accepted them, rewind() on failure. Fully delivered segments are
+//   deleted, which is also the only persisted cursor: after a reboot the oldest
+//   segment may replay again, so every record carries a sequence number the
+//   backend dedupes on.
+// Templated on the filesystem so LittleFS and a host file-backed stand-in both work
+// (needs open(path, mode), exists(), remove(), mkdir(); File: write/read/seek/size/close).
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef EVLOG_SEGMENTS
+#define EVLOG_SEGMENTS 8
+#endif
+#ifndef EVLOG_SEG_BYTES
+#define EVLOG_SEG_BYTES 16384    // must stay below 64 KB (16-bit offsets in tokens)
+#endif
+#ifndef EVLOG_BUF
+#define EVLOG_BUF 1024           // RAM batch before a flash append
+#endif
+#ifndef EVLOG_FLUSH_MS
+#define EVLOG_FLUSH_MS 30000     // max age of unflushed records
+#endif
+#define EVLOG_DIR "/evlog"
+#define EVLOG_HDR 8              // segment header: 'E','L',ver,0,gen(u32)
+#define EVLOG_REC_HDR 8          // record header: 0xE7,len,seq(u32),crc16
+#define EVLOG_REC_MAX 240        // payload bytes per record
+
+inline uint16_t evlogCrc16(const uint8_t *p, size_t n) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < n; ++i) { crc ^= (uint16_t)p[i] << 8; for (int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1); }
+  return crc;
+}
+
+struct EvlogStats {
+  uint32_t appended;         // records accepted
+  uint32_t appendBytes;      // logical record bytes (headers included)
+  uint32_t flushes;          // flash append operations
+  uint32_t flashBytes;       // bytes handed to the filesystem (segment headers included)
+  uint32_t replayed;         // records handed out by next()
+  uint32_t committed;        // records confirmed delivered
+  uint32_t rewinds;
+  uint32_t droppedSegments;  // undelivered segments overwritten when the log was full
+  uint32_t corrupt;          // torn / bad-CRC records skipped
+};
+
+template <class FS>
+struct EventLog {
+  FS *fs = nullptr;
+  uint32_t gen[EVLOG_SEGMENTS];      // 0 = slot empty
+  uint32_t segSize[EVLOG_SEGMENTS];  // flushed bytes per slot
+  uint32_t maxGen = 0;
+  uint8_t wSlot = 0;                 // segment being appended
+  uint8_t rSlot = 0; uint32_t rOff = EVLOG_HDR;   // next record to hand out
+  uint8_t cSlot = 0; uint32_t cOff = EVLOG_HDR;   // everything before is delivered
+  uint8_t buf[EVLOG_BUF];
+  uint16_t bufLen = 0;
+  uint32_t bufSinceMs = 0;
+  EvlogStats st;
+
+  static void path(uint8_t slot, char *out, size_t cap) { snprintf(out, cap, EVLOG_DIR "/s%u.bin", (unsigned)slot); }
+
+  bool begin(FS &f) {
+    fs = &f; memset(&st, 0, sizeof(st));
+    memset(gen, 0, sizeof(gen)); memset(segSize, 0, sizeof(segSize));
+    if (!fs->exists(EVLOG_DIR)) fs->mkdir(EVLOG_DIR);
+    char p[32];
+    for (uint8_t s = 0; s < EVLOG_SEGMENTS; ++s) {
+      path(s, p, sizeof(p));
+      if (!fs->exists(p)) continue;
+      auto file = fs->open(p, "r");
+      uint8_t h[EVLOG_HDR];
+      if (file && file.read(h, EVLOG_HDR) == EVLOG_HDR && h[0] == 'E' && h[1] == 'L' && h[2] == 1) {
+        gen[s] = (uint32_t)h[4] | (uint32_t)h[5] << 8 | (uint32_t)h[6] << 16 | (uint32_t)h[7] << 24;
+        segSize[s] = (uint32_t)file.size();
+      }
+      if (file) file.close();
+      if (!gen[s]) fs->remove(p);
+    }
+    int oldest = -1, newest = -1;
+    for (uint8_t s = 0; s < EVLOG_SEGMENTS; ++s) {
+      if (!gen[s]) continue;
+      if (oldest < 0 || gen[s] < gen[oldest]) oldest = s;
+      if (newest < 0 || gen[s] > gen[newest]) newest = s;
+    }
+    if (newest < 0) { wSlot = 0; rSlot = cSlot = 0; rOff = cOff = EVLOG_HDR; return true; }
+    maxGen = gen[newest]; wSlot = (uint8_t)newest;
+    rSlot = cSlot = (uint8_t)oldest; rOff = cOff = EVLOG_HDR;
+    return true;
+  }
+
+  // No undelivered records at all (read, in flight or buffered)
+  bool idle() const { return bufLen == 0 && cSlot == wSlot && cOff >= segSize[wSlot]; }
+  // Nothing left to hand out (in-flight records may still await commit)
+  bool drained() const { return bufLen == 0 && rSlot == wSlot && rOff >= segSize[wSlot]; }
+
+  bool append(const char *text, uint32_t seq, uint32_t nowMs) {
+    size_t n = strlen(text); if (n > EVLOG_REC_MAX) n = EVLOG_REC_MAX;
+    uint16_t rec = (uint16_t)(EVLOG_REC_HDR + n);
+    if (bufLen + rec > EVLOG_BUF) flush();
+    if (segSize[wSlot] + bufLen + rec > EVLOG_SEG_BYTES || !gen[wSlot]) { flush(); if (gen[wSlot] && segSize[wSlot] + rec > EVLOG_SEG_BYTES) rotate(); }
+    if (!gen[wSlot] && !create(wSlot)) return false;
+    uint8_t *r = buf + bufLen;
+    uint16_t crc = evlogCrc16((const uint8_t *)text, n);
+    r[0] = 0xE7; r[1] = (uint8_t)n;
+    r[2] = (uint8_t)seq; r[3] = (uint8_t)(seq >> 8); r[4] = (uint8_t)(seq >> 16); r[5] = (uint8_t)(seq >> 24);
+    r[6] = (uint8_t)crc; r[7] = (uint8_t)(crc >> 8);
+    memcpy(r + EVLOG_REC_HDR, text, n);
+    if (!bufLen) bufSinceMs = nowMs;
+    bufLen += rec; st.appended++; st.appendBytes += rec;
+    return true;
+  }
+
+  void tick(uint32_t nowMs) { if (bufLen && nowMs - bufSinceMs >= EVLOG_FLUSH_MS) flush(); }
+
+  void flush() {
+    if (!bufLen || !fs) return;
+    if (!gen[wSlot] && !create(wSlot)) { bufLen = 0; return; }
+    char p[32]; path(wSlot, p, sizeof(p));
+    auto file = fs->open(p, "a");
+    if (!file) return;
+    size_t w = file.write(buf, bufLen);
+    file.close();
+    segSize[wSlot] += (uint32_t)w; st.flushes++; st.flashBytes += (uint32_t)w;
+    bufLen = 0;
+  }
+
+  // Next undelivered record in order. token identifies the position after it.
+  bool next(char *out, size_t cap, uint32_t &seq, uint32_t &token) {
+    for (;;) {
+      if (rSlot == wSlot && rOff >= segSize[wSlot]) { flush(); if (rOff >= segSize[wSlot]) return false; }
+      if (rSlot != wSlot && rOff >= segSize[rSlot]) { rSlot = nextSlot(rSlot); rOff = EVLOG_HDR; continue; }
+      char p[32]; path(rSlot, p, sizeof(p));
+      auto file = fs->open(p, "r");
+      uint8_t h[EVLOG_REC_HDR]; uint8_t payload[EVLOG_REC_MAX];
+      bool ok = file && file.seek(rOff) && file.read(h, EVLOG_REC_HDR) == EVLOG_REC_HDR && h[0] == 0xE7 && h[1] <= EVLOG_REC_MAX
+                && file.read(payload, h[1]) == h[1] && evlogCrc16(payload, h[1]) == (uint16_t)(h[6] | h[7] << 8);
+      if (file) file.close();
+      if (!ok) { st.corrupt++; rOff = segSize[rSlot]; if (rSlot == wSlot) return false; continue; }   // torn tail: skip rest of segment
+      seq = (uint32_t)h[2] | (uint32_t)h[3] << 8 | (uint32_t)h[4] << 16 | (uint32_t)h[5] << 24;
+      size_t n = h[1] < cap - 1 ? h[1] : cap - 1;
+      memcpy(out, payload, n); out[n] = 0;
+      rOff += EVLOG_REC_HDR + h[1];
+      token = (gen[rSlot] & 0xFF) << 24 | (uint32_t)rSlot << 16 | (rOff & 0xFFFF);
+      st.replayed++;
+      return true;
+    }
+  }
+
+  // Broker accepted everything up to token: advance and delete delivered segments
+  void commit(uint32_t token) {
+    uint8_t slot = (uint8_t)(token >> 16);
+    if (slot >= EVLOG_SEGMENTS || (gen[slot] & 0xFF) != (token >> 24)) return;   // segment since dropped
+    while (cSlot != slot && cSlot != wSlot) { uint8_t n = nextSlot(cSlot); drop(cSlot); cSlot = n; }   // batch crossed a segment end
+    cSlot = slot; cOff = token & 0xFFFF; st.committed++;
+    while (cSlot != wSlot && cOff >= segSize[cSlot]) { uint8_t n = nextSlot(cSlot); drop(cSlot); cSlot = n; cOff = EVLOG_HDR; }
+    if (cSlot == wSlot && cOff >= segSize[wSlot] && bufLen == 0 && rSlot == cSlot && rOff == cOff && gen[wSlot]) {
+      drop(wSlot); rOff = cOff = EVLOG_HDR;   // fully drained: start a fresh segment on next append
+    }
+  }
+  void rewind() { if (rSlot != cSlot || rOff != cOff) st.rewinds++; rSlot = cSlot; rOff = cOff; }
+
+  uint8_t segmentsUsed() const { uint8_t n = 0; for (uint8_t s = 0; s < EVLOG_SEGMENTS; ++s) if (gen[s]) n++; return n; }
+
+  // ---- internals ----
+  uint8_t nextSlot(uint8_t s) const {
+    int best = -1;
+    for (uint8_t i = 0; i < EVLOG_SEGMENTS; ++i)
+      if (gen[i] > gen[s] && (best < 0 || gen[i] < gen[best])) best = i;
+    return best < 0 ? wSlot : (uint8_t)best;
+  }
+  bool create(uint8_t s) {
+    char p[32]; path(s, p, sizeof(p));
+    auto file = fs->open(p, "w");
+    if (!file) return false;
+    uint32_t g = ++maxGen;
+    uint8_t h[EVLOG_HDR] = { 'E', 'L', 1, 0, (uint8_t)g, (uint8_t)(g >> 8), (uint8_t)(g >> 16), (uint8_t)(g >> 24) };
+    file.write(h, EVLOG_HDR); file.close();
+    gen[s] = g; segSize[s] = EVLOG_HDR; st.flashBytes += EVLOG_HDR;
+    return true;
+  }
+  void drop(uint8_t s) { char p[32]; path(s, p, sizeof(p)); fs->remove(p); gen[s] = 0; segSize[s] = 0; }
+  void rotate() {
+    uint8_t n = (uint8_t)((wSlot + 1) % EVLOG_SEGMENTS);
+    if (gen[n]) {                      // log full: lose the oldest undelivered segment
+      st.droppedSegments++;
+      bool movR = rSlot == n, movC = cSlot == n;
+      uint8_t after = nextSlot(n);
+      drop(n);
+      if (movR) { rSlot = after; rOff = EVLOG_HDR; }
+      if (movC) { cSlot = after; cOff = EVLOG_HDR; }
+    }
+    bool wasIdle = cSlot == wSlot && rSlot == wSlot && cOff >= segSize[wSlot] && rOff >= segSize[wSlot];
+    wSlot = n; create(n);
+    if (wasIdle) { rSlot = cSlot = n; rOff = cOff = EVLOG_HDR; }
+  }
+
+  int statsText(char *out, size_t cap) const {
+    return snprintf(out, cap, "SEGS=%u,APPENDED=%lu,FLUSHES=%lu,FLASH_B=%lu,LOGICAL_B=%lu,REPLAYED=%lu,COMMITTED=%lu,REWINDS=%lu,DROPPED_SEGS=%lu,CORRUPT=%lu",
+                    (unsigned)segmentsUsed(), (unsigned long)st.appended, (unsigned long)st.flushes, (unsigned long)st.flashBytes,
+                    (unsigned long)st.appendBytes, (unsigned long)st.replayed, (unsigned long)st.committed, (unsigned long)st.rewinds,
+                    (unsigned long)st.droppedSegments, (unsigned long)st.corrupt);
+  }
+};
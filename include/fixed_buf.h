@@ -0,0 +1,87 @@
+#pragma once
+// Fixed-capacity text for long-lived controller state, so months of uptime do not
+// fragment the heap.
+// FixedStr<N>: a NUL-terminated char[N] that stands in for String where a value is
+// kept around (schedule ids, the active schedule); longer input is truncated.
+// MsgFifo<CAP>: variable-length messages packed into one preallocated byte ring
+// ([len:2][bytes] records, wrapping at the end); when a message does not fit, the
+// oldest ones are dropped to make room, like the queues it replaces.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+template <size_t N>
+struct FixedStr {
+  char s[N] = "";
+
+  FixedStr() = default;
+  FixedStr(const char *p) { set(p); }
+  void set(const char *p, size_t n = (size_t)-1) {
+    size_t l = p ? strnlen(p, n < N - 1 ? n : N - 1) : 0;
+    if (l) memcpy(s, p, l);
+    s[l] = 0;
+  }
+  FixedStr &operator=(const char *p) { set(p); return *this; }
+  template <class S> auto operator=(const S &o) -> decltype(o.c_str(), *this) { set(o.c_str()); return *this; }   // String, std::string
+  const char *c_str() const { return s; }
+  operator const char *() const { return s; }
+  size_t length() const { return strlen(s); }
+  bool operator==(const char *p) const { return strcmp(s, p ? p : "") == 0; }
+  bool operator!=(const char *p) const { return !(*this == p); }
+  template <class S> auto operator==(const S &o) const -> decltype(o.c_str(), true) { return strcmp(s, o.c_str()) == 0; }
+  template <class S> auto operator!=(const S &o) const -> decltype(o.c_str(), true) { return strcmp(s, o.c_str()) != 0; }
+};
+
+// FNV-1a, for comparing ids by hash before by bytes
+inline uint32_t fixedHash(const char *p) {
+  uint32_t h = 2166136261u;
+  while (*p) { h ^= (uint8_t)*p++; h *= 16777619u; }
+  return h;
+}
+
+template <uint16_t CAP>
+struct MsgFifo {
+  uint8_t buf[CAP];
+  uint16_t head = 0, used = 0, count = 0;   // head: oldest record
+  uint16_t usedMax = 0;                      // high-water mark of used bytes
+  uint32_t pushed = 0, drops = 0, truncated = 0;
+
+  // n clipped to maxLen (and to the arena); true when nothing older had to go
+  bool push(const char *p, uint16_t n, uint16_t maxLen) {
+    if (n > maxLen) { n = maxLen; truncated++; }
+    if (n > CAP - 2) { n = CAP - 2; truncated++; }
+    bool kept = true;
+    while (CAP - used < n + 2) { skip(); drops++; kept = false; }
+    uint16_t at = (uint16_t)((head + used) % CAP);
+    put(at, (const uint8_t *)&n, 2); put((uint16_t)((at + 2) % CAP), (const uint8_t *)p, n);
+    used += n + 2; count++; pushed++;
+    if (used > usedMax) usedMax = used;
+    return kept;
+  }
+  // Oldest message into out (NUL-terminated, clipped to cap - 1); returns its length, -1 when empty
+  int pop(char *out, uint16_t cap) {
+    if (!count) return -1;
+    uint16_t n; get(head, (uint8_t *)&n, 2);
+    uint16_t c = n < cap - 1 ? n : cap - 1;
+    get((uint16_t)((head + 2) % CAP), (uint8_t *)out, c); out[c] = 0;
+    skip();
+    return c;
+  }
+  bool empty() const { return count == 0; }
+
+  // ---- internals ----
+  void skip() {
+    uint16_t n; get(head, (uint8_t *)&n, 2);
+    head = (uint16_t)((head + n + 2) % CAP); used -= n + 2; count--;
+  }
+  void put(uint16_t at, const uint8_t *p, uint16_t n) {
+    uint16_t a = n < CAP - at ? n : CAP - at;
+    memcpy(buf + at, p, a); memcpy(buf, p + a, n - a);
+  }
+  void get(uint16_t at, uint8_t *p, uint16_t n) const {
+    uint16_t a = n < CAP - at ? n : CAP - at;
+    memcpy(p, buf + at, a); memcpy(p + a, buf, n - a);
+  }
+};
@@ -0,0 +1,410 @@
+#pragma once
+// Compact binary LoRa frame (v1) for CMD / ACK / STAT / AUTO_CLOSED traffic.
+//
+//   [0xB1][kind<<4|code][status][varint MID][varint node][u16 sched hash]
+//   [varint idx+1][TLV ...][u16 CRC16-CCITT]
+//
+// The first byte is never printable ASCII, so binary and text frames can share
+// the channel; a receiver checks loraIsBinary() and falls back to the text
+// parser otherwise. TLVs are tag,len,value so older firmware can skip unknown
+// fields. loraFrameToText() renders any frame in the legacy ASCII form for logs.
+//
+// Multicast: a CMD with node 0 and an LT_TARGETS bitmap addresses every node in
+// the set. Each target answers with a normal ACK in its own slot -- its rank in
+// the bitmap times LT_SLOT_MS after the command -- so replies do not collide.
+//
+// Duty-cycled nodes (node_power.h) report their wake cadence in LT_WAKE_MS on every
+// ACK / STAT; POWER carries the new cadence in LT_DUR_MS. CAL (soil calibration)
+// names the valve in idx and the point in LT_DUR_MS (1 dry, 2 wet, 0 defaults).
+//
+// Partial telemetry (tele_delta.h): LT_TELE_META = [seq][flags][fields] says which
+// telemetry fields the frame carries (LoraTeleField mask; moisture per valve by its
+// own TLVs). Fields outside the mask are unchanged, not zero. STAT streams are
+// sequenced (LTM_SEQ) so the receiver can spot a lost delta; LTM_KEY marks a full
+// keyframe. A frame without the TLV carries complete telemetry, as before.
+//
+// Node-local runs (node_plan.h): PLAN carries the node's windows of a schedule run in
+// LT_PLAN = [u32 T0 s][u16 T0 ms] then per window [idx][valves][varint off s][varint dur s],
+// T0 on the controller's clock. PLAN and the TIME beacon (node 0, no targets: every node,
+// nobody answers) stamp that clock in LT_EPOCH = [u32 s][u16 ms] as of the end of the
+// frame. Nodes report plan transitions unasked with AUTO_OPENED / AUTO_CLOSED.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "wire_proto.h"
+
+#define LORA_FRAME_VER   0xB1
+#define LORA_FRAME_MAX   64
+#define LORA_MAX_VALVES  4
+#define LORA_CAP_BIN1    0x01   // advertised in ACKs: understands binary v1
+#define LORA_CAP_PLAN    0x02   //                     runs PLAN windows on its own
+#define LORA_PLAN_MAX    5      // windows per PLAN frame
+#define LORA_GROUP_BYTES 16     // multicast bitmap: up to 128 consecutive node IDs
+#define LORA_NODE_GROUP  0      // node field of a multicast CMD
+#define LORA_SLOT_GUARD_MS 40   // multicast: slot 0 starts this long after the command
+
+enum LoraMsgKind : uint8_t { LF_CMD = 1, LF_ACK = 2, LF_STAT = 3, LF_AUTO_CLOSED = 4, LF_AUTO_OPENED = 5 };
+enum LoraCmdCode : uint8_t { LC_NONE = 0, LC_OPEN, LC_CLOSE, LC_STATUS, LC_EMERGENCY, LC_PING, LC_PONG, LC_SETID, LC_POWER, LC_CAL, LC_PLAN, LC_TIMESYNC, LC_UNKNOWN = 15 };
+
+// TLV tags; per-valve tags carry the valve index (0..3) in the low nibble
+enum LoraTlv : uint8_t {
+  LT_DUR_MS = 0x01, LT_VSEL = 0x02, LT_NEWID = 0x03, LT_CAPS = 0x04, LT_TARGETS = 0x05, LT_SLOT_MS = 0x06, LT_WAKE_MS = 0x07, LT_TELE_META = 0x08,
+  LT_EPOCH = 0x09, LT_PLAN = 0x0A,
+  LT_VALVES = 0x10, LT_BATT = 0x11, LT_BV_MV = 0x12, LT_SOLV_MV = 0x13, LT_SOLI_MA = 0x14, LT_AWAKE_PM = 0x15,
+  LT_VT_MS = 0x20, LT_MOIST = 0x30
+};
+
+enum LoraTeleField : uint8_t {
+  TF_VALVES = 0x01, TF_MOIST = 0x02, TF_BATT = 0x04, TF_SOLV = 0x08, TF_SOLI = 0x10, TF_AWAKE = 0x20, TF_ALL = 0x3F
+};
+#define LTM_KEY 0x01            // LT_TELE_META flags: keyframe (all fields)
+#define LTM_SEQ 0x02            //                     part of a sequenced STAT stream
+
+struct LoraTelemetry {
+  uint8_t valvePresent;               // bit per configured valve
+  uint8_t valveOpen;
+  uint32_t vtMs[LORA_MAX_VALVES];     // remaining open time
+  uint8_t moistPresent;
+  uint8_t moist[LORA_MAX_VALVES];     // percent
+  int16_t battPct;                    // -1 when absent
+  uint16_t bvMv, solvMv;
+  int32_t soliMa;                     // -1 when absent
+  int16_t awakePm;                    // duty-cycled node: awake share in permille, -1 when absent
+};
+
+// Multicast target set: bitmap of node IDs starting at `base` (a multiple of 8)
+struct LoraNodeSet {
+  uint16_t base;
+  uint8_t nbytes;                     // bitmap bytes in use
+  uint8_t bits[LORA_GROUP_BYTES];
+
+  void clear() { memset(this, 0, sizeof(*this)); }
+  bool has(uint32_t node) const {
+    if (node < base) return false;
+    uint32_t o = node - base;
+    return o < (uint32_t)nbytes * 8 && (bits[o / 8] & (1 << (o % 8)));
+  }
+  // False when the node does not fit the 128-ID window of this set
+  bool add(uint32_t node) {
+    if (node > 0xFFFF) return false;
+    if (!count()) { clear(); base = (uint16_t)(node & ~7u); }
+    if (node < base) {                                   // slide the window down
+      uint16_t nb = (uint16_t)(node & ~7u), shift = (uint16_t)((base - nb) / 8);
+      if (nbytes + shift > LORA_GROUP_BYTES) return false;
+      memmove(bits + shift, bits, nbytes); memset(bits, 0, shift); nbytes += shift; base = nb;
+    }
+    uint32_t o = node - base;
+    if (o >= LORA_GROUP_BYTES * 8) return false;
+    bits[o / 8] |= (uint8_t)(1 << (o % 8));
+    if (o / 8 + 1 > nbytes) nbytes = (uint8_t)(o / 8 + 1);
+    return true;
+  }
+  void remove(uint32_t node) { if (has(node)) { uint32_t o = node - base; bits[o / 8] &= (uint8_t)~(1 << (o % 8)); } }
+  uint16_t count() const { uint16_t c = 0; for (uint8_t i = 0; i < nbytes; ++i) for (uint8_t b = bits[i]; b; b &= b - 1) c++; return c; }
+  // Reply slot of a member: number of members with a lower ID; -1 if absent
+  int rank(uint32_t node) const {
+    if (!has(node)) return -1;
+    int r = 0; for (uint32_t n = base; n < node; ++n) if (has(n)) r++;
+    return r;
+  }
+  // Next member >= from, -1 when none (iterate with for (n = s.next(0); n >= 0; n = s.next(n + 1)))
+  int32_t next(uint32_t from) const {
+    for (uint32_t n = from < base ? base : from; n < (uint32_t)base + nbytes * 8; ++n) if (has(n)) return (int32_t)n;
+    return -1;
+  }
+};
+
+// One window of a PLAN: step `idx` opens `valves` (0 = default valve) at T0 + offS for durS
+struct LoraPlanWin { uint8_t idx, valves; uint32_t offS, durS; };
+
+struct LoraFrame {
+  uint8_t kind, code, status;         // status: 0 = OK
+  uint32_t mid, node;
+  uint16_t schedHash;
+  int32_t idx;                        // -1 when absent
+  uint32_t durMs;                     // CMD OPEN
+  uint8_t valveSel;                   // CMD valve bitmask, 0 = default valve
+  uint32_t newId;                     // ACK SETID
+  uint8_t caps;                       // ACK: receiver capability bits
+  LoraNodeSet targets;                // CMD to LORA_NODE_GROUP: addressed nodes
+  uint16_t slotMs;                    // multicast reply slot length
+  int32_t wakeMs;                     // sender's wake cadence (0 = always listening), -1 when absent
+  bool hasMeta;                       // LT_TELE_META present: tele holds teleFields only
+  uint8_t teleSeq, teleFlags, teleFields;
+  int64_t epochMs;                    // sender's clock (unix ms) at the end of the frame, 0 when absent
+  int64_t planT0Ms;                   // PLAN: run start on that clock
+  uint8_t planN;
+  LoraPlanWin plan[LORA_PLAN_MAX];
+  bool hasTele;
+  LoraTelemetry tele;
+};
+
+inline void loraTelemetryClear(LoraTelemetry &t) { memset(&t, 0, sizeof(t)); t.battPct = -1; t.soliMa = -1; t.awakePm = -1; }
+inline void loraFrameClear(LoraFrame &f) { memset(&f, 0, sizeof(f)); f.idx = -1; f.wakeMs = -1; loraTelemetryClear(f.tele); }
+inline bool loraIsBinary(const uint8_t *b, size_t n) { return n >= 3 && b[0] == LORA_FRAME_VER; }
+
+// CRC16-CCITT (poly 0x1021, init 0xFFFF)
+inline uint16_t loraCrc16(const uint8_t *d, size_t n) {
+  uint16_t crc = 0xFFFF;
+  while (n--) { crc ^= (uint16_t)(*d++) << 8; for (uint8_t i = 0; i < 8; ++i) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1; }
+  return crc;
+}
+// 16-bit FNV-1a fold of a schedule ID, so "SC001" travels as two bytes
+inline uint16_t loraSchedHash(const char *s, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; ++i) { h ^= (uint8_t)s[i]; h *= 16777619u; }
+  return (uint16_t)((h >> 16) ^ (h & 0xFFFF));
+}
+inline uint16_t loraSchedHash(const char *s) { return loraSchedHash(s, s ? strlen(s) : 0); }
+
+inline const char *loraCmdName(uint8_t c) {
+  switch (c) {
+    case LC_OPEN: return "OPEN"; case LC_CLOSE: return "CLOSE"; case LC_STATUS: return "STATUS";
+    case LC_EMERGENCY: return "EMERGENCY"; case LC_PING: return "PING"; case LC_PONG: return "PONG";
+    case LC_SETID: return "SETID"; case LC_POWER: return "POWER"; case LC_CAL: return "CAL";
+    case LC_PLAN: return "PLAN"; case LC_TIMESYNC: return "TIME"; default: return "UNKNOWN";
+  }
+}
+inline uint8_t loraCmdFromName(WireSpan s) {
+  for (uint8_t c = LC_OPEN; c <= LC_TIMESYNC; ++c) if (s.eq(loraCmdName(c))) return c;
+  return LC_UNKNOWN;
+}
+
+// ---- byte writer / reader ----
+struct LoraWriter {
+  uint8_t *b; size_t cap, n; bool ok;
+  LoraWriter(uint8_t *buf, size_t c) : b(buf), cap(c), n(0), ok(true) {}
+  void u8(uint8_t v) { if (n < cap) b[n++] = v; else ok = false; }
+  void u16(uint16_t v) { u8(v & 0xFF); u8(v >> 8); }
+  void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+  void epoch(int64_t ms) { u32((uint32_t)(ms / 1000)); u16((uint16_t)(ms % 1000)); }
+  void varint(uint32_t v) { while (v >= 0x80) { u8((uint8_t)(v | 0x80)); v >>= 7; } u8((uint8_t)v); }
+  static uint8_t varintLen(uint32_t v) { uint8_t l = 1; while (v >= 0x80) { v >>= 7; l++; } return l; }
+  void tlvU8(uint8_t tag, uint8_t v) { u8(tag); u8(1); u8(v); }
+  void tlvU16(uint8_t tag, uint16_t v) { u8(tag); u8(2); u16(v); }
+  void tlvVar(uint8_t tag, uint32_t v) { u8(tag); u8(varintLen(v)); varint(v); }
+};
+struct LoraReader {
+  const uint8_t *b; size_t n, pos; bool ok;
+  LoraReader(const uint8_t *buf, size_t len) : b(buf), n(len), pos(0), ok(true) {}
+  uint8_t u8() { if (pos < n) return b[pos++]; ok = false; return 0; }
+  uint16_t u16() { uint16_t lo = u8(); return lo | ((uint16_t)u8() << 8); }
+  uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+  int64_t epoch() { int64_t s = u32(); return s * 1000 + u16(); }
+  uint32_t varint() {
+    uint32_t v = 0; uint8_t shift = 0;
+    while (ok && shift < 35) { uint8_t c = u8(); v |= (uint32_t)(c & 0x7F) << shift; if (!(c & 0x80)) return v; shift += 7; }
+    ok = false; return 0;
+  }
+};
+
+// `fields` limits the output to a LoraTeleField mask; with `partial` set, zero voltages
+// in the mask are still sent (an absent field would read as "unchanged")
+inline void loraEncodeTelemetry(LoraWriter &w, const LoraTelemetry &t, uint8_t fields = TF_ALL, bool partial = false) {
+  if ((fields & TF_VALVES) && t.valvePresent) { w.u8(LT_VALVES); w.u8(2); w.u8(t.valvePresent); w.u8(t.valveOpen); }
+  for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) {
+    if ((fields & TF_VALVES) && (t.valveOpen & (1 << i)) && t.vtMs[i]) w.tlvVar(LT_VT_MS | i, t.vtMs[i]);
+    if ((fields & TF_MOIST) && (t.moistPresent & (1 << i))) w.tlvU8(LT_MOIST | i, t.moist[i]);
+  }
+  if ((fields & TF_BATT) && t.battPct >= 0) w.tlvU8(LT_BATT, (uint8_t)t.battPct);
+  if ((fields & TF_BATT) && (t.bvMv || partial)) w.tlvU16(LT_BV_MV, t.bvMv);
+  if ((fields & TF_SOLV) && (t.solvMv || partial)) w.tlvU16(LT_SOLV_MV, t.solvMv);
+  if ((fields & TF_SOLI) && t.soliMa >= 0) w.tlvVar(LT_SOLI_MA, (uint32_t)t.soliMa);
+  if ((fields & TF_AWAKE) && t.awakePm >= 0) w.tlvU16(LT_AWAKE_PM, (uint16_t)t.awakePm);
+}
+
+// Returns encoded length, 0 if it did not fit.
+inline size_t loraEncode(const LoraFrame &f, uint8_t *buf, size_t cap) {
+  LoraWriter w(buf, cap);
+  w.u8(LORA_FRAME_VER);
+  w.u8((uint8_t)((f.kind << 4) | (f.code & 0x0F)));
+  w.u8(f.status);
+  w.varint(f.mid);
+  w.varint(f.node);
+  w.u16(f.schedHash);
+  w.varint(f.idx < 0 ? 0 : (uint32_t)f.idx + 1);
+  if (f.durMs) w.tlvVar(LT_DUR_MS, f.durMs);
+  if (f.valveSel) w.tlvU8(LT_VSEL, f.valveSel);
+  if (f.newId) w.tlvVar(LT_NEWID, f.newId);
+  if (f.caps) w.tlvU8(LT_CAPS, f.caps);
+  if (f.targets.nbytes) { w.u8(LT_TARGETS); w.u8((uint8_t)(2 + f.targets.nbytes)); w.u16(f.targets.base); for (uint8_t i = 0; i < f.targets.nbytes; ++i) w.u8(f.targets.bits[i]); }
+  if (f.slotMs) w.tlvU16(LT_SLOT_MS, f.slotMs);
+  if (f.wakeMs >= 0) w.tlvVar(LT_WAKE_MS, (uint32_t)f.wakeMs);
+  if (f.hasMeta) { w.u8(LT_TELE_META); w.u8(3); w.u8(f.teleSeq); w.u8(f.teleFlags); w.u8(f.teleFields); }
+  if (f.epochMs) { w.u8(LT_EPOCH); w.u8(6); w.epoch(f.epochMs); }
+  if (f.planN && f.planN <= LORA_PLAN_MAX) {
+    uint8_t l = 6;
+    for (uint8_t i = 0; i < f.planN; ++i) l = (uint8_t)(l + 2 + LoraWriter::varintLen(f.plan[i].offS) + LoraWriter::varintLen(f.plan[i].durS));
+    w.u8(LT_PLAN); w.u8(l); w.epoch(f.planT0Ms);
+    for (uint8_t i = 0; i < f.planN; ++i) { w.u8(f.plan[i].idx); w.u8(f.plan[i].valves); w.varint(f.plan[i].offS); w.varint(f.plan[i].durS); }
+  }
+  if (f.hasTele) loraEncodeTelemetry(w, f.tele, f.hasMeta ? f.teleFields : (uint8_t)TF_ALL, f.hasMeta);
+  uint16_t crc = loraCrc16(buf, w.n);
+  w.u16(crc);
+  return w.ok ? w.n : 0;
+}
+
+// Validates version and CRC; unknown TLVs are skipped.
+inline bool loraDecode(const uint8_t *buf, size_t len, LoraFrame &f) {
+  loraFrameClear(f);
+  if (len < 8 || buf[0] != LORA_FRAME_VER) return false;
+  uint16_t want = (uint16_t)buf[len - 2] | ((uint16_t)buf[len - 1] << 8);
+  if (loraCrc16(buf, len - 2) != want) return false;
+  LoraReader r(buf, len - 2);
+  r.u8();
+  uint8_t kc = r.u8(); f.kind = kc >> 4; f.code = kc & 0x0F;
+  f.status = r.u8();
+  f.mid = r.varint();
+  f.node = r.varint();
+  f.schedHash = r.u16();
+  uint32_t idx1 = r.varint(); f.idx = idx1 ? (int32_t)(idx1 - 1) : -1;
+  while (r.ok && r.pos < r.n) {
+    uint8_t tag = r.u8(); uint8_t l = r.u8();
+    size_t end = r.pos + l; if (end > r.n) return false;
+    uint8_t v = tag & 0x0F;
+    switch (tag & 0xF0) {
+      case LT_VT_MS: if (v < LORA_MAX_VALVES) { f.tele.vtMs[v] = r.varint(); f.hasTele = true; } break;
+      case LT_MOIST: if (v < LORA_MAX_VALVES) { f.tele.moist[v] = r.u8(); f.tele.moistPresent |= (1 << v); f.hasTele = true; } break;
+      default:
+        switch (tag) {
+          case LT_DUR_MS: f.durMs = r.varint(); break;
+          case LT_VSEL: f.valveSel = r.u8(); break;
+          case LT_NEWID: f.newId = r.varint(); break;
+          case LT_CAPS: f.caps = r.u8(); break;
+          case LT_TARGETS:
+            if (l < 2 || l - 2 > LORA_GROUP_BYTES) break;
+            f.targets.base = r.u16(); f.targets.nbytes = (uint8_t)(l - 2);
+            for (uint8_t i = 0; i < f.targets.nbytes; ++i) f.targets.bits[i] = r.u8();
+            break;
+          case LT_SLOT_MS: f.slotMs = r.u16(); break;
+          case LT_WAKE_MS: f.wakeMs = (int32_t)r.varint(); break;
+          case LT_TELE_META: if (l == 3) { f.hasMeta = true; f.teleSeq = r.u8(); f.teleFlags = r.u8(); f.teleFields = r.u8(); } break;
+          case LT_EPOCH: if (l == 6) f.epochMs = r.epoch(); break;
+          case LT_PLAN:
+            if (l < 6) break;
+            f.planT0Ms = r.epoch();
+            while (r.ok && r.pos < end && f.planN < LORA_PLAN_MAX) {
+              LoraPlanWin &pw = f.plan[f.planN++];
+              pw.idx = r.u8(); pw.valves = r.u8(); pw.offS = r.varint(); pw.durS = r.varint();
+            }
+            if (r.pos > end) return false;
+            break;
+          case LT_VALVES: f.tele.valvePresent = r.u8(); f.tele.valveOpen = r.u8(); f.hasTele = true; break;
+          case LT_BATT: f.tele.battPct = r.u8(); f.hasTele = true; break;
+          case LT_BV_MV: f.tele.bvMv = r.u16(); f.hasTele = true; break;
+          case LT_SOLV_MV: f.tele.solvMv = r.u16(); f.hasTele = true; break;
+          case LT_SOLI_MA: f.tele.soliMa = (int32_t)r.varint(); f.hasTele = true; break;
+          case LT_AWAKE_PM: f.tele.awakePm = (int16_t)r.u16(); f.hasTele = true; break;
+          default: break;
+        }
+    }
+    r.pos = end;
+  }
+  return r.ok;
+}
+
+// Legacy text form of the telemetry block: VALVE1=OPEN,VT1=0,M1=40,...,BATT=80,BV=3.95,SOLV=5.10[,SOLI=12][,AWAKE=2.4]
+// (only the fields in `fields` for partial telemetry)
+inline size_t loraTelemetryText(const LoraTelemetry &t, char *out, size_t cap, uint8_t fields = TF_ALL) {
+  size_t n = 0; if (cap == 0) return 0; out[0] = 0;
+#define LF_APPEND(...) do { if (n < cap) { int w_ = snprintf(out + n, cap - n, __VA_ARGS__); if (w_ > 0) n += (size_t)w_; if (n >= cap) n = cap - 1; } } while (0)
+  for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) {
+    bool open = t.valveOpen & (1 << i);
+    if ((fields & TF_VALVES) && (t.valvePresent & (1 << i)))
+      LF_APPEND("%sVALVE%u=%s,VT%u=%lu", n ? "," : "", i + 1, open ? "OPEN" : "CLOSED", i + 1, (unsigned long)(open ? t.vtMs[i] : 0));
+    if ((fields & TF_MOIST) && (t.moistPresent & (1 << i))) LF_APPEND("%sM%u=%u", n ? "," : "", i + 1, t.moist[i]);
+  }
+  if ((fields & TF_BATT) && t.battPct >= 0) LF_APPEND("%sBATT=%d,BV=%u.%02u", n ? "," : "", t.battPct, t.bvMv / 1000, (t.bvMv % 1000) / 10);
+  if (fields & TF_SOLV) LF_APPEND("%sSOLV=%u.%02u", n ? "," : "", t.solvMv / 1000, (t.solvMv % 1000) / 10);
+  if ((fields & TF_SOLI) && t.soliMa >= 0) LF_APPEND("%sSOLI=%ld", n ? "," : "", (long)t.soliMa);
+  if ((fields & TF_AWAKE) && t.awakePm >= 0) LF_APPEND("%sAWAKE=%d.%d", n ? "," : "", t.awakePm / 10, t.awakePm % 10);
+#undef LF_APPEND
+  return n;
+}
+
+// "3.95" -> 3950
+inline uint16_t loraParseMv(WireSpan v) {
+  int dot = v.indexOf('.');
+  uint32_t mv = (uint32_t)(dot < 0 ? v : v.sub(0, (uint16_t)dot)).toLong(0) * 1000, scale = 100;
+  if (dot >= 0) for (uint16_t i = (uint16_t)(dot + 1); i < v.n && scale; ++i, scale /= 10) if (v.p[i] >= '0' && v.p[i] <= '9') mv += (uint32_t)(v.p[i] - '0') * scale;
+  return mv > 0xFFFF ? 0xFFFF : (uint16_t)mv;
+}
+// Reverse of loraTelemetryText for legacy ASCII lines (STAT / ACK extras); returns the
+// fields found (TF_*)
+inline uint8_t loraTelemetryParse(WireSpan text, LoraTelemetry &t) {
+  loraTelemetryClear(t);
+  uint8_t fields = 0; WireKvIter it(text); WireSpan k, v;
+  while (it.next(k, v)) {
+    if (k.n == 2 && k.p[0] == 'M' && k.p[1] >= '1' && k.p[1] < '1' + LORA_MAX_VALVES) {
+      uint8_t i = (uint8_t)(k.p[1] - '1'); long m = v.toLong(-1);
+      if (m >= 0 && m <= 100) { t.moist[i] = (uint8_t)m; t.moistPresent |= (uint8_t)(1 << i); fields |= TF_MOIST; }
+    }
+    else if (k.n == 6 && memcmp(k.p, "VALVE", 5) == 0 && k.p[5] >= '1' && k.p[5] < '1' + LORA_MAX_VALVES) {
+      uint8_t b = (uint8_t)(1 << (k.p[5] - '1'));
+      t.valvePresent |= b; if (v.eq("OPEN")) t.valveOpen |= b;
+      fields |= TF_VALVES;
+    }
+    else if (k.n == 3 && k.p[0] == 'V' && k.p[1] == 'T' && k.p[2] >= '1' && k.p[2] < '1' + LORA_MAX_VALVES) t.vtMs[k.p[2] - '1'] = v.toU32();
+    else if (k.eq("BATT")) { t.battPct = (int16_t)v.toLong(-1); fields |= TF_BATT; }
+    else if (k.eq("BV")) { t.bvMv = loraParseMv(v); fields |= TF_BATT; }
+    else if (k.eq("SOLV")) { t.solvMv = loraParseMv(v); fields |= TF_SOLV; }
+    else if (k.eq("SOLI")) { t.soliMa = (int32_t)v.toLong(-1); fields |= TF_SOLI; }
+    else if (k.eq("AWAKE")) {                                   // "2.4" -> 24 permille
+      int dot = v.indexOf('.');
+      long pm = (dot < 0 ? v : v.sub(0, (uint16_t)dot)).toLong(-1) * 10;
+      if (dot >= 0 && dot + 1 < (int)v.n && v.p[dot + 1] >= '0' && v.p[dot + 1] <= '9') pm += v.p[dot + 1] - '0';
+      if (pm >= 0 && pm <= 1000) { t.awakePm = (int16_t)pm; fields |= TF_AWAKE; }
+    }
+  }
+  return fields;
+}
+
+// Render a decoded frame in its ASCII equivalent (schedule ID shown as #hash).
+inline size_t loraFrameToText(const LoraFrame &f, char *out, size_t cap) {
+  char tele[160] = ""; if (f.hasTele) loraTelemetryText(f.tele, tele, sizeof(tele), f.hasMeta ? f.teleFields : (uint8_t)TF_ALL);
+  int n = 0;
+  switch (f.kind) {
+    case LF_CMD:
+      n = snprintf(out, cap, "CMD|MID=%lu|%s|N=%lu,S=#%04X,I=%ld", (unsigned long)f.mid, loraCmdName(f.code), (unsigned long)f.node, f.schedHash, (long)f.idx);
+      if (f.durMs && n > 0 && (size_t)n < cap) n += snprintf(out + n, cap - n, ",T=%lu", (unsigned long)f.durMs);
+      if (f.targets.nbytes && n > 0 && (size_t)n < cap) n += snprintf(out + n, cap - n, ",G=%u,SL=%u", f.targets.count(), f.slotMs);
+      if (f.epochMs && n > 0 && (size_t)n < cap) n += snprintf(out + n, cap - n, ",EP=%lu.%03u", (unsigned long)(f.epochMs / 1000), (unsigned)(f.epochMs % 1000));
+      if (f.planN && n > 0 && (size_t)n < cap) n += snprintf(out + n, cap - n, ",T0=%lu.%03u,W=", (unsigned long)(f.planT0Ms / 1000), (unsigned)(f.planT0Ms % 1000));
+      for (uint8_t i = 0; i < f.planN && n > 0 && (size_t)n < cap; ++i)
+        n += snprintf(out + n, cap - n, "%s%u@%lu+%lu", i ? ";" : "", f.plan[i].idx, (unsigned long)f.plan[i].offS, (unsigned long)f.plan[i].durS);
+      break;
+    case LF_ACK:
+      n = snprintf(out, cap, "ACK|MID=%lu|%s|N=%lu,S=#%04X,I=%ld|%s%s%s", (unsigned long)f.mid, loraCmdName(f.code), (unsigned long)f.node, f.schedHash, (long)f.idx,
+                   f.status ? "ERR" : "OK", tele[0] ? "|" : "", tele);
+      break;
+    case LF_STAT: n = snprintf(out, cap, "STAT|N=%lu|%s", (unsigned long)f.node, tele); break;
+    case LF_AUTO_CLOSED: n = snprintf(out, cap, "AUTO_CLOSED|N=%lu|S=#%04X,I=%ld,%s", (unsigned long)f.node, f.schedHash, (long)f.idx, tele); break;
+    case LF_AUTO_OPENED: n = snprintf(out, cap, "AUTO_OPENED|N=%lu|S=#%04X,I=%ld,%s", (unsigned long)f.node, f.schedHash, (long)f.idx, tele); break;
+    default: n = snprintf(out, cap, "BIN|KIND=%u", f.kind); break;
+  }
+  // trailing keys join the telemetry block, or open one when there is none
+  bool block = f.hasTele && tele[0];
+#define LF_SEP (out[n - 1] == '|' ? "" : block ? "," : "|")
+  if (f.hasMeta && n > 0 && (size_t)n < cap) { n += snprintf(out + n, cap - n, "%sTF=%02X", LF_SEP, f.teleFields); block = true; }
+  if ((f.teleFlags & LTM_SEQ) && n > 0 && (size_t)n < cap) n += snprintf(out + n, cap - n, ",TSEQ=%u%s", f.teleSeq, (f.teleFlags & LTM_KEY) ? ",KEY=1" : "");
+  if (f.kind != LF_CMD && f.wakeMs >= 0 && n > 0 && (size_t)n < cap) n += snprintf(out + n, cap - n, "%sWAKE=%ld", LF_SEP, (long)f.wakeMs);
+#undef LF_SEP
+  if (n < 0) n = 0;
+  if ((size_t)n >= cap) n = (int)cap - 1;
+  return (size_t)n;
+}
+
+// Time on air in microseconds (Semtech SX127x/SX126x formula).
+// cr: 1..4 for 4/5..4/8, matching LORA_CODINGRATE.
+inline uint32_t loraAirtimeUs(size_t payloadLen, uint8_t sf = 7, uint32_t bwHz = 125000, uint8_t cr = 1,
+                              uint16_t preamble = 8, bool crcOn = true, bool implicitHeader = false) {
+  double tSym = (double)(1UL << sf) / (double)bwHz * 1e6;
+  bool lowDr = tSym > 16000.0;
+  double num = 8.0 * payloadLen - 4.0 * sf + 28 + (crcOn ? 16 : 0) - (implicitHeader ? 20 : 0);
+  double den = 4.0 * (sf - (lowDr ? 2 : 0));
+  double nPayload = 8 + fmax(ceil(num / den) * (cr + 4), 0.0);
+  double tPre = (preamble + 4.25) * tSym;
+  return (uint32_t)(tPre + nPayload * tSym);
+}
@@ -0,0 +1,166 @@
+#pragma once
+// Node-local schedule runs.
+// Instead of an OPEN / CLOSE round trip per step, the controller hands every node its
+// slice of a run before it starts (PLAN): windows of (step, valves, offset, duration)
+// counted from a start time T0 on the controller's clock. Nodes open on their own and
+// close through their valve timer, reporting each transition unasked (AUTO_OPENED /
+// AUTO_CLOSED). The controller keeps the pump and the progress index on the same
+// timeline (PlanRun) and only steps in with a live OPEN when a report is overdue.
+// Hand-over between nodes stays make-before-break: a node keeps every window open
+// NODE_PLAN_OVERLAP_MS past its planned end, which also covers clock error.
+// Clocks: PLAN and the TIME beacon stamp the controller's unix time in ms; EpochClock
+// keeps the node's offset from millis(). OPEN / CLOSE naming one of the plan's steps
+// act on that window only; any other OPEN / CLOSE / EMERGENCY drops the plan.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "lora_frame.h"
+#include "zone_runner.h"
+
+#ifndef NODE_PLAN_OVERLAP_MS
+#define NODE_PLAN_OVERLAP_MS 2000   // node: window closes this long after its planned end
+#endif
+#ifndef NODE_PLAN_LEAD_MS
+#define NODE_PLAN_LEAD_MS 5000      // controller: T0 this far out, plus one ACK round per node
+#endif
+#ifndef NODE_PLAN_REPORT_MS
+#define NODE_PLAN_REPORT_MS 8000    // controller: AUTO_OPENED overdue after this (+ wake cadence)
+#endif
+#ifndef NODE_BEACON_MS
+#define NODE_BEACON_MS 300000UL     // TIME beacon period while a plan runs
+#endif
+#define NODE_EPOCH_MIN_MS 1600000000000LL   // earlier = clock never set
+
+// The controller's clock as seen by a node
+struct EpochClock {
+  int64_t baseMs = 0;
+  uint32_t atMs = 0;            // millis() at the last sync
+  bool valid = false;
+  int32_t lastStepMs = 0;       // correction the last sync applied
+  uint32_t syncs = 0;
+
+  void sync(int64_t epochMs, uint32_t nowMs) {
+    if (epochMs < NODE_EPOCH_MIN_MS) return;
+    if (valid) lastStepMs = (int32_t)(epochMs - now(nowMs));
+    baseMs = epochMs; atMs = nowMs; valid = true; syncs++;
+  }
+  int64_t now(uint32_t nowMs) const { return valid ? baseMs + (uint32_t)(nowMs - atMs) : 0; }
+};
+
+enum PlanWinState : uint8_t {
+  PW_PENDING,    // not opened yet
+  PW_OPEN,       // opened (node: by the plan or a live OPEN; controller: reported)
+  PW_DONE,       // closed
+  PW_MISSED,     // its time passed without an open
+  PW_NUDGED      // controller: live OPEN in flight
+};
+
+// Node side: the windows of one run
+struct NodePlan {
+  uint16_t schedHash = 0;
+  int64_t t0 = 0;
+  uint8_t n = 0;
+  LoraPlanWin w[LORA_PLAN_MAX];
+  uint8_t st[LORA_PLAN_MAX];
+  uint32_t runs = 0, opened = 0, missed = 0, cancels = 0;
+
+  void load(uint16_t hash, int64_t start, const LoraPlanWin *win, uint8_t cnt) {
+    cancel();
+    schedHash = hash; t0 = start; n = cnt > LORA_PLAN_MAX ? LORA_PLAN_MAX : cnt;
+    memcpy(w, win, n * sizeof(LoraPlanWin)); memset(st, PW_PENDING, sizeof(st));
+    if (n) runs++;
+  }
+  bool active() const { for (uint8_t i = 0; i < n; ++i) if (st[i] <= PW_OPEN) return true; return false; }
+  void cancel() { if (active()) cancels++; n = 0; }
+  int find(int idx) const { for (uint8_t i = 0; i < n; ++i) if (w[i].idx == idx) return i; return -1; }
+  int64_t openAt(uint8_t i) const { return t0 + (int64_t)w[i].offS * 1000; }
+  int64_t closeAt(uint8_t i) const { return openAt(i) + (int64_t)w[i].durS * 1000 + NODE_PLAN_OVERLAP_MS; }
+
+  // Opens due windows through act.open(i, ms to keep open); the caller's valve timer closes them.
+  // A window that arrives late opens for what is left of it.
+  template <class Act>
+  void poll(int64_t now, Act &act) {
+    for (uint8_t i = 0; i < n; ++i) {
+      if (st[i] == PW_OPEN && now >= closeAt(i)) st[i] = PW_DONE;
+      if (st[i] != PW_PENDING || now < openAt(i)) continue;
+      if (now >= closeAt(i) - NODE_PLAN_OVERLAP_MS) { st[i] = PW_MISSED; missed++; continue; }
+      st[i] = PW_OPEN; opened++;
+      act.open(i, (uint32_t)(closeAt(i) - now));
+    }
+  }
+  // Until the next window opens, -1 when none is pending
+  int64_t untilNext(int64_t now) const {
+    int64_t best = -1;
+    for (uint8_t i = 0; i < n; ++i) if (st[i] == PW_PENDING) { int64_t d = openAt(i) - now; if (d < 0) d = 0; if (best < 0 || d < best) best = d; }
+    return best;
+  }
+  // Live OPEN / CLOSE for step idx of this plan; false when it is not one of ours
+  bool mark(uint16_t hash, int idx, bool open) {
+    int i = hash == schedHash ? find(idx) : -1;
+    if (i < 0) return false;
+    st[i] = open ? PW_OPEN : PW_DONE;
+    return true;
+  }
+};
+
+// Controller side: the run's timeline and what the nodes reported. Windows are whole
+// seconds; the first group opens at T0 and is timed from the end of the pump lead, as
+// in the live runner.
+struct PlanRun {
+  uint16_t n = 0;
+  uint16_t node[ZR_MAX];
+  uint32_t offS[ZR_MAX], durS[ZR_MAX];
+  uint8_t st[ZR_MAX];
+  int64_t t0 = 0;
+  uint32_t leadS = 0, endS = 0;
+  uint32_t reports = 0, late = 0, missed = 0;
+
+  bool build(const ZoneStep *zs, uint16_t cnt, uint16_t cap, uint32_t leadMs) {
+    if (!cnt || cnt > ZR_MAX) return false;
+    uint32_t at[ZR_MAX], len = zonePlanTimes(zs, cnt, cap, at);
+    n = cnt; leadS = (leadMs + 999) / 1000; endS = leadS + (len + 999) / 1000;
+    uint16_t g0 = zoneGroupEnd(zs, cnt, 0);
+    for (uint16_t i = 0; i < n; ++i) {
+      node[i] = zs[i].node; st[i] = PW_PENDING;
+      durS[i] = (zs[i].durMs + 999) / 1000;
+      if (i < g0 && at[i] == 0) { offS[i] = 0; durS[i] += leadS; }
+      else offS[i] = leadS + (at[i] + 999) / 1000;
+    }
+    reports = late = missed = 0;
+    return true;
+  }
+  // Windows of one node into out[0..max); returns how many it has (may exceed max)
+  uint8_t slice(uint16_t nd, LoraPlanWin *out, uint8_t max) const {
+    uint8_t c = 0;
+    for (uint16_t i = 0; i < n; ++i) {
+      if (node[i] != nd) continue;
+      if (c < max) { out[c].idx = (uint8_t)i; out[c].valves = 0; out[c].offS = offS[i]; out[c].durS = durS[i]; }
+      if (c < 0xFF) c++;
+    }
+    return c;
+  }
+  int64_t openAt(uint16_t i) const { return t0 + (int64_t)offS[i] * 1000; }
+  int64_t closeAt(uint16_t i) const { return openAt(i) + (int64_t)durS[i] * 1000; }
+  int64_t pumpAt() const { return t0 + (int64_t)leadS * 1000; }
+  int64_t endAt() const { return t0 + (int64_t)endS * 1000; }
+  // First step due now that has not been given up, -1 if none
+  int current(int64_t now) const { for (uint16_t i = 0; i < n; ++i) if (st[i] != PW_MISSED && now >= openAt(i) && now < closeAt(i)) return i; return -1; }
+  // Some step that opens at T0 is confirmed open (the pump may start)
+  bool started() const { for (uint16_t i = 0; i < n; ++i) if (!offS[i] && (st[i] == PW_OPEN || st[i] == PW_DONE)) return true; return false; }
+  bool startFailed() const { for (uint16_t i = 0; i < n; ++i) if (!offS[i] && st[i] != PW_MISSED) return false; return true; }
+  // Pending step whose report is `graceMs` overdue and still has time left, -1 if none
+  int overdue(int64_t now, uint32_t graceMs) const {
+    for (uint16_t i = 0; i < n; ++i) if (st[i] == PW_PENDING && now >= openAt(i) + graceMs && now < closeAt(i)) return i;
+    return -1;
+  }
+  // Node report for step i; returns the open latency in ms (report vs. plan) or -1
+  int32_t report(uint16_t i, bool open, int64_t now) {
+    if (i >= n) return -1;
+    reports++;
+    if (!open) { st[i] = PW_DONE; return -1; }
+    bool first = st[i] == PW_PENDING || st[i] == PW_NUDGED;
+    if (st[i] != PW_DONE) st[i] = PW_OPEN;
+    return first && now >= openAt(i) ? (int32_t)(now - openAt(i)) : -1;
+  }
+};
@@ -0,0 +1,114 @@
+#pragma once
+// Duty-cycled (low-power) nodes.
+// A battery/solar node does not listen continuously: the radio samples the channel for
+// NODE_RX_WINDOW_MS every `wakeMs` (SX126x RX duty cycle) while the MCU light-sleeps
+// until the next radio IRQ, valve deadline or telemetry slot. To reach such a node the
+// controller sends with a preamble longer than the node's sleep period, so command
+// latency is bounded by wakeMs + airtime. Nodes advertise their cadence in every ACK /
+// STAT (LT_WAKE_MS, WAKE=<ms>, 0 = always listening) and the controller keeps it in a
+// NodeWakeTable; POWER (T = cadence in ms) changes it remotely.
+// PowerMeter accumulates awake vs. light-sleep time on the node and turns it into an
+// estimated average current from the NODE_I_* figures (no current sensor on the board).
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "wire_proto.h"
+
+#ifndef NODE_RX_WINDOW_MS
+#define NODE_RX_WINDOW_MS 12        // channel sample per wake (>= 8 symbols at SF7/125 kHz)
+#endif
+#ifndef NODE_WAKE_MAX_MS
+#define NODE_WAKE_MAX_MS 10000      // longest cadence (preamble and ACK deadline grow with it)
+#endif
+#ifndef NODE_WAKE_SLOTS
+#define NODE_WAKE_SLOTS 32          // duty-cycled nodes the controller tracks
+#endif
+#ifndef NODE_I_AWAKE_UA
+#define NODE_I_AWAKE_UA 45000       // MCU running, display off
+#endif
+#ifndef NODE_I_SLEEP_UA
+#define NODE_I_SLEEP_UA 800         // MCU light sleep
+#endif
+#ifndef NODE_I_RX_UA
+#define NODE_I_RX_UA 5300           // SX1262 receiving (sleeping radio ~1 uA is ignored)
+#endif
+
+// Preamble (symbols) a sender needs so a node sampling every wakeMs sees at least one
+// full window of it: sleep + 2 x window, plus the default 8 symbols for lock.
+inline uint16_t nodeWakePreamble(uint32_t wakeMs, uint8_t sf = 7, uint32_t bwHz = 125000, uint16_t base = 8) {
+  if (!wakeMs) return base;
+  uint32_t symUs = (uint32_t)((1UL << sf) * 1000000ULL / bwHz);
+  uint32_t sym = (uint32_t)(((uint64_t)(wakeMs + NODE_RX_WINDOW_MS) * 1000 + symUs - 1) / symUs) + base;
+  return sym > 0xFFFF ? 0xFFFF : (uint16_t)sym;
+}
+
+// Cadence per node (controller side); unlisted nodes listen continuously
+struct NodeWakeTable {
+  uint16_t node[NODE_WAKE_SLOTS];
+  uint16_t ms[NODE_WAKE_SLOTS];
+  uint8_t n = 0;
+
+  uint32_t wakeMs(uint16_t nd) const { for (uint8_t i = 0; i < n; ++i) if (node[i] == nd) return ms[i]; return 0; }
+  // True when the table changed; 0 removes the node
+  bool set(uint16_t nd, uint32_t wake) {
+    if (wake > NODE_WAKE_MAX_MS) wake = NODE_WAKE_MAX_MS;
+    for (uint8_t i = 0; i < n; ++i) {
+      if (node[i] != nd) continue;
+      if (wake == ms[i]) return false;
+      if (wake) { ms[i] = (uint16_t)wake; return true; }
+      node[i] = node[n - 1]; ms[i] = ms[n - 1]; n--; return true;
+    }
+    if (!wake || n >= NODE_WAKE_SLOTS) return false;
+    node[n] = nd; ms[n] = (uint16_t)wake; n++; return true;
+  }
+  uint32_t maxWakeMs() const { uint32_t m = 0; for (uint8_t i = 0; i < n; ++i) if (ms[i] > m) m = ms[i]; return m; }
+  // "<node>:<ms>;..." as stored in prefs; false (table unchanged) on a malformed entry
+  bool parse(WireSpan spec) {
+    NodeWakeTable t; WireSpan rest = spec;
+    while (rest.n) {
+      int semi = rest.indexOf(';');
+      WireSpan e = (semi < 0 ? rest : rest.sub(0, (uint16_t)semi)).trim();
+      rest = semi < 0 ? wireSpan("") : rest.sub((uint16_t)(semi + 1));
+      if (e.empty()) continue;
+      int c = e.indexOf(':'); if (c <= 0) return false;
+      long nd = e.sub(0, (uint16_t)c).toLong(-1), w = e.sub((uint16_t)(c + 1)).toLong(-1);
+      if (nd < 0 || nd > 0xFFFF || w < 0 || w > NODE_WAKE_MAX_MS) return false;
+      t.set((uint16_t)nd, (uint32_t)w);
+    }
+    *this = t; return true;
+  }
+  int text(char *out, size_t cap) const {
+    int len = 0; if (cap) out[0] = 0;
+    for (uint8_t i = 0; i < n && len >= 0 && (size_t)len < cap; ++i) len += snprintf(out + len, cap - len, "%s%u:%u", i ? ";" : "", node[i], ms[i]);
+    return len;
+  }
+};
+
+// Awake / asleep bookkeeping (node side)
+struct PowerMeter {
+  uint64_t awakeUs = 0, sleepUs = 0;
+  uint32_t sleeps = 0, wakeRadio = 0, wakeTimer = 0, wakeButton = 0;
+
+  void reset() { *this = PowerMeter(); }
+  void awake(uint32_t us) { awakeUs += us; }
+  void slept(uint32_t us) { sleepUs += us; sleeps++; }
+  // Awake share in permille
+  uint16_t awakePm() const { uint64_t t = awakeUs + sleepUs; return t ? (uint16_t)(awakeUs * 1000 / t) : 1000; }
+  // Estimated average current: MCU share + radio RX duty (rxPm = permille of time in RX)
+  uint32_t avgUa(uint16_t rxPm) const {
+    uint64_t t = awakeUs + sleepUs; if (!t) return NODE_I_AWAKE_UA;
+    uint64_t mcu = (awakeUs * NODE_I_AWAKE_UA + sleepUs * NODE_I_SLEEP_UA) / t;
+    return (uint32_t)(mcu + (uint64_t)NODE_I_RX_UA * rxPm / 1000);
+  }
+  // e.g. "T=3600,AWAKE=2.4%,AVG_UA=2130,SLEEPS=3541,WAKE_RADIO=3,WAKE_TIMER=3530,WAKE_BTN=1"
+  int text(uint16_t rxPm, char *out, size_t cap) const {
+    uint16_t pm = awakePm();
+    return snprintf(out, cap, "T=%lu,AWAKE=%u.%u%%,AVG_UA=%lu,SLEEPS=%lu,WAKE_RADIO=%lu,WAKE_TIMER=%lu,WAKE_BTN=%lu",
+                    (unsigned long)((awakeUs + sleepUs) / 1000000ULL), pm / 10, pm % 10, (unsigned long)avgUa(rxPm), (unsigned long)sleeps,
+                    (unsigned long)wakeRadio, (unsigned long)wakeTimer, (unsigned long)wakeButton);
+  }
+};
+
+// Radio RX share of a cadence in permille (always listening = 1000)
+inline uint16_t nodeRxPm(uint32_t wakeMs) { return wakeMs ? (uint16_t)((uint32_t)NODE_RX_WINDOW_MS * 1000 / wakeMs) : 1000; }
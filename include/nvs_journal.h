@@ -0,0 +1,98 @@
+#pragma once
+// Flash-friendly persistence helpers for Preferences (NVS).
+// - LeasedCounter hands out monotonically increasing IDs from RAM and persists only
+//   the end of the current lease (one NVS write per `block` IDs). After a reboot the
+//   counter resumes at the stored lease end, so IDs may skip but are never reused.
+// - NvsJournal batches runtime progress values: a put that matches the stored value
+//   is dropped, repeated puts before the flush coalesce, and dirty entries are
+//   written once they are NVJ_FLUSH_MS old (or on flush()).
+// Templated on the store (Preferences: getUInt/putUInt/getInt/putInt/getString/putString).
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef NVJ_SLOTS
+#define NVJ_SLOTS 8
+#endif
+#ifndef NVJ_STR_MAX
+#define NVJ_STR_MAX 32
+#endif
+#ifndef NVJ_FLUSH_MS
+#define NVJ_FLUSH_MS 10000
+#endif
+
+template <class Store>
+struct LeasedCounter {
+  Store *st = nullptr;
+  const char *key = "";
+  uint32_t last = 0, end = 0, block = 64;
+  uint32_t taken = 0, leases = 0;
+
+  void begin(Store &s, const char *k, uint32_t blk) { st = &s; key = k; block = blk; last = end = st->getUInt(key, 0); }
+  uint32_t take() {
+    if (last >= end) { end = last + block; st->putUInt(key, end); leases++; }
+    taken++;
+    return ++last;
+  }
+  uint32_t avoided() const { return taken > leases ? taken - leases : 0; }
+};
+
+template <class Store>
+struct NvsJournal {
+  struct Slot {
+    char key[16];
+    bool isStr, dirty, loaded;
+    int32_t val, saved;
+    char str[NVJ_STR_MAX], savedStr[NVJ_STR_MAX];
+    uint32_t dirtySince;
+  };
+  Store *st = nullptr;
+  Slot slots[NVJ_SLOTS];
+  uint8_t count = 0;
+  uint32_t puts = 0, writes = 0;
+
+  void begin(Store &s) { st = &s; count = 0; }
+
+  void putInt(const char *key, int32_t v, uint32_t nowMs) {
+    puts++;
+    Slot *s = slot(key, false); if (!s) { st->putInt(key, v); writes++; return; }
+    if (!s->loaded) { s->saved = st->getInt(key, v == 0 ? -1 : 0); s->loaded = true; }   // missing key never matches v
+    s->val = v;
+    if (v == s->saved) s->dirty = false; else mark(s, nowMs);
+  }
+  void putString(const char *key, const char *v, uint32_t nowMs) {
+    puts++;
+    Slot *s = slot(key, true); if (!s) { st->putString(key, v); writes++; return; }
+    if (!s->loaded) { s->savedStr[0] = 0; st->getString(key, s->savedStr, sizeof(s->savedStr)); s->loaded = true; }
+    snprintf(s->str, sizeof(s->str), "%s", v);
+    if (strcmp(s->str, s->savedStr) == 0) s->dirty = false; else mark(s, nowMs);
+  }
+  // Puts that did not turn into an NVS write (deduplicated or coalesced)
+  uint32_t avoided() const { return puts > writes ? puts - writes : 0; }
+
+  void tick(uint32_t nowMs) { for (uint8_t i = 0; i < count; ++i) if (slots[i].dirty && nowMs - slots[i].dirtySince >= NVJ_FLUSH_MS) write(slots[i]); }
+  void flush() { for (uint8_t i = 0; i < count; ++i) if (slots[i].dirty) write(slots[i]); }
+  bool pending() const { for (uint8_t i = 0; i < count; ++i) if (slots[i].dirty) return true; return false; }
+
+  // ---- internals ----
+  Slot *slot(const char *key, bool isStr) {
+    for (uint8_t i = 0; i < count; ++i) if (strcmp(slots[i].key, key) == 0) return &slots[i];
+    if (count >= NVJ_SLOTS || strlen(key) >= sizeof(slots[0].key)) return nullptr;   // unjournaled: write through
+    Slot &s = slots[count++]; memset(&s, 0, sizeof(s));
+    strcpy(s.key, key); s.isStr = isStr;
+    return &s;
+  }
+  void mark(Slot *s, uint32_t nowMs) { if (!s->dirty) { s->dirty = true; s->dirtySince = nowMs; } }
+  void write(Slot &s) {
+    if (s.isStr) { st->putString(s.key, s.str); memcpy(s.savedStr, s.str, sizeof(s.str)); }
+    else { st->putInt(s.key, s.val); s.saved = s.val; }
+    s.dirty = false; writes++;
+  }
+};
+
+// "WRITES=..,AVOIDED=..,AVOIDED_PER_H=.." over the uptime so far (journal + counters)
+inline int nvsStatsText(uint32_t writes, uint32_t avoided, uint32_t uptimeMs, char *out, size_t cap) {
+  uint32_t perH = uptimeMs ? (uint32_t)((uint64_t)avoided * 3600000ULL / uptimeMs) : 0;
+  return snprintf(out, cap, "WRITES=%lu,AVOIDED=%lu,AVOIDED_PER_H=%lu", (unsigned long)writes, (unsigned long)avoided, (unsigned long)perH);
+}
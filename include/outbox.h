@@ -0,0 +1,225 @@
+#pragma once
+// Prioritized, coalescing outbound status queue.
+// publishStatusMsg() posts here; per-channel workers in the sketch drain it when the
+// channel is ready (MQTT: AT queue has room, BLE: client connected, SMS: periodic
+// digest or immediately for alarms). Each event type is routed to a priority class
+// and a set of channels by prefix; identical messages already queued are coalesced
+// into one with a repeat count, and debug-class events are rate-limited per type.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef OB_MSG_MAX
+#define OB_MSG_MAX 200          // longer messages are truncated (BLE limit)
+#endif
+#ifndef OB_QUEUE_LEN
+#define OB_QUEUE_LEN 16         // per channel
+#endif
+#ifndef OB_ROUTES_MAX
+#define OB_ROUTES_MAX 16
+#endif
+#ifndef OB_RATE_SLOTS
+#define OB_RATE_SLOTS 16
+#endif
+#ifndef OB_DEBUG_MIN_MS
+#define OB_DEBUG_MIN_MS 5000    // at most one debug event of a given type per window
+#endif
+
+enum OutboxPrio : uint8_t { OB_ALARM = 0, OB_STATE = 1, OB_DEBUG = 2 };
+enum OutboxChan : uint8_t { OB_MQTT = 0, OB_BLE = 1, OB_SMS = 2, OB_CH_COUNT = 3 };
+#define OB_CH_MQTT (1u << OB_MQTT)
+#define OB_CH_BLE  (1u << OB_BLE)
+#define OB_CH_SMS  (1u << OB_SMS)
+#define OB_CH_ALL  (OB_CH_MQTT | OB_CH_BLE | OB_CH_SMS)
+
+inline char outboxPrioChar(uint8_t p) { return p == OB_ALARM ? 'A' : p == OB_STATE ? 'S' : 'D'; }
+
+struct OutboxMsg {
+  char text[OB_MSG_MAX];
+  uint8_t prio;
+  uint16_t repeats;             // extra identical posts folded into this one
+  uint32_t firstMs;
+};
+
+struct OutboxQueue {
+  OutboxMsg slots[OB_QUEUE_LEN];
+  bool used[OB_QUEUE_LEN];
+  uint8_t count = 0;
+  uint32_t enqueued = 0, coalesced = 0, dropped = 0, sent = 0;
+
+  OutboxQueue() { memset(used, 0, sizeof(used)); }
+
+  // Coalesces with an identical queued message; when full, evicts the oldest
+  // message of the lowest priority (or refuses the new one if it is the lowest).
+  bool push(const char *text, uint8_t prio, uint32_t now) {
+    for (uint8_t i = 0; i < OB_QUEUE_LEN; ++i)
+      if (used[i] && strncmp(slots[i].text, text, OB_MSG_MAX - 1) == 0) {
+        if (slots[i].repeats < 0xFFFF) slots[i].repeats++;
+        if (prio < slots[i].prio) slots[i].prio = prio;
+        coalesced++; return true;
+      }
+    int slot = -1;
+    for (uint8_t i = 0; i < OB_QUEUE_LEN && slot < 0; ++i) if (!used[i]) slot = i;
+    if (slot < 0) {
+      int victim = -1;
+      for (uint8_t i = 0; i < OB_QUEUE_LEN; ++i) {
+        if (slots[i].prio < prio) continue;        // never evict more important
+        if (victim < 0 || slots[i].prio > slots[victim].prio ||
+            (slots[i].prio == slots[victim].prio && (int32_t)(slots[i].firstMs - slots[victim].firstMs) < 0)) victim = i;
+      }
+      dropped++;
+      if (victim < 0) return false;
+      used[victim] = false; count--; slot = victim;
+    }
+    OutboxMsg &m = slots[slot];
+    snprintf(m.text, sizeof(m.text), "%s", text);
+    m.prio = prio; m.repeats = 0; m.firstMs = now;
+    used[slot] = true; count++; enqueued++;
+    return true;
+  }
+  // Highest priority, then oldest
+  int peekBest() const {
+    int best = -1;
+    for (uint8_t i = 0; i < OB_QUEUE_LEN; ++i) {
+      if (!used[i]) continue;
+      if (best < 0 || slots[i].prio < slots[best].prio ||
+          (slots[i].prio == slots[best].prio && (int32_t)(slots[i].firstMs - slots[best].firstMs) < 0)) best = i;
+    }
+    return best;
+  }
+  bool hasPrio(uint8_t prio) const { for (uint8_t i = 0; i < OB_QUEUE_LEN; ++i) if (used[i] && slots[i].prio == prio) return true; return false; }
+  void remove(int i) { if (i >= 0 && used[i]) { used[i] = false; count--; sent++; } }
+  void clear() { for (uint8_t i = 0; i < OB_QUEUE_LEN; ++i) if (used[i]) { used[i] = false; dropped++; } count = 0; }
+};
+
+// Renders a queued message with its repeat count, e.g. "EVT|INQ|ENQ|SRC=LORA (x4)"
+inline int outboxFormat(const OutboxMsg &m, char *out, size_t cap) {
+  return m.repeats ? snprintf(out, cap, "%s (x%u)", m.text, (unsigned)m.repeats + 1) : snprintf(out, cap, "%s", m.text);
+}
+
+struct OutboxRoute {
+  char prefix[24];
+  uint8_t prio;
+  uint8_t chans;
+};
+
+struct Outbox {
+  OutboxQueue q[OB_CH_COUNT];
+  OutboxRoute routes[OB_ROUTES_MAX];
+  uint8_t routeCount = 0;
+  struct { uint32_t typeHash; uint32_t lastMs; } rate[OB_RATE_SLOTS];
+  uint8_t rateNext = 0;
+  uint32_t posted = 0, rateLimited = 0, filtered = 0;   // filtered: no live channel routed
+
+  Outbox() { memset(rate, 0, sizeof(rate)); }
+
+  // Longest matching prefix wins; an existing prefix is updated in place.
+  bool setRoute(const char *prefix, uint8_t prio, uint8_t chans) {
+    for (uint8_t i = 0; i < routeCount; ++i)
+      if (strcmp(routes[i].prefix, prefix) == 0) { routes[i].prio = prio; routes[i].chans = chans; return true; }
+    if (routeCount >= OB_ROUTES_MAX || strlen(prefix) >= sizeof(routes[0].prefix)) return false;
+    OutboxRoute &r = routes[routeCount++];
+    strcpy(r.prefix, prefix); r.prio = prio; r.chans = chans;
+    return true;
+  }
+  void defaultRoutes() {
+    routeCount = 0;
+    setRoute("",                   OB_STATE, OB_CH_ALL);
+    setRoute("ERR|",               OB_ALARM, OB_CH_ALL);
+    setRoute("EVT|EMERGENCY_STOP", OB_ALARM, OB_CH_ALL);
+    setRoute("EVT|INQ|",           OB_DEBUG, OB_CH_MQTT | OB_CH_BLE);
+    setRoute("EVT|NTP_SYNC|OK",    OB_DEBUG, OB_CH_MQTT | OB_CH_BLE);
+    setRoute("EVT|NVS|",           OB_DEBUG, OB_CH_MQTT | OB_CH_BLE);
+    setRoute("STAT|",              OB_STATE, OB_CH_MQTT | OB_CH_BLE);
+  }
+  const OutboxRoute *route(const char *msg) const {
+    const OutboxRoute *best = nullptr; size_t bestLen = 0;
+    for (uint8_t i = 0; i < routeCount; ++i) {
+      size_t l = strlen(routes[i].prefix);
+      if (strncmp(msg, routes[i].prefix, l) == 0 && (!best || l > bestLen)) { best = &routes[i]; bestLen = l; }
+    }
+    return best;
+  }
+
+  // Event type = first two '|' fields ("EVT|INQ"), used for rate limiting
+  static uint32_t typeHash(const char *msg) {
+    uint32_t h = 2166136261u; int bars = 0;
+    for (const char *p = msg; *p; ++p) { if (*p == '|' && ++bars == 2) break; h = (h ^ (uint8_t)*p) * 16777619u; }
+    return h;
+  }
+  bool rateAllow(const char *msg, uint32_t now) {
+    uint32_t h = typeHash(msg);
+    for (uint8_t i = 0; i < OB_RATE_SLOTS; ++i)
+      if (rate[i].typeHash == h) {
+        if (now - rate[i].lastMs < OB_DEBUG_MIN_MS) return false;
+        rate[i].lastMs = now; return true;
+      }
+    rate[rateNext].typeHash = h; rate[rateNext].lastMs = now;
+    rateNext = (uint8_t)((rateNext + 1) % OB_RATE_SLOTS);
+    return true;
+  }
+
+  // liveChans: channels currently worth queueing for (e.g. BLE only while connected)
+  void post(const char *msg, uint32_t now, uint8_t liveChans = OB_CH_ALL) {
+    posted++;
+    const OutboxRoute *r = route(msg);
+    if (!r || !(r->chans & liveChans)) { filtered++; return; }
+    if (r->prio == OB_DEBUG && !rateAllow(msg, now)) {
+      // still fold into an identical queued copy so the count survives
+      for (uint8_t c = 0; c < OB_CH_COUNT; ++c)
+        if ((r->chans & liveChans) & (1u << c))
+          for (uint8_t i = 0; i < OB_QUEUE_LEN; ++i)
+            if (q[c].used[i] && strncmp(q[c].slots[i].text, msg, OB_MSG_MAX - 1) == 0) { q[c].slots[i].repeats++; q[c].coalesced++; }
+      rateLimited++; return;
+    }
+    for (uint8_t c = 0; c < OB_CH_COUNT; ++c) if ((r->chans & liveChans) & (1u << c)) q[c].push(msg, r->prio, now);
+  }
+
+  // Pops as many SMS-channel messages as fit into one digest text (priority order).
+  // Returns the number of messages included.
+  int buildDigest(char *out, size_t cap) {
+    OutboxQueue &s = q[OB_SMS];
+    size_t n = 0; int taken = 0;
+    if (cap) out[0] = 0;
+    char line[OB_MSG_MAX + 16];
+    while (s.count) {
+      int i = s.peekBest();
+      int l = outboxFormat(s.slots[i], line, sizeof(line));
+      if (l < 0) break;
+      size_t need = (size_t)l + (taken ? 1 : 0);
+      if (n + need >= cap) {
+        if (taken) break;
+        l = (int)(cap - 1); need = (size_t)l;          // first one alone too long: truncate
+      }
+      if (taken) out[n++] = '\n';
+      memcpy(out + n, line, (size_t)l); n += (size_t)l; out[n] = 0;
+      s.remove(i); taken++;
+    }
+    return taken;
+  }
+
+  // Per channel: NAME=depth/sent/coalesced/dropped
+  int statsText(char *out, size_t cap) const {
+    static const char *names[OB_CH_COUNT] = { "MQTT", "BLE", "SMS" };
+    int n = snprintf(out, cap, "POSTED=%lu,RATE_LIMITED=%lu,FILTERED=%lu", (unsigned long)posted, (unsigned long)rateLimited, (unsigned long)filtered);
+    for (uint8_t c = 0; c < OB_CH_COUNT && n > 0 && (size_t)n < cap; ++c)
+      n += snprintf(out + n, cap - n, ",%s=%u/%lu/%lu/%lu", names[c], (unsigned)q[c].count,
+                    (unsigned long)q[c].sent, (unsigned long)q[c].coalesced, (unsigned long)q[c].dropped);
+    return n;
+  }
+};
+
+// "A" / "S" / "D" -> priority; returns false on anything else
+inline bool outboxParsePrio(char c, uint8_t &prio) {
+  if (c == 'A' || c == 'a') prio = OB_ALARM; else if (c == 'S' || c == 's') prio = OB_STATE;
+  else if (c == 'D' || c == 'd') prio = OB_DEBUG; else return false;
+  return true;
+}
+// Channel letters M(QTT) B(LE) S(MS); "-" for none
+inline uint8_t outboxParseChans(const char *s) {
+  uint8_t m = 0;
+  for (; *s; ++s) { char c = *s; if (c == 'M' || c == 'm') m |= OB_CH_MQTT; else if (c == 'B' || c == 'b') m |= OB_CH_BLE; else if (c == 'S' || c == 's') m |= OB_CH_SMS; }
+  return m;
+}
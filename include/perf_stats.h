@@ -0,0 +1,71 @@
+#pragma once
+// On-device run metrics: loop() duration (histogram + stalls), LoRa command ACK
+// success and step-transition latency (step due -> next valve confirmed open).
+// One text line per snapshot so runs on different firmware versions can be diffed.
+// TaskMeter: per-task busy time (CPU load in per mille of wall time, worst pass) and
+// stack headroom, measured by the task itself around each pass.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PERF_STALL_US
+#define PERF_STALL_US 50000      // a loop() pass longer than this counts as a stall
+#endif
+
+struct PerfStats {
+  static const uint8_t BUCKETS = 6;                 // <1, <5, <20, <50, <200, >=200 ms
+  uint32_t loops, stalls, loopMaxUs;
+  uint64_t loopSumUs;
+  uint32_t loopHist[BUCKETS];
+  uint32_t acked, failed, attempts;                 // LoRa transactions
+  uint32_t steps, stepLatMaxMs;
+  uint64_t stepLatSumMs;
+  uint32_t sinceMs;
+
+  void reset(uint32_t nowMs) { memset(this, 0, sizeof(*this)); sinceMs = nowMs; }
+  void loopDone(uint32_t us) {
+    static const uint32_t edges[BUCKETS - 1] = { 1000, 5000, 20000, 50000, 200000 };
+    uint8_t b = 0; while (b < BUCKETS - 1 && us >= edges[b]) b++;
+    loopHist[b]++; loops++; loopSumUs += us;
+    if (us > loopMaxUs) loopMaxUs = us;
+    if (us >= PERF_STALL_US) stalls++;
+  }
+  void txnDone(bool ok, uint8_t tries) { if (ok) acked++; else failed++; attempts += tries; }
+  void stepMoved(uint32_t latencyMs) { steps++; stepLatSumMs += latencyMs; if (latencyMs > stepLatMaxMs) stepLatMaxMs = latencyMs; }
+
+  // e.g. "T=3600,LOOPS=..,AVG_US=..,MAX_US=..,STALLS=..,HIST=a/b/c/d/e/f,ACK=..,FAIL=..,ACK_PCT=..,TRIES=..,STEPS=..,STEP_AVG_MS=..,STEP_MAX_MS=.."
+  int text(uint32_t nowMs, char *out, size_t cap) const {
+    uint32_t txns = acked + failed;
+    return snprintf(out, cap,
+      "T=%lu,LOOPS=%lu,AVG_US=%lu,MAX_US=%lu,STALLS=%lu,HIST=%lu/%lu/%lu/%lu/%lu/%lu,ACK=%lu,FAIL=%lu,ACK_PCT=%lu,TRIES=%lu,STEPS=%lu,STEP_AVG_MS=%lu,STEP_MAX_MS=%lu",
+      (unsigned long)((nowMs - sinceMs) / 1000), (unsigned long)loops, (unsigned long)(loops ? loopSumUs / loops : 0), (unsigned long)loopMaxUs,
+      (unsigned long)stalls, (unsigned long)loopHist[0], (unsigned long)loopHist[1], (unsigned long)loopHist[2], (unsigned long)loopHist[3],
+      (unsigned long)loopHist[4], (unsigned long)loopHist[5], (unsigned long)acked, (unsigned long)failed,
+      (unsigned long)(txns ? acked * 100UL / txns : 0), (unsigned long)attempts, (unsigned long)steps,
+      (unsigned long)(steps ? stepLatSumMs / steps : 0), (unsigned long)stepLatMaxMs);
+  }
+};
+
+struct TaskMeter {
+  const char *name = "";
+  uint8_t core = 0;
+  uint32_t passes = 0, maxUs = 0, sinceMs = 0;
+  uint64_t busyUs = 0;
+  uint32_t stackFree = 0;       // bytes never used (high-water mark), filled in by the owner
+
+  void begin(const char *n, uint8_t c, uint32_t nowMs) { name = n; core = c; reset(nowMs); }
+  void reset(uint32_t nowMs) { passes = maxUs = 0; busyUs = 0; sinceMs = nowMs; }
+  void pass(uint32_t us) { passes++; busyUs += us; if (us > maxUs) maxUs = us; }
+  uint32_t loadPm(uint32_t nowMs) const {
+    uint64_t wallUs = (uint64_t)(nowMs - sinceMs) * 1000;
+    return wallUs ? (uint32_t)(busyUs * 1000 / wallUs) : 0;
+  }
+  // e.g. "CTRL:CORE=1,LOAD=2.4%,MAX_US=8120,PASSES=91002,STACK=5312"
+  int text(uint32_t nowMs, char *out, size_t cap) const {
+    uint32_t pm = loadPm(nowMs);
+    return snprintf(out, cap, "%s:CORE=%u,LOAD=%lu.%lu%%,MAX_US=%lu,PASSES=%lu,STACK=%lu", name, core, (unsigned long)(pm / 10),
+                    (unsigned long)(pm % 10), (unsigned long)maxUs, (unsigned long)passes, (unsigned long)stackFree);
+  }
+};
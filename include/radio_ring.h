@@ -0,0 +1,85 @@
+#pragma once
+// Lock-free single-producer / single-consumer ring of received radio packets.
+// The producer is the radio RxDone callback (ISR or Radio.IrqProcess context): it
+// copies the payload into a fixed slot and never allocates. The consumer is the
+// main loop dispatcher, which peeks, routes and pops one slot at a time.
+// Header-only so the sketches and the src/ tree share it.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#ifndef RADIO_RING_SLOTS
+#define RADIO_RING_SLOTS 8        // power of two
+#endif
+#ifndef RADIO_PKT_MAX
+#define RADIO_PKT_MAX 255         // largest LoRa payload
+#endif
+
+struct RadioPacket {
+  uint32_t ms;                    // millis() at RxDone
+  int16_t rssi;
+  int8_t snr;
+  bool truncated;                 // payload longer than RADIO_PKT_MAX
+  uint16_t len;
+  uint8_t data[RADIO_PKT_MAX + 1]; // +1 keeps ASCII payloads NUL-terminated
+};
+
+struct RadioRxCounters {
+  uint32_t received;              // packets accepted into the ring
+  uint32_t overflows;             // packets lost because the ring was full
+  uint32_t truncated;             // packets clipped to RADIO_PKT_MAX
+  uint32_t acks;                  // routed to the ACK matcher and matched
+  uint32_t staleAcks;             // ACKs with no pending transaction
+  uint32_t badFrames;             // binary frames failing version/CRC
+  uint32_t queued;                // handed to the inbound message queue
+  uint32_t queueDrops;            // inbound queue full, oldest message dropped
+};
+
+struct RadioRing {
+  RadioPacket slots[RADIO_RING_SLOTS];
+  std::atomic<uint8_t> head{0};   // written by consumer
+  std::atomic<uint8_t> tail{0};   // written by producer
+  volatile uint32_t received = 0, overflows = 0, truncated = 0;  // producer-owned
+
+  // Producer side. Returns false (and counts an overflow) when the ring is full.
+  bool push(const uint8_t *p, uint16_t n, int16_t rssi, int8_t snr, uint32_t ms) {
+    uint8_t t = tail.load(std::memory_order_relaxed);
+    uint8_t next = (uint8_t)((t + 1) % RADIO_RING_SLOTS);
+    if (next == head.load(std::memory_order_acquire)) { overflows = overflows + 1; return false; }
+    RadioPacket &s = slots[t];
+    s.truncated = n > RADIO_PKT_MAX;
+    if (s.truncated) { n = RADIO_PKT_MAX; truncated = truncated + 1; }
+    memcpy(s.data, p, n); s.data[n] = 0;
+    s.len = n; s.rssi = rssi; s.snr = snr; s.ms = ms;
+    tail.store(next, std::memory_order_release);
+    received = received + 1;
+    return true;
+  }
+
+  // Consumer side: peek() the oldest packet, pop() once done with it.
+  const RadioPacket *peek() const {
+    uint8_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return nullptr;
+    return &slots[h];
+  }
+  void pop() {
+    uint8_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return;
+    head.store((uint8_t)((h + 1) % RADIO_RING_SLOTS), std::memory_order_release);
+  }
+  uint8_t depth() const {
+    uint8_t h = head.load(std::memory_order_acquire), t = tail.load(std::memory_order_acquire);
+    return (uint8_t)((t + RADIO_RING_SLOTS - h) % RADIO_RING_SLOTS);
+  }
+  void snapshot(RadioRxCounters &c) const { c.received = received; c.overflows = overflows; c.truncated = truncated; }
+};
+
+// One-line summary for logs / status publishes, e.g. "RX=12,OVF=0,TRUNC=0,ACK=5,..."
+inline int radioCountersText(const RadioRxCounters &c, uint8_t depth, char *out, size_t cap) {
+  return snprintf(out, cap, "RX=%lu,OVF=%lu,TRUNC=%lu,ACK=%lu,STALE=%lu,BAD=%lu,INQ=%lu,INQ_DROP=%lu,DEPTH=%u",
+                  (unsigned long)c.received, (unsigned long)c.overflows, (unsigned long)c.truncated,
+                  (unsigned long)c.acks, (unsigned long)c.staleAcks, (unsigned long)c.badFrames,
+                  (unsigned long)c.queued, (unsigned long)c.queueDrops, (unsigned)depth);
+}
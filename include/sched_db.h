@@ -0,0 +1,205 @@
+#pragma once
+// Single-file binary schedule database (replaces one JSON file per schedule).
+// File layout:
+//   step arrays  packed SdbStep[stepCount] per schedule, in index order
+//   index        count x SdbRec (64 B), sorted by id for binary search
+//   footer       SdbFooter (16 B): magic, count, index offset, CRC32 of the index
+// The index is loaded into RAM at begin() with two reads; step arrays stay on flash
+// and are read on demand (readSteps), each verified against the CRC in its record.
+// Every update is a shadow copy: the new database is streamed to SDB_PATH ".new"
+// (unchanged step arrays copied from the current file, so RAM stays bounded) and
+// then renamed over the old file -- a power cut leaves either version intact.
+// Templated on the filesystem like EventLog (open/exists/remove/rename; File:
+// read/write/seek/size/close).
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <utility>
+
+#ifndef SDB_MAX
+#define SDB_MAX 256             // schedules held in the RAM index
+#endif
+#ifndef SDB_STEPS_MAX
+#define SDB_STEPS_MAX 64        // steps per schedule
+#endif
+#ifndef SDB_PATH
+#define SDB_PATH "/sched.db"
+#endif
+#define SDB_ID_MAX 24           // id bytes incl. NUL
+#define SDB_MAGIC 0x31424453u   // "SDB1"
+
+#define SDB_STEP_PAR 0x01       // step runs together with the previous one (zone group)
+#define SDB_STEP_MIN_SHIFT 2    // flags bits 2..7: feedback step minimum, in SDB_STEP_MIN_UNIT_S
+#define SDB_STEP_MIN_UNIT_S 30
+// target != 0: moisture-feedback step (step_feedback.h) -- ends once the node reads
+// `target` percent, not before its minimum; durMs is the cap. Plain steps keep both
+// zero, so their bytes (and schedule versions) are unchanged.
+struct SdbStep { uint16_t node; uint8_t flags; uint8_t target; uint32_t durMs; };
+inline uint32_t sdbStepMinMs(const SdbStep &s) { return (uint32_t)(s.flags >> SDB_STEP_MIN_SHIFT) * SDB_STEP_MIN_UNIT_S * 1000UL; }
+// Rounded up to the unit, capped at 63 units
+inline void sdbStepSetMin(SdbStep &s, uint32_t ms) {
+  uint32_t u = (ms + SDB_STEP_MIN_UNIT_S * 1000UL - 1) / (SDB_STEP_MIN_UNIT_S * 1000UL); if (u > 63) u = 63;
+  s.flags = (uint8_t)((s.flags & ((1 << SDB_STEP_MIN_SHIFT) - 1)) | (u << SDB_STEP_MIN_SHIFT));
+}
+
+struct SdbRec {
+  char id[SDB_ID_MAX];
+  char timeStr[6];              // "HH:MM"
+  char rec;                     // 'O' onetime, 'D' daily, 'W' weekly
+  uint8_t weekdayMask;
+  uint8_t enabled;
+  uint8_t reserved;
+  uint16_t stepCount;
+  uint32_t stepsOff;            // file offset of the step array
+  int64_t startEpoch;
+  uint32_t pumpOnMs, pumpOffMs;
+  uint32_t ts;                  // timestamp/version
+  uint32_t stepsCrc;
+};
+static_assert(sizeof(SdbRec) == 64, "SdbRec is an on-flash format");
+
+struct SdbFooter { uint32_t magic; uint32_t count; uint32_t indexOff; uint32_t crc; };
+
+inline uint32_t sdbCrc32(const void *data, size_t n, uint32_t crc = 0) {
+  const uint8_t *p = (const uint8_t *)data; crc = ~crc;
+  for (size_t i = 0; i < n; ++i) { crc ^= p[i]; for (int b = 0; b < 8; ++b) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1))); }
+  return ~crc;
+}
+
+// Supplies record i (in id order) for a rewrite; steps is null when only the record is wanted.
+typedef bool (*SdbSource)(void *ctx, uint16_t i, SdbRec &rec, SdbStep *steps);
+
+template <class FS>
+struct SchedDb {
+  typedef decltype(std::declval<FS &>().open("", "r")) File;
+  FS *fs = nullptr;
+  SdbRec idx[SDB_MAX];
+  uint16_t count = 0;
+  uint32_t commits = 0, crcErrors = 0;
+
+  // Loads the index. False when there is no (valid) database yet.
+  bool begin(FS &f) {
+    fs = &f; count = 0;
+    if (fs->exists(SDB_PATH ".new")) fs->remove(SDB_PATH ".new");   // interrupted commit
+    if (!fs->exists(SDB_PATH)) return false;
+    auto file = fs->open(SDB_PATH, "r");
+    if (!file) return false;
+    SdbFooter ft; size_t sz = file.size(); bool ok = false;
+    if (sz >= sizeof(ft) && file.seek((uint32_t)(sz - sizeof(ft))) && file.read((uint8_t *)&ft, sizeof(ft)) == sizeof(ft) &&
+        ft.magic == SDB_MAGIC && ft.count <= SDB_MAX && ft.indexOff + ft.count * sizeof(SdbRec) + sizeof(ft) == sz &&
+        file.seek(ft.indexOff) && file.read((uint8_t *)idx, ft.count * sizeof(SdbRec)) == ft.count * sizeof(SdbRec) &&
+        sdbCrc32(idx, ft.count * sizeof(SdbRec)) == ft.crc) { count = (uint16_t)ft.count; ok = true; }
+    file.close();
+    if (!ok) crcErrors++;
+    return ok;
+  }
+
+  int find(const char *id) const {
+    int lo = 0, hi = (int)count - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) / 2, c = strncmp(id, idx[mid].id, SDB_ID_MAX);
+      if (!c) return mid;
+      if (c < 0) hi = mid - 1; else lo = mid + 1;
+    }
+    return -1;
+  }
+
+  // Step array of record i; returns the step count or -1 on read / CRC failure
+  int readSteps(uint16_t i, SdbStep *out, uint16_t max) {
+    if (i >= count || !idx[i].stepCount) return i < count ? 0 : -1;
+    File file = fs->open(SDB_PATH, "r");
+    if (!file) return -1;
+    int n = readStepsAt(file, i, out, max);
+    file.close();
+    return n;
+  }
+
+  // Insert or replace one schedule (rec.id must be set; stepCount/stepsCrc are filled in)
+  bool put(SdbRec rec, const SdbStep *steps, uint16_t n) {
+    if (!rec.id[0] || memchr(rec.id, 0, SDB_ID_MAX) == nullptr || n > SDB_STEPS_MAX) return false;
+    rec.stepCount = n; rec.stepsCrc = sdbCrc32(steps, n * sizeof(SdbStep));
+    int at = find(rec.id);
+    if (at < 0 && count >= SDB_MAX) return false;
+    Edit e{ this, &rec, steps, at >= 0 ? at : insertPos(rec.id), at >= 0, -1, File() };
+    return rewriteEdit(e, (uint16_t)(at >= 0 ? count : count + 1));
+  }
+  // Replace the fields of an existing record, keeping its stored step array
+  bool putRecord(SdbRec rec) {
+    int at = find(rec.id); if (at < 0) return false;
+    rec.stepCount = idx[at].stepCount; rec.stepsCrc = idx[at].stepsCrc;
+    Edit e{ this, &rec, nullptr, at, true, -1, File() };
+    return rewriteEdit(e, count);
+  }
+  bool erase(const char *id) {
+    int at = find(id); if (at < 0) return true;
+    Edit e{ this, nullptr, nullptr, -1, false, at, File() };
+    return rewriteEdit(e, (uint16_t)(count - 1));
+  }
+
+  // Writes a complete new database from `src` (records in id order) and swaps it in.
+  bool rewrite(uint16_t n, SdbSource src, void *ctx) { return writeNew(n, src, ctx) && swapIn(); }
+
+  // ---- internals ----
+  bool writeNew(uint16_t n, SdbSource src, void *ctx) {
+    if (n > SDB_MAX) return false;
+    auto out = fs->open(SDB_PATH ".new", "w");
+    if (!out) return false;
+    SdbStep steps[SDB_STEPS_MAX]; SdbRec r;
+    uint32_t off = 0, crc = 0; bool ok = true;
+    for (uint16_t i = 0; i < n && ok; ++i) {
+      ok = src(ctx, i, r, steps) && r.stepCount <= SDB_STEPS_MAX;
+      size_t bytes = r.stepCount * sizeof(SdbStep);
+      if (ok && bytes) ok = out.write((const uint8_t *)steps, bytes) == bytes;
+      off += (uint32_t)bytes;
+    }
+    uint32_t indexOff = off; off = 0;
+    for (uint16_t i = 0; i < n && ok; ++i) {            // offsets follow from the step counts
+      ok = src(ctx, i, r, nullptr);
+      r.stepsOff = off; off += r.stepCount * sizeof(SdbStep);
+      ok = ok && out.write((const uint8_t *)&r, sizeof(r)) == sizeof(r);
+      crc = sdbCrc32(&r, sizeof(r), crc);
+    }
+    SdbFooter ft{ SDB_MAGIC, n, indexOff, crc };
+    ok = ok && out.write((const uint8_t *)&ft, sizeof(ft)) == sizeof(ft);
+    out.close();
+    if (!ok) fs->remove(SDB_PATH ".new");
+    return ok;
+  }
+  bool swapIn() {
+    if (!fs->rename(SDB_PATH ".new", SDB_PATH)) { fs->remove(SDB_PATH ".new"); return false; }
+    commits++;
+    return begin(*fs);
+  }
+  struct Edit { SchedDb *db; const SdbRec *rec; const SdbStep *steps; int pos; bool replace; int skip; File old; };
+  int readStepsAt(File &file, uint16_t i, SdbStep *out, uint16_t max) {
+    uint16_t n = idx[i].stepCount;
+    if (n > max) return -1;
+    size_t bytes = n * sizeof(SdbStep);
+    if (!file.seek(idx[i].stepsOff) || file.read((uint8_t *)out, bytes) != bytes || sdbCrc32(out, bytes) != idx[i].stepsCrc) { crcErrors++; return -1; }
+    return n;
+  }
+  bool rewriteEdit(Edit &e, uint16_t n) {
+    if (count) { e.old = fs->open(SDB_PATH, "r"); if (!e.old) return false; }
+    bool ok = writeNew(n, editSource, &e);
+    if (e.old) e.old.close();
+    return ok && swapIn();
+  }
+  int insertPos(const char *id) const { int i = 0; while (i < count && strncmp(idx[i].id, id, SDB_ID_MAX) < 0) ++i; return i; }
+  // Merged view of the current index with one record inserted / replaced / skipped;
+  // a replacement without steps keeps the old record's array
+  static bool editSource(void *ctx, uint16_t i, SdbRec &rec, SdbStep *steps) {
+    Edit &e = *(Edit *)ctx;
+    if (e.rec && (int)i == e.pos) {
+      rec = *e.rec;
+      if (steps && rec.stepCount && !e.steps) return e.db->readStepsAt(e.old, i, steps, SDB_STEPS_MAX) >= 0;
+      if (steps && rec.stepCount) memcpy(steps, e.steps, rec.stepCount * sizeof(SdbStep));
+      return true;
+    }
+    int j = i;
+    if (e.rec && !e.replace && (int)i > e.pos) j--;
+    if (e.skip >= 0 && j >= e.skip) j++;
+    if (j < 0 || j >= e.db->count) return false;
+    rec = e.db->idx[j];
+    return !steps || e.db->readStepsAt(e.old, (uint16_t)j, steps, SDB_STEPS_MAX) >= 0;
+  }
+};
@@ -0,0 +1,85 @@
+#pragma once
+// Versioned schedule edits.
+// A schedule's version is a 16-bit hash of its content (record fields + step CRC,
+// not its storage offset or ts), so both ends can tell whether they hold the same
+// schedule without shipping the sequence. A patch names the version it was made
+// against and edits steps in place instead of resending SEQ=:
+//   SCHP|ID=SC1,BASE=3f2a,TS=124,OPS=D2:300;I1:7:120;R4;E0
+// Ops (applied left to right, ';'-separated, indices 0-based):
+//   D<i>:<sec>          set the duration of step i
+//   N<i>:<node>         move step i to another node
+//   I<i>:<node>:<sec>   insert a step before index i (i == count appends)
+//   R<i>                remove step i
+//   P<i>:<0|1>          run step i together with the previous one (1) or after it (0)
+//   M<i>:<pct>[:<sec>]  moisture target (0 = plain timed step) and minimum time of step i
+//   E0 / E1             disable / enable the schedule
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include "wire_proto.h"
+#include "sched_db.h"
+
+inline uint16_t schedVersion(const SdbRec &r) {
+  uint32_t h = 2166136261u;
+  auto mix = [&h](const void *p, size_t n) { const uint8_t *b = (const uint8_t *)p; for (size_t i = 0; i < n; ++i) { h ^= b[i]; h *= 16777619u; } };
+  mix(r.id, strnlen(r.id, SDB_ID_MAX)); mix(r.timeStr, strnlen(r.timeStr, sizeof(r.timeStr)));
+  mix(&r.rec, 1); mix(&r.weekdayMask, 1); mix(&r.enabled, 1); mix(&r.stepCount, 2);
+  mix(&r.startEpoch, 8); mix(&r.pumpOnMs, 4); mix(&r.pumpOffMs, 4); mix(&r.stepsCrc, 4);
+  return (uint16_t)((h >> 16) ^ (h & 0xFFFF));
+}
+
+// Applies `ops` to steps[0..n) (capacity max). Returns -1 on success, else the
+// 0-based index of the op that failed; nothing is written back in that case.
+inline int schedPatchApply(WireSpan ops, SdbStep *steps, uint16_t &n, uint16_t max, uint8_t &enabled) {
+  SdbStep work[SDB_STEPS_MAX];
+  if (n > SDB_STEPS_MAX || max > SDB_STEPS_MAX) return 0;
+  memcpy(work, steps, n * sizeof(SdbStep));
+  uint16_t cnt = n; uint8_t en = enabled; int opIdx = 0;
+  WireSpan part, rest = ops;
+  while (rest.n) {
+    int semi = rest.indexOf(';');
+    part = semi < 0 ? rest : rest.sub(0, (uint16_t)semi);
+    rest = semi < 0 ? wireSpan("") : rest.sub((uint16_t)(semi + 1));
+    part = part.trim();
+    if (part.empty()) continue;
+    char op = part.p[0];
+    WireSpan f[3]; uint8_t nf = 0; WireSpan args = part.sub(1);
+    while (nf < 3) {
+      int c = args.indexOf(':');
+      f[nf++] = c < 0 ? args : args.sub(0, (uint16_t)c);
+      if (c < 0) break;
+      args = args.sub((uint16_t)(c + 1));
+    }
+    long i = f[0].toLong(-1);
+    bool ok = true;
+    switch (op) {
+      case 'D': ok = nf == 2 && i >= 0 && i < cnt; if (ok) work[i].durMs = f[1].toU32() * 1000UL; break;
+      case 'N': ok = nf == 2 && i >= 0 && i < cnt; if (ok) work[i].node = (uint16_t)f[1].toLong(); break;
+      case 'I':
+        ok = nf == 3 && i >= 0 && i <= cnt && cnt < max;
+        if (ok) {
+          memmove(&work[i + 1], &work[i], (cnt - i) * sizeof(SdbStep));
+          work[i].node = (uint16_t)f[1].toLong(); work[i].flags = 0; work[i].target = 0; work[i].durMs = f[2].toU32() * 1000UL; cnt++;
+        }
+        break;
+      case 'R':
+        ok = nf == 1 && i >= 0 && i < cnt;
+        if (ok) { memmove(&work[i], &work[i + 1], (cnt - i - 1) * sizeof(SdbStep)); cnt--; }
+        break;
+      case 'P':
+        ok = nf == 2 && i >= 1 && i < cnt && f[1].toLong(-1) >= 0 && f[1].toLong(-1) <= 1;
+        if (ok) work[i].flags = f[1].toLong() ? (work[i].flags | SDB_STEP_PAR) : (work[i].flags & ~SDB_STEP_PAR);
+        break;
+      case 'M':
+        ok = nf >= 2 && i >= 0 && i < cnt && f[1].toLong(-1) >= 0 && f[1].toLong(-1) <= 100;
+        if (ok) { work[i].target = (uint8_t)f[1].toLong(); sdbStepSetMin(work[i], work[i].target && nf == 3 ? f[2].toU32() * 1000UL : 0); }
+        break;
+      case 'E': ok = nf == 1 && (i == 0 || i == 1); if (ok) en = (uint8_t)i; break;
+      default: ok = false;
+    }
+    if (!ok) return opIdx;
+    opIdx++;
+  }
+  memcpy(steps, work, cnt * sizeof(SdbStep)); n = cnt; enabled = en;
+  return -1;
+}
@@ -8,6 +8,8 @@ bool processSystemConfigSms(const String &smsBody, const String &fromNumber);
 bool processSystemConfigJson(const String &payload);
 bool saveCompactScheduleToMultipleFilesAndLoad(const String &compact);
 bool validateAndLoadScheduleFromJson(const String &json);
+void scheduleUpsert(const Schedule &s, bool persisted);  // add / replace and re-arm its trigger
+void scheduleTimersRebuild(time_t from);         // re-arm all triggers (after load / clock jump)
 
 void setPump(bool on);
 void setModeManual();
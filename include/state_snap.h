@@ -0,0 +1,86 @@
+#pragma once
+// Controller state snapshot for a retained MQTT topic.
+// The controller fills a StateSnap every second; only the hashed part (mode, run,
+// step and its end, pump, link flags, per-node readings / up-down) decides whether it
+// changed, so a running clock or drifting RSSI does not republish it. A changed
+// snapshot is encoded as packed JSON (schema SNAP_VERSION):
+//   {"seq":<last EVT SEQ>,"v":1,"h":"<hash>","t":<epoch s>,"mode":"S|M","pump":0|1,
+//    "run":null | {"s":"<id>","i":<step>,"of":<steps>,"open":<open steps>,"plan":0|1,
+//                  "end":<epoch s>,"left":<s>},
+//    "link":{"mqtt":0|1,"cell":0|1,"backlog":0|1,"ack":<LoRa ACK %>},
+//    "nodes":[[node,batt,moist,valves,full,up,rssi,heard],...],"more":<nodes left out>}
+// valves = open-valve bitmask, batt / moist -1 = unknown, rssi 0 = unknown, heard =
+// epoch s of the last report (0 = before the clock was set). "seq" is prepended by the publisher: EVT| statuses with a higher SEQ
+// happened after the snapshot (a few just before it may also carry a higher one;
+// they describe transitions the snapshot already shows).
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#define SNAP_VERSION 1
+#ifndef SNAP_NODES
+#define SNAP_NODES 32
+#endif
+#ifndef SNAP_JSON_MAX
+#define SNAP_JSON_MAX 1400
+#endif
+
+enum SnapNodeFlags : uint8_t { SNF_FULL = 1, SNF_UP = 2 };
+
+struct SnapCore {                 // hashed; zero-filled so padding hashes the same
+  char mode;
+  uint8_t running, plan, pump, mqtt, cell, backlog;
+  char sched[24];
+  int16_t step;
+  uint16_t steps, open;
+  int64_t stepEndKey;             // millis() or epoch ms of the step end -- stable while it runs
+  uint8_t nodes;
+};
+struct SnapNode { uint16_t node; int16_t batt, moist; uint8_t valves, flags; };   // hashed
+
+struct StateSnap {
+  SnapCore c;
+  SnapNode n[SNAP_NODES];
+  int16_t rssi[SNAP_NODES];       // not hashed
+  uint32_t heard[SNAP_NODES];
+  uint32_t t, endS;               // snapshot time, step end (epoch s)
+  uint8_t ackPct;
+
+  void clear() { memset(this, 0, sizeof(*this)); c.step = -1; }
+  uint32_t hash() const {
+    uint32_t h = 2166136261u;
+    auto mix = [&h](const void *p, size_t k) { const uint8_t *b = (const uint8_t *)p; for (size_t i = 0; i < k; ++i) { h ^= b[i]; h *= 16777619u; } };
+    mix(&c, sizeof(c)); mix(n, c.nodes * sizeof(SnapNode));
+    return h;
+  }
+
+  // Packed JSON without "seq"; returns its length (nodes that do not fit are counted in "more")
+  int json(char *out, size_t cap) const {
+    size_t at = 0;
+    put(out, cap, at, "{\"v\":%d,\"h\":\"%08lx\",\"t\":%lu,\"mode\":\"%c\",\"pump\":%u,\"run\":", SNAP_VERSION, (unsigned long)hash(), (unsigned long)t, c.mode, c.pump);
+    if (!c.running) put(out, cap, at, "null");
+    else put(out, cap, at, "{\"s\":\"%s\",\"i\":%d,\"of\":%u,\"open\":%u,\"plan\":%u,\"end\":%lu,\"left\":%lu}", c.sched, c.step, c.steps, c.open, c.plan,
+             (unsigned long)endS, (unsigned long)(endS > t ? endS - t : 0));
+    put(out, cap, at, ",\"link\":{\"mqtt\":%u,\"cell\":%u,\"backlog\":%u,\"ack\":%u},\"nodes\":[", c.mqtt, c.cell, c.backlog, ackPct);
+    uint8_t i = 0;
+    for (; i < c.nodes; ++i) {
+      char e[64];
+      int w = snprintf(e, sizeof(e), "%s[%u,%d,%d,%u,%u,%u,%d,%lu]", i ? "," : "", n[i].node, n[i].batt, n[i].moist, n[i].valves,
+                       (n[i].flags & SNF_FULL) ? 1 : 0, (n[i].flags & SNF_UP) ? 1 : 0, rssi[i], (unsigned long)heard[i]);
+      if (at + (size_t)w + 16 >= cap) break;          // room for the closing "],"more":N}"
+      memcpy(out + at, e, (size_t)w + 1); at += (size_t)w;
+    }
+    put(out, cap, at, "]");
+    if (i < c.nodes) put(out, cap, at, ",\"more\":%u", c.nodes - i);
+    put(out, cap, at, "}");
+    return at < cap ? (int)at : -1;
+  }
+  static void put(char *out, size_t cap, size_t &at, const char *fmt, ...) {
+    if (at >= cap) return;
+    va_list ap; va_start(ap, fmt); int w = vsnprintf(out + at, cap - at, fmt, ap); va_end(ap);
+    if (w > 0) at += (size_t)w;
+  }
+};
@@ -0,0 +1,84 @@
+#pragma once
+// Moisture-feedback steps.
+// A step with a target moisture runs until its node's soil reading reaches the target:
+// at least minMs, at most durMs. When its turn comes and a recent reading (FB_FRESH_MS)
+// is already at or above the target, the step is skipped without opening. Readings
+// are the controller's telemetry table -- a node reports every TD_FAST_MS while a
+// valve is open -- and only count once taken after the valve opened; with none for
+// FB_POLL_MS the controller asks for a STATUS.
+// RunFeedback holds the run's targets and decisions and reports what feedback saved:
+// valve time (planned minus run, per step) and pump time (the run's static timeline,
+// zonePlanTimes, with planned vs. actual step lengths).
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "zone_runner.h"
+#include "lora_frame.h"
+
+#ifndef FB_FRESH_MS
+#define FB_FRESH_MS 900000UL    // reading recent enough to skip a step on
+#endif
+#ifndef FB_POLL_MS
+#define FB_POLL_MS 60000UL      // STATUS when an open step heard nothing for this long
+#endif
+
+// Soil reading of a step's valve (default valve = first channel reporting), -1 when none
+inline int fbMoisture(const LoraTelemetry &t) {
+  for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) if (t.moistPresent & (1 << i)) return t.moist[i];
+  return -1;
+}
+
+enum FbOutcome : uint8_t { FB_TIMED, FB_EARLY, FB_SKIPPED };
+
+struct RunFeedback {
+  uint16_t n = 0;
+  uint8_t target[ZR_MAX];
+  uint32_t minMs[ZR_MAX], planMs[ZR_MAX];
+  uint8_t out[ZR_MAX];
+  uint32_t polledMs[ZR_MAX];
+  uint16_t steps = 0;           // steps with a target
+
+  void begin(const ZoneStep *zs, uint16_t cnt) {
+    n = cnt > ZR_MAX ? ZR_MAX : cnt; steps = 0;
+    for (uint16_t i = 0; i < n; ++i) {
+      target[i] = zs[i].target; minMs[i] = zs[i].minMs < zs[i].durMs ? zs[i].minMs : zs[i].durMs;
+      planMs[i] = zs[i].durMs; out[i] = FB_TIMED; polledMs[i] = 0;
+      if (target[i]) steps++;
+    }
+  }
+  void clear() { n = steps = 0; }
+  bool any() const { return steps > 0; }
+  bool active(uint16_t i) const { return i < n && target[i]; }
+
+  // Step i about to open; moist / ageMs: the node's last reading (-1 = none)
+  bool skipAtStart(uint16_t i, int moist, uint32_t ageMs) {
+    if (!active(i) || moist < 0 || ageMs > FB_FRESH_MS || moist < target[i]) return false;
+    out[i] = FB_SKIPPED; return true;
+  }
+  // Step i open for ranMs with a reading taken since it opened; true = end it now
+  bool reached(uint16_t i, uint32_t ranMs, int moist) {
+    if (!active(i) || moist < target[i] || ranMs < minMs[i]) return false;
+    out[i] = FB_EARLY; return true;
+  }
+  // Open step i has no usable reading: time for a STATUS?
+  bool pollDue(uint16_t i, uint32_t nowMs) {
+    if (!active(i) || (polledMs[i] && nowMs - polledMs[i] < FB_POLL_MS)) return false;
+    polledMs[i] = nowMs; return true;
+  }
+
+  uint16_t count(uint8_t o) const { uint16_t c = 0; for (uint16_t i = 0; i < n; ++i) if (target[i] && out[i] == o) c++; return c; }
+  // e.g. "STEPS=4,SKIPPED=1,EARLY=2,VALVE_SAVED_S=1260,PUMP_S=900,PUMP_PLAN_S=1500"; actual
+  // step lengths from the runner (cut / skipped steps shortened there)
+  int text(const ZoneRunner &zr, uint16_t cap, char *buf, size_t bufCap) const {
+    uint64_t saved = 0; uint32_t at[ZR_MAX];
+    ZoneStep plan[ZR_MAX]; uint16_t m = zr.n < n ? zr.n : n;
+    for (uint16_t i = 0; i < m; ++i) {
+      plan[i] = zr.s[i]; plan[i].durMs = planMs[i];
+      if (target[i] && planMs[i] > zr.s[i].durMs) saved += planMs[i] - zr.s[i].durMs;
+    }
+    uint32_t planLen = zonePlanTimes(plan, m, cap, at), runLen = zonePlanTimes(zr.s, m, cap, at);
+    return snprintf(buf, bufCap, "STEPS=%u,SKIPPED=%u,EARLY=%u,VALVE_SAVED_S=%lu,PUMP_S=%lu,PUMP_PLAN_S=%lu", steps, count(FB_SKIPPED),
+                    count(FB_EARLY), (unsigned long)(saved / 1000), (unsigned long)(runLen / 1000), (unsigned long)(planLen / 1000));
+  }
+};
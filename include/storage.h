@@ -9,6 +9,8 @@ bool saveStringFile(const String &path, const String &content);
 String loadStringFile(const String &path);
 
 
-bool saveScheduleFile(const Schedule &s);
+bool saveScheduleRecord(const Schedule &s);                       // insert / replace in /sched.db
+bool deleteScheduleRecord(const String &id);
+bool scheduleSteps(const Schedule &s, std::vector<SeqStep> &out);  // sequence, read from the DB on demand
 Schedule scheduleFromJsonString(const String &json);
 void loadAllSchedulesFromFS();
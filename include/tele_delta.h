@@ -0,0 +1,170 @@
+#pragma once
+// Change-driven node telemetry.
+// Node: TeleDelta compares the current readings with what the controller last got
+// and sends only fields that moved past their deadband (TD_BAND_*), as a sequenced
+// delta STAT. Every TD_KEY_EVERY-th report is a full keyframe, and a heartbeat
+// goes out when nothing moved for the heartbeat interval. The check interval adapts:
+// short while a valve is open or moisture is moving, long and with a stretched
+// heartbeat when the battery is low.
+// Controller: NodeTeleTable keeps the full state per node and applies deltas in order.
+// A sequence gap or a delta without a keyframe before it marks the node stale until
+// full telemetry arrives (keyframe or STATUS ACK).
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "lora_frame.h"
+
+#ifndef TD_BAND_MOIST
+#define TD_BAND_MOIST 3         // percent
+#endif
+#ifndef TD_BAND_BATT
+#define TD_BAND_BATT 2          // percent
+#endif
+#ifndef TD_BAND_BV_MV
+#define TD_BAND_BV_MV 50
+#endif
+#ifndef TD_BAND_SOLV_MV
+#define TD_BAND_SOLV_MV 300
+#endif
+#ifndef TD_BAND_SOLI_MA
+#define TD_BAND_SOLI_MA 25
+#endif
+#ifndef TD_BAND_AWAKE_PM
+#define TD_BAND_AWAKE_PM 10
+#endif
+#ifndef TD_KEY_EVERY
+#define TD_KEY_EVERY 12         // reports between keyframes
+#endif
+#ifndef TD_FAST_MS
+#define TD_FAST_MS 30000UL      // check interval: valve open / moisture moving
+#endif
+#ifndef TD_BASE_MS
+#define TD_BASE_MS 120000UL     // check interval: idle
+#endif
+#ifndef TD_SLOW_MS
+#define TD_SLOW_MS 600000UL     // check interval: battery low
+#endif
+#ifndef TD_HEARTBEAT_MS
+#define TD_HEARTBEAT_MS 1800000UL
+#endif
+#ifndef TD_LOW_BATT
+#define TD_LOW_BATT 25          // percent
+#endif
+#ifndef TD_NODES
+#define TD_NODES 32             // controller: nodes with tracked state
+#endif
+
+inline bool tdMoved(int32_t a, int32_t b, int32_t band) { return a - b >= band || b - a >= band; }
+
+// Fields of `cur` that differ from `base` past their deadband; moisture channels that
+// moved come back in `moist` (bit per valve)
+inline uint8_t teleDiff(const LoraTelemetry &cur, const LoraTelemetry &base, uint8_t &moist) {
+  uint8_t f = 0; moist = 0;
+  if (cur.valvePresent != base.valvePresent || cur.valveOpen != base.valveOpen) f |= TF_VALVES;
+  for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i)
+    if ((cur.moistPresent & (1 << i)) && (!(base.moistPresent & (1 << i)) || tdMoved(cur.moist[i], base.moist[i], TD_BAND_MOIST))) moist |= (uint8_t)(1 << i);
+  if (moist) f |= TF_MOIST;
+  if (cur.battPct != base.battPct && (cur.battPct < 0 || base.battPct < 0 || tdMoved(cur.battPct, base.battPct, TD_BAND_BATT))) f |= TF_BATT;
+  if (tdMoved(cur.bvMv, base.bvMv, TD_BAND_BV_MV)) f |= TF_BATT;
+  if (tdMoved(cur.solvMv, base.solvMv, TD_BAND_SOLV_MV)) f |= TF_SOLV;
+  if (cur.soliMa != base.soliMa && (cur.soliMa < 0 || base.soliMa < 0 || tdMoved(cur.soliMa, base.soliMa, TD_BAND_SOLI_MA))) f |= TF_SOLI;
+  if (cur.awakePm != base.awakePm && (cur.awakePm < 0 || base.awakePm < 0 || tdMoved(cur.awakePm, base.awakePm, TD_BAND_AWAKE_PM))) f |= TF_AWAKE;
+  return f;
+}
+
+// Copies the fields in `fields` from src into dst; valves and moisture per channel
+// present in src (an AUTO_CLOSED reports just the valve that closed)
+inline void teleMerge(LoraTelemetry &dst, const LoraTelemetry &src, uint8_t fields) {
+  if (fields & TF_VALVES) for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) {
+    uint8_t b = (uint8_t)(1 << i); if (!(src.valvePresent & b)) continue;
+    dst.valvePresent |= b; dst.valveOpen = (uint8_t)((dst.valveOpen & ~b) | (src.valveOpen & b)); dst.vtMs[i] = src.vtMs[i];
+  }
+  if (fields & TF_MOIST) for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) if (src.moistPresent & (1 << i)) { dst.moist[i] = src.moist[i]; dst.moistPresent |= (uint8_t)(1 << i); }
+  if (fields & TF_BATT) { dst.battPct = src.battPct; dst.bvMv = src.bvMv; }
+  if (fields & TF_SOLV) dst.solvMv = src.solvMv;
+  if (fields & TF_SOLI) dst.soliMa = src.soliMa;
+  if (fields & TF_AWAKE) dst.awakePm = src.awakePm;
+}
+
+// Node side
+struct TeleDelta {
+  LoraTelemetry base;           // what the controller holds
+  bool primed = false, keyWanted = true;
+  uint8_t seq = 0, sinceKey = 0;
+  uint32_t lastSentMs = 0, lastCheckMs = 0;
+  uint8_t lastMoist[LORA_MAX_VALVES];
+  bool moving = false;          // moisture changed since the previous check
+  uint32_t keys = 0, deltas = 0, beats = 0, skipped = 0;
+
+  // Next check, from the readings just taken
+  uint32_t intervalMs(const LoraTelemetry &cur) const {
+    if (cur.valveOpen || moving) return TD_FAST_MS;
+    if (cur.battPct >= 0 && cur.battPct < TD_LOW_BATT) return TD_SLOW_MS;
+    return TD_BASE_MS;
+  }
+  uint32_t heartbeatMs(const LoraTelemetry &cur) const { return cur.battPct >= 0 && cur.battPct < TD_LOW_BATT ? 2 * TD_HEARTBEAT_MS : TD_HEARTBEAT_MS; }
+
+  // Fills `f` (kind / node left to the caller) when a report is due; false = nothing to send.
+  // force: send now even if nothing moved (button, boot)
+  bool poll(const LoraTelemetry &cur, uint32_t nowMs, bool force, LoraFrame &f) {
+    moving = false;
+    for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) if ((cur.moistPresent & (1 << i)) && primed && cur.moist[i] != lastMoist[i]) moving = true;
+    memcpy(lastMoist, cur.moist, sizeof(lastMoist)); lastCheckMs = nowMs;
+    uint8_t moist = 0, fields = primed ? teleDiff(cur, base, moist) : (uint8_t)TF_ALL;
+    bool key = !primed || keyWanted || sinceKey >= TD_KEY_EVERY;
+    bool beat = nowMs - lastSentMs >= heartbeatMs(cur);
+    if (!key && !fields && !beat && !force) { skipped++; return false; }
+    f.hasTele = true; f.hasMeta = true; f.teleSeq = ++seq; f.teleFlags = LTM_SEQ;
+    if (key) {
+      f.tele = cur; f.teleFields = TF_ALL; f.teleFlags |= LTM_KEY;
+      base = cur; primed = true; keyWanted = false; sinceKey = 0; keys++;
+    } else {
+      loraTelemetryClear(f.tele); teleMerge(f.tele, cur, fields & ~TF_MOIST);
+      for (uint8_t i = 0; i < LORA_MAX_VALVES; ++i) if (moist & (1 << i)) { f.tele.moist[i] = cur.moist[i]; f.tele.moistPresent |= (uint8_t)(1 << i); }
+      f.teleFields = fields;
+      teleMerge(base, f.tele, fields); sinceKey++;
+      if (fields) deltas++; else beats++;
+    }
+    lastSentMs = nowMs;
+    return true;
+  }
+};
+
+// Controller side
+enum TeleApply : uint8_t { TA_FULL, TA_DELTA, TA_STALE };
+
+struct NodeTeleTable {
+  struct Entry { uint16_t node; bool full, resync; uint8_t seq; uint32_t atMs; int16_t rssi; LoraTelemetry t; };   // resync: full telemetry requested; rssi: last report
+  Entry e[TD_NODES];
+  uint8_t n = 0;
+  uint32_t keys = 0, deltas = 0, gaps = 0, fulls = 0;
+
+  Entry *find(uint16_t node) { for (uint8_t i = 0; i < n; ++i) if (e[i].node == node) return &e[i]; return nullptr; }
+  // Slot for node, recycling the least recently updated one when full
+  Entry &slot(uint16_t node, uint32_t nowMs) {
+    Entry *x = find(node); if (x) return *x;
+    uint8_t at = n;
+    if (n < TD_NODES) n++;
+    else { at = 0; for (uint8_t i = 1; i < n; ++i) if (nowMs - e[i].atMs > nowMs - e[at].atMs) at = i; }
+    memset(&e[at], 0, sizeof(Entry)); e[at].node = node; loraTelemetryClear(e[at].t);
+    return e[at];
+  }
+  // Folds the telemetry of a decoded frame into the node's state
+  TeleApply apply(const LoraFrame &f, uint32_t nowMs) {
+    Entry &x = slot((uint16_t)f.node, nowMs);
+    x.atMs = nowMs;
+    if (!f.hasMeta || (f.teleFlags & LTM_KEY)) {
+      x.t = f.tele; x.full = true; x.resync = false;
+      if (f.hasMeta) { x.seq = f.teleSeq; keys++; } else fulls++;
+      return TA_FULL;
+    }
+    bool inOrder = !(f.teleFlags & LTM_SEQ) || (uint8_t)(x.seq + 1) == f.teleSeq;
+    if (f.teleFlags & LTM_SEQ) x.seq = f.teleSeq;
+    teleMerge(x.t, f.tele, f.teleFields);
+    if (x.full && !inOrder) { x.full = false; gaps++; }
+    if (x.full) deltas++;
+    return x.full ? TA_DELTA : TA_STALE;
+  }
+  uint8_t stale() const { uint8_t c = 0; for (uint8_t i = 0; i < n; ++i) if (!e[i].full) c++; return c; }
+};
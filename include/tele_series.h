@@ -0,0 +1,230 @@
+#pragma once
+// Per-node telemetry history on the controller.
+// Every telemetry update of a node (its complete state after a STAT / ACK / AUTO_*) is
+// one sample of TS_FIELDS values. A node keeps three fixed-size rings -- raw samples,
+// 15-minute buckets and hourly buckets (mean / min / max / count per field) -- fed by
+// running accumulators, so downsampling costs one add per sample. Hourly buckets that
+// fall out of RAM (or out of an evicted node's slot) are appended to TS_DIR "/n<node>.h";
+// past TS_FILE_BYTES that file becomes ".o" and the previous ".o" is dropped.
+// A query walks one tier over a time range, oldest first (the hourly tier reads the
+// files, then RAM); the bucket still accumulating is included as the newest point.
+// Units: M1..M4 / BATT percent, BV / SOLV mV, SOLI mA.
+// Templated on the filesystem like EventLog (open/exists/remove/rename/mkdir; File:
+// read/write/size/close).
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "lora_frame.h"
+
+#ifndef TS_NODES
+#define TS_NODES 16             // nodes with RAM history (~2.9 KB each)
+#endif
+#ifndef TS_RAW_N
+#define TS_RAW_N 24             // raw samples per node
+#endif
+#ifndef TS_Q_N
+#define TS_Q_N 16               // 15-min buckets per node (4 h)
+#endif
+#ifndef TS_H_N
+#define TS_H_N 24               // hourly buckets per node in RAM (1 day)
+#endif
+#ifndef TS_FILE_BYTES
+#define TS_FILE_BYTES 8192      // per node file generation (~6 days of hourly buckets)
+#endif
+#define TS_DIR "/ts"
+#define TS_Q_S 900
+#define TS_H_S 3600
+#define TS_NONE INT16_MIN       // field absent in a sample
+
+enum TsField : uint8_t { TS_M1, TS_M2, TS_M3, TS_M4, TS_BATT, TS_BV, TS_SOLV, TS_SOLI, TS_FIELDS };
+enum TsRes : uint8_t { TS_RAW, TS_QUARTER, TS_HOUR };
+
+inline const char *tsFieldName(uint8_t f) {
+  static const char *names[TS_FIELDS] = { "M1", "M2", "M3", "M4", "BATT", "BV", "SOLV", "SOLI" };
+  return f < TS_FIELDS ? names[f] : "?";
+}
+inline int tsFieldFromName(WireSpan s) { for (uint8_t f = 0; f < TS_FIELDS; ++f) if (s.ieq(tsFieldName(f))) return f; return -1; }
+
+inline void tsValues(const LoraTelemetry &t, int16_t *v) {
+  for (uint8_t i = 0; i < 4; ++i) v[TS_M1 + i] = (t.moistPresent & (1 << i)) ? t.moist[i] : TS_NONE;
+  v[TS_BATT] = t.battPct >= 0 ? t.battPct : TS_NONE;
+  v[TS_BV] = t.bvMv ? (int16_t)(t.bvMv > 32767 ? 32767 : t.bvMv) : TS_NONE;
+  v[TS_SOLV] = t.solvMv ? (int16_t)(t.solvMv > 32767 ? 32767 : t.solvMv) : TS_NONE;
+  v[TS_SOLI] = t.soliMa >= 0 ? (int16_t)(t.soliMa > 32767 ? 32767 : t.soliMa) : TS_NONE;
+}
+
+struct TsSample { uint32_t t; int16_t v[TS_FIELDS]; };
+struct TsBucket { uint32_t t; uint16_t n; int16_t mean[TS_FIELDS], lo[TS_FIELDS], hi[TS_FIELDS]; };   // n = samples in it
+struct TsPoint { uint32_t t; uint16_t n; int16_t mean, lo, hi; };
+
+struct TsAcc {
+  uint32_t t;                   // bucket start
+  uint16_t n;                   // 0 = empty
+  int32_t sum[TS_FIELDS];
+  uint16_t cnt[TS_FIELDS];
+  int16_t lo[TS_FIELDS], hi[TS_FIELDS];
+
+  void start(uint32_t bucket) { memset(this, 0, sizeof(*this)); t = bucket; }
+  void add(const int16_t *v) {
+    n++;
+    for (uint8_t f = 0; f < TS_FIELDS; ++f) {
+      if (v[f] == TS_NONE) continue;
+      if (!cnt[f] || v[f] < lo[f]) lo[f] = v[f];
+      if (!cnt[f] || v[f] > hi[f]) hi[f] = v[f];
+      sum[f] += v[f]; cnt[f]++;
+    }
+  }
+  TsBucket out() const {
+    TsBucket b; b.t = t; b.n = n;
+    for (uint8_t f = 0; f < TS_FIELDS; ++f) {
+      if (!cnt[f]) { b.mean[f] = b.lo[f] = b.hi[f] = TS_NONE; continue; }
+      b.mean[f] = (int16_t)((sum[f] + (sum[f] >= 0 ? cnt[f] / 2 : -(int32_t)(cnt[f] / 2))) / cnt[f]); b.lo[f] = lo[f]; b.hi[f] = hi[f];
+    }
+    return b;
+  }
+};
+
+template <class T, uint16_t N>
+struct TsRing {
+  T e[N];
+  uint16_t head = 0, count = 0;   // head: next write
+
+  // Returns true and the overwritten entry in `old` when the ring was full
+  bool push(const T &v, T &old) {
+    bool full = count == N;
+    if (full) old = e[head]; else count++;
+    e[head] = v; head = (uint16_t)((head + 1) % N);
+    return full;
+  }
+  const T &at(uint16_t i) const { return e[(head + N - count + i) % N]; }   // 0 = oldest
+  void clear() { head = count = 0; }
+};
+
+struct TsNode {
+  uint16_t node;
+  uint32_t lastT;
+  TsRing<TsSample, TS_RAW_N> raw;
+  TsRing<TsBucket, TS_Q_N> q;
+  TsRing<TsBucket, TS_H_N> h;
+  TsAcc qa, ha;
+};
+
+// Range aggregate (weighted by samples per point)
+struct TsAgg {
+  uint32_t points = 0, samples = 0;
+  int64_t sum = 0;
+  int16_t lo = TS_NONE, hi = TS_NONE;
+  uint32_t first = 0, last = 0;
+  void add(const TsPoint &p) {
+    if (!points) first = p.t;
+    last = p.t; points++; samples += p.n; sum += (int64_t)p.mean * p.n;
+    if (lo == TS_NONE || p.lo < lo) lo = p.lo;
+    if (hi == TS_NONE || p.hi > hi) hi = p.hi;
+  }
+  int16_t mean() const { return samples ? (int16_t)(sum / (int64_t)samples) : TS_NONE; }
+};
+
+template <class FS>
+struct TeleSeries {
+  FS *fs = nullptr;
+  TsNode nodes[TS_NODES];
+  uint8_t n = 0;
+  uint32_t samples = 0, outOfOrder = 0, spilled = 0, spillErrors = 0, evicted = 0;
+
+  void begin(FS &f) { fs = &f; if (!fs->exists(TS_DIR)) fs->mkdir(TS_DIR); }
+
+  TsNode *find(uint16_t nd) { for (uint8_t i = 0; i < n; ++i) if (nodes[i].node == nd) return &nodes[i]; return nullptr; }
+
+  void add(uint16_t nd, uint32_t t, const LoraTelemetry &tele) {
+    TsNode &x = slot(nd);
+    if (x.lastT && t < x.lastT) { outOfOrder++; return; }
+    TsSample s; s.t = t; tsValues(tele, s.v);
+    TsSample oldS; TsBucket oldB;
+    uint32_t qs = t - t % TS_Q_S, hs = t - t % TS_H_S;
+    if (x.qa.n && x.qa.t != qs) { x.q.push(x.qa.out(), oldB); x.qa.n = 0; }
+    if (x.ha.n && x.ha.t != hs) { if (x.h.push(x.ha.out(), oldB)) spill(nd, oldB); x.ha.n = 0; }
+    if (!x.qa.n) x.qa.start(qs);
+    if (!x.ha.n) x.ha.start(hs);
+    x.raw.push(s, oldS); x.qa.add(s.v); x.ha.add(s.v);
+    x.lastT = t; samples++;
+  }
+
+  // Points of field f within [from, to], oldest first; emit(const TsPoint &) returns false
+  // to stop. Returns the number emitted.
+  template <class Emit>
+  uint16_t query(uint16_t nd, uint8_t f, uint8_t res, uint32_t from, uint32_t to, Emit emit) {
+    uint16_t cnt = 0; bool go = true;
+    auto bucket = [&](const TsBucket &b) {
+      if (!go || b.t < from || b.t > to || b.mean[f] == TS_NONE) return;
+      TsPoint p = { b.t, b.n, b.mean[f], b.lo[f], b.hi[f] };
+      go = emit(p); if (go) cnt++;
+    };
+    if (f >= TS_FIELDS) return 0;
+    if (res == TS_HOUR && fs) { char p[24]; path(nd, 'o', p, sizeof(p)); readFile(p, bucket); path(nd, 'h', p, sizeof(p)); readFile(p, bucket); }
+    TsNode *x = find(nd);
+    if (!x) return cnt;
+    if (res == TS_RAW) {
+      for (uint16_t i = 0; i < x->raw.count && go; ++i) {
+        const TsSample &s = x->raw.at(i);
+        if (s.t < from || s.t > to || s.v[f] == TS_NONE) continue;
+        TsPoint p = { s.t, 1, s.v[f], s.v[f], s.v[f] };
+        go = emit(p); if (go) cnt++;
+      }
+      return cnt;
+    }
+    const TsRing<TsBucket, TS_H_N> *hr = &x->h;
+    if (res == TS_QUARTER) { for (uint16_t i = 0; i < x->q.count; ++i) bucket(x->q.at(i)); if (x->qa.n) bucket(x->qa.out()); }
+    else { for (uint16_t i = 0; i < hr->count; ++i) bucket(hr->at(i)); if (x->ha.n) bucket(x->ha.out()); }
+    return cnt;
+  }
+  TsAgg aggregate(uint16_t nd, uint8_t f, uint8_t res, uint32_t from, uint32_t to) {
+    TsAgg a; query(nd, f, res, from, to, [&a](const TsPoint &p) { a.add(p); return true; });
+    return a;
+  }
+
+  int statsText(char *out, size_t cap) const {
+    return snprintf(out, cap, "NODES=%u,SAMPLES=%lu,SPILLED=%lu,SPILL_ERR=%lu,OOO=%lu,EVICTED=%lu", n, (unsigned long)samples,
+                    (unsigned long)spilled, (unsigned long)spillErrors, (unsigned long)outOfOrder, (unsigned long)evicted);
+  }
+
+  // ---- internals ----
+  static void path(uint16_t nd, char gen, char *out, size_t cap) { snprintf(out, cap, TS_DIR "/n%u.%c", nd, gen); }
+  // Slot for nd; when full the node heard from least recently gives up its RAM history
+  // (hourly buckets go to its file first)
+  TsNode &slot(uint16_t nd) {
+    TsNode *x = find(nd); if (x) return *x;
+    uint8_t at = n;
+    if (n < TS_NODES) n++;
+    else {
+      at = 0; for (uint8_t i = 1; i < n; ++i) if (nodes[i].lastT < nodes[at].lastT) at = i;
+      TsNode &v = nodes[at];
+      for (uint16_t i = 0; i < v.h.count; ++i) spill(v.node, v.h.at(i));
+      if (v.ha.n) spill(v.node, v.ha.out());
+      evicted++;
+    }
+    TsNode &e = nodes[at];
+    e.node = nd; e.lastT = 0; e.raw.clear(); e.q.clear(); e.h.clear(); e.qa.n = 0; e.ha.n = 0;
+    return e;
+  }
+  void spill(uint16_t nd, const TsBucket &b) {
+    if (!fs) return;
+    char p[24]; path(nd, 'h', p, sizeof(p));
+    auto file = fs->open(p, "a");
+    if (!file) { spillErrors++; return; }
+    size_t w = file.write((const uint8_t *)&b, sizeof(b)), size = file.size();
+    file.close();
+    if (w != sizeof(b)) { spillErrors++; return; }
+    spilled++;
+    if (size >= TS_FILE_BYTES) { char o[24]; path(nd, 'o', o, sizeof(o)); if (fs->exists(o)) fs->remove(o); fs->rename(p, o); }
+  }
+  template <class Fn>
+  void readFile(const char *p, Fn &fn) {
+    if (!fs->exists(p)) return;
+    auto file = fs->open(p, "r");
+    if (!file) return;
+    TsBucket b;
+    while (file.read((uint8_t *)&b, sizeof(b)) == sizeof(b)) fn(b);
+    file.close();
+  }
+};
@@ -0,0 +1,203 @@
+#pragma once
+// Controller clock discipline.
+// The caller samples its sources without blocking -- SNTP over WiFi (ms offsets), the
+// modem's AT+QNTP (1 s) and the DS3231 -- and TimeDiscipline turns each sample into an
+// action: keep (offset within the sample's error), slew (adjtime, up to TS_SLEW_MAX_MS)
+// or step (settimeofday: unset clock or a larger offset). It also bounds how far the
+// clock may be off by now (errMs: the sample's error plus TS_SYS_PPM since), which is
+// the confidence the scheduler acts on.
+// DS3231 drift: the RTC is rewritten only once a network reference finds it
+// TS_RTC_SET_MS off, so each rewrite measures its rate over the days since the last
+// one. Half of it goes into the chip's aging register (~0.1 ppm per LSB), the rest
+// corrects RTC readings used while the network is away.
+// MonoEpoch: the scheduler's epoch. It never goes backwards: after a backward step it
+// holds until the wall clock catches up, so a run that already fired cannot fire again;
+// past TS_HOLD_MAX_MS (the old time was simply wrong) it rebases.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef TS_SLEW_MAX_MS
+#define TS_SLEW_MAX_MS 5000       // larger offsets are stepped
+#endif
+#ifndef TS_SLEW_RATE_DIV
+#define TS_SLEW_RATE_DIV 64       // adjtime() corrects 1/64 of the elapsed time (ESP-IDF)
+#endif
+#ifndef TS_SYS_PPM
+#define TS_SYS_PPM 50             // system clock error budget between samples
+#endif
+#ifndef TS_TRUST_ERR_MS
+#define TS_TRUST_ERR_MS 60000UL   // trusted: known to within a minute
+#endif
+#ifndef TS_RTC_SET_MS
+#define TS_RTC_SET_MS 2000        // RTC rewritten when a reference finds it this far off
+#endif
+#ifndef TS_RTC_MIN_BASE_S
+#define TS_RTC_MIN_BASE_S 86400UL // shortest interval a drift rate is measured over
+#endif
+#ifndef TS_RTC_PPM
+#define TS_RTC_PPM 5              // DS3231 error budget while its rate is unknown
+#endif
+#ifndef TS_RTC_PPM_KNOWN
+#define TS_RTC_PPM_KNOWN 1        // ... and once measured
+#endif
+#ifndef TS_RTC_UNKNOWN_ERR_MS
+#define TS_RTC_UNKNOWN_ERR_MS 120000UL   // RTC never set from the network: usable, not trusted
+#endif
+#define TS_RTC_AGING_PPB 100      // DS3231 aging offset: one LSB, + slows the oscillator
+#ifndef TS_HOLD_MAX_MS
+#define TS_HOLD_MAX_MS 600000LL   // MonoEpoch: longest hold after a backward step
+#endif
+#define TS_NTP_UNIX_DELTA 2208988800UL   // 1900 -> 1970
+
+enum TimeSource : uint8_t { TSRC_NONE, TSRC_RTC, TSRC_MODEM, TSRC_NTP };
+inline const char *timeSourceName(uint8_t s) { return s == TSRC_RTC ? "RTC" : s == TSRC_MODEM ? "MODEM" : s == TSRC_NTP ? "NTP" : "NONE"; }
+enum TimeAction : uint8_t { TSA_KEEP, TSA_SLEW, TSA_STEP };
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+inline int32_t tsDaysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  int32_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = (uint32_t)(y - era * 400);
+  uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+// "2024/06/01,08:30:05+22", "24/06/01,08:30:05", "2024-06-01 08:30:05" or 14 digits
+// (YYYYMMDDHHMMSS), read as UTC; the zone suffix is ignored
+inline bool tsParseDateTime(const char *p, size_t n, uint32_t &epochS) {
+  int32_t v[6] = {0}; uint8_t k = 0;
+  size_t i = 0; while (i < n && (p[i] < '0' || p[i] > '9')) i++;
+  size_t run = 0; while (i + run < n && p[i + run] >= '0' && p[i + run] <= '9') run++;
+  if (run >= 14) {
+    static const uint8_t w[6] = { 4, 2, 2, 2, 2, 2 };
+    for (; k < 6; ++k) for (uint8_t j = 0; j < w[k]; ++j) v[k] = v[k] * 10 + (p[i++] - '0');
+  } else {
+    for (; i < n && k < 6; ++i) {
+      if (p[i] >= '0' && p[i] <= '9') { v[k] = v[k] * 10 + (p[i] - '0'); if (v[k] > 9999) return false; }
+      else if (p[i - 1] >= '0' && p[i - 1] <= '9') k++;
+    }
+    if (k == 5 && i == n && p[n - 1] >= '0' && p[n - 1] <= '9') k++;
+  }
+  if (k < 6) return false;
+  int32_t y = v[0] < 100 ? v[0] + 2000 : v[0];
+  if (y < 2000 || v[1] < 1 || v[1] > 12 || v[2] < 1 || v[2] > 31 || v[3] > 23 || v[4] > 59 || v[5] > 60) return false;
+  epochS = (uint32_t)tsDaysFromCivil(y, (uint32_t)v[1], (uint32_t)v[2]) * 86400u + (uint32_t)(v[3] * 3600 + v[4] * 60 + v[5]);
+  return true;
+}
+
+// ---- SNTP (RFC 4330), 48-byte packets ----
+inline void sntpPutTs(uint8_t *p, int64_t epochMs) {
+  uint32_t s = (uint32_t)(epochMs / 1000) + TS_NTP_UNIX_DELTA;
+  uint32_t f = (uint32_t)(((uint64_t)(epochMs % 1000) << 32) / 1000);
+  for (int i = 0; i < 4; ++i) { p[i] = (uint8_t)(s >> (24 - 8 * i)); p[4 + i] = (uint8_t)(f >> (24 - 8 * i)); }
+}
+inline int64_t sntpGetTs(const uint8_t *p) {
+  uint32_t s = 0, f = 0;
+  for (int i = 0; i < 4; ++i) { s = s << 8 | p[i]; f = f << 8 | p[4 + i]; }
+  return (int64_t)(s - TS_NTP_UNIX_DELTA) * 1000 + (int64_t)(((uint64_t)f * 1000 + (1ULL << 31)) >> 32);
+}
+// Client request stamped with the local send time t1 (the server echoes it back)
+inline void sntpRequest(uint8_t *pkt, int64_t t1Ms) { memset(pkt, 0, 48); pkt[0] = 0x23; sntpPutTs(pkt + 40, t1Ms); }   // LI 0, v4, client
+// Server reply to req, received at local t4: offset = server - local
+inline bool sntpParse(const uint8_t *rep, size_t n, const uint8_t *req, int64_t t4Ms, int64_t &offsetMs, uint32_t &delayMs) {
+  if (n < 48 || (rep[0] & 7) != 4 || rep[1] == 0 || rep[1] > 15 || memcmp(rep + 24, req + 40, 8) != 0) return false;
+  int64_t t1 = sntpGetTs(req + 40), t2 = sntpGetTs(rep + 32), t3 = sntpGetTs(rep + 40);
+  int64_t d = (t4Ms - t1) - (t3 - t2);
+  offsetMs = ((t2 - t1) + (t3 - t4Ms)) / 2; delayMs = d > 0 ? (uint32_t)d : 0;
+  return true;
+}
+
+struct TimeDiscipline {
+  uint8_t src = TSRC_NONE;        // source of the last accepted sample
+  uint32_t atMs = 0;              // millis() of it
+  uint32_t baseErrMs = 0;
+  int32_t lastOffsetMs = 0;
+  uint8_t lastAction = TSA_KEEP;
+  uint32_t syncs = 0, fails = 0, slews = 0, steps = 0;
+  // DS3231
+  uint32_t rtcSetS = 0;           // last rewrite from a network reference, 0 = unknown
+  int32_t rtcPpb = 0;             // drift rate at the current aging value, + = RTC fast
+  bool rtcRateKnown = false;
+  int8_t rtcAging = 0, agingWant = 0;
+  uint32_t rtcWrites = 0;
+
+  bool set() const { return src != TSRC_NONE; }
+  // Bound on the clock error now: the last sample's error, what a slew has not yet
+  // corrected, and drift since
+  uint32_t errMs(uint32_t nowMs) const {
+    if (!set()) return 0xFFFFFFFFu;
+    uint32_t el = nowMs - atMs;
+    uint32_t mag = (uint32_t)(lastOffsetMs < 0 ? -lastOffsetMs : lastOffsetMs), fixed = el / TS_SLEW_RATE_DIV;
+    uint32_t left = lastAction == TSA_SLEW && mag > fixed ? mag - fixed : 0;
+    return baseErrMs + left + (uint32_t)((uint64_t)el * TS_SYS_PPM / 1000000);
+  }
+  bool trusted(uint32_t nowMs) const { return errMs(nowMs) <= TS_TRUST_ERR_MS; }
+
+  // ref - clock = offsetMs, good to +-sampleErrMs. Samples worse than what the clock is
+  // already known to are ignored (an RTC reading right after an NTP sync).
+  uint8_t sample(uint8_t source, int64_t offsetMs, uint32_t sampleErrMs, uint32_t nowMs) {
+    if (set() && sampleErrMs > errMs(nowMs)) return TSA_KEEP;
+    int64_t mag = offsetMs < 0 ? -offsetMs : offsetMs;
+    uint8_t a = !set() || mag > TS_SLEW_MAX_MS ? TSA_STEP : mag > sampleErrMs ? TSA_SLEW : TSA_KEEP;
+    if (a == TSA_SLEW) slews++; else if (a == TSA_STEP) steps++;
+    if (source != TSRC_RTC) syncs++;
+    src = source; atMs = nowMs; baseErrMs = sampleErrMs; lastAction = a;
+    lastOffsetMs = (int32_t)(mag > 0x7FFFFFFF ? (offsetMs < 0 ? -0x7FFFFFFF : 0x7FFFFFFF) : offsetMs);
+    return a;
+  }
+
+  // RTC reading (epoch ms, before correction) vs a network reference at refMs: true when
+  // the RTC is to be rewritten; a rewrite after at least TS_RTC_MIN_BASE_S measures the
+  // rate and sets agingWant (write it to the chip, then rtcWritten())
+  bool rtcCheck(int64_t rtcMs, int64_t refMs) {
+    int64_t e = rtcMs - refMs, mag = e < 0 ? -e : e;
+    if (mag < TS_RTC_SET_MS && rtcSetS) return false;   // no baseline yet: start one
+    uint32_t refS = (uint32_t)(refMs / 1000);
+    agingWant = rtcAging;
+    if (rtcSetS && refS > rtcSetS && refS - rtcSetS >= TS_RTC_MIN_BASE_S) {
+      int32_t ppb = (int32_t)(e * 1000000 / (int64_t)(refS - rtcSetS));
+      int32_t half = ppb / 2;                        // half steps: a reading is only good to a second
+      int32_t want = rtcAging + (half >= 0 ? half + TS_RTC_AGING_PPB / 2 : half - TS_RTC_AGING_PPB / 2) / TS_RTC_AGING_PPB;
+      agingWant = (int8_t)(want > 127 ? 127 : want < -127 ? -127 : want);
+      rtcPpb = ppb - (agingWant - rtcAging) * TS_RTC_AGING_PPB;
+      rtcRateKnown = true;
+    }
+    return true;
+  }
+  void rtcWritten(uint32_t refS) { rtcSetS = refS; rtcAging = agingWant; rtcWrites++; }
+  // Epoch ms of an RTC reading, drift since its last rewrite taken out
+  int64_t rtcCorrect(int64_t rtcMs) const {
+    if (!rtcSetS || rtcMs / 1000 <= rtcSetS) return rtcMs;
+    return rtcMs - (rtcMs / 1000 - rtcSetS) * rtcPpb / 1000000;
+  }
+  uint32_t rtcErrMs(int64_t rtcMs) const {
+    if (!rtcSetS) return TS_RTC_UNKNOWN_ERR_MS;
+    uint32_t el = rtcMs / 1000 > rtcSetS ? (uint32_t)(rtcMs / 1000 - rtcSetS) : 0;
+    return 1000 + (uint32_t)((uint64_t)el * (rtcRateKnown ? TS_RTC_PPM_KNOWN : TS_RTC_PPM) / 1000);   // 1 s: register resolution
+  }
+
+  // e.g. "SRC=NTP,ERR_MS=212,AGE_S=1800,OFFSET_MS=-38,ACT=SLEW,SYNCS=12,FAILS=1,SLEWS=9,STEPS=1,RTC_PPB=1800,RTC_AGING=3,RTC_WRITES=2"
+  int text(uint32_t nowMs, char *buf, size_t cap) const {
+    static const char *act[] = { "KEEP", "SLEW", "STEP" };
+    return snprintf(buf, cap, "SRC=%s,ERR_MS=%ld,AGE_S=%lu,OFFSET_MS=%ld,ACT=%s,SYNCS=%lu,FAILS=%lu,SLEWS=%lu,STEPS=%lu,RTC_PPB=%s%ld,RTC_AGING=%d,RTC_WRITES=%lu",
+                    timeSourceName(src), set() ? (long)errMs(nowMs) : -1L, set() ? (unsigned long)((nowMs - atMs) / 1000) : 0UL, (long)lastOffsetMs,
+                    act[lastAction], (unsigned long)syncs, (unsigned long)fails, (unsigned long)slews, (unsigned long)steps,
+                    rtcRateKnown ? "" : "?", (long)rtcPpb, rtcAging, (unsigned long)rtcWrites);
+  }
+};
+
+struct MonoEpoch {
+  int64_t last = 0;
+  bool holding = false;
+  uint32_t holds = 0, rebases = 0;
+
+  int64_t now(int64_t wallMs) {
+    if (wallMs >= last) { holding = false; return last = wallMs; }
+    if (last - wallMs > TS_HOLD_MAX_MS) { holding = false; rebases++; return last = wallMs; }
+    if (!holding) { holding = true; holds++; }
+    return last;
+  }
+};
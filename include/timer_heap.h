@@ -0,0 +1,82 @@
+#pragma once
+// Indexed binary min-heap of timers keyed by a small integer (the schedule's slot
+// in the schedules vector). The loop only looks at the head, so checking for due
+// schedules is O(1) and add / edit / delete is O(log n) -- no periodic scan and no
+// per-scan next-run computation.
+// Times are wall-clock epoch seconds; ClockJumpDetector tells the caller when
+// NTP / RTC corrections moved the clock so the heap can be rebuilt.
+// Pure C++, header-only.
+#include <stdint.h>
+
+#ifndef TIMER_HEAP_MAX
+#define TIMER_HEAP_MAX 256      // keys 0..TIMER_HEAP_MAX-1
+#endif
+
+struct TimerHeap {
+  static const uint16_t NONE = 0xFFFF;
+  struct Entry { uint32_t due; uint16_t key; };
+  Entry h[TIMER_HEAP_MAX];
+  uint16_t pos[TIMER_HEAP_MAX];   // key -> heap index, NONE if not armed
+  uint16_t n = 0;
+
+  TimerHeap() { clear(); }
+  void clear() { n = 0; for (uint16_t i = 0; i < TIMER_HEAP_MAX; ++i) pos[i] = NONE; }
+  bool empty() const { return n == 0; }
+  uint16_t size() const { return n; }
+  bool armed(uint16_t key) const { return key < TIMER_HEAP_MAX && pos[key] != NONE; }
+  uint32_t topDue() const { return n ? h[0].due : 0; }
+  uint16_t topKey() const { return n ? h[0].key : NONE; }
+
+  // Arms or re-arms `key`; due == 0 disarms it. False if key is out of range.
+  bool set(uint16_t key, uint32_t due) {
+    if (key >= TIMER_HEAP_MAX) return false;
+    if (!due) { remove(key); return true; }
+    uint16_t i = pos[key];
+    if (i == NONE) { i = n++; h[i].key = key; h[i].due = due; pos[key] = i; up(i); return true; }
+    uint32_t old = h[i].due; h[i].due = due;
+    if (due < old) up(i); else down(i);
+    return true;
+  }
+  void remove(uint16_t key) {
+    if (!armed(key)) return;
+    uint16_t i = pos[key]; pos[key] = NONE;
+    if (i == --n) return;
+    uint16_t moved = h[n].key;                 // last entry fills the hole
+    h[i] = h[n]; pos[moved] = i;
+    up(i); down(pos[moved]);
+  }
+
+  // ---- internals ----
+  void swap(uint16_t a, uint16_t b) {
+    Entry t = h[a]; h[a] = h[b]; h[b] = t;
+    pos[h[a].key] = a; pos[h[b].key] = b;
+  }
+  void up(uint16_t i) {
+    while (i && h[(i - 1) / 2].due > h[i].due) { swap(i, (uint16_t)((i - 1) / 2)); i = (uint16_t)((i - 1) / 2); }
+  }
+  void down(uint16_t i) {
+    for (;;) {
+      uint16_t l = (uint16_t)(2 * i + 1), r = (uint16_t)(l + 1), m = i;
+      if (l < n && h[l].due < h[m].due) m = l;
+      if (r < n && h[r].due < h[m].due) m = r;
+      if (m == i) return;
+      swap(i, m); i = m;
+    }
+  }
+};
+
+// Compares wall-clock progress with the monotonic millisecond counter between
+// calls; a difference beyond `tolS` is reported as a jump (seconds, signed).
+struct ClockJumpDetector {
+  uint32_t lastWall = 0, lastMs = 0;
+  bool primed = false;
+  bool check(uint32_t wall, uint32_t nowMs, uint32_t tolS, int32_t &jumpS) {
+    jumpS = 0;
+    if (!primed) { primed = true; lastWall = wall; lastMs = nowMs; return false; }
+    int32_t expect = (int32_t)((nowMs - lastMs) / 1000);
+    int32_t seen = (int32_t)(wall - lastWall);
+    if (seen - expect > (int32_t)tolS || expect - seen > (int32_t)tolS) jumpS = seen - expect;
+    if (jumpS || nowMs - lastMs >= 1000) { lastWall = wall; lastMs = nowMs; }   // keep rounding error below 1 s
+    return jumpS != 0;
+  }
+};
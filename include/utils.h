@@ -11,6 +11,7 @@ extern TwoWire WireRTC;
 extern bool rtcAvailable;
 
 void dbg(const String &s);
+void dbgf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));   // dbg() without building a String
 String nowISO8601();
 String formatTimeShort();
 
@@ -0,0 +1,144 @@
+#pragma once
+// Zero-allocation tokenizer for the pipe / key=value wire protocol used by
+// radio, modem, BLE and SMS traffic, e.g.
+//   CMD|MID=12|OPEN|N=2,S=SC001,I=1,T=60000,V=1-2
+//   ACK|MID=12|OPEN|N=2,S=SC001,I=1|OK|VALVE1=OPEN,...
+//   SCH|ID=SC001,REC=D,T=06:00,SEQ=1:60;2:30,SRC=MQTT
+// Every accessor returns a WireSpan pointing into the caller's buffer; nothing is
+// copied and nothing touches the heap. Header-only so both firmwares share it.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+struct WireSpan {
+  const char *p;
+  uint16_t n;
+
+  bool empty() const { return n == 0; }
+  bool eq(const char *s) const { size_t l = strlen(s); return l == n && memcmp(p, s, n) == 0; }
+  bool ieq(const char *s) const {
+    size_t l = strlen(s); if (l != n) return false;
+    for (size_t i = 0; i < l; ++i) { char a = p[i], b = s[i]; if (a >= 'a' && a <= 'z') a -= 32; if (b >= 'a' && b <= 'z') b -= 32; if (a != b) return false; }
+    return true;
+  }
+  bool eqSpan(const WireSpan &o) const { return o.n == n && memcmp(p, o.p, n) == 0; }
+  bool startsWith(const char *s) const { size_t l = strlen(s); return l <= n && memcmp(p, s, l) == 0; }
+  int indexOf(char c, uint16_t from = 0) const { for (uint16_t i = from; i < n; ++i) if (p[i] == c) return i; return -1; }
+  bool contains(const char *s) const {
+    size_t l = strlen(s); if (l == 0) return true; if (l > n) return false;
+    for (size_t i = 0; i + l <= n; ++i) if (memcmp(p + i, s, l) == 0) return true;
+    return false;
+  }
+  WireSpan sub(uint16_t from, uint16_t len = 0xFFFF) const {
+    if (from > n) from = n;
+    uint16_t rem = n - from; if (len > rem) len = rem;
+    WireSpan s = { p + from, len }; return s;
+  }
+  WireSpan trim() const {
+    uint16_t a = 0, b = n;
+    while (a < b && (p[a] == ' ' || p[a] == '\r' || p[a] == '\n' || p[a] == '\t')) a++;
+    while (b > a && (p[b-1] == ' ' || p[b-1] == '\r' || p[b-1] == '\n' || p[b-1] == '\t')) b--;
+    WireSpan s = { p + a, (uint16_t)(b - a) }; return s;
+  }
+  // Same leniency as String::toInt(): optional sign, leading digits, garbage after ignored.
+  long toLong(long def = 0) const {
+    uint16_t i = 0; while (i < n && p[i] == ' ') i++;
+    bool neg = false; if (i < n && (p[i] == '-' || p[i] == '+')) { neg = p[i] == '-'; i++; }
+    if (i >= n || p[i] < '0' || p[i] > '9') return def;
+    long v = 0; while (i < n && p[i] >= '0' && p[i] <= '9') { v = v * 10 + (p[i] - '0'); i++; }
+    return neg ? -v : v;
+  }
+  uint32_t toU32(uint32_t def = 0) const { long v = toLong(-1); return v < 0 ? def : (uint32_t)v; }
+  // Copies into a bounded, NUL-terminated buffer; returns bytes copied.
+  size_t copyTo(char *dst, size_t cap) const {
+    if (cap == 0) return 0;
+    size_t l = n < cap - 1 ? n : cap - 1;
+    memcpy(dst, p, l); dst[l] = 0; return l;
+  }
+};
+
+inline WireSpan wireSpan(const char *s) { WireSpan w = { s, (uint16_t)(s ? strlen(s) : 0) }; return w; }
+inline WireSpan wireSpan(const char *s, size_t n) { WireSpan w = { s, (uint16_t)n }; return w; }
+
+// Split on `sep` into at most maxParts spans. The last slot receives the
+// unsplit remainder, so "CMD|MID=1|OPEN|a|b" with maxParts=4 yields "a|b" as part 3.
+inline uint8_t wireSplit(WireSpan in, char sep, WireSpan *out, uint8_t maxParts) {
+  if (maxParts == 0) return 0;
+  uint8_t cnt = 0; uint16_t start = 0;
+  for (uint16_t i = 0; i < in.n && cnt < maxParts - 1; ++i) {
+    if (in.p[i] == sep) { out[cnt++] = in.sub(start, i - start); start = i + 1; }
+  }
+  out[cnt++] = in.sub(start);
+  return cnt;
+}
+
+// Walks KEY=VAL tokens separated by ',' or '|'. Tokens without '=' are reported
+// with an empty key so callers can treat them as continuations (e.g. WD=MON,TUE).
+struct WireKvIter {
+  WireSpan rest;
+  explicit WireKvIter(WireSpan s) : rest(s) {}
+  bool next(WireSpan &key, WireSpan &val) {
+    while (rest.n) {
+      uint16_t e = 0; while (e < rest.n && rest.p[e] != ',' && rest.p[e] != '|') e++;
+      WireSpan tok = rest.sub(0, e).trim();
+      rest = rest.sub(e < rest.n ? e + 1 : e);
+      if (tok.empty()) continue;
+      int eq = tok.indexOf('=');
+      if (eq > 0) { key = tok.sub(0, eq).trim(); val = tok.sub(eq + 1).trim(); }
+      else { key = tok.sub(0, 0); val = tok; }
+      return true;
+    }
+    return false;
+  }
+};
+
+// Exact-key lookup anywhere in the payload (replacement for extractKeyVal()).
+inline bool wireFindKey(WireSpan payload, const char *key, WireSpan &val) {
+  WireKvIter it(payload); WireSpan k, v;
+  while (it.next(k, v)) if (k.eq(key)) { val = v; return true; }
+  return false;
+}
+
+// Parsed view of HEAD|MID=<mid>|<TYPE>|N=..,S=..,I=..,T=..,V=..[|STATUS[|EXTRA]]
+// Used for CMD frames on the node and ACK frames on the controller.
+struct WireCmd {
+  WireSpan head;
+  uint32_t mid;
+  WireSpan type;
+  int32_t node;      // -1 when absent
+  WireSpan sched;
+  int32_t idx;       // -1 when absent
+  uint32_t t;        // raw T= value, unit decided by the consumer
+  WireSpan v;        // valve selector
+  WireSpan status;   // ACK only: "OK" / "ERR_..."
+  WireSpan extra;    // ACK only: telemetry block after status
+};
+
+inline bool wireParseFrame(WireSpan in, const char *wantHead, WireCmd &out) {
+  memset(&out, 0, sizeof(out)); out.node = -1; out.idx = -1;
+  in = in.trim();
+  WireSpan parts[6];
+  uint8_t np = wireSplit(in, '|', parts, 6);
+  if (np < 4) return false;
+  if (!parts[0].eq(wantHead)) return false;
+  if (!parts[1].startsWith("MID=")) return false;
+  out.head = parts[0];
+  out.mid = parts[1].sub(4).toU32();
+  out.type = parts[2].trim();
+  WireKvIter it(parts[3]); WireSpan k, v; bool inV = false;
+  while (it.next(k, v)) {
+    if (k.empty()) { // V=1,3 : bare tokens extend the valve selector in place
+      if (inV) out.v.n = (uint16_t)((v.p + v.n) - out.v.p);
+      continue;
+    }
+    inV = k.eq("V");
+    if (k.eq("N")) out.node = (int32_t)v.toLong(-1);
+    else if (k.eq("S")) out.sched = v;
+    else if (k.eq("I")) out.idx = (int32_t)v.toLong(-1);
+    else if (k.eq("T")) out.t = v.toU32();
+    else if (k.eq("V")) out.v = v;
+  }
+  if (np >= 5) out.status = parts[4].trim();
+  if (np >= 6) out.extra = parts[5];
+  return true;
+}
@@ -0,0 +1,185 @@
+#pragma once
+// Concurrent irrigation zones.
+// A sequence is split into groups: a step flagged `par` runs together with the step
+// before it, so "1:300;2:300+3:300;4:120" is three groups {1} {2,3} {4} that run one
+// after another. Each node has a flow weight (ZoneFlowTable, default 1) and the pump
+// a capacity; inside a group the runner keeps as many valves open as the capacity
+// allows, each with its own timer, and opens waiting members as others finish.
+// Valves are handed over make-before-break like the serial runner: a valve whose
+// time is up is closed only once no OPEN is in flight, so the pump never deadheads.
+// ZoneRunner holds no radio code -- poll() asks the caller to open / close a step
+// (Act: bool open(uint16_t i), bool close(uint16_t i); false = retry next poll) and
+// the caller reports OPEN results back through opened(). Act::skip(i) may pass on a
+// step about to open (moisture feedback: soil already wet); cut() ends an open step
+// before its time.
+// Pure C++, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "wire_proto.h"
+
+#ifndef ZR_MAX
+#define ZR_MAX 64               // steps per run (matches SDB_STEPS_MAX)
+#endif
+#ifndef ZR_FLOW_MAX
+#define ZR_FLOW_MAX 32          // nodes with a non-default flow weight
+#endif
+
+struct ZoneStep { uint16_t node; uint8_t weight; bool par; uint32_t durMs; uint8_t target; uint32_t minMs; };   // target / minMs: step_feedback.h
+
+// Per-node flow weights, configured as "<node>:<w>;<node>:<w>" (w = 1 for unlisted nodes)
+struct ZoneFlowTable {
+  uint16_t node[ZR_FLOW_MAX];
+  uint8_t w[ZR_FLOW_MAX];
+  uint8_t n = 0;
+
+  uint8_t weight(uint16_t nd) const { for (uint8_t i = 0; i < n; ++i) if (node[i] == nd) return w[i]; return 1; }
+  bool set(uint16_t nd, uint8_t wt) {
+    for (uint8_t i = 0; i < n; ++i) if (node[i] == nd) { w[i] = wt; return true; }
+    if (n >= ZR_FLOW_MAX) return false;
+    node[n] = nd; w[n] = wt; n++; return true;
+  }
+  // False (table unchanged) on a malformed entry or a weight outside 1..255
+  bool parse(WireSpan spec) {
+    ZoneFlowTable t = *this; WireSpan rest = spec;
+    while (rest.n) {
+      int semi = rest.indexOf(';');
+      WireSpan e = (semi < 0 ? rest : rest.sub(0, (uint16_t)semi)).trim();
+      rest = semi < 0 ? wireSpan("") : rest.sub((uint16_t)(semi + 1));
+      if (e.empty()) continue;
+      int c = e.indexOf(':'); if (c <= 0) return false;
+      long nd = e.sub(0, (uint16_t)c).toLong(-1), wt = e.sub((uint16_t)(c + 1)).toLong(-1);
+      if (nd < 0 || nd > 0xFFFF || wt < 1 || wt > 255 || !t.set((uint16_t)nd, (uint8_t)wt)) return false;
+    }
+    *this = t; return true;
+  }
+  int text(char *out, size_t cap) const {
+    int len = 0; if (cap) out[0] = 0;
+    for (uint8_t i = 0; i < n && len >= 0 && (size_t)len < cap; ++i) len += snprintf(out + len, cap - len, "%s%u:%u", i ? ";" : "", node[i], w[i]);
+    return len;
+  }
+};
+
+// End (exclusive) of the group starting at b
+inline uint16_t zoneGroupEnd(const ZoneStep *s, uint16_t n, uint16_t b) { uint16_t e = b + 1; while (e < n && s[e].par) e++; return e; }
+
+// Index of the first group (0-based) whose combined weight exceeds cap, -1 if all fit
+inline int zoneCheckCapacity(const ZoneStep *s, uint16_t n, uint16_t cap) {
+  int g = 0;
+  for (uint16_t b = 0; b < n; g++) {
+    uint16_t e = zoneGroupEnd(s, n, b); uint32_t load = 0;
+    for (uint16_t i = b; i < e; ++i) load += s[i].weight;
+    if (e - b > 1 && load > cap) return g;
+    b = e;
+  }
+  return -1;
+}
+
+// Static timeline of a run with no radio delays, as ZoneRunner would play it: groups one
+// after another, members opened in order as the capacity allows. Start of step i (ms from
+// the first open) goes to at[i]; returns the run length.
+inline uint32_t zonePlanTimes(const ZoneStep *s, uint16_t n, uint16_t cap, uint32_t *at) {
+  const uint32_t NONE = 0xFFFFFFFFu;
+  uint32_t t = 0; if (!cap) cap = 1;
+  for (uint16_t b = 0; b < n;) {
+    uint16_t e = zoneGroupEnd(s, n, b), left = (uint16_t)(e - b);
+    for (uint16_t i = b; i < e; ++i) at[i] = NONE;
+    uint32_t now = t;
+    for (;;) {
+      uint32_t load = 0;
+      for (uint16_t i = b; i < e; ++i) if (at[i] != NONE && at[i] + s[i].durMs > now) load += s[i].weight;
+      for (uint16_t i = b; i < e; ++i)
+        if (at[i] == NONE && (load == 0 || load + s[i].weight <= cap)) { at[i] = now; load += s[i].weight; left--; }
+      if (!left) break;
+      uint32_t next = NONE;
+      for (uint16_t i = b; i < e; ++i) if (at[i] != NONE && at[i] + s[i].durMs > now && at[i] + s[i].durMs < next) next = at[i] + s[i].durMs;
+      if (next != NONE) now = next;      // else only zero-length steps ran: the next pass sees them gone
+    }
+    for (uint16_t i = b; i < e; ++i) if (at[i] + s[i].durMs > t) t = at[i] + s[i].durMs;
+    b = e;
+  }
+  return t;
+}
+
+enum ZoneSlot : uint8_t {
+  ZS_WAIT,       // not started (current or later group)
+  ZS_WANT,       // selected to open, command not yet accepted by the caller
+  ZS_OPENING,    // OPEN in flight
+  ZS_OPEN,       // open and timing
+  ZS_EXPIRED,    // time up, CLOSE pending (make-before-break)
+  ZS_DONE,       // closed
+  ZS_FAILED,     // OPEN not acknowledged, skipped
+  ZS_SKIPPED     // passed on by the caller, never opened
+};
+
+struct ZoneRunner {
+  ZoneStep s[ZR_MAX];
+  uint8_t st[ZR_MAX];
+  uint32_t startMs[ZR_MAX];
+  uint16_t n = 0, cap = 1;
+  uint16_t gb = 0, ge = 0;      // current group [gb, ge)
+  bool timing = false;          // timers run (off until the pump lead is over)
+
+  bool begin(const ZoneStep *steps, uint16_t cnt, uint16_t capacity) {
+    if (cnt > ZR_MAX) return false;
+    n = cnt; cap = capacity ? capacity : 1; timing = false;
+    for (uint16_t i = 0; i < n; ++i) { s[i] = steps[i]; st[i] = ZS_WAIT; startMs[i] = 0; }
+    gb = 0; ge = n ? zoneGroupEnd(s, n, 0) : 0;
+    return true;
+  }
+  void clear() { n = 0; gb = ge = 0; timing = false; }
+
+  // Starts every open valve's timer (end of the pump lead)
+  void startTimers(uint32_t nowMs) { timing = true; for (uint16_t i = 0; i < n; ++i) if (st[i] == ZS_OPEN) startMs[i] = nowMs; }
+
+  // OPEN result for step i. Returns the hand-over latency in ms (time since the
+  // earliest expired valve was due) when this open replaces one, else -1.
+  int32_t opened(uint16_t i, bool acked, uint32_t nowMs) {
+    if (i >= n || st[i] != ZS_OPENING) return -1;
+    st[i] = acked ? ZS_OPEN : ZS_FAILED; startMs[i] = nowMs;
+    if (!acked || !timing) return -1;
+    int32_t lat = -1;
+    for (uint16_t j = 0; j < n; ++j) if (st[j] == ZS_EXPIRED) { int32_t l = (int32_t)(nowMs - (startMs[j] + s[j].durMs)); if (l > lat) lat = l; }
+    return lat;
+  }
+
+  // Ends open step i now (its length becomes what it ran); the next poll closes it
+  void cut(uint16_t i, uint32_t nowMs) { if (i < n && st[i] == ZS_OPEN && timing && nowMs - startMs[i] < s[i].durMs) s[i].durMs = nowMs - startMs[i]; }
+
+  template <class Act>
+  void poll(uint32_t nowMs, Act &act) {
+    if (timing) for (uint16_t i = 0; i < n; ++i) if (st[i] == ZS_OPEN && nowMs - startMs[i] >= s[i].durMs) st[i] = ZS_EXPIRED;
+    for (;;) {
+      fill(act);
+      if (groupActive() || ge >= n) break;
+      gb = ge; ge = zoneGroupEnd(s, n, gb);
+    }
+    if (!count(ZS_OPENING) && !count(ZS_WANT)) for (uint16_t i = 0; i < n; ++i) if (st[i] == ZS_EXPIRED && act.close(i)) st[i] = ZS_DONE;
+  }
+
+  uint16_t count(uint8_t state) const { uint16_t c = 0; for (uint16_t i = 0; i < n; ++i) if (st[i] == state) c++; return c; }
+  // Valve may be open on the node (for stop / cleanup)
+  bool live(uint16_t i) const { return i < n && (st[i] == ZS_OPENING || st[i] == ZS_OPEN || st[i] == ZS_EXPIRED); }
+  // First open step, -1 if none (progress index / display)
+  int current() const { for (uint16_t i = 0; i < n; ++i) if (st[i] == ZS_OPEN) return i; return -1; }
+  uint16_t load() const { uint16_t l = 0; for (uint16_t i = 0; i < n; ++i) if (st[i] == ZS_WANT || st[i] == ZS_OPENING || st[i] == ZS_OPEN) l += s[i].weight; return l; }
+  bool settled() const { return !count(ZS_WANT) && !count(ZS_OPENING); }
+  bool finished() const { return ge >= n && !groupActive() && !count(ZS_EXPIRED); }
+
+  // ---- internals ----
+  bool groupActive() const { for (uint16_t i = gb; i < ge; ++i) if (st[i] <= ZS_OPEN) return true; return false; }
+  template <class Act>
+  void fill(Act &act) {
+    for (bool again = true; again;) {           // a skip frees capacity for the next member
+      again = false;
+      uint16_t l = load();
+      for (uint16_t i = gb; i < ge; ++i)
+        if (st[i] == ZS_WAIT && (l == 0 || l + s[i].weight <= cap)) { st[i] = ZS_WANT; l += s[i].weight; }
+      for (uint16_t i = gb; i < ge; ++i) {
+        if (st[i] != ZS_WANT) continue;
+        if (act.skip(i)) { st[i] = ZS_SKIPPED; s[i].durMs = 0; again = true; }
+        else if (act.open(i)) st[i] = ZS_OPENING;
+      }
+    }
+  }
+};
@@ -0,0 +1,152 @@
+#pragma once
+// Discrete-event LoRa channel for the host simulator, and the SX1262 driver stand-in
+// that sits on it (SimRadio: Send / Rx, TxDone / RxDone callbacks).
+// - Airtime: loraAirtimeUs() at SF7 / 125 kHz / CR 4/5, the firmware's settings.
+// - Link budget: log-distance path loss (SIM_PL_D0_DB at 1 m, exponent SIM_PL_EXP),
+//   log-normal shadowing fixed per link for the whole run, and fading drawn per frame.
+//   A frame survives with a probability set by its SNR against the SF7 demodulation
+//   floor: a logistic curve, 50 % at the floor, > 99 % 2.5 dB above it.
+// - Collisions: frames that overlap at a receiver are both lost unless one is
+//   SIM_CAPTURE_DB stronger (capture); the weaker one is always lost.
+// - Half-duplex: a radio that transmits during any part of a frame misses it.
+// Endpoint 0 is the controller: `down` counts controller frames at the nodes, `up`
+// node frames at the controller (node-to-node overhearing is not counted).
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "sim_kernel.h"
+#include "lora_frame.h"
+
+#ifndef SIM_TX_DBM
+#define SIM_TX_DBM 5.0              // TX_OUTPUT_POWER in both sketches
+#endif
+#ifndef SIM_PL_D0_DB
+#define SIM_PL_D0_DB 40.0           // path loss at 1 m, 868 MHz
+#endif
+#ifndef SIM_PL_EXP
+#define SIM_PL_EXP 2.9              // rural, antennas near the ground
+#endif
+#ifndef SIM_SHADOW_DB
+#define SIM_SHADOW_DB 6.0           // per-link sigma
+#endif
+#ifndef SIM_FADE_DB
+#define SIM_FADE_DB 2.0             // per-frame sigma
+#endif
+#ifndef SIM_NOISE_DBM
+#define SIM_NOISE_DBM -117.0        // -174 + 10log10(125 kHz) + 6 dB noise figure
+#endif
+#ifndef SIM_SNR_FLOOR_DB
+#define SIM_SNR_FLOOR_DB -7.5       // SF7
+#endif
+#ifndef SIM_CAPTURE_DB
+#define SIM_CAPTURE_DB 6.0
+#endif
+
+struct LoraChannel;
+
+struct SimRadio {
+  LoraChannel *ch = nullptr;
+  int id = -1;
+  bool txBusy = false;
+  uint64_t txStartUs = 0, txEndUs = 0;
+  uint32_t sent = 0, refused = 0;
+  uint64_t airUs = 0;
+  std::function<void()> onTxDone;
+  std::function<void(const uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr)> onRxDone;
+
+  // Like the driver, a Send while a frame is on air is refused (the firmware waits for TxDone)
+  bool Send(const uint8_t *buf, uint8_t n);
+  void Rx(uint32_t) {}
+};
+
+struct LoraChannel {
+  struct Endpoint { SimRadio *r; double x, y; };
+  struct Frame { int from; uint64_t start, end; std::vector<uint8_t> data; };
+  struct Rx { std::shared_ptr<Frame> f; double dbm; bool lost; uint8_t why; };
+  enum Loss : uint8_t { LOSS_NONE = 0, LOSS_WEAK, LOSS_COLLISION, LOSS_HALF };
+  struct LinkStats { uint32_t frames, delivered, weak, collided, half; };
+
+  SimKernel *k = nullptr;
+  SimRng fade;
+  uint64_t seed = 1;
+  std::vector<Endpoint> eps;
+  std::vector<std::vector<Rx>> active;     // per receiver: frames on air at it
+  LinkStats down = {}, up = {};
+  uint32_t frames = 0;
+  uint64_t airUs = 0;
+
+  void begin(SimKernel &kern, uint64_t s) { k = &kern; seed = s; fade.reseed(simMix(s, 0xFADE)); }
+  int attach(SimRadio &r, double x, double y) {
+    r.ch = this; r.id = (int)eps.size();
+    eps.push_back(Endpoint{ &r, x, y }); active.emplace_back();
+    return r.id;
+  }
+
+  double distance(int a, int b) const { double dx = eps[a].x - eps[b].x, dy = eps[a].y - eps[b].y; double d = sqrt(dx * dx + dy * dy); return d < 1.0 ? 1.0 : d; }
+  // Mean received power on a link (path loss + its shadowing), symmetric
+  double meanDbm(int a, int b) const {
+    SimRng r(simMix(seed, (uint64_t)(a < b ? a : b) << 32 | (uint32_t)(a < b ? b : a)));
+    return SIM_TX_DBM - (SIM_PL_D0_DB + 10.0 * SIM_PL_EXP * log10(distance(a, b))) + r.gauss(SIM_SHADOW_DB);
+  }
+  static double okProbability(double snr) { return 1.0 / (1.0 + exp(-2.0 * (snr - SIM_SNR_FLOOR_DB))); }
+
+  void transmit(SimRadio &r, const uint8_t *buf, uint8_t n) {
+    uint64_t now = k->nowUs, air = loraAirtimeUs(n);
+    auto f = std::make_shared<Frame>(Frame{ r.id, now, now + air, std::vector<uint8_t>(buf, buf + n) });
+    r.txBusy = true; r.txStartUs = now; r.txEndUs = now + air; r.sent++; r.airUs += air;
+    frames++; airUs += air;
+    for (auto &x : active[r.id]) { if (!x.lost) x.why = LOSS_HALF; x.lost = true; }   // it stops listening
+    for (int to = 0; to < (int)eps.size(); ++to) {
+      if (to == r.id) continue;
+      Rx rx{ f, meanDbm(r.id, to) + fade.gauss(SIM_FADE_DB), false, LOSS_NONE };
+      SimRadio &dst = *eps[to].r;
+      if (dst.txBusy && dst.txEndUs > now) { rx.lost = true; rx.why = LOSS_HALF; }
+      for (auto &o : active[to]) {
+        if (rx.dbm < o.dbm + SIM_CAPTURE_DB) { rx.lost = true; if (!rx.why) rx.why = LOSS_COLLISION; }
+        if (o.dbm < rx.dbm + SIM_CAPTURE_DB) { o.lost = true; if (!o.why) o.why = LOSS_COLLISION; }
+      }
+      active[to].push_back(rx);
+    }
+    k->at(now + air, [this, &r, f]() { endFrame(r, f); });
+  }
+
+  // ---- internals ----
+  void endFrame(SimRadio &r, const std::shared_ptr<Frame> &f) {
+    r.txBusy = false;
+    for (int to = 0; to < (int)eps.size(); ++to) {
+      if (to == f->from) continue;
+      auto &v = active[to];
+      for (size_t i = 0; i < v.size(); ++i) {
+        if (v[i].f != f) continue;
+        Rx rx = v[i]; v.erase(v.begin() + i);
+        double snr = rx.dbm - SIM_NOISE_DBM;
+        if (!rx.lost && !fade.chance(okProbability(snr))) { rx.lost = true; rx.why = LOSS_WEAK; }
+        LinkStats *ls = f->from == 0 ? &down : to == 0 ? &up : nullptr;
+        if (ls) {
+          ls->frames++;
+          if (!rx.lost) ls->delivered++;
+          else if (rx.why == LOSS_WEAK) ls->weak++;
+          else if (rx.why == LOSS_COLLISION) ls->collided++;
+          else ls->half++;
+        }
+        if (!rx.lost && eps[to].r->onRxDone) {
+          SimRadio *dst = eps[to].r; std::vector<uint8_t> d = f->data; int16_t rssi = (int16_t)lround(rx.dbm); int8_t s = (int8_t)lround(snr > 20 ? 20 : snr);
+          k->at(k->nowUs, [dst, d, rssi, s]() { dst->onRxDone(d.data(), (uint16_t)d.size(), rssi, s); });
+        }
+        break;
+      }
+    }
+    if (r.onTxDone) r.onTxDone();
+  }
+};
+
+inline bool SimRadio::Send(const uint8_t *buf, uint8_t n) {
+  if (txBusy) { refused++; return false; }
+  ch->transmit(*this, buf, n);
+  return true;
+}
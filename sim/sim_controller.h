@@ -0,0 +1,583 @@
+#pragma once
+// Main_Controller3.0's control path for the host simulator, ported function for
+// function from the sketch over the same pure headers: the LoRa transaction table and
+// multicast engine, the run state machine over ZoneRunner, schedule triggers on a
+// TimerHeap, the NVS progress journal and leased MIDs, and the MQTT status path
+// (AtEngine over the EC200U model, spooling to the LittleFS event log while the broker
+// is away). String / FreeRTOS / BLE glue is left out; node-local PLAN runs and moisture
+// feedback are not modeled (nodes do not advertise LORA_CAP_PLAN), so every run is
+// controller-timed.
+// The ctrl task makes one pass per wake like ctrlTask(): on a received frame, or every
+// CTRL_TICK_MS while commands are in flight. With nothing in flight it sleeps to its
+// next deadline (step timer, pump phase, 1 s housekeeping); ticks that would find
+// nothing due are not simulated. A pass lasts the modeled device cost of what it did
+// (base, SPI frame loads, frame decodes, NVS writes) and is fed to perf.loopDone().
+// The modem task does the same at MODEM_TICK_MS.
+// blocking = true replays the src/ controller's radioSendAndWaitAck() instead: a
+// command holds the pass until its ACK (10 ms polls) or its last retry (+100 ms)
+// times out, and CLOSEs to idle nodes go out one by one.
+// The sketch's remaining String code is charged to a SimHeap (sim_heap.h) at the same
+// points: the QMTPUB command built per status and the hourly EVT|HEAP report, sampled
+// by heapPoll() like the sketch. stringHeap = true charges what the controller did
+// before its fixed buffers instead: every received frame through String
+// incomingQueue[16], statuses built by concatenation, and seq grown per trigger.
+// One controller per process: AtEngine's writer and URC handlers are plain functions.
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "sim_kernel.h"
+#include "sim_hal.h"
+#include "sim_heap.h"
+#include "sim_modem.h"
+#include "lora_channel.h"
+#include "host_fs.h"
+#include "node_power.h"
+#include "lora_frame.h"
+#include "radio_ring.h"
+#include "zone_runner.h"
+#include "timer_heap.h"
+#include "nvs_journal.h"
+#include "event_log.h"
+#include "at_engine.h"
+#include "perf_stats.h"
+
+#ifndef SIM_PASS_US
+#define SIM_PASS_US 60              // ctrl pass with nothing to do
+#endif
+#ifndef SIM_SPI_FRAME_US
+#define SIM_SPI_FRAME_US 400        // Radio.Send: buffer + config over SPI
+#endif
+#ifndef SIM_RX_FRAME_US
+#define SIM_RX_FRAME_US 150         // decode, match, format one received frame
+#endif
+#ifndef SIM_SCHED_MAX
+#define SIM_SCHED_MAX 8
+#endif
+#ifndef SIM_LAT_BINS
+#define SIM_LAT_BINS 300            // step latency histogram, 100 ms bins
+#endif
+
+const uint32_t SIM_CTRL_TICK_MS = 10, SIM_MODEM_TICK_MS = 5;
+const uint8_t SIM_TXN_MAX = 12, SIM_MCAST_MAX = 2;
+const uint32_t SIM_MID_LEASE = 64, SIM_EV_SEQ_LEASE = 64;
+const uint32_t SIM_MODEM_HEALTH_POLL_MS = 30 * 1000;
+const uint8_t SIM_STATUS_Q_LEN = 16, SIM_EVLOG_REPLAY_BATCH = 4;
+const uint16_t SIM_STATUS_MAX = 216;
+const uint8_t SIM_PUMP_PIN = 25;                      // include/config.h is Arduino-only: its values, mirrored
+const uint32_t LORA_ACK_TIMEOUT_MS = 3000;
+const uint8_t LORA_MAX_RETRIES = 3;
+const uint32_t STEP_FAILSAFE_MARGIN_MS = LORA_ACK_TIMEOUT_MS * LORA_MAX_RETRIES;
+
+struct SimSchedule {
+  char id[16];
+  uint32_t startS;                  // seconds after midnight, daily
+  uint16_t n, cap;
+  uint32_t leadMs, tailMs;
+  ZoneStep steps[ZR_MAX];
+};
+
+struct SimController {
+  enum TxnCb : uint8_t { CB_NONE = 0, CB_RUN_OPEN, CB_RUN_CLOSE };
+  enum RunState : uint8_t { RS_IDLE, RS_START_OPEN, RS_PUMP_LEAD, RS_STEP, RS_PUMP_TAIL };
+  struct LoraTxn { bool used, waiting; uint32_t mid; uint8_t code; int node; int idx; uint32_t durMs; uint8_t attempts; uint32_t deadline; uint8_t cb; int tag; };
+  struct LoraMcast { bool used, waiting; uint32_t mid; uint8_t code; LoraNodeSet pending; uint16_t total, slotMs; uint8_t attempts; uint32_t deadline; };
+  struct StatusPub { bool used, replay; uint32_t token, seq; char text[SIM_STATUS_MAX]; };
+
+  SimKernel *k = nullptr;
+  SimClock clk;
+  SimRadio radio;
+  SimPreferences prefs;
+  SimGpio gpio;
+  SimModemSerial *modem = nullptr;
+  HostFS *fs = nullptr;
+  bool blocking = false;
+
+  // ---- sketch state ----
+  RadioRing radioRx;
+  bool radioTxBusy = false;
+  LoraTxn txns[SIM_TXN_MAX];
+  LoraMcast mcasts[SIM_MCAST_MAX];
+  ZoneRunner zones;
+  TimerHeap schedTimers;
+  SimSchedule sched[SIM_SCHED_MAX];
+  uint8_t schedCount = 0;
+  int cur = -1;                     // running schedule
+  uint16_t curHash = 0;
+  RunState runState = RS_IDLE;
+  uint32_t runPhaseStart = 0, lastProgressSave = 0;
+  int currentStepIndex = -1;
+  bool pumpOn = false;
+  NvsJournal<SimPreferences> nvj;
+  LeasedCounter<SimPreferences> midAlloc, evSeqAlloc;
+  EventLog<HostFS> evlog;
+  AtEngine at;
+  StatusPub statusPubs[AT_QUEUE_LEN];
+  char statusQ[SIM_STATUS_Q_LEN][SIM_STATUS_MAX];
+  uint8_t qHead = 0, qCount = 0;
+  bool mqttAvailable = false, mqttConnecting = false;
+  uint8_t mqttPubFailures = 0;
+  uint32_t lastModemHealthPoll = 0;
+  PerfStats perf;
+  SimHeap heap;
+  uint32_t heapLargestMin = UINT32_MAX, heapSampleMs = 0, heapReportMs = 0;
+  bool stringHeap = false;          // charge the pre-fixed-buffer String pattern
+  SimHeapStr inq[16], schedId;      // stringHeap: String incomingQueue[16], currentScheduleId
+  uint8_t inqTail = 0;
+  int32_t seqOff = -1;              // stringHeap: std::vector<SeqStep> seq
+  uint32_t seqCap = 0;
+
+  // ---- simulator bookkeeping ----
+  uint64_t ctrlWakeUs = UINT64_MAX, modemWakeUs = UINT64_MAX;
+  uint64_t passCostUs = 0, prefsCostMark = 0;
+  int blockTxn = -1;                // blocking mode: txn the pass is waiting on
+  uint64_t blockSinceUs = 0;
+  uint32_t blockRetryAt = 0;
+  uint32_t latHist[SIM_LAT_BINS + 1] = {};
+  uint32_t runs = 0, runsDone = 0, stepsFailed = 0, statuses = 0, statusDrops = 0, staleAcks = 0, stats = 0, autoClosed = 0;
+
+  // ---- setup() ----
+  void begin(SimKernel &kern, SimModemSerial &m, HostFS &f, int32_t ppm, int64_t epochS, bool block) {
+    k = &kern; modem = &m; fs = &f; blocking = block;
+    clk.k = k; clk.ppm = ppm; clk.epochAtBootS = epochS;
+    gpio.k = k;
+    memset(txns, 0, sizeof(txns)); memset(mcasts, 0, sizeof(mcasts)); memset(statusPubs, 0, sizeof(statusPubs));
+    schedTimers.clear(); zones.clear(); perf.reset(clk.millis());
+    prefs.begin("irrig");
+    midAlloc.begin(prefs, "msg_counter", SIM_MID_LEASE);
+    evSeqAlloc.begin(prefs, "ev_seq_lease", SIM_EV_SEQ_LEASE);
+    nvj.begin(prefs);
+    evlog.begin(f);
+    heap.begin(SIM_HEAP_BYTES);
+    for (auto &q : inq) q.h = &heap;
+    schedId.h = &heap;
+    heap.alloc(SIM_SCHED_MAX * 128);  // schedules, loaded at boot
+    if (!stringHeap) heap.alloc(ZR_MAX * 12);   // seq, reserved at boot
+    radio.onRxDone = [this](const uint8_t *p, uint16_t n, int16_t rssi, int8_t snr) { radioRx.push(p, n, rssi, snr, clk.millis()); wakeCtrl(k->nowUs); };
+    radio.onTxDone = [this]() { radioTxBusy = false; wakeCtrl(k->nowUs); };
+    simAt() = this;
+    at.begin([](const char *p, size_t n) { simAt()->modem->write((const uint8_t *)p, n); });
+    at.onUrc("+QMTSTAT:", [](WireSpan) { simAt()->modemConfigureAndConnectMQTT(); });
+    modem->onData = [this]() { wakeModem(k->nowUs); };
+    modemConfigureAndConnectMQTT();
+    wakeCtrl(0); wakeModem(0);
+  }
+  static SimController *&simAt() { static SimController *c = nullptr; return c; }
+  void addSchedule(const SimSchedule &s) {
+    if (schedCount >= SIM_SCHED_MAX) return;
+    sched[schedCount] = s;
+    schedTimerArm(schedCount, nextStartS(s.startS));
+    schedCount++;
+  }
+
+  // ---------- LoRa txn engine (loraTxnStart / Transmit / OnFrame / Poll) ----------
+  int loraTxnStart(uint8_t code, int node, int idx, uint32_t durMs, uint8_t cb, int tag) {
+    for (int i = 0; i < SIM_TXN_MAX; ++i) {
+      LoraTxn &t = txns[i];
+      if (t.used) continue;
+      memset(&t, 0, sizeof(t));
+      t.used = true; t.mid = midAlloc.take(); t.code = code; t.node = node; t.idx = idx; t.durMs = durMs; t.cb = cb; t.tag = tag;
+      return i;
+    }
+    return -1;
+  }
+  void loraTxnFinish(LoraTxn &t, bool acked) {
+    LoraTxn done = t;
+    t.used = false;
+    perf.txnDone(acked, done.attempts);
+    if (done.cb == CB_RUN_OPEN) onRunOpenDone(done, acked);
+  }
+  void sendLoRaFrame(const LoraFrame &f) {
+    uint8_t buf[LORA_FRAME_MAX]; size_t n = loraEncode(f, buf, sizeof(buf));
+    if (!n) return;
+    passCostUs += SIM_SPI_FRAME_US;
+    if (radio.Send(buf, (uint8_t)n)) radioTxBusy = true;
+  }
+  void loraTxnTransmit(LoraTxn &t) {
+    LoraFrame f; loraFrameClear(f);
+    f.kind = LF_CMD; f.code = t.code; f.mid = t.mid; f.node = t.node; f.idx = t.idx; f.schedHash = curHash;
+    if (f.code == LC_OPEN) f.durMs = t.durMs;
+    sendLoRaFrame(f);
+    t.attempts++; t.waiting = true; t.deadline = clk.millis() + LORA_ACK_TIMEOUT_MS + NODE_RX_WINDOW_MS;
+  }
+  uint16_t loraMcastSlotMs() const { return (uint16_t)(loraAirtimeUs(LORA_FRAME_MAX) / 1000 + 15); }
+  // Multicast to every node in `nodes`; returns false when no slot is free (caller goes unicast)
+  bool loraMcastStart(uint8_t code, const uint16_t *nodes, uint16_t n) {
+    LoraMcast *m = nullptr;
+    for (auto &x : mcasts) if (!x.used) { m = &x; break; }
+    if (!m || !n) return false;
+    memset(m, 0, sizeof(*m));
+    for (uint16_t i = 0; i < n; ++i) m->pending.add(nodes[i]);
+    m->used = true; m->mid = midAlloc.take(); m->code = code; m->total = m->pending.count(); m->slotMs = loraMcastSlotMs();
+    return true;
+  }
+  void loraMcastTransmit(LoraMcast &m) {
+    LoraFrame f; loraFrameClear(f);
+    f.kind = LF_CMD; f.code = m.code; f.mid = m.mid; f.node = LORA_NODE_GROUP; f.schedHash = curHash;
+    f.targets = m.pending; f.slotMs = m.slotMs;
+    uint8_t tmp[LORA_FRAME_MAX]; size_t n = loraEncode(f, tmp, sizeof(tmp));
+    sendLoRaFrame(f);
+    m.attempts++; m.waiting = true;
+    m.deadline = clk.millis() + loraAirtimeUs(n) / 1000 + 2 * LORA_SLOT_GUARD_MS + (uint32_t)m.pending.count() * m.slotMs;
+  }
+  bool loraMcastWindowOpen() const { for (auto &m : mcasts) if (m.used && m.waiting) return true; return false; }
+  bool loraMcastOnAck(const LoraFrame &f) {
+    for (auto &m : mcasts) {
+      if (!m.used || !m.attempts || f.mid != m.mid || f.code != m.code || !m.pending.has(f.node)) continue;
+      if (f.schedHash != curHash || f.status != 0) continue;
+      m.pending.remove(f.node);
+      if (!m.pending.count()) { m.used = false; perf.txnDone(true, m.attempts); }
+      return true;
+    }
+    return false;
+  }
+  bool loraTxnOnFrame(const LoraFrame &f) {
+    if (f.kind != LF_ACK) return false;
+    if (loraMcastOnAck(f)) return true;
+    for (auto &t : txns) {
+      if (!t.used || t.attempts == 0) continue;
+      if (f.mid == t.mid && f.code == t.code && f.node == (uint32_t)t.node && f.idx == t.idx && f.schedHash == curHash) { loraTxnFinish(t, true); return true; }
+    }
+    staleAcks++;
+    return true;
+  }
+  void loraTxnPoll() {
+    uint32_t now = clk.millis();
+    for (auto &t : txns) {
+      if (!t.used || !t.waiting || (int32_t)(now - t.deadline) < 0) continue;
+      if (t.attempts >= LORA_MAX_RETRIES) loraTxnFinish(t, false);
+      else t.waiting = false;
+    }
+    for (auto &m : mcasts) {
+      if (!m.used || !m.waiting || (int32_t)(now - m.deadline) < 0) continue;
+      if (m.attempts >= LORA_MAX_RETRIES) { m.used = false; perf.txnDone(m.pending.count() == 0, m.attempts); }
+      else m.waiting = false;
+    }
+    if (radioTxBusy || loraMcastWindowOpen()) return;
+    for (auto &m : mcasts) if (m.used && !m.waiting) { loraMcastTransmit(m); return; }
+    for (auto &t : txns) if (t.used && !t.waiting) { loraTxnTransmit(t); break; }
+  }
+  // radioSendAndWaitAck(): one command at a time, the pass waits for it
+  void blockingPoll() {
+    uint32_t now = clk.millis();
+    if (blockTxn < 0) {
+      for (int i = 0; i < SIM_TXN_MAX; ++i) if (txns[i].used) { blockTxn = i; blockSinceUs = k->nowUs; blockRetryAt = now; break; }
+      if (blockTxn < 0) return;
+    }
+    LoraTxn &t = txns[blockTxn];
+    if (!t.used) { blockTxn = -1; return; }                           // ACK matched in radioDispatch
+    if (t.waiting && (int32_t)(now - t.deadline) >= 0) {
+      if (t.attempts >= LORA_MAX_RETRIES) { loraTxnFinish(t, false); blockTxn = -1; return; }
+      t.waiting = false; blockRetryAt = now + 100;                     // delay(100) between tries
+    }
+    if (!t.waiting && !radioTxBusy && (int32_t)(now - blockRetryAt) >= 0) { loraTxnTransmit(t); t.deadline = now + LORA_ACK_TIMEOUT_MS; }
+  }
+
+  void radioDispatch() {
+    const RadioPacket *pk;
+    while ((pk = radioRx.peek()) != nullptr) {
+      passCostUs += SIM_RX_FRAME_US;
+      LoraFrame f; char text[RADIO_PKT_MAX + 1];
+      bool ok = loraIsBinary(pk->data, pk->len) && loraDecode(pk->data, pk->len, f);
+      radioRx.pop();
+      if (!ok) continue;
+      if (stringHeap) heapInbound((uint32_t)loraFrameToText(f, text, sizeof(text)));
+      if (f.kind == LF_STAT || f.kind == LF_AUTO_CLOSED) {
+        if (f.kind == LF_STAT) stats++; else autoClosed++;
+        loraFrameToText(f, text, sizeof(text));
+        publishStatusf("%s|SRC=LORA", text);
+        continue;
+      }
+      loraTxnOnFrame(f);
+    }
+  }
+
+  // ---------- Run state machine ----------
+  void onRunOpenDone(const LoraTxn &t, bool acked) {
+    int32_t lat = zones.opened((uint16_t)t.tag, acked, clk.millis());
+    if (lat >= 0) { perf.stepMoved((uint32_t)lat); latHist[lat / 100 < SIM_LAT_BINS ? lat / 100 : SIM_LAT_BINS]++; }
+    if (!acked) stepsFailed++;
+    if (acked && zones.timing) publishStatusf("EVT|STEP|MOVE|I=%d", t.tag);
+  }
+  struct RunValves {
+    SimController *c;
+    bool skip(uint16_t) { return false; }
+    bool open(uint16_t i) {
+      uint32_t failsafeMs = c->zones.s[i].durMs + (c->zones.timing ? 0 : c->sched[c->cur].leadMs) + STEP_FAILSAFE_MARGIN_MS;
+      return c->loraTxnStart(LC_OPEN, c->zones.s[i].node, i, failsafeMs, CB_RUN_OPEN, i) >= 0;
+    }
+    bool close(uint16_t i) { return c->loraTxnStart(LC_CLOSE, c->zones.s[i].node, i, 0, CB_RUN_CLOSE, i) >= 0; }
+  };
+  void setPump(bool on) {
+    gpio.digitalWrite(SIM_PUMP_PIN, on ? 1 : 0);
+    if (on != pumpOn) { pumpOn = on; publishStatusf("%s", on ? "EVT|PUMP|ON" : "EVT|PUMP|OFF"); }
+  }
+  void saveProgressIndex() { nvj.putInt("active_index", currentStepIndex, clk.millis()); }
+  void runStart(uint8_t i) {
+    const SimSchedule &s = sched[i];
+    cur = i; curHash = loraSchedHash(s.id); runs++;
+    publishStatusf("EVT|SCH|TRIGGER|S=%s", s.id);
+    if (stringHeap) heapTrigger((uint32_t)strlen(s.id), s.n);
+    zones.begin(s.steps, s.n, s.cap); currentStepIndex = -1;
+    RunValves rv{ this }; zones.poll(clk.millis(), rv); runState = RS_START_OPEN;
+  }
+  void runFinish(const char *evt) {
+    runState = RS_IDLE; zones.clear();
+    currentStepIndex = -1; saveProgressIndex();
+    if (evt) { publishStatusf("%s", evt); runsDone++; }
+  }
+  void runScheduleLoop() {
+    uint32_t now = clk.millis();
+    RunValves rv{ this };
+    switch (runState) {
+      case RS_IDLE: return;
+      case RS_START_OPEN:
+        zones.poll(now, rv);
+        if (!zones.settled()) return;
+        if (zones.current() >= 0) {
+          uint16_t idle[ZR_MAX]; uint16_t n = 0;
+          for (uint16_t i = 0; i < zones.n; ++i) {
+            bool busy = false, dup = false;
+            for (uint16_t j = 0; j < zones.n && !busy; ++j) busy = zones.live(j) && zones.s[j].node == zones.s[i].node;
+            for (uint16_t j = 0; j < n && !dup; ++j) dup = idle[j] == zones.s[i].node;
+            if (!busy && !dup) idle[n++] = zones.s[i].node;
+          }
+          if (blocking || !loraMcastStart(LC_CLOSE, idle, n))
+            for (uint16_t j = 0; j < n; ++j) for (uint16_t i = 0; i < zones.n; ++i) if (zones.s[i].node == idle[j]) { loraTxnStart(LC_CLOSE, idle[j], i, 0, CB_RUN_CLOSE, i); break; }
+          currentStepIndex = zones.current(); saveProgressIndex();
+          setPump(true); runPhaseStart = now; runState = RS_PUMP_LEAD;
+        } else if (zones.finished()) runFinish("ERR|no_start_node_opened");
+        return;
+      case RS_PUMP_LEAD:
+        if (now - runPhaseStart < sched[cur].leadMs) return;
+        zones.startTimers(now); runState = RS_STEP;
+        publishStatusf("EVT|START|S=%s", sched[cur].id);
+        break;
+      case RS_STEP: {
+        zones.poll(now, rv);
+        if (zones.finished()) { runPhaseStart = now; runState = RS_PUMP_TAIL; return; }
+        int c = zones.current();
+        if (c >= 0 && c != currentStepIndex) { currentStepIndex = c; saveProgressIndex(); }
+        break;
+      }
+      case RS_PUMP_TAIL:
+        if (now - runPhaseStart < sched[cur].tailMs) return;
+        setPump(false); runFinish("EVT|SCHEDULE_COMPLETE");
+        return;
+    }
+    if (now - lastProgressSave > 60000UL) {
+      nvj.putString("active_schedule", sched[cur].id, now);
+      saveProgressIndex();
+      lastProgressSave = now;
+    }
+  }
+  // Daily triggers on the wall clock
+  uint32_t nextStartS(uint32_t startS) const {
+    uint32_t now = (uint32_t)clk.time(), day = now - now % 86400, t = day + startS;
+    return t > now ? t : t + 86400;
+  }
+  void schedTimerArm(uint8_t i, uint32_t due) { schedTimers.set(i, due); }
+  void schedTimerPoll() {
+    uint32_t now = (uint32_t)clk.time();
+    if (runState != RS_IDLE || schedTimers.empty() || now < schedTimers.topDue()) return;
+    uint8_t i = (uint8_t)schedTimers.topKey();
+    schedTimerArm(i, schedTimers.topDue() + 86400);
+    runStart(i);
+  }
+
+  // ---------- Status path (publishStatusf -> statusQ -> modem task) ----------
+  void publishStatusf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    statuses++;
+    if (qCount >= SIM_STATUS_Q_LEN) { statusDrops++; return; }
+    va_list ap; va_start(ap, fmt);
+    int n = vsnprintf(statusQ[(qHead + qCount) % SIM_STATUS_Q_LEN], SIM_STATUS_MAX, fmt, ap);
+    va_end(ap);
+    if (stringHeap) heapStatusText(n > 0 ? (uint32_t)n : 0);
+    qCount++;
+    wakeModem(k->nowUs);
+  }
+  static void onStatusPublishDone(void *ctx, AtResult res, const char *resp, uint16_t len) {
+    SimController &c = *simAt(); StatusPub &p = *(StatusPub *)ctx;
+    WireSpan l;
+    bool ok = res == AT_OK && atFindLine(resp, len, "+QMTPUB:", l) && l.contains(",0,0");
+    if (ok) { c.mqttPubFailures = 0; if (p.replay) c.evlog.commit(p.token); }
+    else {
+      if (p.replay) c.evlog.rewind(); else c.evlog.append(p.text, p.seq, c.clk.millis());
+      if (++c.mqttPubFailures >= 3 && c.mqttAvailable) { c.mqttPubFailures = 0; c.modemConfigureAndConnectMQTT(); }
+    }
+    p.used = false;
+  }
+  bool publishStatusSeq(const char *text, uint32_t seq, bool replay, uint32_t token) {
+    StatusPub *p = nullptr;
+    for (auto &x : statusPubs) if (!x.used) { p = &x; break; }
+    if (!p) return false;
+    p->replay = replay; p->token = token; p->seq = seq; snprintf(p->text, sizeof(p->text), "%s", text);
+    char cmd[AT_CMD_MAX];
+    snprintf(cmd, sizeof(cmd), "AT+QMTPUB=0,0,0,1,\"irrig/status\",\"%s|SEQ=%lu\"", text, (unsigned long)seq);
+    heapPublish((uint32_t)strlen(text), seq);
+    p->used = at.submit(cmd, 15000, onStatusPublishDone, p, "+QMTPUB:");
+    return p->used;
+  }
+  void outboxMqttWorker() {
+    char text[SIM_STATUS_MAX];
+    if (!mqttAvailable || !evlog.idle())
+      while (qCount) { evlog.append(statusQ[qHead], evSeqAlloc.take(), clk.millis()); qHead = (uint8_t)((qHead + 1) % SIM_STATUS_Q_LEN); qCount--; }
+    if (!mqttAvailable) return;
+    if (!evlog.idle()) {
+      uint8_t inFlight = 0; for (auto &p : statusPubs) if (p.used && p.replay) inFlight++;
+      while (inFlight < SIM_EVLOG_REPLAY_BATCH && at.pending() < AT_QUEUE_LEN / 2) {
+        uint32_t seq, token;
+        if (!evlog.next(text, sizeof(text), seq, token)) break;
+        if (!publishStatusSeq(text, seq, true, token)) { evlog.rewind(); break; }
+        inFlight++;
+      }
+      return;
+    }
+    while (qCount && at.pending() < AT_QUEUE_LEN / 2) {
+      if (!publishStatusSeq(statusQ[qHead], evSeqAlloc.take(), false, 0)) break;
+      qHead = (uint8_t)((qHead + 1) % SIM_STATUS_Q_LEN); qCount--;
+    }
+  }
+  static void onMqttConnDone(void *, AtResult res, const char *resp, uint16_t len) {
+    SimController &c = *simAt(); WireSpan l;
+    c.mqttAvailable = res == AT_OK && atFindLine(resp, len, "+QMTCONN:", l) && l.contains(",0,0");
+    c.mqttConnecting = false;
+  }
+  void modemConfigureAndConnectMQTT() {
+    mqttAvailable = false;
+    bool ok = at.submit("AT", 2000);
+    ok = ok && at.submit("AT+QICSGP=1,1,\"internet\",\"\",\"\",1", 4000);
+    ok = ok && at.submit("AT+QIACT=1", 10000);
+    ok = ok && at.submit("AT+QMTOPEN=0,\"broker\",1883", 10000, nullptr, nullptr, "+QMTOPEN:");
+    ok = ok && at.submit("AT+QMTCONN=0,\"irrig_main\",\"u\",\"p\"", 10000, onMqttConnDone, nullptr, "+QMTCONN:");
+    ok = ok && at.submit("AT+QMTSUB=0,1,\"irrig/schedule\",1", 5000, nullptr, nullptr, "+QMTSUB:");
+    mqttConnecting = ok;
+  }
+  void modemHealthPoll() {
+    if (clk.millis() - lastModemHealthPoll < SIM_MODEM_HEALTH_POLL_MS) return;
+    lastModemHealthPoll = clk.millis();
+    at.submit("AT+CREG?", 2000); at.submit("AT+CPIN?", 2000);
+    if (!mqttAvailable && !mqttConnecting) modemConfigureAndConnectMQTT();   // broker was still away at the last attempt
+  }
+
+  // ---------- Heap (heapPoll, and the String code's allocations) ----------
+  void heapPoll() {
+    uint32_t now = clk.millis();
+    if (now - heapSampleMs < 60000UL) return;
+    heapSampleMs = now;
+    if (heap.largest() < heapLargestMin) heapLargestMin = heap.largest();
+    if (now - heapReportMs < 3600000UL) return;
+    heapReportMs = now;
+    { SimHeapStr b(heap, 150); SimHeapStr sum(heap, 9); sum.append(b.len); }   // String("EVT|HEAP|") + heapStatsText()
+    publishStatusf("EVT|HEAP|FREE=%lu,LARGEST=%lu", (unsigned long)heap.freeBytes, (unsigned long)heap.largest());
+  }
+  uint32_t heapFragPct() const { return heap.freeBytes ? 100 - (uint32_t)((uint64_t)heap.largest() * 100 / heap.freeBytes) : 0; }
+  static uint32_t digits(uint32_t v) { uint32_t d = 1; while (v >= 10) { v /= 10; d++; } return d; }
+  // publishStatusSeq(): cmd = String("AT+QMTPUB=...\"") + topic + String("\",\""); body = String(text) +
+  // "|SEQ=" + String(seq); cmd += body + String("\"")
+  void heapPublish(uint32_t textLen, uint32_t seq) {
+    SimHeapStr cmd(heap, 19); cmd.append(12); cmd.append(3);
+    SimHeapStr body(heap, textLen); body.append(5); { SimHeapStr n(heap, digits(seq)); body.append(n.len); }
+    SimHeapStr sum(heap, body.len); sum.append(1); cmd.append(sum.len);
+  }
+  // Before the fixed buffers: OnRxDone's String msg into String incomingQueue[16], then
+  // loop()'s String iq = dequeue
+  void heapInbound(uint32_t n) {
+    { SimHeapStr msg(heap, n); inq[inqTail].assign(n); inqTail = (uint8_t)((inqTail + 1) % 16); }
+    SimHeapStr iq(heap, n);
+  }
+  // ... publishStatusMsg(String("EVT|...") + a + b): the concatenation, String out = msg, the log line
+  void heapStatusText(uint32_t n) {
+    SimHeapStr msg(heap, n / 3); msg.append(n / 3); msg.append(n - 2 * (n / 3));
+    SimHeapStr out(heap, n); SimHeapStr log(heap, n + 15);
+  }
+  // ... currentScheduleId = sch.id; seq.clear(); seq.push_back() per step (capacity doubles)
+  void heapTrigger(uint32_t idLen, uint16_t steps) {
+    schedId.assign(idLen);
+    while (seqCap < steps) {
+      uint32_t c = seqCap ? seqCap * 2 : 1;
+      int32_t o = heap.alloc(c * 8);
+      if (o < 0) return;
+      if (seqOff >= 0) heap.free(seqOff);
+      seqOff = o; seqCap = c;
+    }
+  }
+
+  // ---------- Tasks ----------
+  bool ctrlBusy() const {
+    if (radioTxBusy || radioRx.depth() || runState == RS_START_OPEN || blockTxn >= 0) return true;
+    for (auto &t : txns) if (t.used) return true;
+    for (auto &m : mcasts) if (m.used) return true;
+    return false;
+  }
+  // Local ms until the next thing the ctrl task has to do when nothing is in flight
+  uint32_t ctrlIdleMs() const {
+    uint32_t now = clk.millis(), next = 1000;
+    if (runState == RS_PUMP_LEAD || runState == RS_PUMP_TAIL) {
+      uint32_t end = runPhaseStart + (runState == RS_PUMP_LEAD ? sched[cur].leadMs : sched[cur].tailMs);
+      next = (int32_t)(end - now) > 0 ? (end - now < next ? end - now : next) : 0;
+    }
+    if (runState == RS_STEP && zones.timing)
+      for (uint16_t i = 0; i < zones.n; ++i) if (zones.st[i] == ZS_OPEN) {
+        uint32_t end = zones.startMs[i] + zones.s[i].durMs;
+        uint32_t d = (int32_t)(end - now) > 0 ? end - now : 0; if (d < next) next = d;
+      }
+    return next;
+  }
+  void ctrlPass() {
+    passCostUs = SIM_PASS_US; prefsCostMark = prefs.costUs;
+    if (blocking) {
+      blockingPoll();
+      radioDispatch();
+      if (blockTxn >= 0 && txns[blockTxn].used) { wakeCtrlAfterMs(SIM_CTRL_TICK_MS); return; }   // still inside radioSendAndWaitAck
+      blockTxn = -1;
+    } else {
+      loraTxnPoll();
+      radioDispatch();
+    }
+    runScheduleLoop();
+    schedTimerPoll();
+    nvj.tick(clk.millis());
+    heapPoll();
+    uint64_t us = passCostUs + (prefs.costUs - prefsCostMark);
+    if (blocking && blockSinceUs) { us += k->nowUs - blockSinceUs; blockSinceUs = 0; }
+    perf.loopDone((uint32_t)us);
+    wakeCtrlAfterMs(ctrlBusy() ? SIM_CTRL_TICK_MS : ctrlIdleMs());
+  }
+  void modemPass() {
+    while (modem->available()) at.feed((char)modem->read());
+    at.poll(clk.millis());
+    modemHealthPoll();
+    outboxMqttWorker();
+    evlog.tick(clk.millis());
+    bool busy = at.pending() || qCount || (mqttAvailable && !evlog.idle());
+    wakeModemAfterMs(busy ? SIM_MODEM_TICK_MS : 1000);
+  }
+
+  // ---- wakeups (FreeRTOS notify / timeout) ----
+  void wakeCtrl(uint64_t atUs) {
+    if (atUs >= ctrlWakeUs && ctrlWakeUs >= k->nowUs) return;
+    ctrlWakeUs = atUs;
+    k->at(atUs, [this, atUs]() { if (ctrlWakeUs != atUs) return; ctrlWakeUs = UINT64_MAX; ctrlPass(); });
+  }
+  void wakeModem(uint64_t atUs) {
+    if (atUs >= modemWakeUs && modemWakeUs >= k->nowUs) return;
+    modemWakeUs = atUs;
+    k->at(atUs, [this, atUs]() { if (modemWakeUs != atUs) return; modemWakeUs = UINT64_MAX; modemPass(); });
+  }
+  void wakeCtrlAfterMs(uint32_t ms) { wakeCtrl(k->nowUs + clk.simUs((uint64_t)(ms ? ms : 1) * 1000)); }
+  void wakeModemAfterMs(uint32_t ms) { wakeModem(k->nowUs + clk.simUs((uint64_t)ms * 1000)); }
+
+  // Step-latency percentile from the 100 ms histogram (upper bin edge)
+  uint32_t latPercentileMs(uint32_t pct) const {
+    uint32_t total = 0; for (uint32_t v : latHist) total += v;
+    if (!total) return 0;
+    uint32_t want = (uint32_t)(((uint64_t)total * pct + 99) / 100), acc = 0;
+    uint32_t ms = (SIM_LAT_BINS + 1) * 100;
+    for (uint32_t b = 0; b <= SIM_LAT_BINS; ++b) { acc += latHist[b]; if (acc >= want) { ms = (b + 1) * 100; break; } }
+    return ms < perf.stepLatMaxMs ? ms : perf.stepLatMaxMs;     // bin's upper edge, never past the worst seen
+  }
+};
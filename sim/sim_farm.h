@@ -0,0 +1,194 @@
+#pragma once
+// A simulated farm: the controller, N nodes scattered around it, the LoRa channel, the
+// EC200U with its broker outages, and the hydraulics that tie pump and valves together.
+// Everything random comes from SimFarmCfg::seed, so a configuration always produces the
+// same report; change the firmware port and diff the reports.
+// Nodes sit uniformly in a disc of radiusM around the controller, each with a crystal
+// error of up to +-ppmMax. Every schedule runs all nodes once a day in a seeded order,
+// steps stepMinS..stepMaxS long (groups of `cap` steps run together when cap > 1).
+// Dead-heading is time the pump runs with every valve shut -- what a late OPEN or an
+// early auto-close costs in the field, and what the pump tail after the last CLOSE
+// costs on every run. A valve's watering time (open with the pump on) is checked
+// against its step's duration when it closes.
+// The controller's heap is snapshot at the end of every day (heapDays) for soak runs;
+// stringHeap replays the String pattern from before the fixed buffers.
+// report() writes one KEY|k=v,... line per area plus HASH, a digest of the rest.
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <memory>
+#include <vector>
+#include "sim_kernel.h"
+#include "sim_hal.h"
+#include "sim_modem.h"
+#include "lora_channel.h"
+#include "sim_node.h"
+#include "sim_controller.h"
+
+struct SimFarmCfg {
+  uint64_t seed = 1;
+  uint16_t nodes = 16;
+  double days = 1;
+  bool blocking = false;            // src/ controller's radioSendAndWaitAck
+  double radiusM = 700;
+  uint8_t schedules = 2;            // 05:00, 17:00, ...
+  uint16_t cap = 1;
+  uint32_t stepMinS = 120, stepMaxS = 600;
+  uint32_t leadMs = 5000, tailMs = 5000;
+  int32_t ppmMax = 40;
+  double outagesPerDay = 2;
+  uint32_t outageMinS = 300, outageMaxS = 3600;
+  bool stringHeap = false;
+};
+
+struct SimHeapDay { uint32_t freeBytes, minFree, largest, largestMin, fragPct, blocks; };
+
+struct SimFarm {
+  SimFarmCfg cfg;
+  SimKernel k;
+  LoraChannel ch;
+  SimModemSerial modem;
+  HostFS fs;
+  SimController ctl;
+  std::vector<std::unique_ptr<SimNode>> nodes;     // lambdas hold node pointers: never moved
+  uint64_t endUs = 0;
+  // hydraulics
+  int valvesOpen = 0;
+  bool pump = false;
+  uint64_t deadSinceUs = 0, deadUs = 0, deadMaxUs = 0;
+  uint32_t deadEvents = 0;
+  std::vector<uint64_t> wetFromUs, wetUs;           // per node id; wetFromUs 0 = not watering
+  uint32_t wetSteps = 0, wetErrMaxMs = 0;
+  uint64_t wetErrSumMs = 0;
+  std::vector<SimHeapDay> heapDays;
+
+  static const int64_t EPOCH0 = 1780282800;        // 2026-06-01 03:00 UTC: first trigger two hours in
+
+  void begin(const SimFarmCfg &c) {
+    cfg = c;
+    SimRng rng(simMix(cfg.seed, 0xFA53));
+    ch.begin(k, cfg.seed);
+    modem.begin(k, cfg.seed, cfg.days, cfg.outagesPerDay, cfg.outageMinS, cfg.outageMaxS);
+    ch.attach(ctl.radio, 0, 0);
+    wetFromUs.assign(cfg.nodes + 1, 0); wetUs.assign(cfg.nodes + 1, 0);
+    ctl.gpio.onChange = [this](uint8_t pin, bool high) {
+      if (pin != SIM_PUMP_PIN) return;
+      pump = high;
+      for (auto &n : nodes) if (n->valve) watering(n->id, pump);
+      hydraulics();
+    };
+    ctl.stringHeap = cfg.stringHeap;
+    ctl.begin(k, modem, fs, 12, EPOCH0, cfg.blocking);
+    for (uint32_t d = 1; d <= (uint32_t)cfg.days; ++d)
+      k.at(d * 86400000000ULL, [this]() {
+        const SimHeap &h = ctl.heap;
+        heapDays.push_back(SimHeapDay{ h.freeBytes, h.minFree, (uint32_t)h.largest(), ctl.heapLargestMin, ctl.heapFragPct(), (uint32_t)h.blocks() });
+      });
+    for (uint16_t i = 1; i <= cfg.nodes; ++i) {
+      double r = cfg.radiusM * sqrt(rng.uniform()), a = rng.range(0, 6.283185307179586);
+      int32_t ppm = (int32_t)rng.range(-cfg.ppmMax, cfg.ppmMax);
+      nodes.emplace_back(new SimNode());
+      SimNode &n = *nodes.back();
+      ch.attach(n.radio, r * cos(a), r * sin(a));
+      n.onValve = [this](uint16_t id, bool open) {
+        valvesOpen += open ? 1 : -1;
+        if (open) { wetUs[id] = 0; watering(id, pump); } else { watering(id, false); closed(id); }
+        hydraulics();
+      };
+      n.begin(k, i, ppm, cfg.seed);
+    }
+    for (uint8_t s = 0; s < cfg.schedules && s < SIM_SCHED_MAX; ++s) {
+      SimSchedule sc; memset(&sc, 0, sizeof(sc));
+      snprintf(sc.id, sizeof(sc.id), "S%u", s + 1);
+      sc.startS = (5 + 12 * (uint32_t)s) % 24 * 3600; sc.cap = cfg.cap; sc.leadMs = cfg.leadMs; sc.tailMs = cfg.tailMs;
+      uint16_t order[ZR_MAX]; sc.n = cfg.nodes < ZR_MAX ? cfg.nodes : ZR_MAX;
+      for (uint16_t i = 0; i < sc.n; ++i) order[i] = i + 1;
+      for (uint16_t i = sc.n; i > 1; --i) { uint16_t j = (uint16_t)rng.below(i); uint16_t t = order[i - 1]; order[i - 1] = order[j]; order[j] = t; }
+      for (uint16_t i = 0; i < sc.n; ++i) {
+        ZoneStep &z = sc.steps[i];
+        z.node = order[i]; z.weight = 1; z.par = cfg.cap > 1 && i % cfg.cap != 0;
+        z.durMs = (uint32_t)rng.range(cfg.stepMinS, cfg.stepMaxS) * 1000;
+      }
+      ctl.addSchedule(sc);
+    }
+    endUs = (uint64_t)(cfg.days * 86400e6);
+  }
+  // Runs the configured days plus an hour for the event log to drain
+  void run() { k.runUntil(endUs + 3600000000ULL); }
+  void runUntil(uint64_t us) { k.runUntil(us); }
+
+  void watering(uint16_t id, bool on) {
+    if (on && !wetFromUs[id]) wetFromUs[id] = k.nowUs ? k.nowUs : 1;
+    if (!on && wetFromUs[id]) { wetUs[id] += k.nowUs - wetFromUs[id]; wetFromUs[id] = 0; }
+  }
+  // A valve of the running schedule closed: its watering time against the step
+  void closed(uint16_t id) {
+    if (ctl.cur < 0) return;
+    const SimSchedule &s = ctl.sched[ctl.cur];
+    for (uint16_t i = 0; i < s.n; ++i) {
+      if (s.steps[i].node != id) continue;
+      if (ctl.zones.n == s.n && ctl.zones.st[i] == ZS_FAILED) return;    // no ACK: the controller moved on
+      uint64_t want = (uint64_t)s.steps[i].durMs * 1000, got = wetUs[id];
+      uint32_t err = (uint32_t)((got > want ? got - want : want - got) / 1000);
+      wetSteps++; wetErrSumMs += err; if (err > wetErrMaxMs) wetErrMaxMs = err;
+      return;
+    }
+  }
+  void hydraulics() {
+    bool dead = pump && valvesOpen == 0;
+    if (dead && !deadSinceUs) { deadSinceUs = k.nowUs ? k.nowUs : 1; deadEvents++; }
+    if (!dead && deadSinceUs) { uint64_t d = k.nowUs - deadSinceUs; deadUs += d; if (d > deadMaxUs) deadMaxUs = d; deadSinceUs = 0; }
+  }
+
+  int report(char *out, size_t cap) {
+    const PerfStats &p = ctl.perf;
+    SimNodeStats ns = {};
+    for (auto &n : nodes) {
+      ns.cmds += n->st.cmds; ns.acks += n->st.acks; ns.stats += n->st.stats; ns.opens += n->st.opens;
+      ns.cmdCloses += n->st.cmdCloses; ns.autoCloses += n->st.autoCloses;
+    }
+    uint32_t txns = p.acked + p.failed;
+    int len = 0;
+#define SF_LINE(...) do { if (len >= 0 && (size_t)len < cap) len += snprintf(out + len, cap - len, __VA_ARGS__); } while (0)
+    SF_LINE("SIM|SEED=%llu,NODES=%u,DAYS=%g,CTRL=%s,RADIUS_M=%.0f,CAP=%u\n", (unsigned long long)cfg.seed, cfg.nodes, cfg.days,
+            cfg.blocking ? "blocking" : "txn", cfg.radiusM, cfg.cap);
+    SF_LINE("RUN|RUNS=%lu,DONE=%lu,STEPS=%lu,FAILED=%lu,STEP_AVG_MS=%lu,STEP_P95_MS=%lu,STEP_MAX_MS=%lu\n",
+            (unsigned long)ctl.runs, (unsigned long)ctl.runsDone, (unsigned long)p.steps, (unsigned long)ctl.stepsFailed,
+            (unsigned long)(p.steps ? p.stepLatSumMs / p.steps : 0), (unsigned long)ctl.latPercentileMs(95), (unsigned long)p.stepLatMaxMs);
+    SF_LINE("LORA|TXNS=%lu,ACK_PCT=%lu.%lu,TRIES=%lu,STALE=%lu,FRAMES=%lu,AIR_S=%lu,DOWN_LOST=%lu/%lu,UP_LOST=%lu/%lu,WEAK=%lu,COLL=%lu,HALF=%lu\n",
+            (unsigned long)txns, (unsigned long)(txns ? p.acked * 100UL / txns : 0), (unsigned long)(txns ? p.acked * 1000UL / txns % 10 : 0),
+            (unsigned long)p.attempts, (unsigned long)ctl.staleAcks, (unsigned long)ch.frames, (unsigned long)(ch.airUs / 1000000),
+            (unsigned long)(ch.down.frames - ch.down.delivered), (unsigned long)ch.down.frames, (unsigned long)(ch.up.frames - ch.up.delivered),
+            (unsigned long)ch.up.frames, (unsigned long)(ch.down.weak + ch.up.weak), (unsigned long)(ch.down.collided + ch.up.collided),
+            (unsigned long)(ch.down.half + ch.up.half));
+    SF_LINE("LOOP|PASSES=%lu,AVG_US=%lu,MAX_US=%lu,STALLS=%lu,HIST=%lu/%lu/%lu/%lu/%lu/%lu\n", (unsigned long)p.loops,
+            (unsigned long)(p.loops ? p.loopSumUs / p.loops : 0), (unsigned long)p.loopMaxUs, (unsigned long)p.stalls,
+            (unsigned long)p.loopHist[0], (unsigned long)p.loopHist[1], (unsigned long)p.loopHist[2], (unsigned long)p.loopHist[3],
+            (unsigned long)p.loopHist[4], (unsigned long)p.loopHist[5]);
+    SF_LINE("VALVE|OPENS=%lu,AUTO_CLOSE=%lu,CMD_CLOSE=%lu,ERR_AVG_MS=%lu,ERR_MAX_MS=%lu,PUMP_S=%lu,DEADHEAD=%lu,DEADHEAD_MS=%lu,DEADHEAD_MAX_MS=%lu\n",
+            (unsigned long)ns.opens, (unsigned long)ns.autoCloses, (unsigned long)ns.cmdCloses,
+            (unsigned long)(wetSteps ? wetErrSumMs / wetSteps : 0), (unsigned long)wetErrMaxMs,
+            (unsigned long)(ctl.gpio.onUs(SIM_PUMP_PIN) / 1000000), (unsigned long)deadEvents, (unsigned long)(deadUs / 1000), (unsigned long)(deadMaxUs / 1000));
+    SF_LINE("MQTT|STATUS=%lu,Q_DROPS=%lu,LAST_SEQ=%lu,DELIVERED=%lu,MISSING=%lu,DUPS=%lu,OUTAGES=%lu,CONNECTS=%lu,CONNECT_FAILS=%lu,AT_TIMEOUTS=%lu\n",
+            (unsigned long)ctl.statuses, (unsigned long)ctl.statusDrops, (unsigned long)ctl.evSeqAlloc.last, (unsigned long)modem.delivered,
+            (unsigned long)modem.missing(ctl.evSeqAlloc.last), (unsigned long)modem.duplicates, (unsigned long)modem.outages.size(),
+            (unsigned long)modem.connects, (unsigned long)modem.connectFails, (unsigned long)ctl.at.timeouts);
+    char ev[256]; ctl.evlog.statsText(ev, sizeof(ev));
+    SF_LINE("FLASH|NVS_WRITES=%lu,NVS_ERASES=%lu,NVS_SKIPPED=%lu,FS_PROGRAMMED=%llu,FS_ERASES=%llu,%s\n", (unsigned long)ctl.prefs.writes,
+            (unsigned long)ctl.prefs.erases, (unsigned long)ctl.prefs.skipped, (unsigned long long)fs.flash.programmed,
+            (unsigned long long)fs.flash.erases, ev);
+    SF_LINE("HEAP|PROFILE=%s,FREE=%lu,MIN=%lu,LARGEST=%lu,LARGEST_MIN=%lu,FRAG_PCT=%lu,BLOCKS=%lu,ALLOCS=%lu,MOVES=%lu,FAILS=%lu\n",
+            cfg.stringHeap ? "strings" : "fixed", (unsigned long)ctl.heap.freeBytes, (unsigned long)ctl.heap.minFree,
+            (unsigned long)ctl.heap.largest(), (unsigned long)ctl.heapLargestMin, (unsigned long)ctl.heapFragPct(),
+            (unsigned long)ctl.heap.blocks(), (unsigned long)ctl.heap.allocs, (unsigned long)ctl.heap.moves, (unsigned long)ctl.heap.fails);
+    SF_LINE("NODES|CMDS=%lu,ACKS=%lu,STATS=%lu\n", (unsigned long)ns.cmds, (unsigned long)ns.acks, (unsigned long)ns.stats);
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < len && (size_t)i < cap; ++i) { h ^= (uint8_t)out[i]; h *= 1099511628211ULL; }
+    SF_LINE("HASH|%016llx\n", (unsigned long long)h);
+#undef SF_LINE
+    return len;
+  }
+};
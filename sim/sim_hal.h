@@ -0,0 +1,92 @@
+#pragma once
+// Board stand-ins for the host simulator: Preferences (NVS) and GPIO.
+// Radio lives with the channel (lora_channel.h), ModemSerial with the EC200U model
+// (sim_modem.h), LittleFS is HostFS (test/host_fs.h), millis()/time() are SimClock.
+// - SimPreferences keeps typed keys in RAM. Like ESP32 NVS it skips a put that stores
+//   the value already there; real writes are counted and priced (entry write + commit,
+//   a page erase every SIM_NVS_PAGE_ENTRIES writes) so the caller can charge them to
+//   the loop pass that made them.
+// - SimGpio tracks pin levels with time spent high and edge counts (pump on-time) and
+//   reports changes to an observer (the farm's hydraulics).
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <functional>
+#include <map>
+#include <string>
+#include "sim_kernel.h"
+
+#ifndef SIM_NVS_WRITE_US
+#define SIM_NVS_WRITE_US 2500       // nvs_set + nvs_commit of one entry
+#endif
+#ifndef SIM_NVS_ERASE_US
+#define SIM_NVS_ERASE_US 30000      // 4 KB page erase when the active page fills
+#endif
+#ifndef SIM_NVS_PAGE_ENTRIES
+#define SIM_NVS_PAGE_ENTRIES 126
+#endif
+
+struct SimPreferences {
+  struct Val { bool isStr; int64_t i; std::string s; };
+  std::map<std::string, Val> kv;
+  uint32_t writes = 0, erases = 0, skipped = 0;
+  uint64_t costUs = 0;               // modeled flash time of all writes so far
+
+  bool begin(const char *, bool = false) { return true; }
+  void end() {}
+  bool isKey(const char *k) const { return kv.count(k) != 0; }
+  bool remove(const char *k) { if (!kv.erase(k)) return false; write(); return true; }
+
+  uint32_t getUInt(const char *k, uint32_t d = 0) const { auto it = kv.find(k); return it == kv.end() || it->second.isStr ? d : (uint32_t)it->second.i; }
+  int32_t getInt(const char *k, int32_t d = 0) const { auto it = kv.find(k); return it == kv.end() || it->second.isStr ? d : (int32_t)it->second.i; }
+  bool getBool(const char *k, bool d = false) const { return getUInt(k, d ? 1 : 0) != 0; }
+  size_t getString(const char *k, char *out, size_t cap) const {
+    auto it = kv.find(k);
+    if (it == kv.end() || !it->second.isStr || !cap) return 0;
+    size_t n = it->second.s.size() < cap - 1 ? it->second.s.size() : cap - 1;
+    memcpy(out, it->second.s.data(), n); out[n] = 0;
+    return n;
+  }
+  size_t putUInt(const char *k, uint32_t v) { return putNum(k, v) ? 4 : 0; }
+  size_t putInt(const char *k, int32_t v) { return putNum(k, v) ? 4 : 0; }
+  size_t putBool(const char *k, bool v) { return putNum(k, v ? 1 : 0) ? 1 : 0; }
+  size_t putString(const char *k, const char *v) {
+    Val &x = kv[k];
+    if (x.isStr && x.s == v) { skipped++; return strlen(v); }
+    x.isStr = true; x.s = v; write();
+    return strlen(v);
+  }
+
+  // ---- internals ----
+  bool putNum(const char *k, int64_t v) {
+    auto it = kv.find(k);
+    if (it != kv.end() && !it->second.isStr && it->second.i == v) { skipped++; return true; }
+    Val &x = kv[k]; x.isStr = false; x.i = v; x.s.clear(); write();
+    return true;
+  }
+  void write() { writes++; costUs += SIM_NVS_WRITE_US; if (writes % SIM_NVS_PAGE_ENTRIES == 0) { erases++; costUs += SIM_NVS_ERASE_US; } }
+};
+
+#ifndef SIM_GPIO_PINS
+#define SIM_GPIO_PINS 64
+#endif
+
+struct SimGpio {
+  const SimKernel *k = nullptr;
+  uint8_t level[SIM_GPIO_PINS] = {};
+  uint64_t sinceUs[SIM_GPIO_PINS] = {}, highUs[SIM_GPIO_PINS] = {};
+  uint32_t edges[SIM_GPIO_PINS] = {};
+  std::function<void(uint8_t pin, bool high)> onChange;
+
+  void pinMode(uint8_t, uint8_t) {}
+  int digitalRead(uint8_t pin) const { return pin < SIM_GPIO_PINS ? level[pin] : 0; }
+  void digitalWrite(uint8_t pin, uint8_t v) {
+    if (pin >= SIM_GPIO_PINS || (v != 0) == (level[pin] != 0)) return;
+    if (level[pin]) highUs[pin] += k->nowUs - sinceUs[pin];
+    level[pin] = v != 0; sinceUs[pin] = k->nowUs; edges[pin]++;
+    if (onChange) onChange(pin, level[pin] != 0);
+  }
+  // Time the pin has spent high, including the current stretch
+  uint64_t onUs(uint8_t pin) const { return pin < SIM_GPIO_PINS ? highUs[pin] + (level[pin] ? k->nowUs - sinceUs[pin] : 0) : 0; }
+};
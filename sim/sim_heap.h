@@ -0,0 +1,119 @@
+#pragma once
+// ESP32 heap model for the host simulator, for soak runs of the heap metrics.
+// SimHeap: one arena of `bytes`, blocks carved first-fit from an address-ordered free
+// list (SIM_HEAP_HDR header, 4-byte granules, nothing smaller than
+// SIM_HEAP_MIN_BLOCK), neighbours coalesced on free, realloc growing in place into a
+// free successor before it moves -- the shape of multi_heap's allocator, which is what
+// decides how the largest free block drifts. freeBytes / minFree / largest() answer
+// ESP.getFreeHeap(), getMinFreeHeap() and getMaxAllocHeap().
+// SimHeapStr: Arduino String's allocation pattern without its text. Up to SIM_STR_SSO
+// chars live inside the object; past that, assignment and concatenation reserve
+// exactly the new length (+1) and the buffer never shrinks.
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+
+#ifndef SIM_HEAP_BYTES
+#define SIM_HEAP_BYTES (160 * 1024)     // internal heap left once BLE and the drivers are up
+#endif
+#ifndef SIM_HEAP_HDR
+#define SIM_HEAP_HDR 8
+#endif
+#ifndef SIM_HEAP_MIN_BLOCK
+#define SIM_HEAP_MIN_BLOCK 16
+#endif
+#ifndef SIM_STR_SSO
+#define SIM_STR_SSO 11                  // arduino-esp32 String's inline buffer
+#endif
+
+struct SimHeap {
+  std::map<uint32_t, uint32_t> freeB, usedB;   // offset -> block size, header included
+  uint32_t size = 0, freeBytes = 0, minFree = 0;
+  uint32_t allocs = 0, frees = 0, moves = 0, fails = 0;
+
+  void begin(uint32_t bytes) {
+    freeB.clear(); usedB.clear();
+    size = freeBytes = minFree = bytes; allocs = frees = moves = fails = 0;
+    freeB[0] = bytes;
+  }
+  static uint32_t blockFor(uint32_t n) { uint32_t b = (n + 3) / 4 * 4 + SIM_HEAP_HDR; return b < SIM_HEAP_MIN_BLOCK ? SIM_HEAP_MIN_BLOCK : b; }
+
+  // Offset of an n-byte block, -1 when no free block is big enough
+  int32_t alloc(uint32_t n) {
+    uint32_t need = blockFor(n);
+    for (auto it = freeB.begin(); it != freeB.end(); ++it) {
+      if (it->second < need) continue;
+      uint32_t off = it->first, have = it->second;
+      freeB.erase(it);
+      if (have - need >= SIM_HEAP_MIN_BLOCK) freeB[off + need] = have - need; else need = have;
+      usedB[off] = need; take(need); allocs++;
+      return (int32_t)off;
+    }
+    fails++;
+    return -1;
+  }
+  void free(int32_t off) {
+    auto it = usedB.find((uint32_t)off);
+    if (off < 0 || it == usedB.end()) return;
+    uint32_t sz = it->second; usedB.erase(it);
+    freeBytes += sz; frees++;
+    release((uint32_t)off, sz);
+  }
+  // Resizes in place when the block or its free successor has room, else moves;
+  // -1 (the old block kept) when nothing fits
+  int32_t realloc(int32_t off, uint32_t n) {
+    if (off < 0) return alloc(n);
+    uint32_t need = blockFor(n), cur = usedB[(uint32_t)off], o = (uint32_t)off;
+    if (need <= cur) {
+      if (cur - need >= SIM_HEAP_MIN_BLOCK) { usedB[o] = need; freeBytes += cur - need; release(o + need, cur - need); }
+      return off;
+    }
+    auto nx = freeB.find(o + cur);
+    if (nx != freeB.end() && cur + nx->second >= need) {
+      uint32_t all = cur + nx->second; freeB.erase(nx);
+      if (all - need >= SIM_HEAP_MIN_BLOCK) freeB[o + need] = all - need; else need = all;
+      usedB[o] = need; take(need - cur);
+      return off;
+    }
+    int32_t to = alloc(n);
+    if (to < 0) return -1;
+    free(off); moves++;
+    return to;
+  }
+  uint32_t largest() const {
+    uint32_t m = 0; for (auto &b : freeB) if (b.second > m) m = b.second;
+    return m > SIM_HEAP_HDR ? m - SIM_HEAP_HDR : 0;
+  }
+  size_t blocks() const { return usedB.size(); }
+
+  // ---- internals ----
+  void take(uint32_t n) { freeBytes -= n; if (freeBytes < minFree) minFree = freeBytes; }
+  void release(uint32_t off, uint32_t sz) {
+    auto nx = freeB.find(off + sz);
+    if (nx != freeB.end()) { sz += nx->second; freeB.erase(nx); }
+    auto pv = freeB.lower_bound(off);
+    if (pv != freeB.begin()) { --pv; if (pv->first + pv->second == off) { pv->second += sz; return; } }
+    freeB[off] = sz;
+  }
+};
+
+struct SimHeapStr {
+  SimHeap *h = nullptr;
+  int32_t off = -1;
+  uint32_t cap = SIM_STR_SSO, len = 0;
+
+  SimHeapStr() = default;
+  explicit SimHeapStr(SimHeap &heap, uint32_t n = 0) : h(&heap) { assign(n); }
+  SimHeapStr(const SimHeapStr &) = delete;
+  SimHeapStr &operator=(const SimHeapStr &) = delete;
+  ~SimHeapStr() { if (off >= 0) h->free(off); }
+
+  void reserve(uint32_t n) {
+    if (n <= cap) return;
+    int32_t o = h->realloc(off, n + 1);
+    if (o >= 0) { off = o; cap = n; }
+  }
+  void assign(uint32_t n) { reserve(n); len = n; }         // s = x
+  void append(uint32_t n) { reserve(len + n); len += n; }  // s += x
+};
@@ -0,0 +1,70 @@
+#pragma once
+// Discrete-event kernel for the host simulator (test/test_sim).
+// Time is simulated microseconds since the start of the run. Events fire in (time,
+// order of scheduling) order, so a run with the same seed replays bit for bit.
+// SimRng is xorshift64* with its own uniform / normal draws -- <random>'s
+// distributions are not the same across standard libraries.
+// SimClock is one device's view of that time: a crystal off by `ppm` plus a boot
+// offset, so millis() / micros() / time() on the controller and on each node drift
+// apart the way they do in the field. Local delays are converted back with simUs().
+// Host only, header-only.
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+struct SimRng {
+  uint64_t s = 1;
+
+  explicit SimRng(uint64_t seed = 1) { reseed(seed); }
+  void reseed(uint64_t seed) { s = seed * 0x9E3779B97F4A7C15ULL ^ 0xD1B54A32D192ED03ULL; if (!s) s = 1; for (int i = 0; i < 4; ++i) next(); }
+  uint64_t next() { s ^= s >> 12; s ^= s << 25; s ^= s >> 27; return s * 0x2545F4914F6CDD1DULL; }
+  double uniform() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }       // [0, 1)
+  uint32_t below(uint32_t n) { return n ? (uint32_t)(uniform() * n) : 0; }
+  double range(double a, double b) { return a + (b - a) * uniform(); }
+  bool chance(double p) { return uniform() < p; }
+  double gauss(double sigma) {                                                             // Box-Muller, one value per call
+    double u = uniform(), v = uniform();
+    return sigma * sqrt(-2.0 * log(u > 1e-300 ? u : 1e-300)) * cos(6.283185307179586 * v);
+  }
+};
+
+// Seed for a sub-stream (per node, per link) that does not depend on draw order
+inline uint64_t simMix(uint64_t a, uint64_t b) {
+  uint64_t z = a * 0x9E3779B97F4A7C15ULL + b + 0x632BE59BD9B4E019ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL; z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+struct SimKernel {
+  struct Ev { uint64_t t, seq; std::function<void()> fn; };
+  struct Later { bool operator()(const Ev &a, const Ev &b) const { return a.t != b.t ? a.t > b.t : a.seq > b.seq; } };
+  std::priority_queue<Ev, std::vector<Ev>, Later> q;
+  uint64_t nowUs = 0, seq = 0, fired = 0;
+
+  void at(uint64_t t, std::function<void()> fn) { q.push(Ev{ t < nowUs ? nowUs : t, seq++, std::move(fn) }); }
+  void after(uint64_t dtUs, std::function<void()> fn) { at(nowUs + dtUs, std::move(fn)); }
+  bool step() {
+    if (q.empty()) return false;
+    Ev e = q.top(); q.pop();
+    nowUs = e.t; fired++; e.fn();
+    return true;
+  }
+  void runUntil(uint64_t t) { while (!q.empty() && q.top().t <= t) step(); if (t > nowUs) nowUs = t; }
+};
+
+struct SimClock {
+  const SimKernel *k = nullptr;
+  int32_t ppm = 0;             // + runs fast
+  uint64_t bootUs = 0;         // local micros() at simulated time 0
+  int64_t epochAtBootS = 0;    // time() at local micros() == 0
+
+  uint64_t localUs() const { uint64_t t = k->nowUs; return bootUs + t + (uint64_t)((int64_t)t * ppm / 1000000); }
+  uint32_t micros() const { return (uint32_t)localUs(); }
+  uint32_t millis() const { return (uint32_t)(localUs() / 1000); }
+  time_t time() const { return (time_t)(epochAtBootS + (int64_t)(localUs() / 1000000)); }
+  // Simulated duration of a local delay
+  uint64_t simUs(uint64_t localDelayUs) const { return (uint64_t)((int64_t)localDelayUs * 1000000 / (1000000 + ppm)); }
+};
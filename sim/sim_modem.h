@@ -0,0 +1,98 @@
+#pragma once
+// ModemSerial stand-in with an EC200U behind it, for the host simulator.
+// The host side looks like HardwareSerial (available / read / write); bytes the modem
+// sends arrive as one burst after its response delay and onData wakes the reader.
+// The modem answers the AT subset the controller uses:
+//   AT+QMTPUB=...     OK, then +QMTPUB: 0,0,0 once the broker has it (ERROR while the
+//                     MQTT session is down; no URC if the link drops in between)
+//   AT+QMTOPEN / AT+QMTCONN / AT+QMTSUB   session bring-up, failing during an outage
+//   AT+CREG? / AT+CPIN?, anything else    canned OK answers
+// Broker outages are drawn up front (`perDay` a day, minS..maxS long): at the start
+// the modem drops the session and raises +QMTSTAT: 0,1. Every published status body
+// ends in |SEQ=<n>; the model records which sequence numbers reached the broker.
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "sim_kernel.h"
+
+struct SimModemSerial {
+  struct Outage { uint64_t fromUs, toUs; };
+  SimKernel *k = nullptr;
+  SimRng rng;
+  std::deque<uint8_t> toHost;
+  std::function<void()> onData;
+  std::string line;                       // command being received
+  bool connected = false;                 // MQTT session
+  std::vector<Outage> outages;
+  std::vector<uint8_t> seen;              // per SEQ: times it reached the broker
+  uint32_t pubs = 0, pubErrors = 0, delivered = 0, duplicates = 0, connects = 0, connectFails = 0, dropped = 0;
+
+  void begin(SimKernel &kern, uint64_t seed, double days, double perDay, uint32_t minS, uint32_t maxS) {
+    k = &kern; rng.reseed(simMix(seed, 0x3CE200));
+    double t = 0, end = days * 86400e6;
+    for (;;) {
+      t += -log(1.0 - rng.uniform()) * 86400e6 / (perDay > 0 ? perDay : 1e-9);       // Poisson arrivals
+      if (t >= end) break;
+      uint64_t from = (uint64_t)t, to = from + (uint64_t)rng.range(minS, maxS) * 1000000ULL;
+      outages.push_back(Outage{ from, to });
+      k->at(from, [this]() { if (connected) { connected = false; dropped++; reply(0, "\r\n+QMTSTAT: 0,1\r\n"); } });
+      t = (double)to;
+    }
+  }
+  bool brokerUp() const { for (auto &o : outages) if (k->nowUs >= o.fromUs && k->nowUs < o.toUs) return false; return true; }
+
+  // ---- HardwareSerial side ----
+  int available() const { return (int)toHost.size(); }
+  int read() { if (toHost.empty()) return -1; uint8_t c = toHost.front(); toHost.pop_front(); return c; }
+  size_t write(const uint8_t *p, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      char c = (char)p[i];
+      if (c == '\n') continue;
+      if (c == '\r') { command(line); line.clear(); } else line += c;
+    }
+    return n;
+  }
+
+  // ---- modem side ----
+  void push(const char *s) { toHost.insert(toHost.end(), s, s + strlen(s)); if (onData) onData(); }
+  void reply(uint32_t delayMs, const char *text) { k->after((uint64_t)delayMs * 1000, [this, text]() { push(text); }); }   // text: a literal
+  void command(const std::string &c) {
+    uint32_t d = 20 + rng.below(30);
+    if (c.compare(0, 10, "AT+QMTPUB=") == 0) {
+      pubs++;
+      if (!connected) { pubErrors++; reply(d, "\r\nERROR\r\n"); return; }
+      size_t at = c.rfind("|SEQ="); uint32_t seq = at == std::string::npos ? 0 : (uint32_t)strtoul(c.c_str() + at + 5, nullptr, 10);
+      reply(d, "\r\nOK\r\n");
+      k->after((uint64_t)(d + 80 + rng.below(400)) * 1000, [this, seq]() {
+        if (!connected) return;                                   // lost with the link: the engine times out
+        if (seq >= seen.size()) seen.resize(seq + 1, 0);
+        if (seen[seq]++) duplicates++; else delivered++;
+        push("\r\n+QMTPUB: 0,0,0\r\n");
+      });
+    } else if (c.compare(0, 11, "AT+QMTOPEN=") == 0) {
+      reply(d, "\r\nOK\r\n");
+      reply(d + 300 + rng.below(700), brokerUp() ? "\r\n+QMTOPEN: 0,0\r\n" : "\r\n+QMTOPEN: 0,3\r\n");
+    } else if (c.compare(0, 11, "AT+QMTCONN=") == 0) {
+      reply(d, "\r\nOK\r\n");
+      bool ok = brokerUp();
+      k->after((uint64_t)(d + 200 + rng.below(500)) * 1000, [this, ok]() {
+        connected = ok && brokerUp();
+        if (connected) connects++; else connectFails++;
+        push(connected ? "\r\n+QMTCONN: 0,0,0\r\n" : "\r\n+QMTCONN: 0,1\r\n");
+      });
+    } else if (c.compare(0, 10, "AT+QMTSUB=") == 0) {
+      reply(d, connected ? "\r\nOK\r\n\r\n+QMTSUB: 0,1,0,1\r\n" : "\r\nERROR\r\n");
+    } else if (c == "AT+CREG?") reply(d, "\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+    else if (c == "AT+CPIN?") reply(d, "\r\n+CPIN: READY\r\n\r\nOK\r\n");
+    else reply(d, "\r\nOK\r\n");
+  }
+  // Sequence numbers 1..last that never reached the broker
+  uint32_t missing(uint32_t last) const { uint32_t m = 0; for (uint32_t s = 1; s <= last; ++s) if (s >= seen.size() || !seen[s]) m++; return m; }
+};
@@ -0,0 +1,144 @@
+#pragma once
+// Node_Controller2's radio behaviour for the host simulator, on the node's own
+// drifting clock: binary OPEN / CLOSE / STATUS with ACKs (a multicast is answered in
+// the node's slot, LORA_SLOT_GUARD_MS + rank * slotMs after it arrived), the valve's
+// auto-close timer with its AUTO_CLOSED report, and TeleDelta STAT traffic.
+// One valve per node. The node's loop() is not stepped: each reaction takes a
+// turnaround of SIM_NODE_TURN_MS..2x (RxDone -> loop -> Radio.Send), and frames queue
+// while the radio is on air.
+// The valve keeps the ground truth the controller cannot see: whether the node's timer
+// or a CLOSE ended it.
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "sim_kernel.h"
+#include "lora_channel.h"
+#include "lora_frame.h"
+#include "tele_delta.h"
+
+#ifndef SIM_NODE_TURN_MS
+#define SIM_NODE_TURN_MS 4
+#endif
+
+struct SimNodeStats {
+  uint32_t cmds, acks, stats, opens, cmdCloses, autoCloses;
+  uint64_t openUs;
+};
+
+struct SimNode {
+  uint16_t id = 0;
+  SimKernel *k = nullptr;
+  SimClock clk;
+  SimRadio radio;
+  SimRng rng;
+  TeleDelta tele;
+  std::deque<std::vector<uint8_t>> txq;
+  std::function<void(uint16_t node, bool open)> onValve;
+  bool valve = false;
+  uint32_t openUntilMs = 0;      // local millis(), 0 = no timer
+  uint64_t openedUs = 0;
+  uint32_t timerGen = 0;
+  uint16_t lastHash = 0;
+  int32_t lastIdx = -1;
+  int moist = 40;
+  uint64_t moistUs = 0;
+  SimNodeStats st = {};
+
+  void begin(SimKernel &kern, uint16_t nodeId, int32_t ppm, uint64_t seed) {
+    k = &kern; id = nodeId; rng.reseed(simMix(seed, nodeId));
+    clk.k = k; clk.ppm = ppm; clk.bootUs = rng.below(3600) * 1000000ULL;
+    moist = 30 + (int)rng.below(30);
+    radio.onRxDone = [this](const uint8_t *p, uint16_t n, int16_t, int8_t) { std::vector<uint8_t> d(p, p + n); later(turnMs(), [this, d]() { handle(d.data(), d.size()); }); };
+    radio.onTxDone = [this]() { pump(); };
+    later(rng.below(TD_BASE_MS), [this]() { telePoll(); });
+  }
+
+  // ---- Node_Controller2 ----
+  void handle(const uint8_t *buf, size_t n) {
+    LoraFrame f;
+    if (!loraIsBinary(buf, n) || !loraDecode(buf, n, f) || f.kind != LF_CMD) return;
+    uint32_t replyMs = 0;
+    if (f.node == LORA_NODE_GROUP) {
+      int rank = f.targets.nbytes ? f.targets.rank(id) : -1;
+      if (rank < 0) return;                                  // TIME beacon, or not addressed
+      replyMs = LORA_SLOT_GUARD_MS + (uint32_t)rank * f.slotMs;
+    } else if (f.node != id) return;
+    st.cmds++; lastHash = f.schedHash; lastIdx = f.idx;
+    switch (f.code) {
+      case LC_OPEN:
+        if (!valve) setValve(true);
+        armTimer(f.durMs);
+        break;
+      case LC_CLOSE:
+        if (valve) { st.cmdCloses++; setValve(false); }
+        armTimer(0);
+        break;
+      case LC_STATUS: break;
+      default: return;
+    }
+    LoraFrame a; loraFrameClear(a);
+    a.kind = LF_ACK; a.code = f.code; a.caps = LORA_CAP_BIN1;   // no PLAN: runs stay controller-timed
+    a.mid = f.mid; a.node = id; a.schedHash = f.schedHash; a.idx = f.idx;
+    a.hasTele = true; fillTelemetry(a.tele);
+    if (f.code != LC_STATUS) { a.hasMeta = true; a.teleFields = TF_VALVES | TF_MOIST; }
+    st.acks++;
+    if (replyMs) later(replyMs, [this, a]() { send(a); }); else send(a);
+  }
+  void armTimer(uint32_t durMs) {
+    timerGen++; openUntilMs = durMs ? clk.millis() + durMs : 0;
+    if (!durMs) return;
+    uint32_t gen = timerGen;
+    later(durMs, [this, gen]() {
+      if (gen != timerGen || !valve) return;
+      st.autoCloses++; setValve(false); openUntilMs = 0;
+      LoraFrame f; loraFrameClear(f);
+      f.kind = LF_AUTO_CLOSED; f.node = id; f.schedHash = lastHash; f.idx = lastIdx;
+      f.hasTele = true; fillTelemetry(f.tele); f.tele.valveOpen = 0;
+      f.hasMeta = true; f.teleFields = TF_VALVES | TF_MOIST;
+      send(f);
+    });
+  }
+  void setValve(bool on) {
+    soil();
+    if (on) { st.opens++; openedUs = k->nowUs; }
+    else st.openUs += k->nowUs - openedUs;
+    valve = on;
+    if (onValve) onValve(id, on);
+  }
+  // Soil gains a point every 2 min of watering, dries a point per 30 min
+  void soil() {
+    uint64_t dt = k->nowUs - moistUs, step = valve ? 120000000ULL : 1800000000ULL;
+    if (dt < step) return;
+    int d = (int)(dt / step); moist += valve ? d : -d; moistUs += (uint64_t)d * step;
+    moist = moist > 95 ? 95 : moist < 5 ? 5 : moist;
+  }
+  void fillTelemetry(LoraTelemetry &t) {
+    soil(); loraTelemetryClear(t);
+    t.valvePresent = 1; t.valveOpen = valve ? 1 : 0;
+    if (valve && openUntilMs) t.vtMs[0] = openUntilMs - clk.millis();
+    t.moistPresent = 1; t.moist[0] = (uint8_t)moist;
+    t.battPct = 80; t.bvMv = 3950; t.solvMv = 5200; t.soliMa = 40;
+  }
+  void telePoll() {
+    LoraTelemetry cur; fillTelemetry(cur);
+    LoraFrame f; loraFrameClear(f);
+    if (tele.poll(cur, clk.millis(), false, f)) { f.kind = LF_STAT; f.node = id; st.stats++; send(f); }
+    later(tele.intervalMs(cur), [this]() { telePoll(); });
+  }
+
+  // ---- radio ----
+  void send(const LoraFrame &frame) {
+    LoraFrame f = frame; f.wakeMs = 0;
+    uint8_t buf[256]; size_t n = loraEncode(f, buf, sizeof(buf));
+    if (!n) return;
+    txq.emplace_back(buf, buf + n);
+    pump();
+  }
+  void pump() { if (!radio.txBusy && !txq.empty()) { radio.Send(txq.front().data(), (uint8_t)txq.front().size()); txq.pop_front(); } }
+  uint32_t turnMs() { return SIM_NODE_TURN_MS + rng.below(SIM_NODE_TURN_MS + 1); }
+  void later(uint32_t localMs, std::function<void()> fn) { k->after(clk.simUs((uint64_t)localMs * 1000), std::move(fn)); }
+};
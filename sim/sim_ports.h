@@ -0,0 +1,117 @@
+#pragma once
+// The sketch functions the simulator ports (sim_controller.h, sim_node.h), each with a
+// fingerprint of the sketch's definition as it stood when the port was last brought
+// in line: FNV-1a over the parameter list and body, comments and whitespace outside
+// literals dropped. test_sim recomputes them from the .ino files and names every
+// function that moved -- port the change, then record the new fingerprint here.
+// Host only, header-only.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#define SIM_SKETCH_CTRL "Main_Controller3.0.ino"
+#define SIM_SKETCH_NODE "Node_Controller2.ino"
+
+struct SimPort { const char *sketch, *fn; uint32_t fp; };
+
+static const SimPort SIM_PORTS[] = {
+  // sim_controller.h
+  { SIM_SKETCH_CTRL, "loraTxnStart", 0x0B266399 },
+  { SIM_SKETCH_CTRL, "loraTxnTransmit", 0x2ED754E5 },
+  { SIM_SKETCH_CTRL, "loraTxnOnFrame", 0xB00D55E0 },
+  { SIM_SKETCH_CTRL, "loraTxnFinish", 0x35F60460 },
+  { SIM_SKETCH_CTRL, "loraTxnPoll", 0x1D69DAFC },
+  { SIM_SKETCH_CTRL, "loraMcastStart", 0xC22BA40B },
+  { SIM_SKETCH_CTRL, "loraMcastTransmit", 0xDA343E8F },
+  { SIM_SKETCH_CTRL, "loraMcastSlotMs", 0xF765C242 },
+  { SIM_SKETCH_CTRL, "loraMcastWindowOpen", 0xC758EA60 },
+  { SIM_SKETCH_CTRL, "loraMcastOnAck", 0x38077E66 },
+  { SIM_SKETCH_CTRL, "sendLoRaFrame", 0xC3605085 },
+  { SIM_SKETCH_CTRL, "radioDispatch", 0x3FD891E1 },
+  { SIM_SKETCH_CTRL, "runScheduleLoop", 0x1B953534 },
+  { SIM_SKETCH_CTRL, "onRunOpenDone", 0xB4F7A6FD },
+  { SIM_SKETCH_CTRL, "runFinish", 0x5B38C237 },
+  { SIM_SKETCH_CTRL, "setPump", 0x08A1D23E },
+  { SIM_SKETCH_CTRL, "saveProgressIndex", 0x9C94006D },
+  { SIM_SKETCH_CTRL, "schedTimerArm", 0x02789BBE },
+  { SIM_SKETCH_CTRL, "schedTimerPoll", 0x0DA5FC1B },
+  { SIM_SKETCH_CTRL, "heapPoll", 0x87273269 },
+  { SIM_SKETCH_CTRL, "publishStatusf", 0xC1377B16 },
+  { SIM_SKETCH_CTRL, "publishStatusSeq", 0x1C8A95F4 },
+  { SIM_SKETCH_CTRL, "outboxMqttWorker", 0x6019D64B },
+  { SIM_SKETCH_CTRL, "onStatusPublishDone", 0x8770AC72 },
+  { SIM_SKETCH_CTRL, "modemConfigureAndConnectMQTT", 0x4D5A3FD0 },
+  { SIM_SKETCH_CTRL, "onMqttConnDone", 0x8B2F65B4 },
+  { SIM_SKETCH_CTRL, "modemHealthPoll", 0xB50DFD76 },
+  // sim_node.h (handle / armTimer / telePoll / setValve; the auto-close is in loop())
+  { SIM_SKETCH_NODE, "decodeCmd", 0x2C03511D },
+  { SIM_SKETCH_NODE, "handleRadioPayload", 0x430B591D },
+  { SIM_SKETCH_NODE, "sendAck", 0x0F1333CA },
+  { SIM_SKETCH_NODE, "setValveState", 0xE6E6B0E0 },
+  { SIM_SKETCH_NODE, "fillTelemetry", 0x3FB3C3FF },
+  { SIM_SKETCH_NODE, "sendPeriodicTelemetry", 0x3876830E },
+  { SIM_SKETCH_NODE, "loop", 0x9226F4A8 },
+};
+
+// ---- internals ----
+inline bool simIdentChar(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'; }
+inline bool simSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+// Index of the closing quote of the literal opening at i
+inline size_t simLiteralEnd(const std::string &s, size_t i) {
+  size_t j = i + 1;
+  while (j < s.size() && s[j] != s[i]) j += s[j] == '\\' ? 2 : 1;
+  return j < s.size() ? j : s.size() - 1;
+}
+// Comments become one space; literals are kept
+inline std::string simStripComments(const std::string &s) {
+  std::string o; o.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s.compare(i, 2, "//") == 0) { while (i < s.size() && s[i] != '\n') i++; o += '\n'; continue; }
+    if (s.compare(i, 2, "/*") == 0) { size_t e = s.find("*/", i + 2); i = e == std::string::npos ? s.size() : e + 1; o += ' '; continue; }
+    if (s[i] == '"' || s[i] == '\'') { size_t e = simLiteralEnd(s, i); o.append(s, i, e + 1 - i); i = e; continue; }
+    o += s[i];
+  }
+  return o;
+}
+// Index of the bracket closing the one at i, npos if unbalanced
+inline size_t simMatch(const std::string &s, size_t i, char open, char close) {
+  int depth = 0;
+  for (size_t j = i; j < s.size(); ++j) {
+    if (s[j] == '"' || s[j] == '\'') { j = simLiteralEnd(s, j); continue; }
+    if (s[j] == open) depth++;
+    else if (s[j] == close && --depth == 0) return j;
+  }
+  return std::string::npos;
+}
+
+// Fingerprint of the first file-scope definition of `fn` in a sketch's source; false
+// when there is none (renamed, removed, or only declared)
+inline bool simSketchFingerprint(const std::string &src, const char *fn, uint32_t &fp) {
+  std::string s = simStripComments(src);
+  size_t fl = strlen(fn); int depth = 0;
+  for (size_t i = 0; i < s.size(); ++i) {
+    char c = s[i];
+    if (c == '"' || c == '\'') { i = simLiteralEnd(s, i); continue; }
+    if (c == '{') { depth++; continue; }
+    if (c == '}') { depth--; continue; }
+    if (depth || s.compare(i, fl, fn) != 0 || (i && simIdentChar(s[i - 1])) || simIdentChar(s[i + fl])) continue;
+    size_t p = i + fl; while (p < s.size() && simSpace(s[p])) p++;
+    if (p >= s.size() || s[p] != '(') continue;
+    size_t q = simMatch(s, p, '(', ')'); if (q == std::string::npos) continue;
+    for (q++; q < s.size() && simSpace(s[q]); q++) {}
+    if (s.compare(q, 5, "const") == 0) for (q += 5; q < s.size() && simSpace(s[q]); q++) {}
+    if (q >= s.size() || s[q] != '{') continue;                      // a prototype or a call
+    size_t e = simMatch(s, q, '{', '}'); if (e == std::string::npos) return false;
+    uint32_t h = 2166136261u;
+    for (size_t k = p; k <= e; ++k) {
+      size_t to = k;
+      if (s[k] == '"' || s[k] == '\'') to = simLiteralEnd(s, k);
+      else if (simSpace(s[k])) continue;
+      for (; k <= to; ++k) { h ^= (uint8_t)s[k]; h *= 16777619u; }
+      k = to;
+    }
+    fp = h; return true;
+  }
+  return false;
+}
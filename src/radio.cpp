@@ -1,21 +1,17 @@
 #include "radio.h"
 #include "LoRaWan_APP.h"
+#include "wire_proto.h"
+#include "radio_ring.h"
 
 static RadioEvents_t RadioEvents;
-volatile bool rxReceivedFlag = false;
-static char rxPayload[512];
-volatile int rxRssi = 0;
-volatile int rxSnr = 0;
+static RadioRing rxRing;             // filled by OnRxDone, drained from loop context
+static RadioRxCounters rxStats;
 
 void OnTxDone(void) { dbg("Radio: TX done"); }
 void OnTxTimeout(void) { dbg("Radio: TX timeout"); }
+// Copy only: no String, no logging in callback context
 void OnRxDone(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr) {
-  if (size >= (int)sizeof(rxPayload)) size = sizeof(rxPayload)-1;
-  memcpy(rxPayload, payload, size);
-  rxPayload[size] = 0;
-  rxRssi = rssi; rxSnr = snr;
-  rxReceivedFlag = true;
-  dbg(String("Radio: RxDone payload: ") + String(rxPayload) + " rssi:" + String(rssi));
+  rxRing.push(payload, size, rssi, snr, millis());
 }
 void OnRxTimeout(void) { dbg("Radio: Rx timeout"); }
 void OnRxError(void) { dbg("Radio: Rx error"); }
@@ -33,14 +29,6 @@ void radioInit() {
   dbg("Radio initialized");
 }
 
-static std::vector<String> splitPipe(const String &s) {
-  std::vector<String> parts;
-  int p = 0;
-  for (int i = 0; i < (int)s.length(); ++i) if (s[i] == '|') { parts.push_back(s.substring(p, i)); p = i + 1; }
-  parts.push_back(s.substring(p));
-  return parts;
-}
-
 void radioSend(const String &payload) { Radio.Send((uint8_t*)payload.c_str(), payload.length()); }
 void radioSendAck(const String &toPayload) {
   String ack = String("ACK|MAIN|") + toPayload + "|OK";
@@ -48,6 +36,18 @@ void radioSendAck(const String &toPayload) {
   Radio.Send((uint8_t*)ack.c_str(), ack.length());
 }
 
+static void handleLoRaPacket(const RadioPacket &pk);
+
+// ACK|MAIN|<node>|<cmd>|<seq>|OK
+static bool isAck(const RadioPacket &pk) { return pk.len >= 4 && memcmp(pk.data, "ACK|", 4) == 0; }
+static bool ackMatches(const RadioPacket &pk, uint32_t wantNode, uint32_t wantSeqIndex) {
+  WireSpan parts[6];
+  if (wireSplit(wireSpan((const char*)pk.data, pk.len), '|', parts, 6) != 6) return false;
+  int node = (int)parts[2].toLong();
+  int seqIdx = (int)parts[4].toLong();
+  return (uint32_t)node == wantNode && (uint32_t)seqIdx == wantSeqIndex && parts[5].trim().startsWith("OK");
+}
+
 bool radioSendAndWaitAck(const String &payload, uint32_t wantNode, uint32_t wantSeqIndex, uint32_t timeout_ms) {
   uint8_t tries = 0;
   while (tries < LORA_MAX_RETRIES) {
@@ -56,19 +56,18 @@ bool radioSendAndWaitAck(const String &payload, uint32_t wantNode, uint32_t want
     unsigned long start = millis();
     while (millis() - start < timeout_ms) {
       Radio.IrqProcess();
-      if (rxReceivedFlag) {
-        rxReceivedFlag = false;
-        String r = String(rxPayload);
-        dbg("Radio RX (waiting ack): " + r);
-        auto parts = splitPipe(r);
-        if (parts.size() >= 6 && parts[0] == "ACK") {
-          int node = parts[2].toInt();
-          int seqIdx = parts[4].toInt();
-          String status = parts[5];
-          if ((uint32_t)node == wantNode && (uint32_t)seqIdx == wantSeqIndex && status == "OK") {
-            dbg("ACK matched for node " + String(node) + " seq " + String(seqIdx));
-            return true;
-          }
+      // drain everything: inbound traffic received while waiting is handled, not lost
+      const RadioPacket *pk;
+      while ((pk = rxRing.peek()) != nullptr) {
+        if (isAck(*pk)) {
+          dbgf("Radio RX (waiting ack): %s", (const char*)pk->data);
+          bool ok = ackMatches(*pk, wantNode, wantSeqIndex);
+          if (ok) rxStats.acks++; else rxStats.staleAcks++;
+          rxRing.pop();
+          if (ok) { dbg("ACK matched for node " + String(wantNode) + " seq " + String(wantSeqIndex)); return true; }
+        } else {
+          handleLoRaPacket(*pk);
+          rxRing.pop();
         }
       }
       delay(10);
@@ -82,42 +81,53 @@ bool radioSendAndWaitAck(const String &payload, uint32_t wantNode, uint32_t want
 }
 
 void handleLoRaIncoming() {
-  if (!rxReceivedFlag) return;
-  rxReceivedFlag = false;
-  String msg = String(rxPayload);
-  dbg("Processing incoming LoRa msg: " + msg);
-  // split by '|'
-  std::vector<String> parts;
-  int p = 0;
-  for (int i = 0; i < (int)msg.length(); ++i) {
-    if (msg[i] == '|') { parts.push_back(msg.substring(p, i)); p = i+1; }
+  Radio.IrqProcess();
+  const RadioPacket *pk;
+  while ((pk = rxRing.peek()) != nullptr) {
+    if (isAck(*pk)) { rxStats.staleAcks++; dbgf("Stale LoRa ACK dropped: %s", (const char*)pk->data); }
+    else handleLoRaPacket(*pk);
+    rxRing.pop();
   }
-  parts.push_back(msg.substring(p));
-  if (parts.size() >= 2 && parts[0] == "CMD") {
-    String cmd = parts[1]; cmd.toUpperCase();
-    if (cmd == "SET" && parts.size() >= 4) {
-      String target = parts[2]; target.toUpperCase();
-      String val = parts[3]; val.toUpperCase();
-      if (target == "PUMP") {
-        if (val == "ON") { setPump(true); publishStatus("pump_remote_on"); }
-        else if (val == "OFF") { setPump(false); publishStatus("pump_remote_off"); }
-        radioSendAck(msg);
+}
+
+String radioStatsText() {
+  RadioRxCounters c = rxStats; rxRing.snapshot(c);
+  char buf[160]; radioCountersText(c, rxRing.depth(), buf, sizeof(buf));
+  return String(buf);
+}
+
+static void handleLoRaPacket(const RadioPacket &pk) {
+  rxStats.queued++;
+  const char *rxPayload = (const char*)pk.data;
+  dbgf("Processing incoming LoRa msg: %s (rssi %d snr %d)", rxPayload, pk.rssi, pk.snr);
+  WireSpan msg = wireSpan(rxPayload);
+  WireSpan parts[4];
+  uint8_t np = wireSplit(msg, '|', parts, 4);
+  if (np >= 2 && parts[0].eq("CMD")) {
+    WireSpan cmd = parts[1].trim();
+    if (cmd.ieq("SET") && np >= 4) {
+      WireSpan target = parts[2].trim();
+      WireSpan val = parts[3].trim();
+      if (target.ieq("PUMP")) {
+        if (val.ieq("ON")) { setPump(true); publishStatus("pump_remote_on"); }
+        else if (val.ieq("OFF")) { setPump(false); publishStatus("pump_remote_off"); }
+        radioSendAck(rxPayload);
         return;
       }
-    } else if (cmd == "MODE" && parts.size() >= 3) {
-      String m = parts[2]; m.toUpperCase(); if (m == "MANUAL") setModeManual(); else setModeAuto(); radioSendAck(msg); return;
-    } else if (cmd == "SCHEDULE" && parts.size() >= 3) {
-      String act = parts[2]; act.toUpperCase(); if (act == "STOP") { stopSchedule(); radioSendAck(msg); return; }
+    } else if (cmd.ieq("MODE") && np >= 3) {
+      if (parts[2].trim().ieq("MANUAL")) setModeManual(); else setModeAuto(); radioSendAck(rxPayload); return;
+    } else if (cmd.ieq("SCHEDULE") && np >= 3) {
+      if (parts[2].trim().ieq("STOP")) { stopSchedule(); radioSendAck(rxPayload); return; }
     }
-    dbg("Unknown CMD received: " + msg);
-    radioSendAck(msg);
+    dbgf("Unknown CMD received: %s", rxPayload);
+    radioSendAck(rxPayload);
     return;
   }
   if (msg.startsWith("TR|")) {
-    dbg("Telemetry request received: " + msg);
+    dbgf("Telemetry request received: %s", rxPayload);
     String resp = String("T|MAIN|{\"ts\":\"") + nowISO8601() + String("\",\"pump\":\"") + (pumpIsOn ? "ON" : "OFF") + String("\"}");
     Radio.Send((uint8_t*)resp.c_str(), resp.length());
     return;
   }
-  dbg("Unrecognized LoRa payload: " + msg);
+  dbgf("Unrecognized LoRa payload: %s", rxPayload);
 }
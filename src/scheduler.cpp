@@ -5,6 +5,8 @@
 #include "storage.h"
 #include <ctype.h>
 #include "config.h"
+#include "wire_proto.h"
+#include "timer_heap.h"
 
 extern bool pumpIsOn;
 
@@ -15,88 +17,87 @@ String normalizePhoneLocal(const String &in) {
   return s;
 }
 
+WireSpan srcSpan(const String &payload) {
+  WireSpan v;
+  if (!wireFindKey(wireSpan(payload.c_str(), payload.length()), "SRC", v)) return wireSpan("UNKNOWN");
+  return v;
+}
 String extractSrc(const String &payload) {
-  int p = payload.indexOf("SRC=");
-  if (p < 0) return String("UNKNOWN");
-  String s = payload.substring(p + 4);
-  int c = s.indexOf(',');
-  if (c >= 0) s = s.substring(0, c);
-  s.trim();
-  return s;
+  char buf[16]; srcSpan(payload).copyTo(buf, sizeof(buf));
+  return String(buf);
 }
 String extractKeyVal(const String &payload, const String &key) {
-  int p = payload.indexOf(key + "=");
-  if (p < 0) return String("");
-  String s = payload.substring(p + key.length() + 1);
-  int c = s.indexOf(',');
-  if (c >= 0) s = s.substring(0, c);
-  s.trim();
-  return s;
+  WireSpan v;
+  if (!wireFindKey(wireSpan(payload.c_str(), payload.length()), key.c_str(), v)) return String("");
+  char buf[96]; v.copyTo(buf, sizeof(buf));
+  return String(buf);
+}
+static bool keyEquals(const String &payload, const char *key, const String &expected) {
+  WireSpan v;
+  if (!wireFindKey(wireSpan(payload.c_str(), payload.length()), key, v)) return false;
+  return !v.empty() && v.eq(expected.c_str());
 }
 bool verifyTokenForSrc(const String &payload, const String &fromNumber = "") {
-  String src = extractSrc(payload);
-  if (src == "SMS") {
+  WireSpan src = srcSpan(payload);
+  if (src.eq("SMS")) {
     if (fromNumber.length()) {
       if (isAdminNumber(fromNumber)) return true;
-      String rec = extractKeyVal(payload, "RECOV");
-      if (rec.length() && rec == sysConfig.recoveryTok) { Serial.println("Recovery token accepted for SMS from " + fromNumber); return true; }
+      if (keyEquals(payload, "RECOV", sysConfig.recoveryTok)) { Serial.println("Recovery token accepted for SMS from " + fromNumber); return true; }
       return false;
     }
     return false;
   }
-  String tok = extractKeyVal(payload, "TOK");
-  if (tok.length() && tok == sysConfig.sharedTok) return true;
-  if (src == "BT") {
-    String t2 = extractKeyVal(payload, "TOK_BT"); if (t2.length() && t2 == prefs.getString("tok_bt","")) return true;
-  }
-  if (src == "LORA") {
-    String t2 = extractKeyVal(payload, "TOK_LORA"); if (t2.length() && t2 == prefs.getString("tok_lora","")) return true;
-  }
-  if (src == "MQTT") {
-    String t2 = extractKeyVal(payload, "TOK_MQ"); if (t2.length() && t2 == prefs.getString("tok_mq","")) return true;
-  }
+  if (keyEquals(payload, "TOK", sysConfig.sharedTok)) return true;
+  if (src.eq("BT") && keyEquals(payload, "TOK_BT", prefs.getString("tok_bt",""))) return true;
+  if (src.eq("LORA") && keyEquals(payload, "TOK_LORA", prefs.getString("tok_lora",""))) return true;
+  if (src.eq("MQTT") && keyEquals(payload, "TOK_MQ", prefs.getString("tok_mq",""))) return true;
   return false;
 }
 
+static int weekdayBit(WireSpan d) {
+  static const char *names[7] = {"SUN","MON","TUE","WED","THU","FRI","SAT"};
+  d = d.trim(); if (d.n != 3) return -1;
+  for (int w = 0; w < 7; ++w) {
+    bool m = true;
+    for (int i = 0; i < 3 && m; ++i) m = toupper((unsigned char)d.p[i]) == names[w][i];
+    if (m) return w;
+  }
+  return -1;
+}
+
 Schedule parseCompactSchedule(const String &payload) {
   Schedule s; s.id=""; s.rec='O'; s.start_epoch=0; s.timeStr=""; s.weekday_mask=0; s.seq.clear();
   s.pump_on_before_ms = PUMP_ON_LEAD_DEFAULT_MS; s.pump_off_after_ms = PUMP_OFF_DELAY_DEFAULT_MS; s.enabled=true; s.next_run_epoch=0; s.ts = 0;
-  int p = payload.indexOf("SCH|"); String body = (p>=0)? payload.substring(p+4): payload; body.trim();
-  int pos=0;
-  while (pos < (int)body.length()) {
-    int comma = body.indexOf(',', pos);
-    String token = (comma==-1) ? body.substring(pos) : body.substring(pos, comma);
-    token.trim();
-    int eq = token.indexOf('=');
-    if (eq>0) {
-      String k = token.substring(0, eq); String v = token.substring(eq+1);
-      k.trim(); v.trim();
-      if (k == "ID") s.id = v;
-      else if (k == "REC") s.rec = v.length()? v.charAt(0) : 'O';
-      else if (k == "T") s.timeStr = v;
-      else if (k == "SEQ") {
-        String seqs = v; int spos=0;
-        while (spos < (int)seqs.length()) {
-          int semi = seqs.indexOf(';', spos);
-          String pair = (semi==-1) ? seqs.substring(spos) : seqs.substring(spos, semi);
+  WireSpan body = wireSpan(payload.c_str(), payload.length());
+  int p = payload.indexOf("SCH|"); if (p >= 0) body = body.sub(p + 4);
+  char tmp[64]; bool inWd = false;
+  WireKvIter it(body); WireSpan k, v;
+  while (it.next(k, v)) {
+    if (k.empty()) { int b = inWd ? weekdayBit(v) : -1; if (b >= 0) s.weekday_mask |= (1<<b); continue; }
+    inWd = false;
+    if (k.eq("ID")) { v.copyTo(tmp, sizeof(tmp)); s.id = tmp; }
+    else if (k.eq("REC")) s.rec = v.n ? v.p[0] : 'O';
+    else if (k.eq("T")) { v.copyTo(tmp, sizeof(tmp)); s.timeStr = tmp; }
+    else if (k.eq("SEQ")) {
+      // ';' separates groups run one after another, '+' joins steps that run together: 1:60;2:60+3:60
+      WireSpan rest = v;
+      while (rest.n) {
+        int semi = rest.indexOf(';');
+        WireSpan grp = semi < 0 ? rest : rest.sub(0, semi);
+        bool first = true;
+        while (grp.n) {
+          int plus = grp.indexOf('+');
+          WireSpan pair = plus < 0 ? grp : grp.sub(0, plus);
           int colon = pair.indexOf(':');
-          if (colon>0) { SeqStep st; st.node_id = pair.substring(0, colon).toInt(); st.duration_ms = (uint32_t)pair.substring(colon+1).toInt() * 1000UL; s.seq.push_back(st); }
-          if (semi==-1) break; spos = semi+1;
-        }
-      } else if (k == "WD") {
-        String tmp = v; tmp.toUpperCase(); int sp=0;
-        while (sp < (int)tmp.length()) {
-          int cm = tmp.indexOf(',', sp);
-          String d = (cm==-1)? tmp.substring(sp) : tmp.substring(sp, cm); d.trim();
-          if (d=="MON") s.weekday_mask |= (1<<1); else if (d=="TUE") s.weekday_mask|=(1<<2); else if (d=="WED") s.weekday_mask|=(1<<3);
-          else if (d=="THU") s.weekday_mask|=(1<<4); else if (d=="FRI") s.weekday_mask|=(1<<5); else if (d=="SAT") s.weekday_mask|=(1<<6); else if (d=="SUN") s.weekday_mask|=(1<<0);
-          if (cm==-1) break; sp = cm+1;
+          if (colon > 0) { SeqStep st; st.node_id = (int)pair.sub(0, colon).toLong(); st.duration_ms = (uint32_t)pair.sub(colon+1).toLong() * 1000UL; st.par = !first; s.seq.push_back(st); first = false; }
+          if (plus < 0) break; grp = grp.sub(plus + 1);
         }
-      } else if (k == "PB") s.pump_on_before_ms = (uint32_t)v.toInt();
-      else if (k == "PA") s.pump_off_after_ms = (uint32_t)v.toInt();
-      else if (k == "TS") s.ts = (uint32_t)v.toInt();
-    }
-    if (comma==-1) break; pos = comma+1;
+        if (semi < 0) break; rest = rest.sub(semi + 1);
+      }
+    } else if (k.eq("WD")) { inWd = true; int b = weekdayBit(v); if (b >= 0) s.weekday_mask |= (1<<b); }
+    else if (k.eq("PB")) s.pump_on_before_ms = v.toU32();
+    else if (k.eq("PA")) s.pump_off_after_ms = v.toU32();
+    else if (k.eq("TS")) s.ts = v.toU32();
   }
   if (s.rec == 'O' && s.timeStr.length()) {
     int year=0,mon=0,mday=0,hour=0,min=0,sec=0;
@@ -132,14 +133,20 @@ bool validateAndLoadScheduleFromJson(const String &json) {
       else if (d=="THU") s.weekday_mask |= (1<<4); else if (d=="FRI") s.weekday_mask |= (1<<5); else if (d=="SAT") s.weekday_mask |= (1<<6); else if (d=="SUN") s.weekday_mask |= (1<<0);
     }
   }
-  JsonArray arr = scheduleDoc["sequence"].as<JsonArray>();
-  for (JsonVariant v : arr) {
+  // an element that is itself an array is a group of steps that run together
+  auto addStep = [&s](JsonVariant v, bool par) {
     SeqStep st; st.node_id = v["node_id"].as<int>(); if (v["duration_ms"]) st.duration_ms = v["duration_ms"].as<uint32_t>(); else if (v["duration_s"]) st.duration_ms = v["duration_s"].as<uint32_t>()*1000; else st.duration_ms = 0;
-    s.seq.push_back(st);
+    st.par = par; s.seq.push_back(st);
+  };
+  JsonArray arr = scheduleDoc["sequence"].as<JsonArray>();
+  for (JsonVariant g : arr) {
+    if (!g.is<JsonArray>()) { addStep(g, false); continue; }
+    bool first = true;
+    for (JsonVariant v : g.as<JsonArray>()) { addStep(v, !first); first = false; }
   }
-  if (!saveScheduleFile(s)) Serial.println("Warning: failed saving JSON schedule");
-  bool found=false; for (size_t i=0;i<schedules.size();++i) if (schedules[i].id == s.id) { schedules[i]=s; found=true; break; }
-  if (!found) schedules.push_back(s);
+  bool saved = saveScheduleRecord(s);
+  if (!saved) Serial.println("Warning: failed saving schedule to DB");
+  scheduleUpsert(s, saved);
   if (!scheduleLoaded) { seq.clear(); for (auto &st: s.seq) seq.push_back(st); currentScheduleId = s.id; pumpOnBeforeMs = s.pump_on_before_ms; pumpOffAfterMs = s.pump_off_after_ms; scheduleLoaded=true; currentStepIndex=-1; scheduleStartEpoch = s.start_epoch; }
   dbg("Loaded schedule id=" + currentScheduleId + " seq size=" + String(seq.size()));
   return true;
@@ -148,9 +155,9 @@ bool validateAndLoadScheduleFromJson(const String &json) {
 bool saveCompactScheduleToMultipleFilesAndLoad(const String &compact) {
   Schedule s = parseCompactSchedule(compact);
   if (s.id.length() == 0) { Serial.println("Missing ID"); return false; }
-  if (!saveScheduleFile(s)) Serial.println("Warning: failed saving schedule file");
-  bool found=false; for (size_t i=0;i<schedules.size();++i) if (schedules[i].id == s.id) { schedules[i] = s; found=true; break; }
-  if (!found) schedules.push_back(s);
+  bool saved = saveScheduleRecord(s);
+  if (!saved) Serial.println("Warning: failed saving schedule to DB");
+  scheduleUpsert(s, saved);
   if (!scheduleLoaded) { seq.clear(); for (auto &st: s.seq) seq.push_back(st); currentScheduleId = s.id; pumpOnBeforeMs = s.pump_on_before_ms; pumpOffAfterMs = s.pump_off_after_ms; scheduleLoaded=true; currentStepIndex=-1; scheduleStartEpoch = s.start_epoch; }
   Serial.printf("Compact schedule saved id=%s seq=%d\n", s.id.c_str(), (int)s.seq.size());
   return true;
@@ -188,6 +195,30 @@ time_t computeNextRunEpoch(const Schedule &s, time_t now) {
   return 0;
 }
 
+// ---------- Schedule timer index ----------
+// next_run_epoch per schedule slot; periodicTasks() only looks at the head.
+// Slots are stable: schedules are only appended or replaced in place.
+#define SCHED_JUMP_TOL_S   30      // wall clock vs millis() disagreement treated as a jump
+#define SCHED_CATCHUP_S    600     // forward jumps up to this fire the triggers they skipped
+static TimerHeap schedTimers;
+static ClockJumpDetector schedClock;
+
+static void scheduleTimerArm(size_t i, time_t from) {
+  Schedule &s = schedules[i];
+  s.next_run_epoch = computeNextRunEpoch(s, from);
+  if (!schedTimers.set((uint16_t)i, s.next_run_epoch > 0 ? (uint32_t)s.next_run_epoch : 0)) dbg("schedule not armed: " + s.id);
+}
+void scheduleTimersRebuild(time_t from) {
+  schedTimers.clear();
+  for (size_t i = 0; i < schedules.size(); ++i) scheduleTimerArm(i, from);
+}
+void scheduleUpsert(const Schedule &s, bool persisted) {
+  size_t i = 0; while (i < schedules.size() && schedules[i].id != s.id) ++i;
+  if (i == schedules.size()) schedules.push_back(s); else schedules[i] = s;
+  if (persisted) schedules[i].seq.clear();   // read back from the DB when it triggers
+  scheduleTimerArm(i, time(nullptr));
+}
+
 void processIncomingScheduleString(const String &payload) {
   String trimmed = payload; trimmed.trim(); if (trimmed.length()==0) return;
   String src = extractSrc(trimmed);
@@ -362,23 +393,27 @@ void runScheduleLoop() {
 
 void periodicTasks() {
   unsigned long nowMs = millis();
-  static unsigned long lastSchedulerCheck = 0;
-  if (nowMs - lastSchedulerCheck > 5000) {
-    time_t now = time(nullptr);
-    for (auto &sch : schedules) {
-      if (!sch.enabled) continue;
-      if (sch.next_run_epoch == 0) sch.next_run_epoch = computeNextRunEpoch(sch, now);
-      if (sch.next_run_epoch > 0 && now >= sch.next_run_epoch) {
-        currentScheduleId = sch.id; seq.clear(); for (auto &st: sch.seq) seq.push_back(st);
-        pumpOnBeforeMs = sch.pump_on_before_ms; pumpOffAfterMs = sch.pump_off_after_ms;
-        scheduleStartEpoch = sch.next_run_epoch; scheduleLoaded = true; currentStepIndex = -1;
-        publishStatusMsg(String("EVT|SCH|TRIGGER|S=") + sch.id);
-        if (sch.rec == 'O') sch.enabled = false;
-        sch.next_run_epoch = computeNextRunEpoch(sch, now + 1);
-        break;
-      }
+  time_t now = time(nullptr); int32_t jump;
+  if (schedClock.check((uint32_t)now, nowMs, SCHED_JUMP_TOL_S, jump)) {
+    dbg("Clock jump " + String(jump) + " s, re-arming schedule timers");
+    scheduleTimersRebuild(jump > 0 && jump <= SCHED_CATCHUP_S ? now - jump : now);
+  }
+  // Triggers are held while a run is in progress (seq is shared with the runner)
+  if (!scheduleRunning && !schedTimers.empty() && (uint32_t)now >= schedTimers.topDue()) {
+    size_t i = schedTimers.topKey(); Schedule &sch = schedules[i];
+    if (!scheduleSteps(sch, seq)) {
+      // the record stays as it is on flash: saving now would store it without its steps
+      publishStatusMsg(String("ERR|SCH|READ|S=") + sch.id);
+      if (sch.rec == 'O') sch.enabled = false;
+      scheduleTimerArm(i, now + 1);
+    } else {
+      currentScheduleId = sch.id;
+      pumpOnBeforeMs = sch.pump_on_before_ms; pumpOffAfterMs = sch.pump_off_after_ms;
+      scheduleStartEpoch = sch.next_run_epoch; scheduleLoaded = true; currentStepIndex = -1;
+      publishStatusMsg(String("EVT|SCH|TRIGGER|S=") + sch.id);
+      if (sch.rec == 'O') { sch.enabled = false; Schedule done = sch; done.seq = seq; saveScheduleRecord(done); }
+      scheduleTimerArm(i, now + 1);
     }
-    lastSchedulerCheck = nowMs;
   }
 
   checkRtcDriftAndSync();
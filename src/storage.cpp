@@ -1,7 +1,10 @@
 #include "storage.h"
 #include "config.h"
+#include "scheduler.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <algorithm>
+#include "sched_db.h"
 
 std::vector<Schedule> schedules;
 
@@ -20,18 +23,43 @@ String loadStringFile(const String &path) {
   String c = f.readString(); f.close(); return c;
 }
 
-bool saveScheduleFile(const Schedule &s) {
-  DynamicJsonDocument d(4096);
-  d["schedule_id"] = s.id; d["recurrence"] = (s.rec=='D'?"daily":(s.rec=='W'?"weekly":"onetime"));
-  d["start_time"] = s.timeStr; d["start_epoch"] = (long long)s.start_epoch;
-  d["pump_on_before_ms"] = s.pump_on_before_ms; d["pump_off_after_ms"] = s.pump_off_after_ms; d["ts"] = s.ts;
-  JsonArray arr = d.createNestedArray("sequence");
-  for (auto &st : s.seq) { JsonObject so = arr.createNestedObject(); so["node_id"]=st.node_id; so["duration_ms"]=st.duration_ms; }
-  String out; serializeJson(d, out);
-  String path = String("/schedules/") + s.id + String(".json");
-  return saveStringFile(path, out);
+// ---------- Schedule database (/sched.db) ----------
+// All schedules live in one binary file (include/sched_db.h); the index is loaded
+// at boot and step sequences are read back only when a schedule triggers.
+static SchedDb<fs::LittleFSFS> schedDb;
+
+static SdbRec scheduleToRec(const Schedule &s) {
+  SdbRec r; memset(&r, 0, sizeof(r));
+  snprintf(r.id, sizeof(r.id), "%s", s.id.c_str()); snprintf(r.timeStr, sizeof(r.timeStr), "%s", s.timeStr.c_str());
+  r.rec = s.rec; r.weekdayMask = s.weekday_mask; r.enabled = s.enabled ? 1 : 0; r.startEpoch = (int64_t)s.start_epoch;
+  r.pumpOnMs = s.pump_on_before_ms; r.pumpOffMs = s.pump_off_after_ms; r.ts = s.ts;
+  return r;
+}
+static Schedule scheduleFromRec(const SdbRec &r) {
+  Schedule s; s.id = String(r.id); s.rec = r.rec; s.start_epoch = (time_t)r.startEpoch; s.timeStr = String(r.timeStr);
+  s.weekday_mask = r.weekdayMask; s.pump_on_before_ms = r.pumpOnMs; s.pump_off_after_ms = r.pumpOffMs;
+  s.enabled = r.enabled != 0; s.next_run_epoch = 0; s.ts = r.ts;   // seq stays on flash (scheduleSteps)
+  return s;
+}
+bool saveScheduleRecord(const Schedule &s) {
+  if (s.id.length() >= SDB_ID_MAX || s.seq.size() > SDB_STEPS_MAX) { Serial.printf("Schedule %s too large for the DB\n", s.id.c_str()); return false; }
+  SdbStep steps[SDB_STEPS_MAX];
+  for (size_t i = 0; i < s.seq.size(); ++i) { steps[i].node = (uint16_t)s.seq[i].node_id; steps[i].flags = s.seq[i].par ? SDB_STEP_PAR : 0; steps[i].target = 0; steps[i].durMs = s.seq[i].duration_ms; }
+  return schedDb.put(scheduleToRec(s), steps, (uint16_t)s.seq.size());
+}
+bool deleteScheduleRecord(const String &id) { return schedDb.erase(id.c_str()); }
+// Sequence of a schedule: from RAM if it never made it to the DB, else read from flash
+bool scheduleSteps(const Schedule &s, std::vector<SeqStep> &out) {
+  out.clear();
+  if (!s.seq.empty()) { out = s.seq; return true; }
+  int i = schedDb.find(s.id.c_str()); if (i < 0) return false;
+  SdbStep steps[SDB_STEPS_MAX]; int n = schedDb.readSteps((uint16_t)i, steps, SDB_STEPS_MAX);
+  if (n < 0) return false;
+  for (int k = 0; k < n; ++k) { SeqStep st; st.node_id = steps[k].node; st.duration_ms = steps[k].durMs; st.par = steps[k].flags & SDB_STEP_PAR; out.push_back(st); }
+  return true;
 }
 
+// Legacy JSON files (/schedules/<ID>.json) are parsed by the one-time migration only
 Schedule scheduleFromJsonString(const String &json) {
   Schedule s; s.seq.clear(); s.id=""; s.rec='O'; s.start_epoch=0; s.timeStr=""; s.weekday_mask=0;
   s.pump_on_before_ms=PUMP_ON_LEAD_DEFAULT_MS; s.pump_off_after_ms=PUMP_OFF_DELAY_DEFAULT_MS; s.enabled=true; s.next_run_epoch=0; s.ts = 0;
@@ -53,19 +81,42 @@ Schedule scheduleFromJsonString(const String &json) {
   return s;
 }
 
-void loadAllSchedulesFromFS() {
-  schedules.clear();
-  if (!LittleFS.exists("/schedules")) {
-    LittleFS.mkdir("/schedules");
-    return;
-  }
+// One-time migration: /schedules/*.json -> /sched.db, migrated JSON files removed afterwards
+static bool migrateSource(void *ctx, uint16_t i, SdbRec &rec, SdbStep *steps) {
+  const Schedule &s = (*(std::vector<Schedule> *)ctx)[i];
+  rec = scheduleToRec(s); rec.stepCount = (uint16_t)s.seq.size();
+  SdbStep buf[SDB_STEPS_MAX]; SdbStep *st = steps ? steps : buf;
+  for (size_t k = 0; k < s.seq.size(); ++k) { st[k].node = (uint16_t)s.seq[k].node_id; st[k].flags = 0; st[k].target = 0; st[k].durMs = s.seq[k].duration_ms; }
+  rec.stepsCrc = sdbCrc32(st, rec.stepCount * sizeof(SdbStep));
+  return true;
+}
+static void migrateJsonSchedules() {
+  if (!LittleFS.exists("/schedules")) return;
+  std::vector<Schedule> found; std::vector<String> paths;
   File root = LittleFS.open("/schedules");
   File file = root.openNextFile();
   while (file) {
     String name = file.name(); if (name.endsWith(".json")) {
       String content = file.readString(); Schedule s = scheduleFromJsonString(content);
-      if (s.id.length()) schedules.push_back(s);
+      if (s.id.length() && s.id.length() < SDB_ID_MAX && s.seq.size() <= SDB_STEPS_MAX && found.size() < SDB_MAX) { found.push_back(s); paths.push_back(String(file.path())); }
+      else Serial.println("Migration: kept " + name + " (does not fit the DB)");
     }
     file = root.openNextFile();
   }
+  root.close();
+  if (found.empty()) return;
+  std::sort(found.begin(), found.end(), [](const Schedule &a, const Schedule &b) { return strcmp(a.id.c_str(), b.id.c_str()) < 0; });
+  size_t w = 0; for (size_t i = 0; i < found.size(); ++i) if (!w || found[i].id != found[w - 1].id) found[w++] = found[i];   // ids must be unique
+  found.resize(w);
+  bool ok = schedDb.rewrite((uint16_t)found.size(), migrateSource, &found);
+  Serial.printf("Migration: %u JSON schedules -> %s %s\n", (unsigned)found.size(), SDB_PATH, ok ? "OK" : "FAILED");
+  if (ok) for (auto &p : paths) LittleFS.remove(p);
+}
+void loadAllSchedulesFromFS() {
+  unsigned long t0 = millis();
+  schedules.clear();
+  if (!schedDb.begin(LittleFS)) migrateJsonSchedules();
+  for (uint16_t i = 0; i < schedDb.count; ++i) schedules.push_back(scheduleFromRec(schedDb.idx[i]));
+  scheduleTimersRebuild(time(nullptr));
+  Serial.printf("Schedules: %u loaded in %lu ms\n", (unsigned)schedules.size(), millis() - t0);
 }
@@ -1,4 +1,5 @@
 #include "utils.h"
+#include <stdarg.h>
 
 Preferences prefs;
 RTC_DS3231 rtc;
@@ -21,6 +22,11 @@ uint32_t DRIFT_THRESHOLD_S = 300;
 uint32_t SYNC_CHECK_INTERVAL_MS = 3600UL * 1000UL;
 
 void dbg(const String &s) { Serial.println(s); }
+void dbgf(const char *fmt, ...) {
+  char buf[192]; va_list ap;
+  va_start(ap, fmt); vsnprintf(buf, sizeof(buf), fmt, ap); va_end(ap);
+  Serial.println(buf);
+}
 String nowISO8601() {
   struct tm timeinfo; time_t t = time(nullptr); gmtime_r(&t, &timeinfo);
   char buf[32]; strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
@@ -0,0 +1,66 @@
+#pragma once
+// Shared helpers for the host tests (pio test -e native): heap call counting and
+// timers for the per-message benchmarks. Include from exactly one file per test
+// program: it replaces the global operator new / delete.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+static uint64_t hbAllocs = 0, hbFrees = 0, hbBytes = 0;
+static int64_t hbLive = 0, hbLivePeak = 0;
+
+// Live bytes through the allocator's own block size (glibc); counts only elsewhere.
+// noinline: inlined, GCC pairs the malloc / free inside with new / delete and warns.
+static size_t hbBlock(void *p) {
+#if defined(__GLIBC__)
+  return malloc_usable_size(p);
+#else
+  (void)p; return 0;
+#endif
+}
+__attribute__((noinline)) void *operator new(size_t n) {
+  void *p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  hbAllocs++; hbBytes += n; hbLive += (int64_t)hbBlock(p); if (hbLive > hbLivePeak) hbLivePeak = hbLive;
+  return p;
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  if (!p) return;
+  hbFrees++; hbLive -= (int64_t)hbBlock(p); free(p);
+}
+void operator delete(void *q, size_t) noexcept { operator delete(q); }
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete[](void *q) noexcept { operator delete(q); }
+void operator delete[](void *q, size_t) noexcept { operator delete(q); }
+
+inline uint64_t hbNowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+// TSC cycles on x86-64, 0 elsewhere (reports then show ns only)
+inline uint64_t hbCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Runs fn() iters times; per-call heap calls, ns and cycles
+struct HbResult { double allocs, ns, cycles; };
+template <class F>
+HbResult hbMeasure(uint32_t iters, F fn) {
+  for (uint32_t i = 0; i < iters / 10 + 1; ++i) fn();            // warm-up
+  uint64_t a0 = hbAllocs, t0 = hbNowNs(), c0 = hbCycles();
+  for (uint32_t i = 0; i < iters; ++i) fn();
+  uint64_t c1 = hbCycles(), t1 = hbNowNs(), a1 = hbAllocs;
+  HbResult r = { (double)(a1 - a0) / iters, (double)(t1 - t0) / iters, (double)(c1 - c0) / iters };
+  return r;
+}
+inline void hbReport(const char *name, const HbResult &r) {
+  printf("BENCH %-28s allocs/msg=%6.2f  ns/msg=%8.1f  cycles/msg=%8.0f\n", name, r.allocs, r.ns, r.cycles);
+}
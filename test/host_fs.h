@@ -0,0 +1,87 @@
+#pragma once
+// File-backed LittleFS stand-in for the host tests: paths map into a fresh temp
+// directory, files are stdio FILEs. It also counts what the flash would see, on a
+// littlefs-like model (LFS_BLOCK-byte erase blocks):
+// - appending to a file whose last block is partly used copies that block's bytes
+//   into a newly erased one first (littlefs CTZ lists never program a block twice);
+// - every close after a write, rename and remove commits LFS_META bytes of metadata.
+// programmed / logical bytes is the write amplification the tests report.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef LFS_BLOCK
+#define LFS_BLOCK 4096
+#endif
+#ifndef LFS_META
+#define LFS_META 64
+#endif
+
+struct HostFlash { uint64_t programmed = 0, erases = 0, metaCommits = 0, opens = 0, logical = 0, readBytes = 0; };
+
+struct HostFile {
+  struct St { FILE *f = nullptr; HostFlash *fl = nullptr; bool wrote = false; uint32_t appendAt = 0; bool appending = false; };
+  std::shared_ptr<St> s;
+
+  explicit operator bool() const { return s && s->f; }
+  size_t write(const uint8_t *b, size_t n) {
+    if (!*this || !n) return 0;
+    long at = ftell(s->f);
+    size_t w = fwrite(b, 1, n, s->f);
+    HostFlash &fl = *s->fl;
+    uint32_t used = (uint32_t)at % LFS_BLOCK, b0 = (uint32_t)at / LFS_BLOCK, b1 = ((uint32_t)at + (uint32_t)w - 1) / LFS_BLOCK;
+    if (!used) fl.erases++;                                              // starts a fresh block
+    else if (!s->wrote) { fl.programmed += used; fl.erases++; }          // first write this session into a partial block: copy it
+    fl.erases += b1 - b0;
+    fl.programmed += w; fl.logical += w; s->wrote = true;
+    return w;
+  }
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t read(uint8_t *b, size_t n) { size_t r = *this ? fread(b, 1, n, s->f) : 0; if (r) s->fl->readBytes += r; return r; }
+  int read() { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+  bool seek(uint32_t pos) { return *this && fseek(s->f, (long)pos, SEEK_SET) == 0; }
+  size_t position() const { return *this ? (size_t)ftell(s->f) : 0; }
+  size_t size() const {
+    if (!*this) return 0;
+    fflush(s->f); struct stat st; return fstat(fileno(s->f), &st) == 0 ? (size_t)st.st_size : 0;
+  }
+  void close() {
+    if (!*this) return;
+    fclose(s->f); s->f = nullptr;
+    if (s->wrote) { s->fl->programmed += LFS_META; s->fl->metaCommits++; }
+  }
+};
+
+struct HostFS {
+  std::string root;
+  HostFlash flash;
+
+  HostFS() {
+    char t[] = "/tmp/hostfsXXXXXX";
+    root = mkdtemp(t) ? t : "/tmp";
+  }
+  ~HostFS() { std::string cmd = "rm -rf '" + root + "'"; if (system(cmd.c_str())) {} }
+  std::string full(const char *p) const { return root + (p[0] == '/' ? "" : "/") + p; }
+
+  // "r", "w", "a" as in LittleFS
+  HostFile open(const char *path, const char *mode) {
+    HostFile f; f.s = std::make_shared<HostFile::St>();
+    const char *m = mode[0] == 'w' ? "w+b" : mode[0] == 'a' ? "a+b" : "rb";
+    f.s->f = fopen(full(path).c_str(), m); f.s->fl = &flash;
+    if (f.s->f && mode[0] == 'a') fseek(f.s->f, 0, SEEK_END);
+    flash.opens++;
+    return f;
+  }
+  bool exists(const char *path) const { struct stat st; return stat(full(path).c_str(), &st) == 0; }
+  bool remove(const char *path) { flash.programmed += LFS_META; flash.metaCommits++; return ::remove(full(path).c_str()) == 0; }
+  bool rename(const char *a, const char *b) { flash.programmed += LFS_META; flash.metaCommits++; return ::rename(full(a).c_str(), full(b).c_str()) == 0; }
+  bool mkdir(const char *path) { return ::mkdir(full(path).c_str(), 0755) == 0; }
+  // test helpers
+  long fileSize(const char *path) const { struct stat st; return stat(full(path).c_str(), &st) == 0 ? (long)st.st_size : -1; }
+  bool truncateTo(const char *path, long n) { return ::truncate(full(path).c_str(), n) == 0; }
+};
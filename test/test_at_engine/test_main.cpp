@@ -0,0 +1,217 @@
+// at_engine.h replayed against EC200U transcripts.
+// Transcript lines: "> text" = what the engine must write next (CR/LF implied for
+// commands), "< text" = modem output (CR/LF appended, unless the line ends in '\'),
+// "@ms" = clock advances to ms. Each step is followed by a poll().
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "at_engine.h"
+
+static std::string written;                 // everything the engine wrote, not yet matched
+static std::vector<std::string> log_;       // callbacks and URCs in the order they ran
+static uint32_t nowMs = 0;
+
+static void writer(const char *p, size_t n) { written.append(p, n); }
+static void onDone(void *ctx, AtResult r, const char *resp, uint16_t len) {
+  log_.push_back(std::string((const char *)ctx) + ":" + atResultName(r) + ":" + std::string(resp, len));
+}
+static void onUrc(WireSpan l) { log_.push_back("URC:" + std::string(l.p, l.n)); }
+
+static AtEngine eng;
+
+static void reset() {
+  eng = AtEngine(); eng.begin(writer);
+  eng.onUrc("+QMTRECV:", onUrc); eng.onUrc("+CMTI:", onUrc); eng.onUrc("+QMTSTAT:", onUrc);
+  written.clear(); log_.clear(); nowMs = 0;
+}
+
+// Replays a transcript; returns the first mismatch ("" when it all matched)
+static std::string replay(const char *t) {
+  std::string s(t);
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t e = s.find('\n', pos); if (e == std::string::npos) e = s.size();
+    std::string line = s.substr(pos, e - pos); pos = e + 1;
+    while (!line.empty() && line[0] == ' ') line.erase(0, 1);
+    if (line.empty()) continue;
+    if (line[0] == '@') nowMs = (uint32_t)atol(line.c_str() + 1);
+    else if (line[0] == '<') {
+      std::string out = line.size() > 2 ? line.substr(2) : "";
+      if (!out.empty() && out.back() == '\\') out.pop_back(); else out += "\r\n";
+      eng.feed((const uint8_t *)out.data(), out.size());
+    } else if (line[0] == '>') {
+      eng.poll(nowMs);
+      std::string want = line.substr(2);
+      size_t at = written.find(want);
+      if (at != 0) return "expected write \"" + want + "\", engine wrote \"" + written + "\"";
+      written.erase(0, want.size());
+      if (written.compare(0, 2, "\r\n") == 0) written.erase(0, 2);
+    }
+    eng.poll(nowMs);
+  }
+  return "";
+}
+
+void setUp() { reset(); }
+void tearDown() {}
+
+void test_boot_init_with_echo() {
+  eng.submit("AT+CMGF=1", 1000, onDone, (void *)"CMGF");
+  eng.submit("AT+CREG?", 2000, onDone, (void *)"CREG");
+  eng.submit("AT+CPIN?", 2000, onDone, (void *)"CPIN");
+  std::string r = replay(R"(
+    > AT+CMGF=1
+    < AT+CMGF=1
+    @40
+    < OK
+    > AT+CREG?
+    < AT+CREG?
+    <
+    < +CREG: 0,1
+    <
+    < OK
+    > AT+CPIN?
+    @90
+    < +CPIN: READY
+    < OK
+  )");
+  TEST_ASSERT_TRUE_MESSAGE(r.empty(), r.c_str());
+  TEST_ASSERT_EQUAL(3, (int)log_.size());
+  TEST_ASSERT_EQUAL_STRING("CMGF:OK:OK", log_[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("CREG:OK:+CREG: 0,1\nOK", log_[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("CPIN:OK:+CPIN: READY\nOK", log_[2].c_str());
+  TEST_ASSERT_TRUE(eng.idle());
+}
+
+void test_mqtt_bringup_with_interleaved_urcs() {
+  eng.submit("AT+QMTOPEN=0,\"broker.example\",1883", 10000, onDone, (void *)"OPEN", "+QMTOPEN:");
+  eng.submit("AT+QMTCONN=0,\"ctrl01\"", 10000, onDone, (void *)"CONN", "+QMTCONN:");
+  eng.submit("AT+QMTSUB=0,1,\"irrigation/site01/schedule\",1", 5000, onDone, (void *)"SUB", "+QMTSUB:");
+  std::string r = replay(R"(
+    > AT+QMTOPEN=0,"broker.example",1883
+    < OK
+    @350
+    < +CMTI: "SM",3
+    @900
+    < +QMTOPEN: 0,0
+    > AT+QMTCONN=0,"ctrl01"
+    < OK
+    @1500
+    < +QMTCONN: 0,0,0
+    > AT+QMTSUB=0,1,"irrigation/site01/schedule",1
+    < OK
+    < +QMTRECV: 0,1,"irrigation/site01/schedule","SCH|ID=A,REC=D,T=06:00,SEQ=1:60"
+    < +QMTSUB: 0,1,0,1
+  )");
+  TEST_ASSERT_TRUE_MESSAGE(r.empty(), r.c_str());
+  TEST_ASSERT_EQUAL(5, (int)log_.size());
+  TEST_ASSERT_EQUAL_STRING("URC:+CMTI: \"SM\",3", log_[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("OPEN:OK:OK\n+QMTOPEN: 0,0", log_[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("CONN:OK:OK\n+QMTCONN: 0,0,0", log_[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("URC:+QMTRECV: 0,1,\"irrigation/site01/schedule\",\"SCH|ID=A,REC=D,T=06:00,SEQ=1:60\"", log_[3].c_str());
+  TEST_ASSERT_EQUAL_STRING("SUB:OK:OK\n+QMTSUB: 0,1,0,1", log_[4].c_str());
+}
+
+void test_sms_prompt_and_body() {
+  eng.submit("AT+CMGS=\"+919876543210\"", 30000, onDone, (void *)"CMGS", nullptr, "EVT|PUMP|ON");
+  std::string r = replay(R"(
+    > AT+CMGS="+919876543210"
+    < AT+CMGS="+919876543210"
+    @120
+    < > \
+    > EVT|PUMP|ON)" "\x1A" R"(
+    @2400
+    < +CMGS: 17
+    <
+    < OK
+  )");
+  TEST_ASSERT_TRUE_MESSAGE(r.empty(), r.c_str());
+  TEST_ASSERT_EQUAL(1, (int)log_.size());
+  TEST_ASSERT_EQUAL_STRING("CMGS:OK:+CMGS: 17\nOK", log_[0].c_str());
+}
+
+void test_pubex_payload_verbatim() {
+  static const char snap[] = "{\"seq\":41,\"v\":1,\"mode\":\"S\"}";
+  eng.submitData("AT+QMTPUBEX=0,0,0,1,\"irrigation/site01/state\",27", (const uint8_t *)snap, 27, 15000, onDone, (void *)"PUBEX", "+QMTPUB:");
+  std::string r = replay(R"(
+    > AT+QMTPUBEX=0,0,0,1,"irrigation/site01/state",27
+    < >\
+    > {"seq":41,"v":1,"mode":"S"}
+    < OK
+    < +QMTPUB: 0,0,0
+  )");
+  TEST_ASSERT_TRUE_MESSAGE(r.empty(), r.c_str());
+  TEST_ASSERT_EQUAL_STRING("PUBEX:OK:OK\n+QMTPUB: 0,0,0", log_[0].c_str());
+}
+
+void test_errors_and_timeout() {
+  eng.submit("AT+QIACT=1", 10000, onDone, (void *)"QIACT");
+  eng.submit("AT+CMGR=9", 3000, onDone, (void *)"CMGR");
+  eng.submit("AT+QNTP=1,\"pool.ntp.org\"", 15000, onDone, (void *)"QNTP", "+QNTP:");
+  eng.submit("AT", 2000, onDone, (void *)"AT");
+  std::string r = replay(R"(
+    > AT+QIACT=1
+    < ERROR
+    > AT+CMGR=9
+    @30
+    < +CMS ERROR: 321
+    > AT+QNTP=1,"pool.ntp.org"
+    @40
+    < OK
+    @14000
+    < +QMTSTAT: 0,1
+    @15039
+    @15040
+    > AT
+    < OK
+  )");
+  TEST_ASSERT_TRUE_MESSAGE(r.empty(), r.c_str());
+  TEST_ASSERT_EQUAL(5, (int)log_.size());
+  TEST_ASSERT_EQUAL_STRING("QIACT:ERROR:ERROR", log_[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("CMGR:ERROR:+CMS ERROR: 321", log_[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("URC:+QMTSTAT: 0,1", log_[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("QNTP:TIMEOUT:OK", log_[3].c_str());   // OK seen, awaited URC never came
+  TEST_ASSERT_EQUAL_STRING("AT:OK:OK", log_[4].c_str());
+  TEST_ASSERT_EQUAL_UINT32(2, eng.errors);
+  TEST_ASSERT_EQUAL_UINT32(1, eng.timeouts);
+}
+
+// Long URCs fed in odd-sized chunks so lines wrap the ring
+void test_ring_wrap_long_lines() {
+  std::string all;
+  std::vector<std::string> sent;
+  for (int i = 0; i < 40; ++i) {
+    std::string body(150 + i * 7, 'a' + i % 26);
+    sent.push_back("+QMTRECV: 0," + std::to_string(i) + ",\"irrigation/site01/config\",\"" + body + "\"");
+    all += sent.back() + "\r\n";
+  }
+  for (size_t at = 0; at < all.size(); at += 97) {
+    size_t n = all.size() - at < 97 ? all.size() - at : 97;
+    eng.feed((const uint8_t *)all.data() + at, n);
+    eng.poll(nowMs);
+  }
+  TEST_ASSERT_EQUAL(40, (int)log_.size());
+  for (int i = 0; i < 40; ++i) TEST_ASSERT_EQUAL_STRING(("URC:" + sent[i]).c_str(), log_[i].c_str());
+  TEST_ASSERT_EQUAL_UINT32(0, eng.rx.overflows);
+}
+
+void test_queue_sum_bounds_wait() {
+  eng.submit("AT+QIACT=1", 10000);
+  eng.submit("AT+CSQ", 300);
+  TEST_ASSERT_EQUAL_UINT32(10300, eng.queuedMs());
+  eng.poll(0);
+  eng.poll(10000);                      // first times out, second starts
+  TEST_ASSERT_EQUAL_UINT32(300, eng.queuedMs());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_init_with_echo);
+  RUN_TEST(test_mqtt_bringup_with_interleaved_urcs);
+  RUN_TEST(test_sms_prompt_and_body);
+  RUN_TEST(test_pubex_payload_verbatim);
+  RUN_TEST(test_errors_and_timeout);
+  RUN_TEST(test_ring_wrap_long_lines);
+  RUN_TEST(test_queue_sum_bounds_wait);
+  return UNITY_END();
+}
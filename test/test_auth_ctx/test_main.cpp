@@ -0,0 +1,139 @@
+// auth_ctx.h: SHA-256 / HMAC-SHA256 against the FIPS 180 and RFC 4231 vectors, and
+// the signed-command rules -- one acceptance per SIG, the ATS window with and without
+// a trusted clock, the floor left by SIGs pushed out of the replay ring, nothing but
+// SRC / _FROM after SIG, and SRC / _FROM taken from the transport's own copy.
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "auth_ctx.h"
+
+static std::string hex(const uint8_t *d, size_t n) {
+  std::string s; char b[3];
+  for (size_t i = 0; i < n; ++i) { snprintf(b, sizeof(b), "%02x", d[i]); s += b; }
+  return s;
+}
+static std::string sha(const void *p, size_t n, size_t chunk) {
+  Sha256 s; s.init();
+  for (size_t o = 0; o < n; o += chunk) s.update((const uint8_t *)p + o, n - o < chunk ? n - o : chunk);
+  uint8_t d[32]; s.final(d);
+  return hex(d, 32);
+}
+static std::string hmac(const std::string &key, const std::string &msg) {
+  AuthKey k; k.load(key.c_str());
+  uint8_t d[32]; k.mac(msg.data(), msg.size(), d);
+  return hex(d, 32);
+}
+
+// Signed "<body>,ATS=<ts>,NONCE=<nonce>,SIG=..,SRC=LORA" as the LoRa transport hands it over
+static std::string signedMsg(const AuthCtx &c, const char *body, uint32_t ts, const char *nonce) {
+  char text[128], out[160];
+  snprintf(text, sizeof(text), "%s,ATS=%lu,NONCE=%s", body, (unsigned long)ts, nonce);
+  if (c.sign(AUTH_LORA, text, out, sizeof(out)) <= 0) return std::string();   // no key: the check fails on it
+  return std::string(out) + ",SRC=LORA";
+}
+static AuthResult check(AuthCtx &c, const std::string &msg, uint32_t nowS) {
+  AuthMsg m; return c.check(msg.c_str(), msg.size(), nowS, m);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_sha256_vectors() {
+  TEST_ASSERT_EQUAL_STRING("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", sha("", 0, 1).c_str());
+  TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", sha("abc", 3, 3).c_str());
+  static const char m896[] = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+  for (size_t chunk : { (size_t)1, (size_t)55, (size_t)64, (size_t)112 })     // every split of the 112 bytes hashes the same
+    TEST_ASSERT_EQUAL_STRING("cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1", sha(m896, 112, chunk).c_str());
+  std::string million(1000000, 'a');
+  TEST_ASSERT_EQUAL_STRING("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", sha(million.data(), million.size(), 997).c_str());
+}
+
+static void test_hmac_rfc4231() {
+  std::string k25; for (int i = 1; i <= 25; ++i) k25 += (char)i;
+  TEST_ASSERT_EQUAL_STRING("b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7", hmac(std::string(20, '\x0b'), "Hi There").c_str());
+  TEST_ASSERT_EQUAL_STRING("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", hmac("Jefe", "what do ya want for nothing?").c_str());
+  TEST_ASSERT_EQUAL_STRING("773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe", hmac(std::string(20, '\xaa'), std::string(50, '\xdd')).c_str());
+  TEST_ASSERT_EQUAL_STRING("82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b", hmac(k25, std::string(50, '\xcd')).c_str());
+  // 131-byte key: longer than the block, hashed first
+  TEST_ASSERT_EQUAL_STRING("60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54",
+                           hmac(std::string(131, '\xaa'), "Test Using Larger Than Block-Size Key - Hash Key First").c_str());
+  TEST_ASSERT_EQUAL_STRING("9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2",
+                           hmac(std::string(131, '\xaa'), "This is a test using a larger than block-size key and a larger than block-size data. "
+                                                          "The key needs to be hashed before being used by the HMAC algorithm.").c_str());
+}
+
+static void test_sig_then_replay() {
+  AuthCtx c; c.key[AUTH_SHARED].load("s3cret");
+  std::string m = signedMsg(c, "CFG|PUMP_CAP=2", 1000000, "a1");
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, m, 1000000));
+  TEST_ASSERT_EQUAL(AUTH_REPLAY, check(c, m, 1000010));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, signedMsg(c, "CFG|PUMP_CAP=2", 1000000, "a2"), 1000010));   // new nonce, new SIG
+  std::string bad = m; bad[bad.find("SIG=") + 4] ^= 1;
+  TEST_ASSERT_EQUAL(AUTH_BAD_SIG, check(c, bad, 1000000));
+  c.key[AUTH_LORA].load("lora-own");                                  // a source key replaces the shared one
+  TEST_ASSERT_EQUAL(AUTH_BAD_SIG, check(c, m, 1000000));
+  TEST_ASSERT_EQUAL(2, (int)c.seenN);
+}
+
+static void test_stale_window() {
+  const uint32_t now = 2000000;
+  AuthCtx c; c.key[AUTH_SHARED].load("s3cret");
+  TEST_ASSERT_EQUAL(AUTH_STALE, check(c, signedMsg(c, "CFG|X=1", now - AUTH_WINDOW_S - 1, "t1"), now));
+  TEST_ASSERT_EQUAL(AUTH_STALE, check(c, signedMsg(c, "CFG|X=1", now + AUTH_WINDOW_S + 1, "t2"), now));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, signedMsg(c, "CFG|X=1", now - AUTH_WINDOW_S, "t3"), now));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, signedMsg(c, "CFG|X=1", now + AUTH_WINDOW_S, "t4"), now));
+
+  // No trusted clock: any first ATS, then the window trails the newest one accepted
+  AuthCtx u; u.key[AUTH_SHARED].load("s3cret");
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(u, signedMsg(u, "CFG|X=1", 5000, "u1"), 0));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(u, signedMsg(u, "CFG|X=1", 9000, "u2"), 0));
+  TEST_ASSERT_EQUAL(AUTH_STALE, check(u, signedMsg(u, "CFG|X=1", 9000 - AUTH_WINDOW_S - 1, "u3"), 0));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(u, signedMsg(u, "CFG|X=1", 9000 - AUTH_WINDOW_S, "u4"), 0));
+  TEST_ASSERT_EQUAL(9000u, u.newestTs);
+}
+
+static void test_floor_after_eviction() {
+  const uint32_t now = 3000000;
+  AuthCtx c; c.key[AUTH_SHARED].load("s3cret");
+  std::string first = signedMsg(c, "CFG|X=1", now - 100, "f0");
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, first, now));
+  char nonce[8];
+  for (int i = 1; i <= AUTH_SEEN_MAX; ++i) {                           // pushes `first` out of the ring
+    snprintf(nonce, sizeof(nonce), "f%d", i);
+    TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, signedMsg(c, "CFG|X=1", now - 100 + i, nonce), now));
+  }
+  TEST_ASSERT_EQUAL(now - 100, c.floorTs);
+  TEST_ASSERT_EQUAL(AUTH_STALE, check(c, first, now));                 // forgotten SIG, still in the window: refused
+  TEST_ASSERT_EQUAL(AUTH_STALE, check(c, signedMsg(c, "CFG|X=1", now - 100, "new"), now));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, signedMsg(c, "CFG|X=1", now - 99, "new"), now));
+}
+
+static void test_tail_and_spoofing() {
+  AuthCtx c; c.key[AUTH_SHARED].load("s3cret"); c.setAdmins("+919999999999");
+  std::string m = signedMsg(c, "CFG|PUMP_CAP=2", 1000000, "s1");
+  std::string tail = m; tail.insert(tail.rfind(",SRC="), ",PUMP_CAP=9");   // appended after SIG
+  TEST_ASSERT_EQUAL(AUTH_BAD_SIG, check(c, tail, 1000000));
+  TEST_ASSERT_EQUAL(AUTH_OK_SIG, check(c, m + ",_FROM=+911111111111", 1000000));   // SRC / _FROM may follow
+
+  // The transport's SRC is the last one: a sender's own SRC=SMS and _FROM=<admin> do not make an admin SMS
+  std::string spoof = "CFG|AP=+911234567890,SRC=SMS,_FROM=+919999999999,SRC=LORA";
+  AuthMsg am; TEST_ASSERT_EQUAL(AUTH_NONE, c.check(spoof.c_str(), spoof.size(), 1000000, am));
+  TEST_ASSERT_EQUAL(AUTH_LORA, am.s);
+  spoof = "CFG|AP=+911234567890,_FROM=+919999999999,SRC=SMS,_FROM=+911111111111";
+  TEST_ASSERT_EQUAL(AUTH_NONE, check(c, spoof, 1000000));             // SMS, but the modem's _FROM is not an admin
+  TEST_ASSERT_EQUAL(AUTH_OK_ADMIN, check(c, "CFG|AP=+911234567890,SRC=SMS,_FROM=09999999999", 1000000));
+  TEST_ASSERT_FALSE(authMayChangeKeys(AUTH_OK_TOK));
+  TEST_ASSERT_TRUE(authMayChangeKeys(AUTH_OK_SIG));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sha256_vectors);
+  RUN_TEST(test_hmac_rfc4231);
+  RUN_TEST(test_sig_then_replay);
+  RUN_TEST(test_stale_window);
+  RUN_TEST(test_floor_after_eviction);
+  RUN_TEST(test_tail_and_spoofing);
+  return UNITY_END();
+}
@@ -0,0 +1,124 @@
+// event_log.h on the file-backed LittleFS stand-in: order and sequence numbers across
+// a reboot, torn tails, bounded flash when the outage outlasts it, and the numbers the
+// batching is for: flash bytes programmed per logical byte (batched vs. one append per
+// event, the pre-log behaviour) and replay throughput / file opens per record.
+#include <unity.h>
+#include <stdio.h>
+#include "host_fs.h"
+#include "host_bench.h"
+#include "event_log.h"
+
+#define EVLOG_REPLAY_BATCH 4   // as in the sketch's MQTT worker
+
+static void event(uint32_t seq, char *out, size_t cap) {
+  snprintf(out, cap, "EVT|STEP|S=SC%03u|I=%u|N=%u|OPEN|T=%lu", (unsigned)(seq % 40), (unsigned)(seq % 7), (unsigned)(seq % 30 + 1), (unsigned long)(seq * 1000UL));
+}
+static void fill(EventLog<HostFS> &log, uint32_t first, uint32_t n, bool flushEach, uint32_t &nowMs) {
+  char t[96];
+  for (uint32_t s = first; s < first + n; ++s) { event(s, t, sizeof(t)); log.append(t, s, nowMs); if (flushEach) log.flush(); nowMs += 2000; log.tick(nowMs); }
+}
+// Replays everything, EVLOG_REPLAY_BATCH in flight, commit per batch; returns records seen
+static uint32_t drain(EventLog<HostFS> &log, uint32_t &firstSeq, uint32_t &lastSeq, bool &inOrder) {
+  char t[EVLOG_REC_MAX + 1]; uint32_t seq, token = 0, n = 0; inOrder = true;
+  for (;;) {
+    uint8_t k = 0;
+    while (k < EVLOG_REPLAY_BATCH && log.next(t, sizeof(t), seq, token)) {
+      char want[96]; event(seq, want, sizeof(want));
+      if (strcmp(t, want) != 0 || (n && seq != lastSeq + 1)) inOrder = false;
+      if (!n) firstSeq = seq;
+      lastSeq = seq; n++; k++;
+    }
+    if (!k) return n;
+    log.commit(token);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_replay_survives_reboot() {
+  HostFS fs; uint32_t now = 0;
+  { EventLog<HostFS> log; log.begin(fs); fill(log, 1, 500, false, now); log.flush(); }
+  EventLog<HostFS> log; TEST_ASSERT_TRUE(log.begin(fs));          // reboot
+  TEST_ASSERT_GREATER_THAN(1, log.segmentsUsed());
+  uint32_t a = 0, b = 0; bool ordered;
+  TEST_ASSERT_EQUAL(500, drain(log, a, b, ordered));
+  TEST_ASSERT_TRUE(ordered); TEST_ASSERT_EQUAL(1, a); TEST_ASSERT_EQUAL(500, b);
+  TEST_ASSERT_TRUE(log.idle()); TEST_ASSERT_EQUAL(0, log.segmentsUsed());
+}
+
+static void test_rewind_redelivers() {
+  HostFS fs; uint32_t now = 0; EventLog<HostFS> log; log.begin(fs);
+  fill(log, 1, 20, false, now);
+  char t[EVLOG_REC_MAX + 1]; uint32_t seq, token;
+  for (int i = 0; i < 5; ++i) TEST_ASSERT_TRUE(log.next(t, sizeof(t), seq, token));
+  log.commit(token);
+  TEST_ASSERT_TRUE(log.next(t, sizeof(t), seq, token)); TEST_ASSERT_EQUAL(6, seq);
+  log.rewind();                                                       // publish failed
+  TEST_ASSERT_TRUE(log.next(t, sizeof(t), seq, token)); TEST_ASSERT_EQUAL(6, seq);
+  TEST_ASSERT_EQUAL(1, log.st.rewinds);
+}
+
+static void test_torn_tail_skipped() {
+  HostFS fs; uint32_t now = 0;
+  { EventLog<HostFS> log; log.begin(fs); fill(log, 1, 10, false, now); log.flush(); }
+  char p[32]; EventLog<HostFS>::path(0, p, sizeof(p));
+  TEST_ASSERT_TRUE(fs.truncateTo(p, fs.fileSize(p) - 3));           // power cut mid-append
+  EventLog<HostFS> log; log.begin(fs);
+  uint32_t a = 0, b = 0; bool ordered;
+  TEST_ASSERT_EQUAL(9, drain(log, a, b, ordered));
+  TEST_ASSERT_TRUE(ordered); TEST_ASSERT_EQUAL(9, b); TEST_ASSERT_EQUAL(1, log.st.corrupt);
+}
+
+static void test_bounded_when_full() {
+  HostFS fs; uint32_t now = 0; EventLog<HostFS> log; log.begin(fs);
+  fill(log, 1, 20000, false, now); log.flush();                      // ~1.2 MB of events into 128 KB
+  long disk = 0; char p[32];
+  for (uint8_t s = 0; s < EVLOG_SEGMENTS; ++s) { EventLog<HostFS>::path(s, p, sizeof(p)); long n = fs.fileSize(p); if (n > 0) disk += n; }
+  TEST_ASSERT_LESS_OR_EQUAL(EVLOG_SEGMENTS * EVLOG_SEG_BYTES, disk);
+  TEST_ASSERT_GREATER_THAN(0, log.st.droppedSegments);
+  uint32_t a = 0, b = 0; bool ordered;
+  uint32_t n = drain(log, a, b, ordered);
+  TEST_ASSERT_TRUE(ordered); TEST_ASSERT_EQUAL(20000, b); TEST_ASSERT_EQUAL(b - a + 1, n);   // newest, contiguous
+}
+
+// Outage of N events, then reconnect and replay. Write amplification = bytes the
+// flash model programs / record bytes appended.
+struct Outage { double wa, erasesPerK, recPerSec, opensPerRec; uint32_t flushes, replayed; bool ordered; };
+static Outage outage(uint32_t n, bool flushEach) {
+  HostFS fs; uint32_t now = 0; EventLog<HostFS> log; log.begin(fs);
+  fill(log, 1, n, flushEach, now); log.flush();
+  Outage o;
+  o.wa = (double)fs.flash.programmed / log.st.appendBytes;
+  o.erasesPerK = fs.flash.erases * 1000.0 / n;
+  o.flushes = log.st.flushes;
+  uint64_t opens0 = fs.flash.opens, t0 = hbNowNs();
+  uint32_t a = 0, b = 0; bool ordered;
+  uint32_t got = drain(log, a, b, ordered);
+  uint64_t t1 = hbNowNs();
+  o.replayed = got; o.ordered = ordered;
+  o.recPerSec = got * 1e9 / (double)(t1 - t0);
+  o.opensPerRec = (double)(fs.flash.opens - opens0) / got;
+  return o;
+}
+
+static void test_bench() {
+  const uint32_t N = 1500;                                            // ~90 KB, fits without drops
+  Outage batched = outage(N, false), each = outage(N, true);
+  printf("BENCH evlog %u events  batched:  flushes=%5u  WA=%5.2f  erases/1k=%6.1f  replay=%8.0f rec/s  opens/rec=%.2f\n",
+         (unsigned)N, (unsigned)batched.flushes, batched.wa, batched.erasesPerK, batched.recPerSec, batched.opensPerRec);
+  printf("BENCH evlog %u events  per-event: flushes=%5u  WA=%5.2f  erases/1k=%6.1f  replay=%8.0f rec/s  opens/rec=%.2f\n",
+         (unsigned)N, (unsigned)each.flushes, each.wa, each.erasesPerK, each.recPerSec, each.opensPerRec);
+  TEST_ASSERT_TRUE(batched.ordered && each.ordered); TEST_ASSERT_EQUAL(N, batched.replayed); TEST_ASSERT_EQUAL(N, each.replayed);
+  TEST_ASSERT_LESS_THAN(each.wa / 5, batched.wa);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_survives_reboot);
+  RUN_TEST(test_rewind_redelivers);
+  RUN_TEST(test_torn_tail_skipped);
+  RUN_TEST(test_bounded_when_full);
+  RUN_TEST(test_bench);
+  return UNITY_END();
+}
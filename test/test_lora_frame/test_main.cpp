@@ -0,0 +1,207 @@
+// lora_frame.h: encode -> decode of every frame kind with the TLVs each one carries
+// (TARGETS, PLAN, EPOCH, TELE_META included), frames refused on CRC or version, unknown
+// TLVs skipped, truncated TLVs refused, and the ASCII telemetry block read back by
+// loraTelemetryParse as loraTelemetryText / loraFrameToText wrote it.
+#include <unity.h>
+#include <string.h>
+#include "lora_frame.h"
+
+static LoraTelemetry fullTele() {
+  LoraTelemetry t; loraTelemetryClear(t);
+  t.valvePresent = 0x03; t.valveOpen = 0x02; t.vtMs[1] = 45000;
+  t.moistPresent = 0x05; t.moist[0] = 40; t.moist[2] = 73;
+  t.battPct = 81; t.bvMv = 3950; t.solvMv = 5100; t.soliMa = 12; t.awakePm = 24;
+  return t;
+}
+// encode -> decode, and the decoded frame encodes to the same bytes
+static bool roundTrip(const LoraFrame &f, LoraFrame &out) {
+  uint8_t a[LORA_FRAME_MAX], b[LORA_FRAME_MAX];
+  size_t n = loraEncode(f, a, sizeof(a));
+  if (!n || !loraDecode(a, n, out)) return false;
+  return loraEncode(out, b, sizeof(b)) == n && memcmp(a, b, n) == 0;
+}
+static void resign(uint8_t *buf, size_t n) {
+  uint16_t c = loraCrc16(buf, n - 2); buf[n - 2] = (uint8_t)c; buf[n - 1] = (uint8_t)(c >> 8);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_cmd_round_trip() {
+  LoraFrame f, d; loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_OPEN; f.mid = 300; f.node = 17; f.schedHash = 0xBEEF; f.idx = 2;
+  f.durMs = 600000; f.valveSel = 0x05;
+  TEST_ASSERT_TRUE(roundTrip(f, d));
+  TEST_ASSERT_EQUAL(LF_CMD, d.kind); TEST_ASSERT_EQUAL(LC_OPEN, d.code);
+  TEST_ASSERT_EQUAL(300, d.mid); TEST_ASSERT_EQUAL(17, d.node); TEST_ASSERT_EQUAL(0xBEEF, d.schedHash);
+  TEST_ASSERT_EQUAL(2, d.idx); TEST_ASSERT_EQUAL(600000, d.durMs); TEST_ASSERT_EQUAL(0x05, d.valveSel);
+  TEST_ASSERT_EQUAL(-1, d.wakeMs); TEST_ASSERT_FALSE(d.hasTele);
+
+  // multicast: node 0, target bitmap and reply slot
+  loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_CLOSE; f.mid = 9; f.node = LORA_NODE_GROUP; f.slotMs = 120;
+  static const uint32_t members[] = { 3, 9, 40, 66 };
+  for (uint32_t n : members) TEST_ASSERT_TRUE(f.targets.add(n));
+  TEST_ASSERT_TRUE(roundTrip(f, d));
+  TEST_ASSERT_EQUAL(4, d.targets.count()); TEST_ASSERT_EQUAL(120, d.slotMs);
+  TEST_ASSERT_EQUAL(0, d.targets.rank(3)); TEST_ASSERT_EQUAL(3, d.targets.rank(66)); TEST_ASSERT_FALSE(d.targets.has(4));
+
+  // PLAN with its T0 and the sender's clock
+  loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_PLAN; f.mid = 77; f.node = 5; f.schedHash = 0x1234;
+  f.epochMs = 1760000000123LL; f.planT0Ms = 1760000060500LL; f.planN = 3;
+  f.plan[0] = { 0, 0x01, 0, 600 }; f.plan[1] = { 1, 0x02, 600, 300 }; f.plan[2] = { 2, 0x0C, 200000, 90000 };
+  TEST_ASSERT_TRUE(roundTrip(f, d));
+  TEST_ASSERT_EQUAL(1760000000123LL, d.epochMs); TEST_ASSERT_EQUAL(1760000060500LL, d.planT0Ms);
+  TEST_ASSERT_EQUAL(3, d.planN);
+  TEST_ASSERT_EQUAL(0x0C, d.plan[2].valves); TEST_ASSERT_EQUAL(200000, d.plan[2].offS); TEST_ASSERT_EQUAL(90000, d.plan[2].durS);
+
+  loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_TIMESYNC; f.node = LORA_NODE_GROUP; f.epochMs = 1760000000999LL;
+  TEST_ASSERT_TRUE(roundTrip(f, d));
+  TEST_ASSERT_EQUAL(LC_TIMESYNC, d.code); TEST_ASSERT_EQUAL(1760000000999LL, d.epochMs);
+}
+
+static void test_reply_round_trip() {
+  LoraFrame f, d; loraFrameClear(f);
+  f.kind = LF_ACK; f.code = LC_SETID; f.mid = 5000; f.node = 1; f.newId = 42;
+  f.caps = LORA_CAP_BIN1 | LORA_CAP_PLAN; f.wakeMs = 2000; f.hasTele = true; f.tele = fullTele();
+  TEST_ASSERT_TRUE(roundTrip(f, d));
+  TEST_ASSERT_EQUAL(42, d.newId); TEST_ASSERT_EQUAL(LORA_CAP_BIN1 | LORA_CAP_PLAN, d.caps); TEST_ASSERT_EQUAL(2000, d.wakeMs);
+  TEST_ASSERT_TRUE(d.hasTele); TEST_ASSERT_FALSE(d.hasMeta);
+  TEST_ASSERT_EQUAL_MEMORY(&f.tele, &d.tele, sizeof(f.tele));
+
+  // partial STAT: only the fields in the mask, zero voltages still sent
+  loraFrameClear(f);
+  f.kind = LF_STAT; f.node = 12; f.wakeMs = 0; f.hasTele = true; f.tele = fullTele(); f.tele.solvMv = 0;
+  f.hasMeta = true; f.teleSeq = 201; f.teleFlags = LTM_SEQ; f.teleFields = TF_BATT | TF_SOLV;
+  TEST_ASSERT_TRUE(roundTrip(f, d));
+  TEST_ASSERT_TRUE(d.hasMeta); TEST_ASSERT_EQUAL(201, d.teleSeq); TEST_ASSERT_EQUAL(LTM_SEQ, d.teleFlags);
+  TEST_ASSERT_EQUAL(TF_BATT | TF_SOLV, d.teleFields);
+  TEST_ASSERT_EQUAL(81, d.tele.battPct); TEST_ASSERT_EQUAL(3950, d.tele.bvMv); TEST_ASSERT_EQUAL(0, d.tele.solvMv);
+  TEST_ASSERT_EQUAL(0, d.tele.valvePresent); TEST_ASSERT_EQUAL(0, d.tele.moistPresent);
+  TEST_ASSERT_EQUAL(-1, d.tele.soliMa); TEST_ASSERT_EQUAL(-1, d.tele.awakePm);
+
+  static const uint8_t kinds[] = { LF_AUTO_CLOSED, LF_AUTO_OPENED };
+  for (uint8_t kind : kinds) {
+    loraFrameClear(f);
+    f.kind = kind; f.node = 3; f.schedHash = 0x0A0B; f.idx = 0; f.hasTele = true; f.tele = fullTele();
+    TEST_ASSERT_TRUE(roundTrip(f, d));
+    TEST_ASSERT_EQUAL(kind, d.kind); TEST_ASSERT_EQUAL(0, d.idx); TEST_ASSERT_EQUAL(0x0A0B, d.schedHash);
+    TEST_ASSERT_EQUAL_MEMORY(&f.tele, &d.tele, sizeof(f.tele));
+  }
+}
+
+static void test_crc_and_version() {
+  LoraFrame f, d; loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_OPEN; f.mid = 1; f.node = 2; f.durMs = 1000;
+  uint8_t buf[LORA_FRAME_MAX]; size_t n = loraEncode(f, buf, sizeof(buf));
+  TEST_ASSERT_TRUE(loraDecode(buf, n, d));
+  for (size_t i = 1; i < n; ++i) {                                     // any flipped bit fails the CRC
+    buf[i] ^= 0x10; TEST_ASSERT_FALSE(loraDecode(buf, n, d)); buf[i] ^= 0x10;
+  }
+  TEST_ASSERT_FALSE(loraDecode(buf, n - 1, d));
+  buf[0] = LORA_FRAME_VER + 1; resign(buf, n);                         // valid CRC, unknown version
+  TEST_ASSERT_FALSE(loraDecode(buf, n, d));
+  TEST_ASSERT_FALSE(loraIsBinary(buf, n));
+  TEST_ASSERT_FALSE(loraDecode(buf, 7, d));
+
+  // a frame that does not fit is not encoded at all
+  f.planN = LORA_PLAN_MAX; f.planT0Ms = 1760000000000LL;
+  for (uint8_t i = 0; i < LORA_PLAN_MAX; ++i) f.plan[i] = { i, 0x0F, 100000000u, 100000000u };
+  f.hasTele = true; f.tele = fullTele(); f.targets.add(1); f.targets.add(120);
+  TEST_ASSERT_EQUAL(0, loraEncode(f, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL(0, loraEncode(f, buf, 8));
+}
+
+static void test_unknown_tlv_skipped() {
+  LoraFrame f, d; loraFrameClear(f);
+  f.kind = LF_ACK; f.code = LC_OPEN; f.mid = 8; f.node = 4; f.hasTele = true; f.tele = fullTele();
+  uint8_t buf[LORA_FRAME_MAX + 8]; size_t n = loraEncode(f, buf, LORA_FRAME_MAX);
+  TEST_ASSERT_GREATER_THAN(0, (int)n);
+  // one-byte mid / node / idx: the TLVs start at 8; add a future tag and a sixth valve's moisture
+  static const uint8_t extra[] = { 0x0F, 3, 0xAA, 0xBB, 0xCC, LT_MOIST | 5, 1, 55 };
+  memmove(buf + 8 + sizeof(extra), buf + 8, n - 8);
+  memcpy(buf + 8, extra, sizeof(extra)); n += sizeof(extra); resign(buf, n);
+  TEST_ASSERT_TRUE(loraDecode(buf, n, d));
+  TEST_ASSERT_EQUAL(8, d.mid); TEST_ASSERT_EQUAL(4, d.node);
+  TEST_ASSERT_EQUAL_MEMORY(&f.tele, &d.tele, sizeof(f.tele));
+}
+
+static void test_truncated_tlv() {
+  LoraFrame f, d; loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_OPEN; f.mid = 1; f.node = 2; f.durMs = 600000;   // DUR_MS: 0x01, 3, varint
+  uint8_t buf[LORA_FRAME_MAX]; size_t n = loraEncode(f, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(LT_DUR_MS, buf[8]);
+  buf[9] = 9; resign(buf, n);                                          // length runs past the CRC
+  TEST_ASSERT_FALSE(loraDecode(buf, n, d));
+  uint8_t tagOnly[] = { LORA_FRAME_VER, (LF_CMD << 4) | LC_OPEN, 0, 1, 2, 0, 0, 0, LT_CAPS, 0, 0 };
+  resign(tagOnly, sizeof(tagOnly));                                    // tag with no length byte
+  TEST_ASSERT_FALSE(loraDecode(tagOnly, sizeof(tagOnly), d));
+
+  // PLAN whose windows run past the TLV length
+  loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_PLAN; f.planT0Ms = 1760000000000LL; f.planN = 2;
+  f.plan[0] = { 0, 1, 0, 60 }; f.plan[1] = { 1, 2, 60, 60 };
+  n = loraEncode(f, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(LT_PLAN, buf[8]);
+  buf[9] = (uint8_t)(buf[9] - 1); resign(buf, n);
+  TEST_ASSERT_FALSE(loraDecode(buf, n, d));
+}
+
+static void test_telemetry_text_symmetry() {
+  LoraTelemetry t = fullTele(), p;
+  char a[160], b[160];
+  loraTelemetryText(t, a, sizeof(a));
+  TEST_ASSERT_EQUAL_STRING("VALVE1=CLOSED,VT1=0,M1=40,VALVE2=OPEN,VT2=45000,M3=73,BATT=81,BV=3.95,SOLV=5.10,SOLI=12,AWAKE=2.4", a);
+  TEST_ASSERT_EQUAL(TF_ALL, loraTelemetryParse(wireSpan(a), p));
+  TEST_ASSERT_EQUAL_MEMORY(&t, &p, sizeof(t));
+  loraTelemetryText(p, b, sizeof(b));
+  TEST_ASSERT_EQUAL_STRING(a, b);
+
+  // the text keeps 10 mV: values off that grid come back rounded down, then stay put
+  t.bvMv = 3957; t.awakePm = 1000; t.soliMa = -1;
+  loraTelemetryText(t, a, sizeof(a), TF_BATT | TF_AWAKE | TF_SOLI);
+  TEST_ASSERT_EQUAL_STRING("BATT=81,BV=3.95,AWAKE=100.0", a);
+  TEST_ASSERT_EQUAL(TF_BATT | TF_AWAKE, loraTelemetryParse(wireSpan(a), p));
+  TEST_ASSERT_EQUAL(3950, p.bvMv); TEST_ASSERT_EQUAL(1000, p.awakePm); TEST_ASSERT_EQUAL(-1, p.soliMa);
+  loraTelemetryText(p, b, sizeof(b), TF_BATT | TF_AWAKE);
+  TEST_ASSERT_EQUAL_STRING(a, b);
+}
+
+static void test_frame_to_text() {
+  LoraFrame f; loraFrameClear(f);
+  f.kind = LF_CMD; f.code = LC_OPEN; f.mid = 12; f.node = 2; f.schedHash = 0x00AB; f.idx = 1; f.durMs = 60000;
+  char out[256];
+  loraFrameToText(f, out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("CMD|MID=12|OPEN|N=2,S=#00AB,I=1,T=60000", out);
+
+  loraFrameClear(f);
+  f.kind = LF_ACK; f.code = LC_OPEN; f.mid = 12; f.node = 2; f.schedHash = 0x00AB; f.idx = 1;
+  f.wakeMs = 2000; f.hasTele = true; f.tele = fullTele();
+  loraFrameToText(f, out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("ACK|MID=12|OPEN|N=2,S=#00AB,I=1|OK|VALVE1=CLOSED,VT1=0,M1=40,VALVE2=OPEN,VT2=45000,M3=73,"
+                           "BATT=81,BV=3.95,SOLV=5.10,SOLI=12,AWAKE=2.4,WAKE=2000", out);
+  // the block after OK| is what a legacy node sends: it parses back to the same telemetry
+  LoraTelemetry p;
+  TEST_ASSERT_EQUAL(TF_ALL, loraTelemetryParse(wireSpan(strstr(out, "OK|") + 3), p));
+  TEST_ASSERT_EQUAL_MEMORY(&f.tele, &p, sizeof(p));
+
+  loraFrameClear(f);
+  f.kind = LF_STAT; f.node = 7; f.hasTele = true; f.tele = fullTele();
+  f.hasMeta = true; f.teleSeq = 4; f.teleFlags = LTM_SEQ | LTM_KEY; f.teleFields = TF_BATT;
+  loraFrameToText(f, out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("STAT|N=7|BATT=81,BV=3.95,TF=04,TSEQ=4,KEY=1", out);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cmd_round_trip);
+  RUN_TEST(test_reply_round_trip);
+  RUN_TEST(test_crc_and_version);
+  RUN_TEST(test_unknown_tlv_skipped);
+  RUN_TEST(test_truncated_tlv);
+  RUN_TEST(test_telemetry_text_symmetry);
+  RUN_TEST(test_frame_to_text);
+  return UNITY_END();
+}
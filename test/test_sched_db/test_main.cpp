@@ -0,0 +1,151 @@
+// sched_db.h on the file-backed LittleFS stand-in: round trips, shadow-copy commits,
+// recovery from an interrupted commit or a damaged index, and the boot-time
+// benchmark -- loading 100 / 250 / 500 schedules from the database vs. the one JSON
+// file per schedule it replaced.
+#define SDB_MAX 512              // the device keeps 256; raised so the 500-schedule case fits
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "host_fs.h"
+#include "host_bench.h"
+#include "sched_db.h"
+
+static void makeRec(uint32_t i, SdbRec &r, SdbStep *steps, uint16_t &n) {
+  memset(&r, 0, sizeof(r));
+  snprintf(r.id, sizeof(r.id), "SC%04u", (unsigned)i);
+  snprintf(r.timeStr, sizeof(r.timeStr), "%02u:%02u", (unsigned)(i % 24), (unsigned)(i * 7 % 60));
+  r.rec = i % 3 == 0 ? 'W' : 'D'; r.weekdayMask = (uint8_t)(i % 128); r.enabled = 1;
+  r.pumpOnMs = 5000; r.pumpOffMs = 10000; r.ts = 1760000000UL + i;
+  n = (uint16_t)(2 + i % 8);
+  for (uint16_t k = 0; k < n; ++k) { steps[k].node = (uint16_t)(1 + (i + k) % 30); steps[k].flags = 0; steps[k].target = 0; steps[k].durMs = 60000UL * (1 + k); }
+}
+static bool genSource(void *, uint16_t i, SdbRec &rec, SdbStep *steps) {
+  SdbStep buf[SDB_STEPS_MAX]; uint16_t n; makeRec(i, rec, steps ? steps : buf, n);
+  rec.stepCount = n; rec.stepsCrc = sdbCrc32(steps ? steps : buf, n * sizeof(SdbStep));
+  return true;
+}
+
+// ---- legacy: /schedules/<ID>.json, one file per schedule, read and parsed at boot ----
+struct LegacySched { std::string id, time; char rec; uint32_t pumpOn, pumpOff, ts; std::vector<SdbStep> seq; };
+static std::string legacyJson(uint32_t i) {
+  SdbRec r; SdbStep st[SDB_STEPS_MAX]; uint16_t n; makeRec(i, r, st, n);
+  char b[128]; std::string j;
+  snprintf(b, sizeof(b), "{\"schedule_id\":\"%s\",\"recurrence\":\"%s\",\"start_time\":\"%s\",", r.id, r.rec == 'W' ? "weekly" : "daily", r.timeStr); j += b;
+  snprintf(b, sizeof(b), "\"pump_on_before_ms\":%lu,\"pump_off_after_ms\":%lu,\"ts\":%lu,\"sequence\":[", (unsigned long)r.pumpOnMs, (unsigned long)r.pumpOffMs, (unsigned long)r.ts); j += b;
+  for (uint16_t k = 0; k < n; ++k) { snprintf(b, sizeof(b), "%s{\"node_id\":%u,\"duration_ms\":%lu}", k ? "," : "", (unsigned)st[k].node, (unsigned long)st[k].durMs); j += b; }
+  return j + "]}";
+}
+static const char *jsonVal(const std::string &j, const char *key, size_t from = 0) {
+  std::string k = std::string("\"") + key + "\":"; size_t p = j.find(k, from);
+  return p == std::string::npos ? nullptr : j.c_str() + p + k.size();
+}
+// Minimal key scan standing in for deserializeJson (so the legacy times are a lower bound)
+static bool legacyParse(const std::string &j, LegacySched &s) {
+  const char *v = jsonVal(j, "schedule_id"); if (!v) return false;
+  s.id.assign(v + 1, strchr(v + 1, '"'));
+  v = jsonVal(j, "recurrence"); s.rec = v && (v[1] == 'd' || v[1] == 'D') ? 'D' : v && (v[1] == 'w' || v[1] == 'W') ? 'W' : 'O';
+  v = jsonVal(j, "start_time"); if (v) s.time.assign(v + 1, strchr(v + 1, '"'));
+  s.pumpOn = (v = jsonVal(j, "pump_on_before_ms")) ? strtoul(v, nullptr, 10) : 0;
+  s.pumpOff = (v = jsonVal(j, "pump_off_after_ms")) ? strtoul(v, nullptr, 10) : 0;
+  s.ts = (v = jsonVal(j, "ts")) ? strtoul(v, nullptr, 10) : 0;
+  size_t at = j.find("\"sequence\""); s.seq.clear();
+  while (at != std::string::npos && (v = jsonVal(j, "node_id", at))) {
+    SdbStep st; st.node = (uint16_t)atoi(v); st.flags = 0; st.target = 0;
+    at = (size_t)(v - j.c_str()); v = jsonVal(j, "duration_ms", at); st.durMs = v ? strtoul(v, nullptr, 10) : 0;
+    s.seq.push_back(st);
+  }
+  return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_put_find_read_erase() {
+  HostFS fs; SchedDb<HostFS> db;
+  TEST_ASSERT_FALSE(db.begin(fs));                                    // no database yet
+  for (uint32_t i : { 7u, 3u, 11u, 5u }) { SdbRec r; SdbStep st[SDB_STEPS_MAX]; uint16_t n; makeRec(i, r, st, n); TEST_ASSERT_TRUE(db.put(r, st, n)); }
+  TEST_ASSERT_EQUAL(4, db.count);
+  TEST_ASSERT_EQUAL_STRING("SC0003", db.idx[0].id); TEST_ASSERT_EQUAL_STRING("SC0011", db.idx[3].id);   // id order
+  int i = db.find("SC0007"); TEST_ASSERT_EQUAL(2, i);
+  SdbStep got[SDB_STEPS_MAX], want[SDB_STEPS_MAX]; SdbRec r; uint16_t n; makeRec(7, r, want, n);
+  TEST_ASSERT_EQUAL(n, db.readSteps((uint16_t)i, got, SDB_STEPS_MAX));
+  TEST_ASSERT_EQUAL_MEMORY(want, got, n * sizeof(SdbStep));
+  r.enabled = 0; TEST_ASSERT_TRUE(db.put(r, want, 1));                // replace, fewer steps
+  TEST_ASSERT_EQUAL(4, db.count); TEST_ASSERT_EQUAL(0, db.idx[2].enabled); TEST_ASSERT_EQUAL(1, db.readSteps(2, got, SDB_STEPS_MAX));
+  TEST_ASSERT_TRUE(db.erase("SC0003")); TEST_ASSERT_EQUAL(3, db.count); TEST_ASSERT_EQUAL(-1, db.find("SC0003"));
+  SchedDb<HostFS> again; TEST_ASSERT_TRUE(again.begin(fs)); TEST_ASSERT_EQUAL(3, again.count);   // reboot
+  SdbStep w11[SDB_STEPS_MAX]; makeRec(11, r, w11, n);
+  TEST_ASSERT_EQUAL(2, again.find("SC0011")); TEST_ASSERT_EQUAL(n, again.readSteps(2, got, SDB_STEPS_MAX));
+  TEST_ASSERT_EQUAL_MEMORY(w11, got, n * sizeof(SdbStep));
+}
+
+static void test_put_record_keeps_steps() {
+  HostFS fs; SchedDb<HostFS> db; db.begin(fs);
+  TEST_ASSERT_TRUE(db.rewrite(5, genSource, nullptr));
+  SdbRec r; SdbStep want[SDB_STEPS_MAX], got[SDB_STEPS_MAX]; uint16_t n; makeRec(2, r, want, n);
+  r.ts += 100; r.stepCount = 0; r.stepsCrc = 0;                       // newer stamp, same content
+  TEST_ASSERT_TRUE(db.putRecord(r));
+  SchedDb<HostFS> again; TEST_ASSERT_TRUE(again.begin(fs));           // reboot
+  int i = again.find("SC0002"); TEST_ASSERT_EQUAL(2, i);
+  TEST_ASSERT_EQUAL_UINT32(1760000000UL + 102, again.idx[i].ts);
+  TEST_ASSERT_EQUAL(n, again.readSteps((uint16_t)i, got, SDB_STEPS_MAX));
+  TEST_ASSERT_EQUAL_MEMORY(want, got, n * sizeof(SdbStep));
+  SdbStep w4[SDB_STEPS_MAX]; uint16_t n4; makeRec(4, r, w4, n4);      // neighbours untouched
+  TEST_ASSERT_EQUAL(n4, again.readSteps(4, got, SDB_STEPS_MAX)); TEST_ASSERT_EQUAL_MEMORY(w4, got, n4 * sizeof(SdbStep));
+  snprintf(r.id, sizeof(r.id), "NOPE"); TEST_ASSERT_FALSE(again.putRecord(r));   // record-only needs an existing entry
+}
+
+static void test_interrupted_commit_and_damage() {
+  HostFS fs; SchedDb<HostFS> db; db.begin(fs);
+  TEST_ASSERT_TRUE(db.rewrite(20, genSource, nullptr));
+  auto f = fs.open(SDB_PATH ".new", "w"); const uint8_t junk[5] = { 1, 2, 3, 4, 5 }; f.write(junk, 5); f.close();   // power cut mid-commit
+  SchedDb<HostFS> b1; TEST_ASSERT_TRUE(b1.begin(fs)); TEST_ASSERT_EQUAL(20, b1.count); TEST_ASSERT_FALSE(fs.exists(SDB_PATH ".new"));
+  f = fs.open(SDB_PATH, "r"); size_t sz = f.size(); f.close();
+  std::vector<uint8_t> img(sz); f = fs.open(SDB_PATH, "r"); f.read(img.data(), sz); f.close();
+  img[sz - sizeof(SdbFooter) - 40] ^= 0x20;                            // flip a bit in the index
+  f = fs.open(SDB_PATH, "w"); f.write(img.data(), sz); f.close();
+  SchedDb<HostFS> b2; TEST_ASSERT_FALSE(b2.begin(fs)); TEST_ASSERT_EQUAL(0, b2.count); TEST_ASSERT_EQUAL(1, b2.crcErrors);
+}
+
+// Boot: index (+ every step array, as a trigger would) vs. opening and parsing n JSON files
+static void bench(uint16_t n) {
+  HostFS fs; SchedDb<HostFS> db; db.begin(fs);
+  TEST_ASSERT_TRUE(db.rewrite(n, genSource, nullptr));
+  fs.mkdir("/schedules");
+  for (uint16_t i = 0; i < n; ++i) {
+    char p[40]; snprintf(p, sizeof(p), "/schedules/SC%04u.json", (unsigned)i);
+    std::string j = legacyJson(i); auto f = fs.open(p, "w"); f.write((const uint8_t *)j.data(), j.size()); f.close();
+  }
+  uint64_t o0 = fs.flash.opens, r0 = fs.flash.readBytes, a0 = hbAllocs, t0 = hbNowNs();
+  SchedDb<HostFS> boot; bool ok = boot.begin(fs);
+  uint64_t t1 = hbNowNs(), o1 = fs.flash.opens, r1 = fs.flash.readBytes, a1 = hbAllocs;
+  SdbStep st[SDB_STEPS_MAX]; uint32_t steps = 0;
+  for (uint16_t i = 0; i < boot.count; ++i) { int k = boot.readSteps(i, st, SDB_STEPS_MAX); if (k > 0) steps += (uint32_t)k; }
+  uint64_t t2 = hbNowNs(), o2 = fs.flash.opens, r2 = fs.flash.readBytes, a2 = hbAllocs;
+  std::vector<LegacySched> legacy; legacy.reserve(n);
+  for (uint16_t i = 0; i < n; ++i) {
+    char p[40]; snprintf(p, sizeof(p), "/schedules/SC%04u.json", (unsigned)i);
+    auto f = fs.open(p, "r"); std::string j(f.size(), '\0'); f.read((uint8_t *)&j[0], j.size()); f.close();
+    LegacySched s; if (legacyParse(j, s)) legacy.push_back(s);
+  }
+  uint64_t t3 = hbNowNs(), o3 = fs.flash.opens, r3 = fs.flash.readBytes, a3 = hbAllocs;
+  uint32_t legacySteps = 0; for (auto &s : legacy) legacySteps += (uint32_t)s.seq.size();
+  TEST_ASSERT_TRUE(ok); TEST_ASSERT_EQUAL(n, boot.count); TEST_ASSERT_EQUAL(n, legacy.size()); TEST_ASSERT_EQUAL(legacySteps, steps);
+  printf("BENCH sched boot n=%3u  db index: %7.1f us  opens=%llu  read=%6llu B  allocs=%llu | +all steps: %7.1f us  opens=%llu  read=%6llu B\n",
+         (unsigned)n, (t1 - t0) / 1e3, (unsigned long long)(o1 - o0), (unsigned long long)(r1 - r0), (unsigned long long)(a1 - a0),
+         (t2 - t1) / 1e3, (unsigned long long)(o2 - o1), (unsigned long long)(r2 - r1));
+  printf("BENCH sched boot n=%3u  legacy JSON files: %7.1f us  opens=%llu  read=%6llu B  allocs=%llu\n",
+         (unsigned)n, (t3 - t2) / 1e3, (unsigned long long)(o3 - o2), (unsigned long long)(r3 - r2), (unsigned long long)(a3 - a2));
+}
+static void test_bench() { bench(100); bench(250); bench(500); }
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_put_find_read_erase);
+  RUN_TEST(test_put_record_keeps_steps);
+  RUN_TEST(test_interrupted_commit_and_damage);
+  RUN_TEST(test_bench);
+  return UNITY_END();
+}
@@ -0,0 +1,114 @@
+// sched_patch.h: every SCHP op at the edges of its index range, the index of the op
+// that failed with the steps / count / enabled flag left as they were, and
+// schedVersion following the content but not the ts.
+#include <unity.h>
+#include <string.h>
+#include "sched_patch.h"
+
+static SdbStep base[4];
+static SdbStep st[SDB_STEPS_MAX];
+static uint16_t n;
+static uint8_t en;
+
+static int apply(const char *ops, uint16_t max = SDB_STEPS_MAX) { return schedPatchApply(wireSpan(ops), st, n, max, en); }
+static bool unchanged() { return n == 4 && en == 1 && memcmp(st, base, sizeof(base)) == 0; }
+
+void setUp() {
+  for (uint16_t i = 0; i < 4; ++i) { base[i].node = (uint16_t)(10 + i); base[i].flags = 0; base[i].target = 0; base[i].durMs = 60000UL * (i + 1); }
+  memset(st, 0, sizeof(st)); memcpy(st, base, sizeof(base)); n = 4; en = 1;
+}
+void tearDown() {}
+
+static void test_duration_and_node() {
+  TEST_ASSERT_EQUAL(-1, apply("D0:30;D3:600;N3:42"));
+  TEST_ASSERT_EQUAL(30000, st[0].durMs); TEST_ASSERT_EQUAL(600000, st[3].durMs); TEST_ASSERT_EQUAL(42, st[3].node);
+  setUp();
+  TEST_ASSERT_EQUAL(0, apply("D4:30"));                                // past the last step
+  TEST_ASSERT_EQUAL(0, apply("D-1:30"));
+  TEST_ASSERT_EQUAL(0, apply("D1"));                                   // missing duration
+  TEST_ASSERT_EQUAL(0, apply("N4:7"));
+  TEST_ASSERT_EQUAL(0, apply("N0:7:9"));
+  TEST_ASSERT_TRUE(unchanged());
+}
+
+static void test_insert_and_remove() {
+  TEST_ASSERT_EQUAL(-1, apply("I0:1:10;I5:2:20"));                     // front, then append at count
+  TEST_ASSERT_EQUAL(6, n);
+  TEST_ASSERT_EQUAL(1, st[0].node); TEST_ASSERT_EQUAL(10000, st[0].durMs);
+  TEST_ASSERT_EQUAL(10, st[1].node); TEST_ASSERT_EQUAL(2, st[5].node);
+  TEST_ASSERT_EQUAL(-1, apply("R0;R4"));
+  TEST_ASSERT_EQUAL(4, n);
+  TEST_ASSERT_EQUAL_MEMORY(base, st, sizeof(base));
+
+  TEST_ASSERT_EQUAL(0, apply("I5:1:10"));                              // past the append position
+  TEST_ASSERT_EQUAL(0, apply("I0:1"));
+  TEST_ASSERT_EQUAL(1, apply("I4:1:10;I0:2:10", 5));                   // full after the first insert
+  TEST_ASSERT_EQUAL(0, apply("R4"));
+  TEST_ASSERT_EQUAL(4, apply("R3;R2;R1;R0;R0"));                       // nothing left to remove
+  TEST_ASSERT_TRUE(unchanged());
+
+  // an insert clears what the step slot held before
+  st[1].flags = SDB_STEP_PAR; st[1].target = 30; memcpy(base, st, sizeof(base));
+  TEST_ASSERT_EQUAL(-1, apply("I1:5:60"));
+  TEST_ASSERT_EQUAL(0, st[1].flags); TEST_ASSERT_EQUAL(0, st[1].target);
+  TEST_ASSERT_EQUAL(SDB_STEP_PAR, st[2].flags); TEST_ASSERT_EQUAL(30, st[2].target);
+}
+
+static void test_par_and_moisture() {
+  TEST_ASSERT_EQUAL(-1, apply("P1:1;P3:1;P3:0;M2:35:90"));
+  TEST_ASSERT_EQUAL(SDB_STEP_PAR, st[1].flags & SDB_STEP_PAR);
+  TEST_ASSERT_EQUAL(0, st[3].flags & SDB_STEP_PAR);
+  TEST_ASSERT_EQUAL(35, st[2].target); TEST_ASSERT_EQUAL(90000, sdbStepMinMs(st[2]));
+  TEST_ASSERT_EQUAL(-1, apply("M1:40:30"));                            // the minimum keeps the PAR bit
+  TEST_ASSERT_EQUAL(SDB_STEP_PAR, st[1].flags & SDB_STEP_PAR); TEST_ASSERT_EQUAL(30000, sdbStepMinMs(st[1]));
+  TEST_ASSERT_EQUAL(-1, apply("M2:0:90"));                             // plain timed step: no minimum
+  TEST_ASSERT_EQUAL(0, st[2].target); TEST_ASSERT_EQUAL(0, sdbStepMinMs(st[2]));
+
+  setUp();
+  TEST_ASSERT_EQUAL(0, apply("P0:1"));                                 // nothing before the first step
+  TEST_ASSERT_EQUAL(0, apply("P1:2"));
+  TEST_ASSERT_EQUAL(0, apply("P4:1"));
+  TEST_ASSERT_EQUAL(0, apply("M0:101"));
+  TEST_ASSERT_EQUAL(0, apply("M4:50"));
+  TEST_ASSERT_EQUAL(0, apply("M0"));
+  TEST_ASSERT_TRUE(unchanged());
+}
+
+static void test_enable_and_failure_index() {
+  TEST_ASSERT_EQUAL(-1, apply("E0"));
+  TEST_ASSERT_EQUAL(0, en);
+  TEST_ASSERT_EQUAL(-1, apply(" E1 ;"));
+  TEST_ASSERT_EQUAL(1, en);
+  TEST_ASSERT_EQUAL(0, apply("E2"));
+  TEST_ASSERT_EQUAL(0, apply("E"));
+
+  // the index counts ops, not empty parts; nothing before the failing op sticks
+  TEST_ASSERT_EQUAL(3, apply("D0:5;;E0;R3;X1"));
+  TEST_ASSERT_EQUAL(2, apply("I0:9:9;R0;D9:1"));
+  TEST_ASSERT_TRUE(unchanged());
+  TEST_ASSERT_EQUAL(-1, apply(""));
+  TEST_ASSERT_TRUE(unchanged());
+}
+
+static void test_version() {
+  SdbRec r; memset(&r, 0, sizeof(r));
+  strcpy(r.id, "SC1"); strcpy(r.timeStr, "06:00"); r.rec = 'D'; r.enabled = 1; r.stepCount = 4;
+  r.stepsCrc = sdbCrc32(base, sizeof(base)); r.ts = 100;
+  uint16_t v = schedVersion(r);
+  r.ts = 124; r.stepsOff = 4096;
+  TEST_ASSERT_EQUAL(v, schedVersion(r));                               // where and when it was stored: same version
+  r.enabled = 0;
+  TEST_ASSERT_TRUE(v != schedVersion(r));
+  r.enabled = 1; base[2].durMs += 1000; r.stepsCrc = sdbCrc32(base, sizeof(base));
+  TEST_ASSERT_TRUE(v != schedVersion(r));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_duration_and_node);
+  RUN_TEST(test_insert_and_remove);
+  RUN_TEST(test_par_and_moisture);
+  RUN_TEST(test_enable_and_failure_index);
+  RUN_TEST(test_version);
+  return UNITY_END();
+}
@@ -0,0 +1,173 @@
+// Host simulation of a farm (sim/): the controller's txn engine and run state machine
+// against N nodes over a seeded LoRa channel, with broker outages on the modem.
+// Checks that a seed replays to the same report, that runs complete with the event log
+// drained and every step ended by the controller's CLOSE (the node's timer is only a
+// failsafe), and that the non-blocking engine keeps the ctrl loop free of the stalls
+// the src/ controller's blocking send has. A 30-day soak checks the controller's heap
+// holds no long-lived blocks past boot, so free heap and the largest free block stay
+// put; it prints the daily series next to the String pattern the fixed buffers
+// replaced. Prints the reports for both controllers. The sketch functions the sim ports
+// are fingerprinted (sim_ports.h): one that changed without its port fails by name.
+// SIM_NODES / SIM_DAYS / SIM_SEED / SIM_RADIUS / SIM_CAP override the printed run, e.g.
+//   SIM_NODES=40 SIM_DAYS=7 SIM_SEED=3 pio test -e native -f test_sim -v
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "sim_farm.h"
+#include "sim_ports.h"
+
+static char repA[2048], repB[2048];
+
+static SimFarmCfg smallFarm(uint64_t seed, bool blocking) {
+  SimFarmCfg c; c.seed = seed; c.nodes = 8; c.days = 1; c.blocking = blocking;
+  return c;
+}
+static void simulate(const SimFarmCfg &c, char *out, size_t cap) {
+  SimFarm f; f.begin(c); f.run(); f.report(out, cap);
+}
+static long envLong(const char *name, long d) { const char *v = getenv(name); return v && *v ? strtol(v, nullptr, 10) : d; }
+static std::string readFile(const char *path) {
+  std::string s; FILE *f = fopen(path, "rb"); if (!f) return s;
+  char b[4096]; size_t n;
+  while ((n = fread(b, 1, sizeof(b), f)) > 0) s.append(b, n);
+  fclose(f); return s;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_same_seed_same_report() {
+  simulate(smallFarm(7, false), repA, sizeof(repA));
+  simulate(smallFarm(7, false), repB, sizeof(repB));
+  TEST_ASSERT_EQUAL_STRING(repA, repB);
+  simulate(smallFarm(8, false), repB, sizeof(repB));
+  TEST_ASSERT_TRUE(strcmp(repA, repB) != 0);
+}
+
+static void test_runs_complete_and_log_drains() {
+  SimFarmCfg c = smallFarm(13, false); c.radiusM = 400;
+  SimFarm f; f.begin(c); f.run();
+  TEST_ASSERT_EQUAL(2, f.ctl.runs);                       // 05:00 and 17:00
+  TEST_ASSERT_EQUAL(f.ctl.runs, f.ctl.runsDone);
+  TEST_ASSERT_EQUAL(SimController::RS_IDLE, f.ctl.runState);
+  TEST_ASSERT_FALSE(f.pump);
+  TEST_ASSERT_EQUAL(0, f.valvesOpen);
+  uint32_t autoCloses = 0; for (auto &n : f.nodes) autoCloses += n->st.autoCloses;
+  TEST_ASSERT_EQUAL(0, autoCloses);
+  TEST_ASSERT_TRUE(f.ctl.perf.acked * 10 >= (f.ctl.perf.acked + f.ctl.perf.failed) * 9);
+  TEST_ASSERT_TRUE(f.modem.outages.size() > 0);
+  TEST_ASSERT_TRUE(f.ctl.evlog.drained());
+  TEST_ASSERT_EQUAL(0, f.modem.missing(f.ctl.evSeqAlloc.last));   // every status reached the broker
+}
+
+static void test_txn_engine_does_not_stall() {
+  SimFarm a; a.begin(smallFarm(5, false)); a.run();
+  SimFarm b; b.begin(smallFarm(5, true)); b.run();
+  TEST_ASSERT_EQUAL(0, a.ctl.perf.stalls);
+  TEST_ASSERT_TRUE(a.ctl.perf.loopMaxUs < PERF_STALL_US);
+  TEST_ASSERT_TRUE(b.ctl.perf.stalls > 0);
+  TEST_ASSERT_TRUE(b.ctl.perf.loopMaxUs > a.ctl.perf.loopMaxUs);   // a pass held for an ACK
+  TEST_ASSERT_EQUAL(a.ctl.runs, b.ctl.runs);
+}
+
+static void test_fingerprint() {
+  const char *a = "void f(int x);\nint g() { return f(1); }\nvoid f(int x) {\n  if (x) { puts(\"}{\"); }   // note\n}\n";
+  const char *b = "void f( int x ) { /* reworded */ if (x) {puts(\"}{\");} }";
+  const char *c = "void f(int x) { if (x) { puts(\"} {\"); } }";
+  uint32_t fa = 0, fb = 0, fc = 0;
+  TEST_ASSERT_TRUE(simSketchFingerprint(a, "f", fa));                  // the definition, not the prototype or the call
+  TEST_ASSERT_TRUE(simSketchFingerprint(b, "f", fb));
+  TEST_ASSERT_TRUE(simSketchFingerprint(c, "f", fc));
+  TEST_ASSERT_EQUAL(fa, fb);                                           // layout and comments do not count
+  TEST_ASSERT_TRUE(fa != fc);                                          // literals do
+  TEST_ASSERT_FALSE(simSketchFingerprint("void f(int x);", "f", fa));
+  TEST_ASSERT_FALSE(simSketchFingerprint(a, "g2", fa));
+}
+
+// Run from the project root (pio test does)
+static void test_ports_match_sketches() {
+  int drifted = 0; char msg[200];
+  for (const SimPort &p : SIM_PORTS) {
+    std::string src = readFile(p.sketch);
+    uint32_t fp = 0;
+    if (src.empty()) snprintf(msg, sizeof(msg), "%s: not found", p.sketch);
+    else if (!simSketchFingerprint(src, p.fn, fp)) snprintf(msg, sizeof(msg), "%s: %s() not found", p.sketch, p.fn);
+    else if (fp != p.fp) snprintf(msg, sizeof(msg), "%s: %s() changed since its sim port (now 0x%08lX, recorded 0x%08lX)",
+                                  p.sketch, p.fn, (unsigned long)fp, (unsigned long)p.fp);
+    else continue;
+    TEST_MESSAGE(msg); drifted++;
+  }
+  if (drifted) TEST_FAIL_MESSAGE("sketch and simulator have diverged: port the functions above, then update sim_ports.h");
+}
+
+static void test_heap_model() {
+  SimHeap h; h.begin(1024);
+  int32_t a = h.alloc(100), b = h.alloc(100), c = h.alloc(100);
+  TEST_ASSERT_EQUAL(108, b);                                 // 100 + header
+  TEST_ASSERT_EQUAL(216, c);
+  h.free(b);
+  TEST_ASSERT_EQUAL(1024 - 324 - SIM_HEAP_HDR, h.largest()); // the hole does not count
+  TEST_ASSERT_EQUAL(a, h.realloc(a, 200));                   // grows into the free neighbour
+  h.free(c);
+  TEST_ASSERT_EQUAL(1024 - 216 - SIM_HEAP_HDR, h.largest()); // coalesced with the tail
+  h.free(a);
+  TEST_ASSERT_EQUAL(1024, h.freeBytes);
+  TEST_ASSERT_EQUAL(1024 - SIM_HEAP_HDR, h.largest());
+  uint32_t allocs = h.allocs;
+  { SimHeapStr t(h, SIM_STR_SSO); TEST_ASSERT_EQUAL(allocs, h.allocs); t.append(1); TEST_ASSERT_EQUAL(allocs + 1, h.allocs); }
+  TEST_ASSERT_EQUAL(1024, h.freeBytes);
+}
+
+static void printSoak(const SimFarm &f) {
+  for (size_t d = 0; d < f.heapDays.size(); ++d) {
+    if (d && (d + 1) % 7 && d + 1 != f.heapDays.size()) continue;
+    const SimHeapDay &h = f.heapDays[d];
+    printf("SOAK|PROFILE=%s,DAY=%u,FREE=%lu,MIN=%lu,LARGEST=%lu,LARGEST_MIN=%lu,FRAG_PCT=%lu,BLOCKS=%lu\n", f.cfg.stringHeap ? "strings" : "fixed",
+           (unsigned)(d + 1), (unsigned long)h.freeBytes, (unsigned long)h.minFree, (unsigned long)h.largest, (unsigned long)h.largestMin,
+           (unsigned long)h.fragPct, (unsigned long)h.blocks);
+  }
+}
+
+static void test_heap_flat_over_30_day_soak() {
+  SimFarmCfg c = smallFarm(3, false); c.days = 30;
+  SimFarm f; f.begin(c); f.run();
+  TEST_ASSERT_EQUAL(30, f.heapDays.size());
+  TEST_ASSERT_EQUAL(0, f.ctl.heap.fails);
+  const SimHeapDay &d1 = f.heapDays[0];
+  for (const SimHeapDay &d : f.heapDays) {
+    TEST_ASSERT_EQUAL(d1.blocks, d.blocks);                // nothing but the boot allocations outlives a pass
+    TEST_ASSERT_EQUAL(d1.freeBytes, d.freeBytes);
+    TEST_ASSERT_EQUAL(d1.largestMin, d.largestMin);
+  }
+  printSoak(f);
+  c.stringHeap = true;
+  SimFarm s; s.begin(c); s.run();
+  printSoak(s);
+}
+
+// Reports to compare across firmware versions (not asserted)
+static void test_report() {
+  SimFarmCfg c;
+  c.seed = (uint64_t)envLong("SIM_SEED", 1); c.nodes = (uint16_t)envLong("SIM_NODES", 24); c.days = (double)envLong("SIM_DAYS", 2);
+  c.radiusM = (double)envLong("SIM_RADIUS", 700); c.cap = (uint16_t)envLong("SIM_CAP", 1);
+  for (int blocking = 0; blocking < 2; ++blocking) {
+    c.blocking = blocking != 0;
+    simulate(c, repA, sizeof(repA));
+    printf("%s", repA);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_same_seed_same_report);
+  RUN_TEST(test_runs_complete_and_log_drains);
+  RUN_TEST(test_txn_engine_does_not_stall);
+  RUN_TEST(test_fingerprint);
+  RUN_TEST(test_ports_match_sketches);
+  RUN_TEST(test_heap_model);
+  RUN_TEST(test_heap_flat_over_30_day_soak);
+  RUN_TEST(test_report);
+  return UNITY_END();
+}
@@ -0,0 +1,109 @@
+// timer_heap.h against a brute-force scan of the same due times: random arm /
+// re-arm / disarm sequences on a full table of schedules, pop order, and the cost
+// of the per-second due check and a fire + re-arm, heap vs. the linear walk it replaced.
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "host_bench.h"
+#include "timer_heap.h"
+
+static uint32_t rng = 12345;
+static uint32_t rnd() { rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng; }
+
+// Reference: due per key, 0 = not armed; the minimum is found by scanning
+struct Scan {
+  uint32_t due[TIMER_HEAP_MAX] = {};
+  int minKey(int lim = TIMER_HEAP_MAX) const { int k = -1; for (int i = 0; i < lim; ++i) if (due[i] && (k < 0 || due[i] < due[k])) k = i; return k; }
+  int count() const { int c = 0; for (int i = 0; i < TIMER_HEAP_MAX; ++i) if (due[i]) c++; return c; }
+};
+
+static bool heapValid(const TimerHeap &t) {
+  for (uint16_t i = 1; i < t.n; ++i) if (t.h[(i - 1) / 2].due > t.h[i].due) return false;
+  for (uint16_t i = 0; i < t.n; ++i) if (t.pos[t.h[i].key] != i) return false;
+  return true;
+}
+
+void setUp() { rng = 12345; }
+void tearDown() {}
+
+static void test_random_ops_match_scan() {
+  TimerHeap t; Scan s;
+  const uint32_t base = 1760000000UL;
+  for (int op = 0; op < 200000; ++op) {
+    uint16_t key = (uint16_t)(rnd() % TIMER_HEAP_MAX);
+    uint32_t r = rnd() % 10;
+    uint32_t due = r < 2 ? 0 : base + rnd() % 86400 * (r < 5 ? 1 : 14);   // disarm, today, next two weeks
+    t.set(key, due); s.due[key] = due;
+    if (op % 97 == 0) { t.remove(key); s.due[key] = 0; }
+    int k = s.minKey();
+    TEST_ASSERT_EQUAL(s.count(), t.size());
+    if (k < 0) { TEST_ASSERT_TRUE(t.empty()); continue; }
+    TEST_ASSERT_EQUAL(s.due[k], t.topDue());                                 // ties: any key with the minimum due
+    TEST_ASSERT_EQUAL(s.due[k], s.due[t.topKey()]);
+  }
+  TEST_ASSERT_TRUE(heapValid(t));
+}
+
+static void test_pop_order_matches_sorted_scan() {
+  TimerHeap t; Scan s;
+  for (uint16_t k = 0; k < TIMER_HEAP_MAX; ++k) { uint32_t d = 1000 + rnd() % 5000; t.set(k, d); s.due[k] = d; }
+  for (uint16_t k = 0; k < TIMER_HEAP_MAX; k += 3) { t.set(k, 1000 + rnd() % 5000 + 1); s.due[k] = t.h[t.pos[k]].due; }   // edits
+  uint32_t last = 0; int popped = 0;
+  while (!t.empty()) {
+    int k = s.minKey();
+    uint16_t key = t.topKey();
+    TEST_ASSERT_EQUAL(s.due[k], t.topDue());
+    TEST_ASSERT_TRUE(t.topDue() >= last);
+    last = t.topDue(); t.remove(key); s.due[key] = 0; popped++;
+  }
+  TEST_ASSERT_EQUAL(TIMER_HEAP_MAX, popped);
+  TEST_ASSERT_EQUAL(-1, s.minKey());
+}
+
+static void test_out_of_range_and_disarm() {
+  TimerHeap t;
+  TEST_ASSERT_FALSE(t.set(TIMER_HEAP_MAX, 5));
+  TEST_ASSERT_TRUE(t.set(3, 50)); TEST_ASSERT_TRUE(t.armed(3));
+  TEST_ASSERT_TRUE(t.set(3, 0)); TEST_ASSERT_FALSE(t.armed(3)); TEST_ASSERT_TRUE(t.empty());
+  t.remove(3); t.remove(TIMER_HEAP_MAX + 1);                                 // harmless
+  TEST_ASSERT_EQUAL(0, t.size());
+}
+
+static void test_clock_jump() {
+  ClockJumpDetector d; int32_t j;
+  TEST_ASSERT_FALSE(d.check(1000, 0, 5, j));
+  TEST_ASSERT_FALSE(d.check(1010, 10000, 5, j));
+  TEST_ASSERT_TRUE(d.check(1010 + 3600 + 1, 11000, 5, j)); TEST_ASSERT_EQUAL(3600, j);   // NTP moved the clock an hour
+  TEST_ASSERT_FALSE(d.check(4612, 12000, 5, j));
+  TEST_ASSERT_TRUE(d.check(4500, 13000, 5, j)); TEST_ASSERT_EQUAL(-113, j);
+}
+
+// Due check once a second and fire + re-arm (+1 day), n schedules armed
+static volatile uint32_t vNow = 1760000000UL, vSink;
+static void bench(uint16_t n) {
+  TimerHeap t; Scan s; uint32_t now = vNow, sink = 0;
+  for (uint16_t k = 0; k < n; ++k) { uint32_t d = now + 60 + rnd() % 86400; t.set(k, d); s.due[k] = d; }
+  HbResult headCheck = hbMeasure(100000, [&] { sink += t.topDue() <= vNow; });
+  HbResult scanCheck = hbMeasure(100000, [&] { for (uint16_t k = 0; k < n; ++k) sink += s.due[k] && s.due[k] <= vNow; });
+  HbResult heapFire = hbMeasure(100000, [&] { uint16_t k = t.topKey(); t.set(k, t.topDue() + 86400); });
+  HbResult scanFire = hbMeasure(20000, [&] { int k = s.minKey(n); s.due[k] += 86400; vSink = s.due[k]; });
+  char name[40];
+  snprintf(name, sizeof(name), "due check heap   n=%u", (unsigned)n); hbReport(name, headCheck);
+  snprintf(name, sizeof(name), "due check scan   n=%u", (unsigned)n); hbReport(name, scanCheck);
+  snprintf(name, sizeof(name), "fire+rearm heap  n=%u", (unsigned)n); hbReport(name, heapFire);
+  snprintf(name, sizeof(name), "fire+rearm scan  n=%u", (unsigned)n); hbReport(name, scanFire);
+  TEST_ASSERT_EQUAL(0, headCheck.allocs + heapFire.allocs);
+  TEST_ASSERT_TRUE(heapValid(t));
+  vSink = sink;
+}
+static void test_bench() { bench(50); bench(150); bench(TIMER_HEAP_MAX); }
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_random_ops_match_scan);
+  RUN_TEST(test_pop_order_matches_sorted_scan);
+  RUN_TEST(test_out_of_range_and_disarm);
+  RUN_TEST(test_clock_jump);
+  RUN_TEST(test_bench);
+  return UNITY_END();
+}
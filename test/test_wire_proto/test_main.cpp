@@ -0,0 +1,184 @@
+// wire_proto.h: frame / key-value parsing on the header's CMD / ACK / SCH examples,
+// and heap calls + time per message against the String-based parsers it replaced
+// (parseCmd, parseAckWithMid, extractKeyVal), ported to a String model that
+// allocates like Arduino's (every copy / substring / concat with text is a heap block).
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "host_bench.h"
+#include "wire_proto.h"
+
+static const char *CMD = "CMD|MID=12|OPEN|N=2,S=SC001,I=1,T=60000,V=1-2";
+static const char *ACK = "ACK|MID=12|OPEN|N=2,S=SC001,I=1|OK|VALVE1=OPEN,BATT=81";
+static const char *SCH = "SCH|ID=SC001,REC=D,T=06:00,SEQ=1:60;2:30,SRC=MQTT";
+
+// ---- legacy String model ----
+struct LStr {
+  char *p = nullptr; size_t n = 0;
+  LStr() {}
+  LStr(const char *s, size_t l) { set(s, l); }
+  LStr(const char *s) { set(s, strlen(s)); }
+  LStr(const LStr &o) { set(o.p, o.n); }
+  LStr &operator=(const LStr &o) { if (this != &o) { delete[] p; p = nullptr; set(o.p, o.n); } return *this; }
+  ~LStr() { delete[] p; }
+  void set(const char *s, size_t l) { n = l; if (l) { p = new char[l + 1]; memcpy(p, s, l); p[l] = 0; } }
+  size_t length() const { return n; }
+  char operator[](size_t i) const { return p[i]; }
+  LStr substring(size_t a, size_t b = (size_t)-1) const { if (b > n) b = n; if (a > b) a = b; return LStr(p + a, b - a); }
+  int indexOf(char c, size_t from = 0) const { for (size_t i = from; i < n; ++i) if (p[i] == c) return (int)i; return -1; }
+  int indexOf(const LStr &s) const { for (size_t i = 0; i + s.n <= n; ++i) if (memcmp(p + i, s.p, s.n) == 0) return (int)i; return -1; }
+  bool startsWith(const char *s) const { size_t l = strlen(s); return l <= n && memcmp(p, s, l) == 0; }
+  void trim() { size_t a = 0, b = n; while (a < b && p[a] == ' ') a++; while (b > a && p[b - 1] == ' ') b--; if (a || b != n) *this = substring(a, b); }
+  long toInt() const { return n ? atol(p) : 0; }
+  bool operator==(const char *s) const { return n == strlen(s) && (!n || memcmp(p, s, n) == 0); }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  LStr operator+(const char *s) const { LStr r; size_t l = strlen(s); r.n = n + l; r.p = new char[r.n + 1]; if (n) memcpy(r.p, p, n); memcpy(r.p + n, s, l + 1); return r; }
+};
+
+static std::vector<LStr> legacySplit(const LStr &s) {
+  std::vector<LStr> parts; size_t start = 0;
+  for (size_t i = 0; i < s.length(); ++i) if (s[i] == '|') { parts.push_back(s.substring(start, i)); start = i + 1; }
+  parts.push_back(s.substring(start));
+  return parts;
+}
+static bool legacyParseCmd(const LStr &msg, uint32_t &mid, LStr &type, int &n, LStr &sch, int &idx, uint32_t &t, LStr &v) {
+  LStr s = msg; s.trim();
+  if (!s.startsWith("CMD|")) return false;
+  std::vector<LStr> parts = legacySplit(s);
+  if (parts.size() < 4 || !parts[1].startsWith("MID=")) return false;
+  mid = (uint32_t)parts[1].substring(4).toInt(); type = parts[2];
+  LStr kv = parts[3]; size_t pos = 0;
+  while (pos < kv.length()) {
+    int comma = kv.indexOf(',', pos);
+    LStr tok = comma < 0 ? kv.substring(pos) : kv.substring(pos, comma); tok.trim();
+    int eq = tok.indexOf('=');
+    if (eq > 0) {
+      LStr k = tok.substring(0, eq), val = tok.substring(eq + 1); k.trim(); val.trim();
+      if (k == "N") n = (int)val.toInt(); else if (k == "S") sch = val; else if (k == "I") idx = (int)val.toInt();
+      else if (k == "T") t = (uint32_t)val.toInt(); else if (k == "V") v = val;
+    }
+    if (comma < 0) break;
+    pos = comma + 1;
+  }
+  return true;
+}
+static bool legacyParseAck(const LStr &msg, uint32_t wantMid, const char *wantType, int wantNode, const char *wantSched, int wantIdx) {
+  if (!msg.startsWith("ACK|")) return false;
+  std::vector<LStr> parts = legacySplit(msg);
+  if (parts.size() < 4 || !parts[1].startsWith("MID=")) return false;
+  if ((uint32_t)parts[1].substring(4).toInt() != wantMid || parts[2] != wantType) return false;
+  LStr kv = parts[3]; int node = -1, idx = -1; LStr sched(""); size_t pos = 0;
+  while (pos < kv.length()) {
+    int c = kv.indexOf(',', pos);
+    LStr t = c < 0 ? kv.substring(pos) : kv.substring(pos, c); t.trim();
+    if (t.startsWith("N=")) node = (int)t.substring(2).toInt();
+    else if (t.startsWith("I=")) idx = (int)t.substring(2).toInt();
+    else if (t.startsWith("S=")) sched = t.substring(2);
+    if (c < 0) break;
+    pos = c + 1;
+  }
+  return node == wantNode && idx == wantIdx && sched == wantSched && parts[4].indexOf(LStr("OK")) >= 0;
+}
+static LStr legacyKeyVal(const LStr &payload, const char *key) {
+  int p = payload.indexOf(LStr(key) + "=");
+  if (p < 0) return LStr("");
+  LStr s = payload.substring(p + strlen(key) + 1);
+  int c = s.indexOf(',');
+  if (c >= 0) s = s.substring(0, c);
+  s.trim();
+  return s;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_cmd_frame() {
+  WireCmd c;
+  TEST_ASSERT_TRUE(wireParseFrame(wireSpan(CMD), "CMD", c));
+  TEST_ASSERT_EQUAL_UINT32(12, c.mid);
+  TEST_ASSERT_TRUE(c.type.eq("OPEN"));
+  TEST_ASSERT_EQUAL_INT32(2, c.node);
+  TEST_ASSERT_TRUE(c.sched.eq("SC001"));
+  TEST_ASSERT_EQUAL_INT32(1, c.idx);
+  TEST_ASSERT_EQUAL_UINT32(60000, c.t);
+  TEST_ASSERT_TRUE(c.v.eq("1-2"));
+  TEST_ASSERT_TRUE(c.status.empty());
+  TEST_ASSERT_FALSE(wireParseFrame(wireSpan(CMD), "ACK", c));
+  TEST_ASSERT_FALSE(wireParseFrame(wireSpan("CMD|12|OPEN|N=2"), "CMD", c));
+}
+
+void test_valve_list_kept_whole() {
+  WireCmd c;
+  TEST_ASSERT_TRUE(wireParseFrame(wireSpan("CMD|MID=7|OPEN|N=3,V=1,3,T=5"), "CMD", c));
+  TEST_ASSERT_TRUE(c.v.eq("1,3"));
+  TEST_ASSERT_EQUAL_UINT32(5, c.t);
+}
+
+void test_ack_frame() {
+  WireCmd a;
+  TEST_ASSERT_TRUE(wireParseFrame(wireSpan(ACK), "ACK", a));
+  TEST_ASSERT_EQUAL_UINT32(12, a.mid);
+  TEST_ASSERT_TRUE(a.status.eq("OK"));
+  TEST_ASSERT_TRUE(a.extra.eq("VALVE1=OPEN,BATT=81"));
+  WireSpan v;
+  TEST_ASSERT_TRUE(wireFindKey(a.extra, "BATT", v));
+  TEST_ASSERT_EQUAL(81, v.toLong());
+}
+
+void test_sch_kv() {
+  WireKvIter it(wireSpan(SCH)); WireSpan k, v; int n = 0;
+  const char *keys[] = { "", "ID", "REC", "T", "SEQ", "SRC" };
+  while (it.next(k, v)) { TEST_ASSERT_TRUE(n < 6); TEST_ASSERT_TRUE(k.eq(keys[n])); n++; }
+  TEST_ASSERT_EQUAL(6, n);                                   // "SCH" comes back as a bare token
+  TEST_ASSERT_TRUE(wireFindKey(wireSpan(SCH), "SEQ", v) && v.eq("1:60;2:30"));
+  TEST_ASSERT_TRUE(wireFindKey(wireSpan(SCH), "T", v) && v.eq("06:00"));
+  TEST_ASSERT_FALSE(wireFindKey(wireSpan(SCH), "EQ", v));   // whole keys only
+}
+
+void test_legacy_agrees() {
+  uint32_t mid = 0, t = 0; LStr type, sch, v; int n = -1, idx = -1;
+  TEST_ASSERT_TRUE(legacyParseCmd(LStr(CMD), mid, type, n, sch, idx, t, v));
+  WireCmd c; wireParseFrame(wireSpan(CMD), "CMD", c);
+  TEST_ASSERT_EQUAL_UINT32(c.mid, mid); TEST_ASSERT_EQUAL(c.node, n); TEST_ASSERT_EQUAL(c.idx, idx); TEST_ASSERT_EQUAL_UINT32(c.t, t);
+  TEST_ASSERT_TRUE(c.v.eq(v.p));
+  TEST_ASSERT_TRUE(legacyParseAck(LStr(ACK), 12, "OPEN", 2, "SC001", 1));
+  TEST_ASSERT_TRUE(legacyKeyVal(LStr(SCH), "SEQ") == "1:60;2:30");
+}
+
+void test_bench() {
+  const uint32_t N = 20000;
+  volatile uint32_t sink = 0;
+  HbResult newCmd = hbMeasure(N, [&] { WireCmd c; sink += wireParseFrame(wireSpan(CMD), "CMD", c) ? c.mid : 0; });
+  HbResult oldCmd = hbMeasure(N, [&] { LStr m(CMD), type, sch, v; uint32_t mid = 0, t = 0; int n = -1, idx = -1; sink += legacyParseCmd(m, mid, type, n, sch, idx, t, v) ? mid : 0; });
+  HbResult newAck = hbMeasure(N, [&] {
+    WireCmd a; sink += wireParseFrame(wireSpan(ACK), "ACK", a) && a.mid == 12 && a.type.eq("OPEN") && a.node == 2 && a.sched.eq("SC001") && a.idx == 1 && a.status.eq("OK");
+  });
+  HbResult oldAck = hbMeasure(N, [&] { LStr m(ACK); sink += legacyParseAck(m, 12, "OPEN", 2, "SC001", 1); });
+  static const char *keys[] = { "ID", "REC", "T", "SEQ", "SRC" };
+  HbResult newSch = hbMeasure(N, [&] { WireSpan v; for (const char *k : keys) sink += wireFindKey(wireSpan(SCH), k, v) ? v.n : 0; });
+  HbResult oldSch = hbMeasure(N, [&] { LStr m(SCH); for (const char *k : keys) sink += (uint32_t)legacyKeyVal(m, k).length(); });
+  HbResult newIter = hbMeasure(N, [&] { WireKvIter it(wireSpan(SCH)); WireSpan k, v; while (it.next(k, v)) sink += v.n; });
+  hbReport("CMD wireParseFrame", newCmd);
+  hbReport("CMD legacy parseCmd", oldCmd);
+  hbReport("ACK wireParseFrame", newAck);
+  hbReport("ACK legacy parseAckWithMid", oldAck);
+  hbReport("SCH wireFindKey x5", newSch);
+  hbReport("SCH legacy extractKeyVal x5", oldSch);
+  hbReport("SCH WireKvIter walk", newIter);
+  TEST_ASSERT_EQUAL(0, (int)newCmd.allocs);
+  TEST_ASSERT_EQUAL(0, (int)newAck.allocs);
+  TEST_ASSERT_EQUAL(0, (int)newSch.allocs);
+  TEST_ASSERT_EQUAL(0, (int)newIter.allocs);
+  TEST_ASSERT_GREATER_THAN(10, (int)oldCmd.allocs);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cmd_frame);
+  RUN_TEST(test_valve_list_kept_whole);
+  RUN_TEST(test_ack_frame);
+  RUN_TEST(test_sch_kv);
+  RUN_TEST(test_legacy_agrees);
+  RUN_TEST(test_bench);
+  return UNITY_END();
+}
@@ -0,0 +1,140 @@
+// zone_runner.h: groups and the capacity check, zonePlanTimes filling a group as the
+// capacity allows, and ZoneRunner driven through a recording Act -- members opened as
+// others finish, a time-up valve closed only after its successor's OPEN is acknowledged
+// (make-before-break), steps passed on by skip() and ended early by cut().
+#include <unity.h>
+#include <string>
+#include "zone_runner.h"
+
+// Records the runner's requests as "O<i> " / "C<i> "
+struct RecAct {
+  std::string log;
+  uint32_t skipMask = 0;
+  bool busy = false;              // open() refused: the radio has a command in flight
+  bool open(uint16_t i) { if (busy) return false; log += "O" + std::to_string(i) + " "; return true; }
+  bool close(uint16_t i) { log += "C" + std::to_string(i) + " "; return true; }
+  bool skip(uint16_t i) { return skipMask & (1u << i); }
+};
+
+static ZoneStep step(uint16_t node, uint32_t durMs, bool par = false, uint8_t weight = 1) {
+  ZoneStep z = {}; z.node = node; z.weight = weight; z.par = par; z.durMs = durMs; return z;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_groups_and_capacity() {
+  // "1:300;2:300+3:300+4:300;5:120"
+  ZoneStep s[] = { step(1, 300), step(2, 300), step(3, 300, true), step(4, 300, true), step(5, 120) };
+  TEST_ASSERT_EQUAL(1, zoneGroupEnd(s, 5, 0));
+  TEST_ASSERT_EQUAL(4, zoneGroupEnd(s, 5, 1));
+  TEST_ASSERT_EQUAL(5, zoneGroupEnd(s, 5, 4));
+  TEST_ASSERT_EQUAL(-1, zoneCheckCapacity(s, 5, 3));
+  TEST_ASSERT_EQUAL(1, zoneCheckCapacity(s, 5, 2));
+  s[0].weight = 9;                                                     // a lone step never exceeds the pump
+  TEST_ASSERT_EQUAL(-1, zoneCheckCapacity(s, 5, 3));
+
+  ZoneFlowTable t;
+  TEST_ASSERT_TRUE(t.parse(wireSpan("7:2; 9:3;")));
+  TEST_ASSERT_EQUAL(2, t.weight(7)); TEST_ASSERT_EQUAL(3, t.weight(9)); TEST_ASSERT_EQUAL(1, t.weight(8));
+  TEST_ASSERT_FALSE(t.parse(wireSpan("7:4;9:0")));                     // bad entry: table unchanged
+  TEST_ASSERT_EQUAL(2, t.weight(7));
+  char out[32]; t.text(out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("7:2;9:3", out);
+}
+
+static void test_plan_times_capacity_fill() {
+  // {1} then {2,3,4} on a pump for two, then {5}
+  ZoneStep s[] = { step(1, 100), step(2, 300), step(3, 100, true), step(4, 200, true), step(5, 50) };
+  uint32_t at[5];
+  TEST_ASSERT_EQUAL(100 + 300 + 50, zonePlanTimes(s, 5, 2, at));
+  TEST_ASSERT_EQUAL(0, at[0]);
+  TEST_ASSERT_EQUAL(100, at[1]); TEST_ASSERT_EQUAL(100, at[2]);
+  TEST_ASSERT_EQUAL(200, at[3]);                                       // waits for step 3 to finish
+  TEST_ASSERT_EQUAL(400, at[4]);                                       // after the longest member
+
+  // a weight-2 member waits until both the others are done
+  s[2].durMs = 300; s[3].weight = 2;
+  TEST_ASSERT_EQUAL(100 + 300 + 200 + 50, zonePlanTimes(s, 5, 2, at));
+  TEST_ASSERT_EQUAL(400, at[3]);
+
+  // capacity 1: the group runs one after another
+  s[3].weight = 1;
+  TEST_ASSERT_EQUAL(100 + 300 + 300 + 200 + 50, zonePlanTimes(s, 5, 1, at));
+  TEST_ASSERT_EQUAL(700, at[3]);
+}
+
+static void test_make_before_break() {
+  ZoneStep s[] = { step(1, 100), step(2, 100) };
+  ZoneRunner zr; RecAct a;
+  TEST_ASSERT_TRUE(zr.begin(s, 2, 1));
+  zr.poll(0, a);
+  TEST_ASSERT_EQUAL_STRING("O0 ", a.log.c_str());
+  zr.opened(0, true, 0); zr.startTimers(0);
+  zr.poll(99, a);
+  TEST_ASSERT_EQUAL_STRING("O0 ", a.log.c_str());
+
+  a.busy = true; zr.poll(100, a);                                      // step 0 due, next OPEN not accepted yet
+  TEST_ASSERT_EQUAL_STRING("O0 ", a.log.c_str());
+  TEST_ASSERT_TRUE(zr.live(0));
+  a.busy = false; zr.poll(110, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O1 ", a.log.c_str());                   // OPEN in flight: still no CLOSE
+  TEST_ASSERT_EQUAL(30, zr.opened(1, true, 130));                      // hand-over latency
+  zr.poll(130, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O1 C0 ", a.log.c_str());
+  TEST_ASSERT_EQUAL(1, zr.current());
+  zr.poll(230, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O1 C0 C1 ", a.log.c_str());
+  TEST_ASSERT_TRUE(zr.finished());
+}
+
+static void test_runner_fills_group() {
+  ZoneStep s[] = { step(1, 100), step(2, 300, true), step(3, 100, true) };
+  ZoneRunner zr; RecAct a;
+  zr.begin(s, 3, 2);
+  zr.poll(0, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O1 ", a.log.c_str());
+  zr.opened(0, true, 0); zr.opened(1, true, 0); zr.startTimers(0);
+  TEST_ASSERT_EQUAL(2, zr.load());
+  zr.poll(100, a);                                                     // step 0 done: step 2 takes its place
+  TEST_ASSERT_EQUAL_STRING("O0 O1 O2 ", a.log.c_str());
+  zr.opened(2, false, 120);                                            // not acknowledged: skipped
+  zr.poll(120, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O1 O2 C0 ", a.log.c_str());
+  TEST_ASSERT_EQUAL(ZS_FAILED, zr.st[2]);
+  TEST_ASSERT_FALSE(zr.finished());
+  zr.poll(300, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O1 O2 C0 C1 ", a.log.c_str());
+  TEST_ASSERT_TRUE(zr.finished());
+}
+
+static void test_skip_and_cut() {
+  ZoneStep s[] = { step(1, 100), step(2, 100), step(3, 100) };
+  ZoneRunner zr; RecAct a; a.skipMask = 1u << 1;
+  zr.begin(s, 3, 1);
+  zr.poll(0, a);
+  zr.opened(0, true, 0); zr.startTimers(0);
+  zr.cut(0, 40);                                                       // soil wet early
+  TEST_ASSERT_EQUAL(40, zr.s[0].durMs);
+  zr.poll(40, a);                                                      // step 1 passed on, step 2 opens in the same poll
+  TEST_ASSERT_EQUAL_STRING("O0 O2 ", a.log.c_str());
+  TEST_ASSERT_EQUAL(ZS_SKIPPED, zr.st[1]);
+  TEST_ASSERT_EQUAL(0, zr.s[1].durMs);
+  zr.opened(2, true, 50); zr.poll(50, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O2 C0 ", a.log.c_str());
+  zr.cut(2, 200);                                                      // past its time: length unchanged
+  TEST_ASSERT_EQUAL(100, zr.s[2].durMs);
+  zr.poll(150, a);
+  TEST_ASSERT_EQUAL_STRING("O0 O2 C0 C2 ", a.log.c_str());
+  TEST_ASSERT_TRUE(zr.finished());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_groups_and_capacity);
+  RUN_TEST(test_plan_times_capacity_fill);
+  RUN_TEST(test_make_before_break);
+  RUN_TEST(test_runner_fills_group);
+  RUN_TEST(test_skip_and_cut);
+  return UNITY_END();
+}